@@ -0,0 +1,477 @@
+/**
+ * @file stp_bench.c
+ * @brief Офлайн бенчмарк пути приёма BPDU и автомата STP.
+ *
+ * Программа линкуется с stp/libstp.a и lib/libcommonstp.a и заглушками
+ * окружения из stp_bench_stub.c. BPDU из pcap-файла или
+ * синтетические PVST/STP кадры подаются прямо в stpmgr_process_rx_bpdu(),
+ * а stptimer_tick() вызывается в виртуальном времени (один вызов - 100мс).
+ *
+ * Выводится стоимость обработки одного BPDU и одного тика, количество
+ * выделений памяти и вызовов процедур автомата 802.1D за время замера.
+ *
+ * @code
+ * stpd_bench -v 64 -p 48 -n 200 -m churn
+ * stpd_bench -v 16 -p 32 -r capture.pcap -n 10
+ * @endcode
+ */
+
+#define _GNU_SOURCE
+#include <getopt.h>
+
+#include "stp_inc.h"
+#include "stp_main.h"
+#include "stp_bench.h"
+
+#define STP_BENCH_VLAN_BASE 2         // VLAN первого экземпляра, VLAN 1 обрабатывается через untagged IEEE BPDU
+#define STP_BENCH_TICKS_PER_HELLO 20  // тиков 100мс между соседними hello соседей (2с)
+#define STP_BENCH_PCAP_MAX_FRAMES 65536
+
+#define PCAP_MAGIC 0xa1b2c3d4
+#define PCAP_MAGIC_NS 0xa1b23c4d
+#define PCAP_MAGIC_SWAP 0xd4c3b2a1
+#define PCAP_MAGIC_NS_SWAP 0x4d3cb2a1
+#define PCAP_LINKTYPE_ETHERNET 1
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+} __attribute__((packed)) STP_BENCH_PCAP_HDR;
+
+typedef struct
+{
+    uint32_t ts_sec;
+    uint32_t ts_frac;
+    uint32_t incl_len;
+    uint32_t orig_len;
+} __attribute__((packed)) STP_BENCH_PCAP_REC;
+
+/**
+ * @struct STP_BENCH_FRAME
+ * @brief Кадр для подачи в stpmgr_process_rx_bpdu(): без 802.1Q тега, как отдаёт raw-сокет.
+ */
+typedef struct
+{
+    uint16_t vlan_id;
+    uint32_t port_id;
+    uint16_t len;
+    uint8_t data[STP_MAX_PKT_LEN];
+} STP_BENCH_FRAME;
+
+typedef enum
+{
+    STP_BENCH_MODE_STEADY, // соседи повторяют одну и ту же информацию
+    STP_BENCH_MODE_CHURN,  // каждый раунд новый лучший корень на другом порту, запуская пересчёт топологии
+} STP_BENCH_MODE;
+
+/**
+ * @brief Создаёт PVST экземпляры так же, как stpmgr_vlan_stp_enable() для нового экземпляра.
+ *
+ * @param vlans Количество экземпляров.
+ * @param ports Количество портов в каждом экземпляре.
+ * @return void
+ */
+static void stp_bench_init_vlans(uint16_t vlans, uint32_t ports)
+{
+    static const uint8_t base_mac[L2_ETH_ADD_LEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    uint16_t i;
+    uint32_t port;
+
+    stpmgr_init(vlans);
+
+    stp_global.enable = true;
+    stp_global.proto_mode = L2_PVSTP;
+    memcpy((char*)&g_stp_base_mac_addr._ulong, base_mac, sizeof(g_stp_base_mac_addr._ulong));
+    memcpy((char*)&g_stp_base_mac_addr._ushort, base_mac + 4, sizeof(g_stp_base_mac_addr._ushort));
+
+    for (i = 0; i < vlans; i++)
+    {
+        stpdata_init_class(i, STP_BENCH_VLAN_BASE + i);
+        stpsync_add_vlan_to_instance(STP_BENCH_VLAN_BASE + i, i);
+        for (port = 0; port < ports; port++)
+            stpmgr_add_control_port(i, port, i ? 1 /* tagged */ : 0 /* untagged, для передачи IEEE BPDU */);
+    }
+}
+
+/**
+ * @brief Собирает PVST config BPDU соседнего моста в сетевом порядке байт.
+ *
+ * @param frame Кадр для заполнения.
+ * @param vlan_id VLAN экземпляра.
+ * @param root_prio Приоритет корня, объявляемого соседом.
+ * @param root_mac_low Младшие два байта MAC адреса корня.
+ * @param root_cost Стоимость пути соседа до корня, 0 - сосед сам корень.
+ * @param bridge_mac_low Младшие два байта MAC адреса соседа.
+ * @param port_number Номер порта соседа.
+ * @return void
+ */
+static void stp_bench_build_pvst(STP_BENCH_FRAME* frame, VLAN_ID vlan_id, UINT16 root_prio, UINT16 root_mac_low,
+                                 UINT32 root_cost, UINT16 bridge_mac_low, UINT16 port_number)
+{
+    uint8_t root_mac[L2_ETH_ADD_LEN] = {0x00, 0x11, 0x22, 0x00, 0x00, 0x00};
+    uint8_t bridge_mac[L2_ETH_ADD_LEN] = {0x00, 0x11, 0x22, 0x00, 0x00, 0x00};
+    STP_CONFIG_BPDU bpdu;
+    PVST_CONFIG_BPDU* pvst = (PVST_CONFIG_BPDU*)frame->data;
+
+    root_mac[4] = root_mac_low >> 8;
+    root_mac[5] = root_mac_low & 0xff;
+    bridge_mac[4] = bridge_mac_low >> 8;
+    bridge_mac[5] = bridge_mac_low & 0xff;
+
+    memset(&bpdu, 0, sizeof(bpdu));
+    bpdu.protocol_id = 0;
+    bpdu.protocol_version_id = STP_VERSION_ID;
+    bpdu.type = CONFIG_BPDU_TYPE;
+    bpdu.root_id.priority = root_prio >> 12;
+    bpdu.root_id.system_id = vlan_id;
+    NET_TO_HOST_MAC(&bpdu.root_id.address, root_cost ? root_mac : bridge_mac);
+    bpdu.root_path_cost = root_cost;
+    bpdu.bridge_id.priority = (root_cost ? STP_DFLT_PRIORITY : root_prio) >> 12;
+    bpdu.bridge_id.system_id = vlan_id;
+    NET_TO_HOST_MAC(&bpdu.bridge_id.address, bridge_mac);
+    bpdu.port_id.priority = STP_DFLT_PORT_PRIORITY >> 4;
+    bpdu.port_id.number = port_number;
+    bpdu.message_age = 0;
+    bpdu.max_age = STP_DFLT_MAX_AGE << 8;
+    bpdu.hello_time = STP_DFLT_HELLO_TIME << 8;
+    bpdu.forward_delay = STP_DFLT_FORWARD_DELAY << 8;
+    stputil_encode_bpdu(&bpdu);
+
+    memcpy(pvst, &g_stp_pvst_config_bpdu, sizeof(PVST_CONFIG_BPDU));
+    HOST_TO_NET_MAC(&pvst->mac_header.source_address, bridge_mac);
+    memcpy((UINT8*)pvst + sizeof(MAC_HEADER) + sizeof(SNAP_HEADER),
+           (UINT8*)&bpdu + sizeof(MAC_HEADER) + sizeof(LLC_HEADER), STP_SIZEOF_CONFIG_BPDU);
+    pvst->tag_length = htons(2);
+    pvst->vlan_id = htons(vlan_id);
+
+    frame->vlan_id = vlan_id;
+    frame->len = sizeof(PVST_CONFIG_BPDU);
+}
+
+/**
+ * @brief Строит синтетический набор кадров: порт 0 смотрит на корень, остальные - на соседние мосты.
+ *
+ * @return uint32_t количество кадров в одном раунде
+ */
+static uint32_t stp_bench_build_synthetic(STP_BENCH_FRAME* frames, uint16_t vlans, uint32_t ports, UINT16 root_prio)
+{
+    uint32_t n = 0, port;
+    uint16_t i;
+
+    for (i = 0; i < vlans; i++)
+    {
+        for (port = 0; port < ports; port++, n++)
+        {
+            if (port == 0)
+                stp_bench_build_pvst(&frames[n], STP_BENCH_VLAN_BASE + i, root_prio, 0x0101, 0, 0x0101, 1);
+            else
+                stp_bench_build_pvst(&frames[n], STP_BENCH_VLAN_BASE + i, root_prio, 0x0001, 4, 0x0110 + port % 200,
+                                     port + 1);
+            frames[n].port_id = port;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Строит кадры раунда churn.
+ *
+ * Худшая информация от того же назначенного моста не вытесняет записанную
+ * (supercedes_port_info()), поэтому churn не может просто чередовать лучший
+ * и худший корень. Вместо этого в каждом раунде на следующем порту
+ * появляется новый корень с приоритетом 0, лучше всех прежних (младшие
+ * байты MAC убывают): у всех экземпляров меняются корень и корневой порт.
+ * Кадр корня идёт первым: остальные порты ещё хранят прежний корень и
+ * становятся назначенными. Затем соседи на них передают новый корень со
+ * стоимостью 1, меньше стоимости пути любого порта, и возвращают порты в
+ * BLOCKING, как при приходе BPDU нового корня в реальной сети.
+ *
+ * @param frames Кадры раунда.
+ * @param round Номер раунда.
+ * @return void
+ */
+static void stp_bench_build_churn(STP_BENCH_FRAME* frames, uint16_t vlans, uint32_t ports, uint32_t round)
+{
+    UINT16 root_mac_low = 0xfffe - (round & 0x7fff);
+    uint32_t root_port, port, n = 0;
+    uint16_t i;
+
+    root_port = ports > 1 ? 1 + round % (ports - 1) : 0;
+    for (i = 0; i < vlans; i++)
+    {
+        stp_bench_build_pvst(&frames[n], STP_BENCH_VLAN_BASE + i, 0, root_mac_low, 0, root_mac_low, root_port + 1);
+        frames[n++].port_id = root_port;
+        for (port = 0; port < ports; port++)
+        {
+            if (port == root_port)
+                continue;
+            stp_bench_build_pvst(&frames[n], STP_BENCH_VLAN_BASE + i, 0, root_mac_low, 1, 0x0110 + port % 200,
+                                 port + 1);
+            frames[n++].port_id = port;
+        }
+    }
+}
+
+/**
+ * @brief Считает экземпляры, у которых корневой порт изменился с прошлого вызова.
+ */
+static uint32_t stp_bench_root_port_changes(PORT_ID* last_root, uint16_t vlans)
+{
+    STP_CLASS* stp_class;
+    uint32_t changes = 0;
+    uint16_t i;
+
+    for (i = 0; i < vlans; i++)
+    {
+        stp_class = GET_STP_CLASS(i);
+        if (stp_class->bridge_info.root_port != last_root[i])
+            changes++;
+        last_root[i] = stp_class->bridge_info.root_port;
+    }
+    return changes;
+}
+
+/**
+ * @brief Загружает Ethernet кадры из pcap, снимая 802.1Q тег, как это делает ядро для raw-сокета.
+ *
+ * Порты назначаются кадрам по кругу среди ports.
+ *
+ * @return int количество кадров, -1 при ошибке
+ */
+static int stp_bench_load_pcap(const char* path, STP_BENCH_FRAME* frames, int max_frames, uint32_t ports)
+{
+    STP_BENCH_PCAP_HDR hdr;
+    STP_BENCH_PCAP_REC rec;
+    uint8_t buf[65536];
+    bool swap;
+    uint32_t len;
+    uint16_t tpid;
+    int n = 0;
+    FILE* fp;
+
+    fp = fopen(path, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "pcap open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1)
+        goto bad;
+
+    swap = (hdr.magic == PCAP_MAGIC_SWAP || hdr.magic == PCAP_MAGIC_NS_SWAP);
+    if (!swap && hdr.magic != PCAP_MAGIC && hdr.magic != PCAP_MAGIC_NS)
+        goto bad;
+    if ((swap ? __builtin_bswap32(hdr.linktype) : hdr.linktype) != PCAP_LINKTYPE_ETHERNET)
+        goto bad;
+
+    while (n < max_frames && fread(&rec, sizeof(rec), 1, fp) == 1)
+    {
+        len = swap ? __builtin_bswap32(rec.incl_len) : rec.incl_len;
+        if (len > sizeof(buf) || fread(buf, len, 1, fp) != 1)
+            break;
+        if (len < 14)
+            continue;
+
+        frames[n].vlan_id = 0;
+        tpid = (buf[12] << 8) | buf[13];
+        if (tpid == 0x8100 && len >= 18)
+        {
+            frames[n].vlan_id = ((buf[14] << 8) | buf[15]) & 0x0fff;
+            memmove(buf + 12, buf + 16, len - 16);
+            len -= 4;
+        }
+
+        if (len > STP_MAX_PKT_LEN)
+            len = STP_MAX_PKT_LEN;
+        memset(frames[n].data, 0, sizeof(frames[n].data));
+        memcpy(frames[n].data, buf, len);
+        frames[n].len = len;
+        frames[n].port_id = n % ports;
+        n++;
+    }
+
+    fclose(fp);
+    return n;
+
+bad:
+    fprintf(stderr, "%s: not an ethernet pcap file\n", path);
+    fclose(fp);
+    return -1;
+}
+
+static void stp_bench_usage(const char* prog)
+{
+    fprintf(stderr,
+            "usage: %s [-v vlans] [-p ports] [-n rounds] [-m steady|churn] [-r file.pcap] [-w workers]\n"
+            "  -v  PVST instances (VLAN %d..), default 16\n"
+            "  -p  ports per instance, default 48\n"
+            "  -n  rounds; each round feeds every frame once and then %d ticks, default 100\n"
+            "  -m  synthetic traffic pattern, default steady\n"
+            "  -r  replay frames from pcap instead of synthetic ones\n"
+            "  -w  worker threads (see stp_worker.c), default 0\n",
+            prog, STP_BENCH_VLAN_BASE, STP_BENCH_TICKS_PER_HELLO);
+}
+
+int main(int argc, char** argv)
+{
+    STP_BENCH_MODE mode = STP_BENCH_MODE_STEADY;
+    STP_BENCH_COUNTERS start_cnt;
+    STP_SM_STATS start_sm, sm;
+    STP_BENCH_FRAME* frames;
+    STP_BENCH_FRAME* good = NULL;
+    STP_BENCH_FRAME* churn = NULL;
+    STP_BENCH_FRAME* round_frames;
+    static uint8_t pkt[STP_MAX_PKT_LEN];
+    const char* pcap = NULL;
+    uint16_t vlans = 16;
+    uint32_t ports = 48, rounds = 100, workers = 0, r, i, t;
+    uint64_t rx_ns = 0, tick_ns = 0, ts, bpdus = 0, ticks = 0, root_changes = 0;
+    PORT_ID* last_root;
+    int nframes, opt;
+
+    while ((opt = getopt(argc, argv, "v:p:n:m:r:w:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'v':
+            vlans = atoi(optarg);
+            break;
+        case 'p':
+            ports = atoi(optarg);
+            break;
+        case 'n':
+            rounds = atoi(optarg);
+            break;
+        case 'm':
+            mode = (0 == strcmp(optarg, "churn")) ? STP_BENCH_MODE_CHURN : STP_BENCH_MODE_STEADY;
+            break;
+        case 'r':
+            pcap = optarg;
+            break;
+        case 'w':
+            workers = atoi(optarg);
+            break;
+        default:
+            stp_bench_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (vlans == 0 || ports == 0 || vlans > MAX_VLAN_ID - STP_BENCH_VLAN_BASE)
+    {
+        stp_bench_usage(argv[0]);
+        return 1;
+    }
+
+    stp_bench_env_init(ports);
+    if (workers && -1 == stp_worker_init(g_stpd_evbase, workers))
+        return 1;
+    stp_bench_init_vlans(vlans, ports);
+
+    if (pcap)
+    {
+        frames = calloc(STP_BENCH_PCAP_MAX_FRAMES, sizeof(STP_BENCH_FRAME));
+        nframes = frames ? stp_bench_load_pcap(pcap, frames, STP_BENCH_PCAP_MAX_FRAMES, ports) : -1;
+        if (nframes <= 0)
+            return 1;
+        good = frames;
+    }
+    else
+    {
+        frames = calloc(2 * (size_t)vlans * ports, sizeof(STP_BENCH_FRAME));
+        if (!frames)
+            return 1;
+        good = frames;
+        churn = frames + (size_t)vlans * ports;
+        nframes = stp_bench_build_synthetic(good, vlans, ports, 4096);
+    }
+
+    // Разогрев: сходимость и выход портов в FORWARDING не входят в замер
+    for (t = 0; t < 2 * STP_DFLT_FORWARD_DELAY * 10; t++)
+    {
+        if (t % STP_BENCH_TICKS_PER_HELLO == 0)
+        {
+            for (i = 0; i < (uint32_t)nframes; i++)
+            {
+                memcpy(pkt, good[i].data, good[i].len);
+                stpmgr_process_rx_bpdu(good[i].vlan_id, good[i].port_id, pkt);
+            }
+            stp_worker_drain();
+        }
+        stptimer_tick();
+    }
+
+    last_root = calloc(vlans, sizeof(PORT_ID));
+    if (!last_root)
+        return 1;
+    stp_bench_root_port_changes(last_root, vlans);
+
+    start_cnt = g_bench;
+    start_sm = stp_global.sm_stats;
+
+    for (r = 0; r < rounds; r++)
+    {
+        round_frames = good;
+        if (mode == STP_BENCH_MODE_CHURN && churn)
+        {
+            stp_bench_build_churn(churn, vlans, ports, r);
+            round_frames = churn;
+        }
+
+        ts = stp_bench_ns();
+        for (i = 0; i < (uint32_t)nframes; i++)
+        {
+            // приём кладёт кадр в свежий буфер, как raw-сокет
+            memcpy(pkt, round_frames[i].data, round_frames[i].len);
+            stpmgr_process_rx_bpdu(round_frames[i].vlan_id, round_frames[i].port_id, pkt);
+        }
+        // without the event loop queued BPDUs are processed right away
+        stp_worker_drain();
+        rx_ns += stp_bench_ns() - ts;
+        bpdus += nframes;
+
+        ts = stp_bench_ns();
+        for (t = 0; t < STP_BENCH_TICKS_PER_HELLO; t++)
+            stptimer_tick();
+        tick_ns += stp_bench_ns() - ts;
+        ticks += STP_BENCH_TICKS_PER_HELLO;
+
+        root_changes += stp_bench_root_port_changes(last_root, vlans);
+    }
+
+    sm = stp_global.sm_stats;
+    printf("scale           : %u vlans x %u ports, %s, %u rounds, %u workers\n", vlans, ports,
+           pcap ? pcap : (mode == STP_BENCH_MODE_CHURN ? "synthetic churn" : "synthetic steady"), rounds,
+           stp_worker_count());
+    printf("rx              : %lu bpdus, %.1f ns/bpdu\n", bpdus, bpdus ? (double)rx_ns / bpdus : 0.0);
+    printf("tick            : %lu ticks, %.1f ns/tick, %.1f ns/tick/port\n", ticks,
+           ticks ? (double)tick_ns / ticks : 0.0, ticks ? (double)tick_ns / ticks / ((double)vlans * ports) : 0.0);
+    printf("allocations     : %lu malloc, %lu free\n", g_bench.malloc_calls - start_cnt.malloc_calls,
+           g_bench.free_calls - start_cnt.free_calls);
+    printf("tx frames       : %lu\n", g_bench.tx_frames - start_cnt.tx_frames);
+    printf("system()        : %lu\n", g_bench.system_calls - start_cnt.system_calls);
+    printf("drops           : stp %u tcn %u pvst %u\n", stp_global.stp_drop_count, stp_global.tcn_drop_count,
+           stp_global.pvst_drop_count);
+    printf("state machine   : received_config_bpdu %lu received_tcn_bpdu %lu\n",
+           sm.received_config_bpdu - start_sm.received_config_bpdu, sm.received_tcn_bpdu - start_sm.received_tcn_bpdu);
+    printf("                  configuration_update %lu root_selection %lu designated_port_selection %lu\n",
+           sm.configuration_update - start_sm.configuration_update, sm.root_selection - start_sm.root_selection,
+           sm.designated_port_selection - start_sm.designated_port_selection);
+    printf("                  port_state_selection %lu config_bpdu_generation %lu transmit_config %lu\n",
+           sm.port_state_selection - start_sm.port_state_selection,
+           sm.config_bpdu_generation - start_sm.config_bpdu_generation, sm.transmit_config - start_sm.transmit_config);
+    printf("                  topology_change_detection %lu make_forwarding %lu make_blocking %lu\n",
+           sm.topology_change_detection - start_sm.topology_change_detection,
+           sm.make_forwarding - start_sm.make_forwarding, sm.make_blocking - start_sm.make_blocking);
+    printf("                  selection_skipped %lu\n", sm.selection_skipped - start_sm.selection_skipped);
+    printf("root port moves : %lu\n", root_changes);
+
+    return 0;
+}
@@ -0,0 +1,48 @@
+/**
+ * @file stp_bench.h
+ * @brief Общее окружение офлайн бенчмарков stpd (stp_bench.c, stp_sim.c).
+ *
+ * Заглушки stpsync, перехват libc через -Wl,--wrap и синтетическая база
+ * интерфейсов реализованы в stp_bench_stub.c.
+ */
+#ifndef _STP_BENCH_H_
+#define _STP_BENCH_H_
+
+#define STP_BENCH_PORT_SPEED 10000 // скорость портов, Мбит/с
+#define STP_BENCH_KIF_BASE 1000    // kernel ifindex первого порта
+
+/**
+ * @struct STP_BENCH_COUNTERS
+ * @brief Счётчики перехваченных вызовов.
+ */
+typedef struct
+{
+    uint64_t malloc_calls; // malloc/calloc/realloc
+    uint64_t free_calls;
+    uint64_t tx_frames;    // кадров, переданных в sendmmsg
+    uint64_t system_calls;
+    uint64_t sync_calls;   // обновлений APP DB через stpsync_update_*
+} STP_BENCH_COUNTERS;
+
+extern STP_BENCH_COUNTERS g_bench;
+
+/**
+ * @brief Текущее время CLOCK_MONOTONIC в наносекундах.
+ */
+static inline uint64_t stp_bench_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Готовит контекст stpd без сокетов IPC и netlink и заполняет базу портами Ethernet0..N-1.
+ *
+ * @param ports Количество портов.
+ * @return void
+ */
+void stp_bench_env_init(uint32_t ports);
+
+#endif
@@ -0,0 +1,175 @@
+/**
+ * @file stp_bench_stub.c
+ * @brief Заглушки окружения stpd для офлайн бенчмарков.
+ *
+ * swss (stpsync) заменён пустыми функциями, raw-сокеты, sendmmsg, system()
+ * и аллокатор перехватываются через -Wl,--wrap, а база интерфейсов
+ * заполняется синтетическими событиями netlink.
+ */
+
+#define _GNU_SOURCE
+#include <sys/socket.h>
+
+#include "stp_inc.h"
+#include "stp_main.h"
+#include "stp_dbsync.h"
+#include "stp_bench.h"
+
+STP_BENCH_COUNTERS g_bench;
+
+/*
+ * Перехват libc через -Wl,--wrap=...
+ */
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nmemb, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size)
+{
+    g_bench.malloc_calls++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t nmemb, size_t size)
+{
+    g_bench.malloc_calls++;
+    return __real_calloc(nmemb, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    g_bench.malloc_calls++;
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void* ptr)
+{
+    if (ptr)
+        g_bench.free_calls++;
+    __real_free(ptr);
+}
+
+/*
+ * Raw PF_PACKET сокеты портов требуют CAP_NET_RAW, поэтому вместо них
+ * отдаётся обычный UDP сокет, а setsockopt()/bind() для него подтверждаются
+ * без обращения к ядру.
+ */
+#define STP_BENCH_MAX_FD 65536
+static uint8_t g_bench_fake_fd[STP_BENCH_MAX_FD];
+
+int __real_socket(int domain, int type, int protocol);
+int __real_setsockopt(int sockfd, int level, int optname, const void* optval, socklen_t optlen);
+int __real_bind(int sockfd, const struct sockaddr* addr, socklen_t addrlen);
+
+int __wrap_socket(int domain, int type, int protocol)
+{
+    int fd;
+
+    if (domain != PF_PACKET)
+        return __real_socket(domain, type, protocol);
+
+    fd = __real_socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd >= 0 && fd < STP_BENCH_MAX_FD)
+        g_bench_fake_fd[fd] = 1;
+    return fd;
+}
+
+int __wrap_setsockopt(int sockfd, int level, int optname, const void* optval, socklen_t optlen)
+{
+    if (sockfd >= 0 && sockfd < STP_BENCH_MAX_FD && g_bench_fake_fd[sockfd])
+        return 0;
+    return __real_setsockopt(sockfd, level, optname, optval, optlen);
+}
+
+int __wrap_bind(int sockfd, const struct sockaddr* addr, socklen_t addrlen)
+{
+    if (sockfd >= 0 && sockfd < STP_BENCH_MAX_FD && g_bench_fake_fd[sockfd])
+        return 0;
+    return __real_bind(sockfd, addr, addrlen);
+}
+
+int __wrap_sendmmsg(int sockfd, struct mmsghdr* msgvec, unsigned int vlen, int flags)
+{
+    g_bench.tx_frames += vlen;
+    return vlen;
+}
+
+int __wrap_system(const char* command)
+{
+    g_bench.system_calls++;
+    return 0;
+}
+
+/*
+ * Заглушки stpsync (APP DB)
+ */
+void stpsync_add_vlan_to_instance(uint16_t vlan_id, uint16_t instance) {}
+void stpsync_del_vlan_from_instance(uint16_t vlan_id, uint16_t instance) {}
+void stpsync_update_stp_class(STP_VLAN_TABLE* stp_vlan) { g_bench.sync_calls++; }
+void stpsync_del_stp_class(uint16_t vlan_id) {}
+void stpsync_update_port_class(STP_VLAN_PORT_TABLE* stp_vlan_intf) { g_bench.sync_calls++; }
+void stpsync_del_port_class(char* if_name, uint16_t vlan_id) {}
+void stpsync_update_port_state(char* ifName, uint16_t instance, uint8_t state) { g_bench.sync_calls++; }
+void stpsync_del_port_state(char* ifName, uint16_t instance) {}
+void stpsync_update_vlan_port_state(char* ifName, uint16_t vlan_id, uint8_t state) { g_bench.sync_calls++; }
+void stpsync_del_vlan_port_state(char* ifName, uint16_t vlan_id) {}
+void stpsync_update_fastage_state(uint16_t vlan_id, bool add) {}
+void stpsync_update_fastage_vlans(const uint16_t *add, uint16_t add_count, const uint16_t *del, uint16_t del_count) {}
+uint32_t stpsync_get_port_speed(char* ifName) { return STP_BENCH_PORT_SPEED; }
+void stpsync_update_port_admin_state(char* ifName, bool up, bool physical) {}
+void stpsync_update_bpdu_guard_shutdown(char* ifName, bool enabled) {}
+void stpsync_del_stp_port(char* ifName) {}
+void stpsync_update_port_fast(char* ifName, bool enabled) {}
+void stpsync_clear_appdb_stp_tables(void) {}
+void stpsync_flush(void) {}
+
+/**
+ * @brief Заполняет базу интерфейсов портами Ethernet0..N-1 так же, как stp_intf_event_mgr_init() после дампа netlink.
+ *
+ * @param ports Количество портов.
+ * @return void
+ */
+static void stp_bench_init_ports(uint32_t ports)
+{
+    netlink_db_t if_db;
+    uint16_t i;
+
+    g_stpd_intf_db = avl_create(&stp_intf_avl_compare, NULL, NULL);
+    if (!g_stpd_intf_db)
+        sys_assert(0);
+
+    g_max_stp_port = 0;
+    for (i = 0; i < ports; i++)
+    {
+        memset(&if_db, 0, sizeof(if_db));
+        snprintf(if_db.ifname, sizeof(if_db.ifname), "Ethernet%u", i);
+        if_db.kif_index = STP_BENCH_KIF_BASE + i;
+        if_db.oper_state = 1;
+        if_db.speed = STP_BENCH_PORT_SPEED;
+        stp_intf_netlink_cb(&if_db, 1, true);
+    }
+    stp_intf_init_port_speeds();
+
+    g_max_stp_port = g_max_stp_port * 2; // Phy Ports + LAG
+    stp_intf_init_port_stats();
+    if (-1 == stp_intf_init_po_id_pool())
+        sys_assert(0);
+    g_stpd_port_init_done = 1;
+}
+
+/**
+ * @brief Готовит контекст stpd без сокетов IPC и netlink и заполняет базу интерфейсов.
+ *
+ * @param ports Количество портов.
+ * @return void
+ */
+void stp_bench_env_init(uint32_t ports)
+{
+    STP_LOG_SET_LEVEL(APP_LOG_LEVEL_NONE);
+    memset(&stpd_context, 0, sizeof(STPD_CONTEXT));
+    g_stpd_evbase = event_base_new();
+    event_base_priority_init(g_stpd_evbase, STP_LIBEV_PRIO_QUEUES);
+
+    stp_bench_init_ports(ports);
+}
@@ -0,0 +1,684 @@
+/**
+ * @file stp_sim.c
+ * @brief Симулятор сходимости сети из нескольких мостов в одном процессе.
+ *
+ * Каждый мост - отдельная копия состояния автомата (stp_global и базовый MAC),
+ * которая подставляется перед вызовом кода stp/ и сохраняется после него.
+ * Передача BPDU перехватывается через -Wl,--wrap=stp_pkt_tx_handler: кадр
+ * попадает в очередь виртуального линка и в том же тике доставляется в
+ * stpmgr_process_rx_bpdu() соседнего моста. Все мосты разделяют виртуальные
+ * часы таймеров, один тик - 100мс.
+ *
+ * Для фаз запуска и отказа линка выводится время согласия всех мостов о корне,
+ * время последнего изменения состояния порта, число BPDU и затраты CPU на мост.
+ *
+ * Message age растёт на каждом мосту, и BPDU дальше max_age (20 с) от корня
+ * отбрасываются. 802.1D рекомендует диаметр сети не больше 7 мостов, с
+ * таймерами по умолчанию симулятор сходится в цепочке до 12 мостов. В более
+ * длинной (ring больше 12 мостов после отказа линка, ring:64 уже при запуске)
+ * часть мостов не согласится о корне. Такая фаза помечается "NOT CONVERGED",
+ * и stpd_sim завершается с кодом 2.
+ *
+ * @code
+ * stpd_sim -t ring -b 16 -v 4
+ * stpd_sim -t fattree -b 40 -k 4 -v 16 -f 0
+ * stpd_sim -t mesh -b 8 -f 3 -s
+ * @endcode
+ */
+
+#define _GNU_SOURCE
+#include <getopt.h>
+
+#include "stp_inc.h"
+#include "stp_main.h"
+#include "stp_bench.h"
+
+#define STP_SIM_MAX_BRIDGES 1024
+#define STP_SIM_MAX_MESH 64
+#define STP_SIM_NATIVE_VLAN 1     // VLAN первого экземпляра, untagged на всех портах
+#define STP_SIM_TICKS_PER_SEC 10  // один тик - 100мс
+#define STP_SIM_DFLT_PHASE_SEC 90 // max_age + 2 * forward_delay с запасом
+
+typedef enum
+{
+    STP_SIM_TOPO_RING,    // мост b порт 0 - мост b+1 порт 1
+    STP_SIM_TOPO_MESH,    // полная связность
+    STP_SIM_TOPO_FATTREE, // двухуровневое дерево: каждый leaf связан с каждым spine
+} STP_SIM_TOPO;
+
+/**
+ * @struct STP_SIM_LINK
+ * @brief Виртуальный линк между портами двух мостов.
+ */
+typedef struct
+{
+    uint16_t bridge[2];
+    uint16_t port[2];
+    uint8_t up;
+} STP_SIM_LINK;
+
+/**
+ * @struct STP_SIM_BRIDGE
+ * @brief Сохранённое состояние одного моста.
+ */
+typedef struct
+{
+    STP_GLOBAL g;           // состояние автомата, пока мост не активен
+    MAC_ADDRESS base_mac;
+    int32_t* port_link;     // [ports] индекс линка порта или -1
+    uint8_t* port_state;    // [vlans * ports] последнее наблюдаемое состояние порта
+    uint64_t timer_ns;
+    uint64_t rx_ns;
+    uint64_t rx_bpdus;
+    uint64_t tx_bpdus;
+} STP_SIM_BRIDGE;
+
+/**
+ * @struct STP_SIM_FRAME
+ * @brief BPDU в очереди доставки.
+ */
+typedef struct
+{
+    uint16_t bridge;
+    uint16_t port;
+    uint16_t vlan_id; // 0 для untagged кадра
+    uint16_t len;
+    uint8_t data[STP_MAX_PKT_LEN];
+} STP_SIM_FRAME;
+
+/**
+ * @struct STP_SIM_PHASE
+ * @brief Результаты одной фазы симуляции.
+ */
+typedef struct
+{
+    uint32_t start;          // тик начала фазы
+    uint32_t last_change;    // тик последнего изменения состояния порта
+    uint32_t root_agreed;    // тик, с которого все экземпляры согласны о корне
+    uint16_t vlans_agreed;   // экземпляров, согласных о корне, в последнем тике
+    uint32_t state_changes;
+    uint64_t tx_bpdus;
+    uint64_t rx_bpdus;
+    uint64_t lost_bpdus;
+    uint64_t sync_calls;
+} STP_SIM_PHASE;
+
+typedef struct
+{
+    STP_SIM_BRIDGE* bridges;
+    STP_SIM_LINK* links;
+    uint16_t nbridges;
+    uint32_t nlinks;
+    uint16_t vlans;
+    uint32_t ports;
+    uint16_t cur;               // мост, чьё состояние сейчас в stp_global
+    uint32_t now;               // виртуальное время, тики
+    BRIDGE_IDENTIFIER* root_id; // [vlans] ожидаемый корень: мост 0
+    uint16_t* agree;            // [vlans] мостов, согласных о корне, в текущем тике
+    STP_SIM_FRAME* queue;
+    uint32_t queue_head;
+    uint32_t queue_count;
+    uint32_t queue_size;
+    uint64_t lost_bpdus;
+} STP_SIM;
+
+static STP_SIM g_sim;
+
+/**
+ * @brief Делает состояние моста текущим для кода stp/.
+ *
+ * @param bridge Индекс моста.
+ * @return void
+ */
+static void stp_sim_switch(uint16_t bridge)
+{
+    if (g_sim.cur == bridge)
+        return;
+
+    g_sim.bridges[g_sim.cur].g = stp_global;
+    g_sim.bridges[g_sim.cur].base_mac = g_stp_base_mac_addr;
+    stp_global = g_sim.bridges[bridge].g;
+    g_stp_base_mac_addr = g_sim.bridges[bridge].base_mac;
+    g_sim.cur = bridge;
+}
+
+static STP_SIM_FRAME* stp_sim_queue_push(void)
+{
+    STP_SIM_FRAME* queue;
+    uint32_t size;
+
+    if (g_sim.queue_count == g_sim.queue_size)
+    {
+        size = g_sim.queue_size ? 2 * g_sim.queue_size : 1024;
+        queue = realloc(g_sim.queue, size * sizeof(STP_SIM_FRAME));
+        if (!queue)
+            sys_assert(0);
+        g_sim.queue = queue;
+        g_sim.queue_size = size;
+    }
+    return &g_sim.queue[g_sim.queue_count++];
+}
+
+/*
+ * Без слота очереди sendmmsg кадр собирается в буфере и проходит через
+ * __wrap_stp_pkt_tx_handler().
+ */
+char* __wrap_stp_pkt_tx_frame_get(uint32_t port_id)
+{
+    return NULL;
+}
+
+/*
+ * Передача BPDU из stputil_send_bpdu()/stputil_send_pvst_bpdu() уходит в виртуальный линк.
+ */
+int __wrap_stp_pkt_tx_handler(uint32_t port_id, VLAN_ID vlan_id, char* buffer, uint16_t size, bool tagged)
+{
+    STP_SIM_BRIDGE* br = &g_sim.bridges[g_sim.cur];
+    STP_SIM_LINK* link;
+    STP_SIM_FRAME* frame;
+    int end;
+
+    if (port_id >= g_sim.ports || br->port_link[port_id] < 0)
+        return -1;
+
+    br->tx_bpdus++;
+    link = &g_sim.links[br->port_link[port_id]];
+    if (!link->up)
+    {
+        g_sim.lost_bpdus++;
+        return 0;
+    }
+
+    end = (link->bridge[0] == g_sim.cur && link->port[0] == port_id) ? 1 : 0;
+    frame = stp_sim_queue_push();
+    frame->bridge = link->bridge[end];
+    frame->port = link->port[end];
+    frame->vlan_id = tagged ? vlan_id : 0;
+    frame->len = size < STP_MAX_PKT_LEN ? size : STP_MAX_PKT_LEN;
+    memset(frame->data, 0, sizeof(frame->data));
+    memcpy(frame->data, buffer, frame->len);
+    return 0;
+}
+
+/**
+ * @brief Доставляет все BPDU из очереди, включая порождённые при их обработке.
+ *
+ * @return void
+ */
+static void stp_sim_deliver(void)
+{
+    static uint8_t pkt[STP_MAX_PKT_LEN];
+    STP_SIM_BRIDGE* br;
+    uint16_t vlan_id, port;
+    uint64_t ts;
+
+    while (g_sim.queue_head < g_sim.queue_count)
+    {
+        // обработка может дописать очередь и перенести её при realloc
+        STP_SIM_FRAME* frame = &g_sim.queue[g_sim.queue_head++];
+
+        memcpy(pkt, frame->data, sizeof(pkt));
+        vlan_id = frame->vlan_id ? frame->vlan_id : STP_SIM_NATIVE_VLAN; // pvid из auxdata
+        port = frame->port;
+        stp_sim_switch(frame->bridge);
+        br = &g_sim.bridges[g_sim.cur];
+
+        ts = stp_bench_ns();
+        stpmgr_process_rx_bpdu(vlan_id, port, pkt);
+        br->rx_ns += stp_bench_ns() - ts;
+        br->rx_bpdus++;
+    }
+    g_sim.queue_head = g_sim.queue_count = 0;
+}
+
+/**
+ * @brief Сравнивает состояние портов текущего моста с предыдущим наблюдением.
+ *
+ * @param phase Текущая фаза.
+ * @return void
+ */
+static void stp_sim_scan(STP_SIM_PHASE* phase)
+{
+    STP_SIM_BRIDGE* br = &g_sim.bridges[g_sim.cur];
+    STP_CLASS* stp_class;
+    STP_PORT_CLASS* stp_port;
+    uint8_t* state;
+    uint32_t port;
+    uint16_t i;
+
+    for (i = 0; i < g_sim.vlans; i++)
+    {
+        stp_class = GET_STP_CLASS(i);
+        if (stp_class->state == STP_CLASS_FREE)
+            continue;
+
+        if (0 == memcmp(&stp_class->bridge_info.root_id, &g_sim.root_id[i], sizeof(BRIDGE_IDENTIFIER)))
+            g_sim.agree[i]++;
+
+        for (port = 0; port < g_sim.ports; port++)
+        {
+            if (br->port_link[port] < 0)
+                continue;
+
+            stp_port = GET_STP_PORT_CLASS(stp_class, port);
+            state = &br->port_state[i * g_sim.ports + port];
+            if (*state != stp_port->state)
+            {
+                *state = stp_port->state;
+                phase->state_changes++;
+                phase->last_change = g_sim.now;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Один тик виртуального времени: таймеры всех мостов, затем доставка BPDU.
+ *
+ * Состояние портов, наблюдаемое перед тиком таймера моста, - результат
+ * предыдущего тика.
+ *
+ * @param phase Текущая фаза.
+ * @return void
+ */
+static void stp_sim_tick(STP_SIM_PHASE* phase)
+{
+    STP_SIM_BRIDGE* br;
+    UINT32 clock, next;
+    uint64_t ts;
+    uint16_t b, i;
+
+    memset(g_sim.agree, 0, g_sim.vlans * sizeof(uint16_t));
+
+    clock = next = timer_clock_get();
+    for (b = 0; b < g_sim.nbridges; b++)
+    {
+        stp_sim_switch(b);
+        br = &g_sim.bridges[b];
+        stp_sim_scan(phase);
+
+        timer_clock_set(clock);
+        ts = stp_bench_ns();
+        stptimer_tick();
+        br->timer_ns += stp_bench_ns() - ts;
+        next = timer_clock_get();
+    }
+    timer_clock_set(next);
+
+    phase->vlans_agreed = 0;
+    for (i = 0; i < g_sim.vlans; i++)
+    {
+        if (g_sim.agree[i] == g_sim.nbridges)
+            phase->vlans_agreed++;
+    }
+    if (phase->vlans_agreed != g_sim.vlans)
+        phase->root_agreed = 0;
+    else if (!phase->root_agreed)
+        phase->root_agreed = g_sim.now;
+
+    stp_sim_deliver();
+    g_sim.now++;
+}
+
+/**
+ * @brief Соединяет порты двух мостов.
+ *
+ * @return void
+ */
+static void stp_sim_connect(uint16_t b0, uint16_t p0, uint16_t b1, uint16_t p1)
+{
+    STP_SIM_LINK* link = &g_sim.links[g_sim.nlinks];
+
+    link->bridge[0] = b0;
+    link->port[0] = p0;
+    link->bridge[1] = b1;
+    link->port[1] = p1;
+    link->up = 1;
+    g_sim.bridges[b0].port_link[p0] = g_sim.nlinks;
+    g_sim.bridges[b1].port_link[p1] = g_sim.nlinks;
+    g_sim.nlinks++;
+}
+
+/**
+ * @brief Строит топологию и возвращает число портов, нужное самому нагруженному мосту.
+ *
+ * @param topo Топология.
+ * @param spines Число spine мостов для fat-tree.
+ * @return int -1 при неверных параметрах
+ */
+static int stp_sim_build_topology(STP_SIM_TOPO topo, uint16_t spines)
+{
+    uint16_t n = g_sim.nbridges, b, c, leaves;
+    uint32_t max_links;
+
+    switch (topo)
+    {
+    case STP_SIM_TOPO_RING:
+        if (n < 3)
+            return -1;
+        g_sim.ports = 2;
+        max_links = n;
+        break;
+    case STP_SIM_TOPO_MESH:
+        if (n < 2 || n > STP_SIM_MAX_MESH)
+            return -1;
+        g_sim.ports = n - 1;
+        max_links = (uint32_t)n * (n - 1) / 2;
+        break;
+    case STP_SIM_TOPO_FATTREE:
+        if (spines == 0 || spines >= n)
+            return -1;
+        leaves = n - spines;
+        g_sim.ports = leaves > spines ? leaves : spines;
+        max_links = (uint32_t)spines * leaves;
+        break;
+    default:
+        return -1;
+    }
+
+    g_sim.links = calloc(max_links, sizeof(STP_SIM_LINK));
+    if (!g_sim.links)
+        return -1;
+
+    for (b = 0; b < n; b++)
+    {
+        g_sim.bridges[b].port_link = malloc(g_sim.ports * sizeof(int32_t));
+        if (!g_sim.bridges[b].port_link)
+            return -1;
+        memset(g_sim.bridges[b].port_link, 0xff, g_sim.ports * sizeof(int32_t));
+    }
+
+    switch (topo)
+    {
+    case STP_SIM_TOPO_RING:
+        for (b = 0; b < n; b++)
+            stp_sim_connect(b, 0, (b + 1) % n, 1);
+        break;
+    case STP_SIM_TOPO_MESH:
+        for (b = 0; b < n; b++)
+            for (c = b + 1; c < n; c++)
+                stp_sim_connect(b, c - 1, c, b);
+        break;
+    case STP_SIM_TOPO_FATTREE:
+        // spine идут первыми, поэтому корнем становится spine 0
+        for (b = 0; b < spines; b++)
+            for (c = spines; c < n; c++)
+                stp_sim_connect(b, c - spines, c, b);
+        break;
+    }
+    return 0;
+}
+
+/**
+ * @brief Создаёт автомат моста так же, как stpmgr_vlan_stp_enable() для каждого экземпляра.
+ *
+ * Экземпляр 0 обслуживает нативный VLAN (untagged на всех портах), остальные - tagged.
+ *
+ * @param bridge Индекс моста, определяет его базовый MAC.
+ * @return void
+ */
+static void stp_sim_init_bridge(uint16_t bridge)
+{
+    STP_SIM_BRIDGE* br = &g_sim.bridges[bridge];
+    uint8_t base_mac[L2_ETH_ADD_LEN] = {0x02, 0x00, 0x00, 0x01, 0x00, 0x00};
+    uint32_t port;
+    uint16_t i;
+
+    base_mac[4] = bridge >> 8;
+    base_mac[5] = bridge & 0xff;
+
+    memset(&stp_global, 0, sizeof(STP_GLOBAL));
+    stpmgr_init(g_sim.vlans);
+
+    stp_global.enable = true;
+    stp_global.proto_mode = L2_PVSTP;
+    memcpy((char*)&g_stp_base_mac_addr._ulong, base_mac, sizeof(g_stp_base_mac_addr._ulong));
+    memcpy((char*)&g_stp_base_mac_addr._ushort, base_mac + 4, sizeof(g_stp_base_mac_addr._ushort));
+
+    for (i = 0; i < g_sim.vlans; i++)
+    {
+        stpdata_init_class(i, STP_SIM_NATIVE_VLAN + i);
+        for (port = 0; port < g_sim.ports; port++)
+        {
+            if (br->port_link[port] >= 0)
+                stpmgr_add_control_port(i, port, i ? 1 /* tagged */ : 0 /* untagged */);
+        }
+        if (bridge == 0)
+            g_sim.root_id[i] = GET_STP_CLASS(i)->bridge_info.bridge_id;
+    }
+
+    br->port_state = calloc((size_t)g_sim.vlans * g_sim.ports, sizeof(uint8_t));
+    if (!br->port_state)
+        sys_assert(0);
+
+    br->g = stp_global;
+    br->base_mac = g_stp_base_mac_addr;
+    g_sim.cur = bridge;
+}
+
+/**
+ * @brief Роняет линк: порт down на обоих концах или, при silent, только потеря кадров.
+ *
+ * @return void
+ */
+static void stp_sim_fail_link(uint32_t index, bool silent)
+{
+    STP_SIM_LINK* link = &g_sim.links[index];
+    int end;
+
+    link->up = 0;
+    if (silent)
+        return;
+
+    for (end = 0; end < 2; end++)
+    {
+        stp_sim_switch(link->bridge[end]);
+        stpmgr_port_event(link->port[end], false);
+    }
+    stp_sim_deliver();
+}
+
+static void stp_sim_phase_begin(STP_SIM_PHASE* phase)
+{
+    uint16_t b;
+
+    memset(phase, 0, sizeof(STP_SIM_PHASE));
+    phase->start = g_sim.now;
+    phase->last_change = g_sim.now;
+    for (b = 0; b < g_sim.nbridges; b++)
+    {
+        phase->tx_bpdus += g_sim.bridges[b].tx_bpdus;
+        phase->rx_bpdus += g_sim.bridges[b].rx_bpdus;
+    }
+    phase->lost_bpdus = g_sim.lost_bpdus;
+    phase->sync_calls = g_bench.sync_calls;
+}
+
+static void stp_sim_phase_report(const char* name, STP_SIM_PHASE* phase)
+{
+    uint32_t forwarding = 0, blocking = 0, port;
+    uint16_t b, i;
+    uint64_t tx = 0, rx = 0;
+    uint8_t state;
+
+    for (b = 0; b < g_sim.nbridges; b++)
+    {
+        tx += g_sim.bridges[b].tx_bpdus;
+        rx += g_sim.bridges[b].rx_bpdus;
+        for (i = 0; i < g_sim.vlans; i++)
+        {
+            for (port = 0; port < g_sim.ports; port++)
+            {
+                if (g_sim.bridges[b].port_link[port] < 0)
+                    continue;
+                state = g_sim.bridges[b].port_state[i * g_sim.ports + port];
+                if (state == FORWARDING)
+                    forwarding++;
+                else if (state == BLOCKING)
+                    blocking++;
+            }
+        }
+    }
+
+    printf("%-16s: root agreed %u/%u vlans", name, phase->vlans_agreed, g_sim.vlans);
+    if (phase->root_agreed)
+        printf(" in %.1f s", (double)(phase->root_agreed - phase->start) / STP_SIM_TICKS_PER_SEC);
+    else
+        printf(" NOT CONVERGED");
+    printf(", ");
+    printf("stable %.1f s (%u port state changes)\n",
+           (double)(phase->last_change - phase->start) / STP_SIM_TICKS_PER_SEC, phase->state_changes);
+    printf("                  ports forwarding %u blocking %u\n", forwarding, blocking);
+    printf("                  bpdus tx %lu rx %lu lost %lu, app db updates %lu\n", tx - phase->tx_bpdus,
+           rx - phase->rx_bpdus, g_sim.lost_bpdus - phase->lost_bpdus, g_bench.sync_calls - phase->sync_calls);
+}
+
+static void stp_sim_usage(const char* prog)
+{
+    fprintf(stderr,
+            "usage: %s [-t ring|mesh|fattree] [-b bridges] [-k spines] [-v vlans] [-T seconds] [-f link [-s]]\n"
+            "  -t  topology, default ring\n"
+            "  -b  number of bridges, default 16 (mesh: up to %d)\n"
+            "  -k  fattree spine bridges, default bridges / 8 (at least 2)\n"
+            "  -v  PVST instances (VLAN %d..), default 1, VLAN %d is untagged\n"
+            "  -T  virtual seconds per phase, default %d\n"
+            "  -f  fail link index after the first phase and measure reconvergence\n"
+            "  -s  silent failure: frames are lost but ports stay up (ages out via max_age)\n"
+            "exit status 2 if a phase ends without all bridges agreeing on the root\n"
+            "(BPDUs age out via max_age in chains longer than 12 bridges, 802.1D suggests 7)\n",
+            prog, STP_SIM_MAX_MESH, STP_SIM_NATIVE_VLAN, STP_SIM_NATIVE_VLAN, STP_SIM_DFLT_PHASE_SEC);
+}
+
+int main(int argc, char** argv)
+{
+    STP_SIM_TOPO topo = STP_SIM_TOPO_RING;
+    const char* topo_name = "ring";
+    STP_SIM_PHASE phase;
+    STP_SIM_LINK* link;
+    uint32_t seconds = STP_SIM_DFLT_PHASE_SEC, t, ticks;
+    uint64_t timer_ns = 0, rx_ns = 0, rx_bpdus = 0, cpu, cpu_max = 0;
+    int32_t fail = -1;
+    uint16_t spines = 0, b;
+    bool silent = false, converged;
+    int opt;
+
+    g_sim.nbridges = 16;
+    g_sim.vlans = 1;
+
+    while ((opt = getopt(argc, argv, "t:b:k:v:T:f:sh")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            topo_name = optarg;
+            if (0 == strcmp(optarg, "ring"))
+                topo = STP_SIM_TOPO_RING;
+            else if (0 == strcmp(optarg, "mesh"))
+                topo = STP_SIM_TOPO_MESH;
+            else if (0 == strcmp(optarg, "fattree"))
+                topo = STP_SIM_TOPO_FATTREE;
+            else
+            {
+                stp_sim_usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'b':
+            g_sim.nbridges = atoi(optarg);
+            break;
+        case 'k':
+            spines = atoi(optarg);
+            break;
+        case 'v':
+            g_sim.vlans = atoi(optarg);
+            break;
+        case 'T':
+            seconds = atoi(optarg);
+            break;
+        case 'f':
+            fail = atoi(optarg);
+            break;
+        case 's':
+            silent = true;
+            break;
+        default:
+            stp_sim_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!spines)
+        spines = g_sim.nbridges / 8 > 2 ? g_sim.nbridges / 8 : 2;
+
+    if (g_sim.nbridges == 0 || g_sim.nbridges > STP_SIM_MAX_BRIDGES || g_sim.vlans == 0 ||
+        g_sim.vlans > MAX_VLAN_ID - STP_SIM_NATIVE_VLAN || seconds == 0)
+    {
+        stp_sim_usage(argv[0]);
+        return 1;
+    }
+
+    g_sim.bridges = calloc(g_sim.nbridges, sizeof(STP_SIM_BRIDGE));
+    g_sim.root_id = calloc(g_sim.vlans, sizeof(BRIDGE_IDENTIFIER));
+    g_sim.agree = calloc(g_sim.vlans, sizeof(uint16_t));
+    if (!g_sim.bridges || !g_sim.root_id || !g_sim.agree)
+        return 1;
+
+    if (-1 == stp_sim_build_topology(topo, spines))
+    {
+        stp_sim_usage(argv[0]);
+        return 1;
+    }
+
+    if (fail >= (int32_t)g_sim.nlinks)
+    {
+        fprintf(stderr, "link %d does not exist, topology has %u links\n", fail, g_sim.nlinks);
+        return 1;
+    }
+
+    stp_bench_env_init(g_sim.ports);
+    for (b = 0; b < g_sim.nbridges; b++)
+        stp_sim_init_bridge(b);
+
+    printf("topology        : %s, %u bridges, %u links, %u vlans, %u ports per bridge\n", topo_name,
+           g_sim.nbridges, g_sim.nlinks, g_sim.vlans, g_sim.ports);
+
+    ticks = seconds * STP_SIM_TICKS_PER_SEC;
+    stp_sim_phase_begin(&phase);
+    for (t = 0; t < ticks; t++)
+        stp_sim_tick(&phase);
+    stp_sim_phase_report("start", &phase);
+    converged = phase.root_agreed != 0;
+
+    if (fail >= 0)
+    {
+        link = &g_sim.links[fail];
+        printf("fail link %-6d: bridge %u port %u - bridge %u port %u%s at %.1f s\n", fail, link->bridge[0],
+               link->port[0], link->bridge[1], link->port[1], silent ? " (silent)" : "",
+               (double)g_sim.now / STP_SIM_TICKS_PER_SEC);
+
+        stp_sim_phase_begin(&phase);
+        stp_sim_fail_link(fail, silent);
+        for (t = 0; t < ticks; t++)
+            stp_sim_tick(&phase);
+        stp_sim_phase_report("reconverge", &phase);
+        converged = converged && phase.root_agreed != 0;
+    }
+
+    for (b = 0; b < g_sim.nbridges; b++)
+    {
+        timer_ns += g_sim.bridges[b].timer_ns;
+        rx_ns += g_sim.bridges[b].rx_ns;
+        rx_bpdus += g_sim.bridges[b].rx_bpdus;
+        cpu = g_sim.bridges[b].timer_ns + g_sim.bridges[b].rx_ns;
+        if (cpu > cpu_max)
+            cpu_max = cpu;
+    }
+
+    printf("cpu per bridge  : avg %.1f us, max %.1f us over %.1f virtual s\n",
+           (double)(timer_ns + rx_ns) / g_sim.nbridges / 1000, (double)cpu_max / 1000,
+           (double)g_sim.now / STP_SIM_TICKS_PER_SEC);
+    printf("timer           : %.1f ns/tick/bridge\n", (double)timer_ns / g_sim.now / g_sim.nbridges);
+    printf("rx              : %.1f ns/bpdu\n", rx_bpdus ? (double)rx_ns / rx_bpdus : 0.0);
+
+    return converged ? 0 : 2;
+}
@@ -114,14 +114,31 @@
 #define g_stp_instances stp_global.max_instances
 #define g_stp_active_instances stp_global.active_instances
 #define g_stp_class_array stp_global.class_array
-#define g_stp_port_array stp_global.port_array
+#define g_stp_port_slab stp_global.port_slab
+#define g_stp_port_free_list stp_global.port_free_list
+#define g_stp_port_in_use stp_global.port_in_use
 #define g_stp_tick_id stp_global.tick_id
 #define g_stp_bpdu_sync_tick_id stp_global.bpdu_sync_tick_id
-
-#define g_stp_config_bpdu stp_global.config_bpdu
-#define g_stp_tcn_bpdu stp_global.tcn_bpdu
-#define g_stp_pvst_config_bpdu stp_global.pvst_config_bpdu
-#define g_stp_pvst_tcn_bpdu stp_global.pvst_tcn_bpdu
+#define g_stp_timer_wheel stp_global.timer_wheel
+#define g_stp_vlan_index_map stp_global.vlan_index_map
+#define g_stp_dirty_head stp_global.dirty_head
+#define g_stp_dirty_tail stp_global.dirty_tail
+#define g_stp_wbos_class_mask stp_global.wbos_class_mask
+#define g_stp_batch_depth stp_global.batch_depth
+#define g_stp_batch_class_mask stp_global.batch_class_mask
+#define g_stp_fastage_vlan_mask stp_global.fastage_vlan_mask
+#define g_stp_fastage_state_mask stp_global.fastage_state_mask
+#define g_stp_group_vlan stp_global.group_vlan
+#define g_stp_snapshot_gen stp_global.snapshot_gen
+
+#define g_stp_timer_wheel_sets stp_global.timer_wheel_sets
+
+/* BPDU templates are filled in place before tx, each worker thread has its own copy */
+#define STP_BPDU_TMPL_CUR (g_stp_bpdu_tmpl ? g_stp_bpdu_tmpl : &stp_global.tmpl)
+#define g_stp_config_bpdu (STP_BPDU_TMPL_CUR->config_bpdu)
+#define g_stp_tcn_bpdu (STP_BPDU_TMPL_CUR->tcn_bpdu)
+#define g_stp_pvst_config_bpdu (STP_BPDU_TMPL_CUR->pvst_config_bpdu)
+#define g_stp_pvst_tcn_bpdu (STP_BPDU_TMPL_CUR->pvst_tcn_bpdu)
 
 #define g_fastspan_mask stp_global.fastspan_mask
 #define g_fastspan_config_mask stp_global.fastspan_admin_mask
@@ -144,9 +161,51 @@
 #define GET_STP_PORT_CLASS(class, port) stpdata_get_port_class(class, port)
 #define GET_STP_PORT_IFNAME(port) stp_intf_get_port_name(port->port_id.number)
 
+/* VLAN сгруппирован в экземпляр (STP_VLAN_GROUP_CONFIG): BPDU этого VLAN не
+ * передаются и не принимаются, состояние портов повторяет экземпляр.
+ */
+#define STP_IS_GROUP_VLAN(_class, _vlan) \
+	((_class)->group_vlan_count && is_member((_class)->group_vlan_mask, _vlan))
+
+/* Изменение полей для APP DB: бит взводится, а экземпляр/порт ставится в
+ * очередь синхронизации, которую разбирает stptimer_sync_dirty().
+ */
+#define STP_SET_BRIDGE_MODIFIED(_class, _bit)                         \
+	do                                                                \
+	{                                                                 \
+		SET_BIT((_class)->bridge_info.modified_fields, _bit);         \
+		stputil_mark_class_dirty(_class);                             \
+	} while (0)
+#define STP_SET_CLASS_MODIFIED_ALL(_class)                            \
+	do                                                                \
+	{                                                                 \
+		SET_ALL_BITS((_class)->bridge_info.modified_fields);          \
+		SET_ALL_BITS((_class)->modified_fields);                      \
+		stputil_mark_class_dirty(_class);                             \
+	} while (0)
+#define STP_SET_PORT_MODIFIED(_class, _port, _bit)                    \
+	do                                                                \
+	{                                                                 \
+		SET_BIT((_port)->modified_fields, _bit);                      \
+		stputil_mark_port_dirty(_class, _port);                       \
+	} while (0)
+#define STP_SET_PORT_MODIFIED_ALL(_class, _port)                      \
+	do                                                                \
+	{                                                                 \
+		SET_ALL_BITS((_port)->modified_fields);                       \
+		stputil_mark_port_dirty(_class, _port);                       \
+	} while (0)
+
 #define STP_TICKS_TO_SECONDS(x) ((x) >> 1)
 #define STP_SECONDS_TO_TICKS(x) ((x) << 1)
 
+/* STP instances are serviced in groups, one group per 100ms tick */
+#define STP_TIMER_GROUPS 5
+#define STP_TIMER_GROUP(stp_class) (GET_STP_INDEX(stp_class) % STP_TIMER_GROUPS)
+/* with worker threads every worker owns a set of STP_TIMER_GROUPS wheels */
+#define STP_TIMER_WHEEL_SET(stp_class) STP_WORKER_OF_INDEX(GET_STP_INDEX(stp_class), g_stp_timer_wheel_sets)
+#define STP_TIMER_WHEEL(stp_class) (&g_stp_timer_wheel[STP_TIMER_WHEEL_SET(stp_class) * STP_TIMER_GROUPS + STP_TIMER_GROUP(stp_class)])
+
 #define STP_IS_FASTSPAN_ENABLED(port) is_member(g_fastspan_mask, (port))
 #define STP_IS_ENABLED(port) is_member(g_stp_enable_mask, (port))
 
@@ -333,12 +392,35 @@ typedef struct STP_CLASS
 	UINT32 last_expiry_time;	 /**< Время последнего истечения таймера (для логирования событий задержки). */
 	UINT32 last_bpdu_rx_time;	 /**< Время получения последнего BPDU (для логирования задержек приема). */
 	UINT32 rx_drop_bpdu;		 /**< Количество отброшенных BPDU. */
+	TIMER_WHEEL_NODE timer_node; /**< Узел колеса таймеров группы обслуживания экземпляра. */
+	struct STP_PORT_CLASS **port_tbl; /**< Таблица port_number -> класс порта, выделяется по первому обращению. */
+	PORT_MASK *dirty_port_mask;	 /**< Порты с несинхронизированными в APP DB изменениями. */
+	struct STP_CLASS *dirty_next; /**< Следующий экземпляр в очереди синхронизации. */
+	UINT8 dirty_queued;			 /**< Экземпляр стоит в очереди синхронизации. */
+	PORT_MASK *wbos_port_mask;	 /**< Порты, изменившиеся с последней отправки статуса в WBOS. */
+	VLAN_MASK *group_vlan_mask;	 /**< VLAN, сгруппированные в экземпляр помимо vlan_id, выделяется по первому VLAN. */
+	UINT16 group_vlan_count;	 /**< Количество сгруппированных VLAN. */
 #define STP_CLASS_MEMBER_VLAN_BIT 0
 #define STP_CLASS_MEMBER_BRIDEGINFO_BIT 1
 #define STP_CLASS_MEMBER_ALL_PORT_CLASS_BIT 31
 	UINT32 modified_fields; /**< Поля, которые были изменены, обозначаются соответствующими битами. */
 } __attribute__((__packed__)) STP_CLASS;
 
+/**
+ * @struct STP_PORT_CLEARED
+ * @brief Счётчики BPDU порта, накопленные до очистки статистики.
+ *
+ * Экспорт (stp_export.c) складывает их с текущими значениями и получает
+ * 64-битные счётчики, которые не сбрасываются командой очистки статистики.
+ */
+typedef struct STP_PORT_CLEARED
+{
+	uint64_t rx_config_bpdu;
+	uint64_t tx_config_bpdu;
+	uint64_t rx_tcn_bpdu;
+	uint64_t tx_tcn_bpdu;
+} __attribute__((__packed__)) STP_PORT_CLEARED;
+
 /**
  * @struct STP_PORT_CLASS
  * @brief Вектор состояния для порта в  stp
@@ -393,8 +475,103 @@ typedef struct STP_PORT_CLASS
 #define STP_PORT_CLASS_BPDU_PROTECT_BIT 16
 #define STP_PORT_CLASS_CLEAR_STATS_BIT 17
 	UINT32 modified_fields; /**< Поля, которые были модифицированы. */
+	STP_PORT_CLEARED cleared; /**< Счётчики BPDU до очистки статистики. */
 } __attribute__((__packed__)) STP_PORT_CLASS;
 
+/* Классы портов выделяются блоками по STP_PORT_SLAB_SIZE только для портов,
+ * реально добавленных в экземпляр, вместо плотного массива
+ * g_max_stp_port * g_stp_instances.
+ */
+#define STP_PORT_SLAB_SIZE 64
+
+/**
+ * @struct STP_PORT_SLAB
+ * @brief Блок памяти для классов портов STP.
+ */
+typedef struct STP_PORT_SLAB
+{
+	struct STP_PORT_SLAB *next;				 /**< Следующий блок. */
+	STP_PORT_CLASS port[STP_PORT_SLAB_SIZE]; /**< Классы портов блока. */
+} STP_PORT_SLAB;
+
+/**
+ * @struct STP_SM_STATS
+ * @brief Счётчики вызовов процедур автомата 802.1D, для профилирования и бенчмарка.
+ */
+typedef struct STP_SM_STATS
+{
+	uint64_t received_config_bpdu;		/**< received_config_bpdu(). */
+	uint64_t received_tcn_bpdu;			/**< received_tcn_bpdu(). */
+	uint64_t configuration_update;		/**< configuration_update(). */
+	uint64_t root_selection;			/**< root_selection(). */
+	uint64_t designated_port_selection; /**< designated_port_selection(). */
+	uint64_t port_state_selection;		/**< port_state_selection(). */
+	uint64_t config_bpdu_generation;	/**< config_bpdu_generation(). */
+	uint64_t transmit_config;			/**< transmit_config(). */
+	uint64_t topology_change_detection; /**< topology_change_detection(). */
+	uint64_t make_forwarding;			/**< make_forwarding(). */
+	uint64_t make_blocking;				/**< make_blocking(). */
+	uint64_t selection_skipped;			/**< BPDU без пересчёта configuration_update(). */
+} STP_SM_STATS;
+
+/**
+ * @struct STP_FASTAGE_STATS
+ * @brief Счётчики отправки быстрого старения FDB (stputil_flush_vlan_fastage()).
+ */
+typedef struct STP_FASTAGE_STATS
+{
+	uint64_t requests;	/**< Изменений быстрого старения VLAN. */
+	uint64_t merged;	/**< Повторы уже ожидающего состояния VLAN в пределах тика. */
+	uint64_t vlans;		/**< VLAN, отправленных в APP DB. */
+	uint64_t batches;	/**< Пакетов, по одному за тик с изменениями. */
+	uint32_t max_batch; /**< Наибольшее число VLAN в пакете. */
+} STP_FASTAGE_STATS;
+
+/**
+ * @struct STP_GROUP_VLAN
+ * @brief Порты сгруппированного VLAN в мосте ядра.
+ *
+ * Сгруппированный VLAN программируется только на своих портах и со своим
+ * режимом тегирования. После исключения из группы запись остаётся с
+ * STP_INDEX_INVALID: заблокированные порты не открываются, пока VLAN не
+ * получит свой экземпляр или STP на нём не будет выключен.
+ */
+typedef struct STP_GROUP_VLAN
+{
+	STP_INDEX stp_index;	 /**< Экземпляр группы, STP_INDEX_INVALID - VLAN исключён, порты удерживаются. */
+	PORT_MASK *member_mask;	 /**< Порты VLAN под управлением STP (VLAN_MEM). */
+	PORT_MASK *untag_mask;	 /**< Нетегированные порты VLAN. */
+	PORT_MASK *blocked_mask; /**< Порты, с которых VLAN снят в ядре. */
+} STP_GROUP_VLAN;
+
+/* skip configuration_update() for BPDUs that cannot change the selection (mostly periodic
+   repeats; a root change still sweeps every port), 0 always recomputes */
+#ifndef STP_SELECTION_CACHE
+#define STP_SELECTION_CACHE 1
+#endif
+
+/* worker threads count into their own copy, folded into stp_global after each round */
+#define STP_SM_INCR(_field)                    \
+	do                                         \
+	{                                          \
+		if (g_stp_sm_local)                    \
+			g_stp_sm_local->_field++;          \
+		else                                   \
+			stp_global.sm_stats._field++;      \
+	} while (0)
+
+/**
+ * @struct STP_BPDU_TMPL
+ * @brief Шаблоны передаваемых BPDU.
+ */
+typedef struct STP_BPDU_TMPL
+{
+	STP_CONFIG_BPDU config_bpdu;		/**< Структура конфигурационного BPDU. */
+	STP_TCN_BPDU tcn_bpdu;				/**< Структура BPDU уведомления об изменении топологии. */
+	PVST_CONFIG_BPDU pvst_config_bpdu;	/**< Конфигурационный BPDU для PVST. */
+	PVST_TCN_BPDU pvst_tcn_bpdu;		/**< BPDU уведомления об изменении топологии для PVST. */
+} __attribute__((__packed__)) STP_BPDU_TMPL;
+
 /**
  * @struct STP_GLOBAL
  * @brief Глобальная структура данных для управления протоколом STP.
@@ -407,13 +584,24 @@ typedef struct STP_GLOBAL
 	UINT16 max_instances;				/**< Максимальное количество экземпляров STP. */
 	UINT16 active_instances;			/**< Количество активных экземпляров STP. */
 	STP_CLASS *class_array;				/**< Указатель на массив экземпляров STP. */
-	STP_PORT_CLASS *port_array;			/**< Указатель на массив классов портов. */
-	STP_CONFIG_BPDU config_bpdu;		/**< Структура конфигурационного BPDU. */
-	STP_TCN_BPDU tcn_bpdu;				/**< Структура BPDU уведомления об изменении топологии. */
-	PVST_CONFIG_BPDU pvst_config_bpdu;	/**< Конфигурационный BPDU для PVST. */
-	PVST_TCN_BPDU pvst_tcn_bpdu;		/**< BPDU уведомления об изменении топологии для PVST. */
+	struct STP_PORT_SLAB *port_slab;	/**< Список блоков памяти классов портов. */
+	STP_PORT_CLASS *port_free_list;		/**< Список свободных классов портов. */
+	UINT32 port_in_use;					/**< Количество выделенных классов портов. */
+	STP_BPDU_TMPL tmpl;					/**< Шаблоны передаваемых BPDU главного потока. */
 	UINT8 tick_id;						/**< Идентификатор текущего тика. */
 	UINT8 bpdu_sync_tick_id;			/**< Идентификатор тика для синхронизации BPDU. */
+	TIMER_WHEEL *timer_wheel;			/**< Колёса таймеров, по одному на группу обслуживания (STP_TIMER_GROUPS) в каждом наборе. */
+	UINT8 timer_wheel_sets;				/**< Количество наборов колёс: по одному на рабочий поток, иначе 1. */
+	STP_INDEX vlan_index_map[MAX_VLAN_ID + 1]; /**< Прямое отображение VLAN -> индекс экземпляра STP (STP_INDEX_INVALID, если нет). */
+	STP_CLASS *dirty_head;				/**< Начало очереди экземпляров с изменениями для APP DB. */
+	STP_CLASS *dirty_tail;				/**< Конец очереди экземпляров с изменениями для APP DB. */
+	BITMAP_T *wbos_class_mask;			/**< Экземпляры, изменившиеся с последней отправки статуса в WBOS. */
+	UINT8 batch_depth;					/**< Вложенность пакетного изменения конфигурации (stpmgr_batch_begin()). */
+	BITMAP_T *batch_class_mask;			/**< Экземпляры с отложенным до конца пакета пересчётом состояний портов. */
+	BITMAP_T *fastage_vlan_mask;		/**< VLAN с изменением быстрого старения, ожидающим отправки в APP DB. */
+	BITMAP_T *fastage_state_mask;		/**< Ожидающее отправки состояние быстрого старения VLAN. */
+	STP_GROUP_VLAN **group_vlan;		/**< Порты сгруппированных и удерживаемых VLAN, по VLAN. */
+	UINT32 snapshot_gen;				/**< Счётчик изменений для снимка тёплого перезапуска (stp_snapshot.c). */
 	UINT8 fast_span : 1;				/**< Флаг быстрого охвата. */
 	UINT8 enable : 1;					/**< Флаг включения STP. */
 	UINT8 sstp_enabled : 1;				/**< Флаг включения SSTP. */
@@ -433,6 +621,8 @@ typedef struct STP_GLOBAL
 	UINT32 stp_drop_count;				/**< Количество отброшенных BPDU для STP. */
 	UINT32 tcn_drop_count;				/**< Количество отброшенных TCN BPDU. */
 	UINT32 pvst_drop_count;				/**< Количество отброшенных PVST BPDU. */
+	STP_SM_STATS sm_stats;				/**< Счётчики вызовов процедур автомата. */
+	STP_FASTAGE_STATS fastage_stats;	/**< Счётчики пакетной отправки быстрого старения. */
 } __attribute__((__packed__)) STP_GLOBAL;
 
 #define INVALID_STP_PARAM ((UINT32)0xffffffff)
@@ -0,0 +1,51 @@
+/**
+ * @file stp_bpdu.h
+ * @brief Разбор и формирование BPDU фиксированного формата за один проход.
+ *
+ * @details
+ * Кадры 802.1D (LLC) и PVST+ (SNAP) имеют постоянную раскладку, поэтому поля
+ * читаются и пишутся по постоянным смещениям от начала тела BPDU, без
+ * промежуточных копий и перестановки байт на месте.
+ *
+ * stp_bpdu_decode() за один проход проверяет заголовок LLC/SNAP, тип и тег
+ * PVST, переводит поля в порядок байт хоста (как делал stputil_decode_bpdu)
+ * и проверяет возраст сообщения (802.1D 9.3.4).
+ *
+ * stp_bpdu_encode_config() и stp_bpdu_encode_pvst_config() пишут кадр hello
+ * целиком, вместе с тегом 802.1Q, из шаблона g_stp_config_bpdu в порядке байт
+ * хоста прямо в буфер очереди передачи (stp_pkt_tx_frame_get()).
+ */
+
+#ifndef _STP_BPDU_H_
+#define _STP_BPDU_H_
+
+// Field offsets from the start of the BPDU body (protocol id)
+#define STP_BPDU_OFS_PROTOCOL_ID 0
+#define STP_BPDU_OFS_VERSION 2
+#define STP_BPDU_OFS_TYPE 3
+#define STP_BPDU_OFS_FLAGS 4
+#define STP_BPDU_OFS_ROOT_ID 5
+#define STP_BPDU_OFS_ROOT_PATH_COST 13
+#define STP_BPDU_OFS_BRIDGE_ID 17
+#define STP_BPDU_OFS_PORT_ID 25
+#define STP_BPDU_OFS_MESSAGE_AGE 27
+#define STP_BPDU_OFS_MAX_AGE 29
+#define STP_BPDU_OFS_HELLO_TIME 31
+#define STP_BPDU_OFS_FORWARD_DELAY 33
+// PVST+ only, after 3 bytes of padding
+#define STP_BPDU_OFS_PVST_TAG_LENGTH 38
+#define STP_BPDU_OFS_PVST_VLAN_ID 40
+#define STP_BPDU_OFS_PVST_BODY_LEN 42
+
+/**
+ * @enum STP_BPDU_RX_RESULT
+ * @brief Результат stp_bpdu_decode()
+ */
+enum STP_BPDU_RX_RESULT
+{
+    STP_BPDU_RX_OK,      // BPDU разобран
+    STP_BPDU_RX_INVALID, // Неверный заголовок, тип или тег PVST - BPDU отбрасывается
+    STP_BPDU_RX_AGED,    // Разобран, но message age не меньше max age
+};
+
+#endif
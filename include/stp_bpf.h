@@ -0,0 +1,65 @@
+/**
+ * @file stp_bpf.h
+ * @brief Ограничение частоты BPDU в ядре: eBPF фильтр сокетов приёма с token bucket.
+ *
+ * @details
+ * Пока не задано ни одного правила, на сокеты приёма ставится классический
+ * фильтр g_stp_filter. Первое правило (stpctl stormguard) загружает eBPF
+ * программу, которая выполняет те же проверки MAC/длины и дополнительно
+ * ограничивает число BPDU на пару (порт, VLAN). Программа ставится на все
+ * открытые и новые сокеты приёма.
+ *
+ * Правила ищутся от точного к общему: (порт, VLAN), (порт, любой VLAN),
+ * (все порты, VLAN), (все порты, любой VLAN). Счётчик (bucket) всегда
+ * свой для каждой пары (порт, VLAN) и создаётся программой при первом BPDU,
+ * карта счётчиков LRU. Удаление правила удаляет и его счётчики.
+ * Кредит хранится в наносекундах: каждый BPDU стоит 10^9 / pps нс, кредит
+ * ограничен burst BPDU.
+ */
+
+#ifndef _STP_BPF_H_
+#define _STP_BPF_H_
+
+#define STP_BPF_PORT_ALL 0      // STP_BPF_KEY::kif_index правила для всех портов
+#define STP_BPF_VLAN_ANY 0xffff // STP_BPF_KEY::vlan_id правила для всех VLAN
+#define STP_BPF_DEFAULT_BURST 8 // burst, если не задан
+
+#define STP_BPF_MAX_RULES 1024
+#define STP_BPF_MAX_BUCKETS 65536 // LRU: при заполнении вытесняются давно не использованные счётчики
+
+/**
+ * @struct STP_BPF_KEY
+ * @brief Ключ правил и счётчиков: ifindex ядра и VLAN (0 для untagged)
+ */
+typedef struct STP_BPF_KEY
+{
+    UINT32 kif_index;
+    UINT32 vlan_id;
+} STP_BPF_KEY;
+
+/**
+ * @struct STP_BPF_RULE
+ * @brief Правило ограничения
+ */
+typedef struct STP_BPF_RULE
+{
+    uint64_t cost_ns;   // Кредит на один BPDU, 10^9 / pps
+    uint64_t max_ns;    // Максимальный кредит, cost_ns * burst
+    uint32_t pps;       // Для вывода
+    uint32_t burst;
+    uint32_t master;    // ifindex Port-channel, с которого скопировано правило участника, или 0
+} STP_BPF_RULE;
+
+/**
+ * @struct STP_BPF_BUCKET
+ * @brief Счётчик пары (порт, VLAN), обновляется программой в ядре
+ */
+typedef struct STP_BPF_BUCKET
+{
+    uint64_t credit_ns; // Накопленный кредит
+    uint64_t last_ns;   // bpf_ktime_get_ns() последнего BPDU
+    uint64_t passed;    // Пропущено BPDU
+    uint64_t dropped;   // Отброшено BPDU
+} STP_BPF_BUCKET;
+
+#endif
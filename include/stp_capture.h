@@ -0,0 +1,67 @@
+/**
+ * @file stp_capture.h
+ * @brief Постоянно включённый захват последних BPDU в памяти.
+ *
+ * @details
+ * Для каждого порта хранится кольцо последних STP_CAPTURE_PORT_SLOTS
+ * принятых и отправленных BPDU: время, направление, VLAN и байты кадра.
+ * Запись на путях приёма и передачи - одно memcpy, разбор кадров делается
+ * только по запросу: stpctl bpducap выводит их в текстовом виде,
+ * stpctl bpdupcap сохраняет в STP_CAPTURE_PCAP_FILE.
+ *
+ * Свои кольца у портов нужны, чтобы шторм на одном порту не вытеснял
+ * историю остальных. BPDU Port-channel записываются на Port-channel, как и
+ * статистика приёма.
+ */
+
+#ifndef _STP_CAPTURE_H_
+#define _STP_CAPTURE_H_
+
+// BPDUs kept per port, 0 disables the capture
+#ifndef STP_CAPTURE_PORT_SLOTS
+#define STP_CAPTURE_PORT_SLOTS 32
+#endif
+
+#define STP_CAPTURE_SNAPLEN 80 // STP_MAX_PKT_LEN + VLAN_HEADER_LEN, rounded up
+
+#ifndef STP_CAPTURE_PCAP_FILE
+#define STP_CAPTURE_PCAP_FILE "/var/log/stpd_bpdu.pcap"
+#endif
+
+/**
+ * @enum STP_CAPTURE_FLAGS
+ * @brief Флаги записи захвата
+ */
+enum STP_CAPTURE_FLAGS
+{
+    STP_CAPTURE_RX = 0x01,     // Принятый BPDU, иначе отправленный
+    STP_CAPTURE_TAGGED = 0x02, // Кадр содержит тег 802.1Q (передача); у принятых тег снят ядром
+};
+
+/**
+ * @struct STP_CAPTURE_REC
+ * @brief Запись захвата
+ */
+typedef struct STP_CAPTURE_REC
+{
+    uint64_t ts_ns;                    // CLOCK_REALTIME, нс
+    UINT16 port_id;                    // Порт STP
+    UINT16 vlan_id;                    // VLAN (0 - принят без тега)
+    UINT16 len;                        // Длина кадра
+    UINT8 caplen;                      // Сохранено байт, не больше STP_CAPTURE_SNAPLEN
+    UINT8 flags;                       // STP_CAPTURE_FLAGS
+    UINT8 data[STP_CAPTURE_SNAPLEN];   // Кадр
+} STP_CAPTURE_REC;
+
+/**
+ * @struct stp_capture_stats_t
+ * @brief Статистика захвата
+ */
+typedef struct stp_capture_stats_s
+{
+    uint64_t frames;     // Записано BPDU
+    uint64_t overwrites; // Вытеснено из заполненных колец
+    uint32_t ports;      // Портов с кольцом
+} stp_capture_stats_t;
+
+#endif
@@ -27,6 +27,9 @@ extern "C"
 #define STP_SYNC_PORT_IDENTIFIER_LEN (16) // максимальный размер идентификатора порта
 #define STP_SYNC_PORT_STATE_LEN (15)	  // максимальный размер идентификатора состояния
 
+#define STPSYNC_PIPELINE_SIZE (128)		  // размер конвейера Redis для таблиц VLAN/порт VLAN
+#define STPSYNC_FLUSH_MAX_KEYS (1024)	  // максимум ключей, записываемых в APP DB за один тик
+
 	/**
 	 * @struct STP_VLAN_TABLE
 	 * @brief Вектор состояния VLAN и их настроек.
@@ -89,12 +92,15 @@ extern "C"
 	extern void stpsync_update_vlan_port_state(char *ifName, uint16_t vlan_id, uint8_t state); // обновить состояние vlan
 	extern void stpsync_del_vlan_port_state(char *ifName, uint16_t vlan_id);				   // удалить порт из vlan
 	extern void stpsync_update_fastage_state(uint16_t vlan_id, bool add);					   // обновить период перехода
+	extern void stpsync_update_fastage_vlans(const uint16_t *add, uint16_t add_count,
+											 const uint16_t *del, uint16_t del_count);		   // обновить быстрое старение VLAN одним пакетом
 	extern uint32_t stpsync_get_port_speed(char *ifName);									   // получить скорость интерфейса
 	extern void stpsync_update_port_admin_state(char *ifName, bool up, bool physical);		   // обновить статус порта
 	extern void stpsync_update_bpdu_guard_shutdown(char *ifName, bool enabled);				   // обновить статус защитника
 	extern void stpsync_del_stp_port(char *ifName);											   // удалить порт из стп
 	extern void stpsync_update_port_fast(char *ifName, bool enabled);						   // обновить порт быстро
 	extern void stpsync_clear_appdb_stp_tables(void);										   // удалить таблицы из баз
+	extern void stpsync_flush(void);														   // записать накопленные изменения в APP DB
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
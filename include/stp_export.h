@@ -0,0 +1,225 @@
+/**
+ * @file stp_export.h
+ * @brief Экспорт состояния STP в разделяемую память только для чтения.
+ *
+ * @details
+ * stpd публикует глобальное состояние, экземпляры, их порты, интерфейсы и
+ * счётчики в файл STP_EXPORT_FILE (tmpfs). Команды show, stpctl и агенты
+ * телеметрии отображают файл только для чтения и получают согласованный
+ * снимок без IPC, Redis и без участия потока демона.
+ *
+ * Согласованность обеспечивается seqlock: на время записи STP_EXPORT_HDR::seq
+ * нечётный. Читатель запоминает чётный seq, копирует нужные записи и
+ * повторяет чтение, если seq изменился. Если STP_EXPORT_HDR::size больше
+ * отображения, файл нужно отобразить заново.
+ *
+ * Формат: STP_EXPORT_HDR, затем class_count записей STP_EXPORT_CLASS по
+ * смещению class_offset, port_count записей STP_EXPORT_PORT по смещению
+ * port_offset (порты экземпляра идут подряд с STP_EXPORT_CLASS::port_first),
+ * intf_count записей STP_EXPORT_INTF по смещению intf_offset. Поля только
+ * фиксированной ширины, порядок байт хоста, записи упакованы, поэтому файл
+ * читается и из других языков (например, struct в Python). Заголовок не
+ * зависит от остальных заголовков stpd.
+ *
+ * Счётчики BPDU и пакетов 64-битные и монотонные с запуска stpd: очистка
+ * статистики (sonic-clear, stpctl clrsts*) их не сбрасывает, поэтому
+ * агенты телеметрии считают по ним скорость (stpctl metrics выводит их в
+ * текстовом формате Prometheus).
+ */
+
+#ifndef _STP_EXPORT_H_
+#define _STP_EXPORT_H_
+
+#include <stdint.h>
+
+// State export to shared memory, 0 disables it
+#ifndef STP_EXPORT_STATE
+#define STP_EXPORT_STATE 1
+#endif
+
+#ifndef STP_EXPORT_FILE
+#define STP_EXPORT_FILE "/dev/shm/stpd_state"
+#endif
+
+// The file is built under this name and renamed over STP_EXPORT_FILE
+#define STP_EXPORT_TMP_FILE STP_EXPORT_FILE ".tmp"
+
+#define STP_EXPORT_MAGIC "STPSTAT"
+#define STP_EXPORT_VERSION 2
+
+#define STP_EXPORT_CHECK_TICKS 5 // changed state is published twice a second
+#define STP_EXPORT_FULL_TICKS 10 // and unchanged once a second (timers, counters)
+
+#define STP_EXPORT_TIMER_OFF 0xffff // timer is not running
+#define STP_EXPORT_NAME_LEN 16      // IFNAMSIZ
+
+/**
+ * @enum STP_EXPORT_PORT_FLAGS
+ * @brief Биты STP_EXPORT_PORT::flags
+ */
+enum STP_EXPORT_PORT_FLAGS
+{
+    STP_EXPORT_PORT_ENABLED = 0x0001,       // Порт в enable_mask экземпляра
+    STP_EXPORT_PORT_UNTAGGED = 0x0002,      // Порт в untag_mask экземпляра
+    STP_EXPORT_PORT_TC_ACK = 0x0004,        // topology_change_acknowledge
+    STP_EXPORT_PORT_CONFIG_PENDING = 0x0008,
+    STP_EXPORT_PORT_SELF_LOOP = 0x0010,
+    STP_EXPORT_PORT_OPER_EDGE = 0x0020,
+    STP_EXPORT_PORT_ROOT_INCONSISTENT = 0x0040, // Запущен таймер root protect
+};
+
+/**
+ * @enum STP_EXPORT_INTF_FLAGS
+ * @brief Биты STP_EXPORT_INTF::flags (глобальные маски порта)
+ */
+enum STP_EXPORT_INTF_FLAGS
+{
+    STP_EXPORT_INTF_OPER_UP = 0x0001,
+    STP_EXPORT_INTF_STP_ENABLE = 0x0002,    // g_stp_enable_mask
+    STP_EXPORT_INTF_PORT_FAST = 0x0004,     // g_fastspan_mask
+    STP_EXPORT_INTF_UPLINK_FAST = 0x0008,   // g_fastuplink_mask
+    STP_EXPORT_INTF_BPDU_PROTECT = 0x0010,  // g_stp_protect_mask
+    STP_EXPORT_INTF_BPDU_DISABLED = 0x0020, // g_stp_protect_disabled_mask
+    STP_EXPORT_INTF_ROOT_PROTECT = 0x0040,  // g_stp_root_protect_mask
+    STP_EXPORT_INTF_PORTCHANNEL = 0x0080,
+};
+
+/**
+ * @struct STP_EXPORT_HDR
+ * @brief Заголовок области экспорта
+ */
+typedef struct STP_EXPORT_HDR
+{
+    char magic[8];              // STP_EXPORT_MAGIC
+    uint32_t version;           // STP_EXPORT_VERSION
+    uint16_t hdr_size;          // sizeof(STP_EXPORT_HDR)
+    uint16_t class_size;        // sizeof(STP_EXPORT_CLASS)
+    uint16_t port_size;         // sizeof(STP_EXPORT_PORT)
+    uint16_t intf_size;         // sizeof(STP_EXPORT_INTF)
+    volatile uint32_t seq;      // Нечётный, пока данные записываются
+    uint32_t size;              // Байт данных вместе с заголовком
+    uint32_t pid;               // pid stpd
+    uint16_t tick_ms;           // Длительность тика таймеров STP, мс
+    uint16_t spare;
+    uint64_t publish_count;     // Публикаций с запуска
+    uint64_t published_ms;      // CLOCK_MONOTONIC публикации, мс
+    uint64_t state_gen;         // g_stp_snapshot_gen на момент публикации
+    // STP_GLOBAL
+    uint8_t enable;
+    uint8_t proto_mode;
+    uint8_t fast_span;
+    uint8_t extend_mode;
+    uint16_t root_protect_timeout;
+    uint8_t base_mac[6];
+    uint16_t max_instances;
+    uint16_t active_instances;
+    uint16_t max_port;
+    uint16_t spare2;
+    uint32_t class_count;
+    uint32_t class_offset;
+    uint32_t port_count;
+    uint32_t port_offset;
+    uint32_t intf_count;
+    uint32_t intf_offset;
+    // STPD_LIBEV_STATS
+    uint64_t ev_timer;
+    uint64_t ev_pkt_rx;
+    uint64_t ev_ipc;
+    uint64_t ev_netlink;
+} __attribute__((__packed__)) STP_EXPORT_HDR;
+
+/**
+ * @struct STP_EXPORT_CLASS
+ * @brief Экземпляр STP
+ *
+ * Идентификаторы мостов: приоритет (4 бита), system id (12 бит) и MAC в
+ * младших 48 битах.
+ */
+typedef struct STP_EXPORT_CLASS
+{
+    uint16_t index;             // Индекс экземпляра
+    uint16_t vlan_id;
+    uint8_t state;              // STP_CLASS_STATE
+    uint8_t topology_change;    // Идёт изменение топологии
+    uint8_t max_age;            // Действующие значения, с
+    uint8_t hello_time;
+    uint8_t forward_delay;
+    uint8_t bridge_max_age;     // Настроенные значения, с
+    uint8_t bridge_hello_time;
+    uint8_t bridge_forward_delay;
+    uint8_t hold_time;
+    uint8_t spare;
+    uint16_t root_port;         // Номер порта STP, 0xfff - мост корневой
+    uint64_t bridge_id;
+    uint64_t root_id;
+    uint32_t root_path_cost;
+    uint32_t topology_change_count;
+    uint64_t rx_drop_bpdu;
+    uint16_t hello_timer;       // Тиков с запуска, STP_EXPORT_TIMER_OFF
+    uint16_t tcn_timer;
+    uint16_t topology_change_timer;
+    uint16_t group_vlans;       // VLAN, сгруппированных в экземпляр помимо vlan_id
+    uint32_t port_first;        // Индекс первого STP_EXPORT_PORT
+    uint32_t port_count;        // Портов экземпляра (control_mask)
+} __attribute__((__packed__)) STP_EXPORT_CLASS;
+
+/**
+ * @struct STP_EXPORT_PORT
+ * @brief Порт экземпляра STP
+ */
+typedef struct STP_EXPORT_PORT
+{
+    uint16_t port_number;       // Номер порта STP
+    uint8_t priority;           // Приоритет порта (4 бита)
+    uint8_t state;              // L2_PORT_STATE
+    uint16_t flags;             // STP_EXPORT_PORT_FLAGS
+    uint16_t designated_port;   // Приоритет и номер назначенного порта
+    uint32_t path_cost;
+    uint32_t designated_cost;
+    uint64_t designated_root;
+    uint64_t designated_bridge;
+    uint16_t message_age_timer; // Тиков с запуска, STP_EXPORT_TIMER_OFF
+    uint16_t forward_delay_timer;
+    uint16_t hold_timer;
+    uint16_t root_protect_timer;
+    uint64_t forward_transitions;
+    uint64_t rx_config_bpdu;    // Вместе со значениями до очистки статистики
+    uint64_t tx_config_bpdu;
+    uint64_t rx_tcn_bpdu;
+    uint64_t tx_tcn_bpdu;
+    uint64_t rx_delayed_bpdu;
+    uint64_t rx_drop_bpdu;
+} __attribute__((__packed__)) STP_EXPORT_PORT;
+
+/**
+ * @struct STP_EXPORT_INTF
+ * @brief Интерфейс базы интерфейсов stpd
+ */
+typedef struct STP_EXPORT_INTF
+{
+    char name[STP_EXPORT_NAME_LEN];
+    uint16_t port_number;       // Номер порта STP
+    uint16_t flags;             // STP_EXPORT_INTF_FLAGS
+    uint32_t kif_index;
+    uint32_t speed;             // Мбит/с
+    uint32_t path_cost;
+    uint64_t pkt_rx;            // STPD_INTF_STATS
+    uint64_t pkt_tx;
+    uint64_t pkt_rx_err;
+    uint64_t pkt_rx_err_trunc;  // Усечённые кадры, не входят в pkt_rx_err
+    uint64_t pkt_tx_err;
+    uint64_t pkt_rx_storm_drop; // Отброшено storm guard в ядре
+} __attribute__((__packed__)) STP_EXPORT_INTF;
+
+/**
+ * @struct stp_export_stats_t
+ * @brief Статистика экспорта
+ */
+typedef struct stp_export_stats_s
+{
+    uint64_t publishes;         // Публикаций
+    uint64_t publish_us;        // Суммарное время публикации
+    uint32_t last_size;         // Размер последней публикации
+} stp_export_stats_t;
+
+#endif
@@ -22,7 +22,7 @@ extern MAC_ADDRESS g_stp_base_mac_addr;
 /* stp.c */
 extern void transmit_config(STP_CLASS* stp_class, PORT_ID port_number);
 extern bool supercedes_port_info(STP_CLASS* stp_class, PORT_ID port_number, STP_CONFIG_BPDU* bpdu);
-extern void record_config_information(STP_CLASS* stp_class, PORT_ID port_number, STP_CONFIG_BPDU* bpdu);
+extern bool record_config_information(STP_CLASS* stp_class, PORT_ID port_number, STP_CONFIG_BPDU* bpdu);
 extern void record_config_timeout_values(STP_CLASS* stp_class, STP_CONFIG_BPDU* bpdu);
 extern void config_bpdu_generation(STP_CLASS* stp_class);
 extern void reply(STP_CLASS* stp_class, PORT_ID port_number);
@@ -78,19 +78,28 @@ extern bool stpmgr_add_control_port(STP_INDEX stp_index, PORT_ID port_number, ui
 extern bool stpmgr_delete_control_port(STP_INDEX stp_index, PORT_ID port_number, bool del_stp_port);
 extern bool stpmgr_add_enable_port(STP_INDEX stp_index, PORT_ID port_number);
 extern bool stpmgr_delete_enable_port(STP_INDEX stp_index, PORT_ID port_number);
-extern void stpmgr_process_stp_bpdu(STP_INDEX stp_index, PORT_ID port_number, void* buffer);
-extern void stpmgr_process_pvst_bpdu(STP_INDEX stp_index, PORT_ID port_number, void* buffer);
+extern void stpmgr_process_stp_bpdu(STP_INDEX stp_index, PORT_ID port_number, STP_CONFIG_BPDU* bpdu);
+extern void stpmgr_process_pvst_bpdu(STP_INDEX stp_index, PORT_ID port_number, STP_CONFIG_BPDU* bpdu);
 extern void stpmgr_config_fastuplink(PORT_ID port_number, bool enable);
 extern void stpmgr_set_extend_mode(bool enable);
+extern void stpmgr_batch_begin();
+extern void stpmgr_batch_end();
 extern void stpmgr_port_event(PORT_ID port_number, bool up);
 extern void stpmgr_100ms_timer(evutil_socket_t fd, short what, void* arg);
 extern void stpmgr_recv_client_msg(evutil_socket_t fd, short what, void* arg);
 extern struct event* stpmgr_libevent_create(struct event_base* base, evutil_socket_t sock, short flags,
-                                            void* cb_fn, void* arg, const struct timeval* timeout);
+                                            void* cb_fn, void* arg, const struct timeval* timeout, const char* name);
+extern struct event* stpmgr_libevent_create_prio(struct event_base* base, evutil_socket_t sock, short flags,
+                                                 void* cb_fn, void* arg, const struct timeval* tv, const char* name, int prio);
+extern void stpmgr_ipc_rx_sample(void);
+extern void stpmgr_ipc_rx_pkt_batch(void);
 extern struct event* stpmgr_libevent_create_periodic_sender(struct event_base* base, evutil_socket_t sock, short flags,
-                                                            void* cb_fn, void* arg, const struct timeval* tv);
+                                                            void* cb_fn, void* arg, const struct timeval* tv, const char* name);
 extern void stpmgr_process_rx_bpdu(uint16_t vlan_id, uint32_t port_id, unsigned char* pkt);
 extern void stpmgr_libevent_destroy(struct event* ev);
+extern void stpmgr_libevent_prof_clear(void);
+struct STPD_LAT_HIST;
+extern uint32_t stpd_lat_hist_percentile(const struct STPD_LAT_HIST* hist, uint32_t permille);
 extern void stpmgr_clear_statistics(VLAN_ID vlan_id, PORT_ID port_number);
 
 /* stp_util.c */
@@ -100,18 +109,26 @@ extern void stputil_bridge_to_string(BRIDGE_IDENTIFIER* bridge_id, UINT8* buffer
 extern UINT32 stputil_get_default_path_cost(PORT_ID port_number, bool extend);
 extern UINT32 stputil_get_path_cost(STP_PORT_SPEED port_speed, bool extend);
 extern void stputil_set_vlan_topo_change(STP_CLASS* stp_class);
+extern void stputil_set_vlan_fastage(VLAN_ID vlan_id, bool enable);
+extern void stputil_flush_vlan_fastage(void);
+extern bool stputil_group_vlan_set_port(STP_CLASS* stp_class, VLAN_ID vlan_id, PORT_ID port_number, bool blocked);
+extern void stputil_group_vlan_join(STP_CLASS* stp_class, VLAN_ID vlan_id);
+extern void stputil_group_vlan_leave(STP_CLASS* stp_class, VLAN_ID vlan_id);
+extern void stputil_group_vlan_release(VLAN_ID vlan_id);
+extern void stputil_group_vlan_claim(STP_CLASS* stp_class);
+extern void stputil_group_vlan_set_member(STP_CLASS* stp_class, VLAN_ID vlan_id, PORT_ID port_number, bool member,
+                                          bool untagged);
+extern void stputil_group_vlan_del_member(VLAN_ID vlan_id, PORT_ID port_number);
 extern bool stputil_set_port_state(STP_CLASS* stp_class, STP_PORT_CLASS* stp_port_class);
 extern bool stputil_get_index_from_vlan(VLAN_ID vlan_id, STP_INDEX* stp_index);
+extern STP_CLASS* stputil_get_class_from_vlan(VLAN_ID vlan_id);
 extern enum SORT_RETURN stputil_compare_mac(MAC_ADDRESS* mac1, MAC_ADDRESS* mac2);
 extern enum SORT_RETURN stputil_compare_bridge_id(BRIDGE_IDENTIFIER* id1, BRIDGE_IDENTIFIER* id2);
 extern enum SORT_RETURN stputil_compare_port_id(PORT_IDENTIFIER* port_id1, PORT_IDENTIFIER* port_id2);
 extern UINT16 stputil_get_bridge_priority(BRIDGE_IDENTIFIER* id);
 extern void stputil_set_bridge_priority(BRIDGE_IDENTIFIER* id, UINT16 priority, VLAN_ID vlan_id);
 extern bool stputil_is_same_bridge_priority(BRIDGE_IDENTIFIER* id1, UINT16 priority);
-extern bool stputil_validate_bpdu(STP_CONFIG_BPDU* bpdu);
-extern bool stputil_validate_pvst_bpdu(PVST_CONFIG_BPDU* bpdu);
 extern void stputil_encode_bpdu(STP_CONFIG_BPDU* bpdu);
-extern void stputil_decode_bpdu(STP_CONFIG_BPDU* bpdu);
 extern void stputil_send_bpdu(STP_CLASS* stp_class, PORT_ID port_number, enum STP_BPDU_TYPE type);
 extern void stputil_send_pvst_bpdu(STP_CLASS* stp_class, PORT_ID port_number, enum STP_BPDU_TYPE type);
 extern void stputil_process_bpdu(STP_INDEX stp_index, PORT_ID port_number, void* buffer);
@@ -121,8 +138,17 @@ extern bool stputil_stop_periodic_timer();
 extern void stputil_set_global_enable_mask(PORT_ID port_id, uint8_t add);
 extern void stptimer_tick();
 extern void stptimer_update(STP_CLASS* stp_class);
+extern void stptimer_schedule_class(STP_CLASS* stp_class);
+extern void stptimer_class_wakeup(STP_CLASS* stp_class);
+extern void stptimer_unschedule_class(STP_CLASS* stp_class);
+extern void stptimer_wakeup_all();
 extern void stputil_sync_port_counters(STP_CLASS* stp_class, STP_PORT_CLASS* stp_port);
 extern void stptimer_sync_db(STP_CLASS* stp_class);
+extern void stptimer_sync_dirty(void);
+extern void stptimer_expire_wheel(TIMER_WHEEL* wheel);
+extern void stputil_mark_class_dirty(STP_CLASS* stp_class);
+extern void stputil_mark_port_dirty(STP_CLASS* stp_class, STP_PORT_CLASS* stp_port);
+extern void stputil_mark_wbos_port(STP_CLASS* stp_class, PORT_ID port_number);
 extern void stptimer_start(TIMER* sptr_timer, UINT32 start_value_in_seconds);
 extern void stptimer_stop(TIMER* sptr_timer);
 extern bool stptimer_expired(TIMER* timer, UINT32 timer_limit_in_seconds);
@@ -134,11 +160,15 @@ extern bool stpdata_init_global_structures(UINT16 max_instances);
 extern bool stpdata_deinit_global_structures();
 extern bool stpdata_malloc_port_structures();
 extern void stpdata_free_port_structures();
+extern void stpdata_release_port_class(STP_CLASS *stp_class, PORT_ID port_number);
 extern int stpdata_init_class(STP_INDEX stp_index, VLAN_ID vlan_id);
 extern void stpdata_class_free(STP_INDEX stp_index);
 extern void stpdata_init_bpdu_structures();
 extern int stpdata_init_debug_structures(void);
 extern STP_PORT_CLASS* stpdata_get_port_class(STP_CLASS* stp_class, PORT_ID port_number);
+extern STP_PORT_CLASS* stpdata_ensure_port_class(STP_CLASS* stp_class, PORT_ID port_number);
+extern STP_GROUP_VLAN* stpdata_group_vlan_get(VLAN_ID vlan_id, bool create);
+extern void stpdata_group_vlan_free(VLAN_ID vlan_id);
 
 /* stp_debug.c */
 extern UINT8 stp_log_msg_src_string[][20];
@@ -147,6 +177,9 @@ extern void stpdm_class(STP_CLASS* stp_class);
 extern void stpdm_port_class(STP_CLASS* stp_class, PORT_ID port_number);
 extern void stpdm_global();
 extern int stpdm_global_wbos(char* buffer, size_t buffer_size);
+extern int stpdm_global_wbos_bin(struct STPD_CONTEXT* ctx, uint8_t* buffer, size_t buffer_size);
+extern int stpdm_global_wbos_delta(struct STPD_CONTEXT* ctx, uint8_t* buffer, size_t buffer_size);
+extern void stpdm_wbos_delta_tick(struct STPD_CONTEXT* ctx);
 extern void stpdm_clear();
 
 extern void stp_show_debug_log(UINT16 instance_id, UINT16 print_count, UINT8 print_all);
@@ -175,7 +208,11 @@ extern struct event_base* stp_intf_get_evbase();
 extern int stp_intf_event_mgr_init(void);
 extern int stp_intf_avl_compare(const void* user_p, const void* data_p, void* param);
 extern void stp_intf_netlink_cb(struct netlink_db_s* if_db, uint8_t is_add, bool init_in_prog);
+extern int stp_intf_init_port_stats();
+extern int stp_intf_init_po_id_pool();
 extern void stp_intf_reset_port_params();
+extern void stp_intf_set_port_id(INTERFACE_NODE* node, uint32_t port_id);
+extern void stp_intf_init_port_speeds();
 
 extern void sys_assert(int status);
 
@@ -186,9 +223,107 @@ extern void stpdbg_process_msg(void* msg);
 
 extern void stp_pkt_sock_close(INTERFACE_NODE* intf_node);
 extern int stp_pkt_sock_create(INTERFACE_NODE* intf_node);
+extern void stp_pkt_sock_enable(uint32_t port_id);
 extern void stp_pkt_rx_handler(evutil_socket_t fd, short what, void* arg);
+extern int stp_pkt_rx_ring_init(struct event_base* base);
+extern void stp_pkt_rx_ring_deinit();
+extern bool stp_pkt_rx_ring_is_active();
+extern struct stp_pkt_rx_ring_stats_s* stp_pkt_rx_ring_get_stats();
+extern void stp_pkt_sock_refilter();
 extern int stp_pkt_tx_handler(uint32_t kif_index, VLAN_ID vlan_id, char* buffer, uint16_t size, bool tagged);
+extern int stp_pkt_tx_init(struct event_base* base);
+extern void stp_pkt_tx_flush();
+extern void stp_pkt_tx_port_invalidate(uint32_t port_id);
+extern void stp_pkt_tx_invalidate_all();
+extern char* stp_pkt_tx_frame_get(uint32_t port_id);
+extern const UINT8* stp_pkt_tx_hdr_get(uint32_t port_id, bool pvst);
+extern int stp_pkt_tx_frame_send(uint32_t port_id, VLAN_ID vlan_id, uint16_t size, bool tagged);
+extern struct stp_pkt_tx_stats_s* stp_pkt_tx_get_stats();
 extern void stpdbg_process_ctl_msg(void* msg);
+extern void stpdbg_process_ctl_stream(void* msg, struct sockaddr* addr, socklen_t addr_len);
 extern PORT_ID stp_intf_handle_po_preconfig(char* ifname);
 extern bool stputil_set_kernel_bridge_port_state(STP_CLASS* stp_class, STP_PORT_CLASS* stp_port_class);
+extern bool stputil_set_kernel_vlan_port(STP_INDEX stp_index, PORT_ID port_number, VLAN_ID vlan_id, bool add,
+                                         bool untagged);
+struct stp_netlink_br_vlan_op_s;
+extern void stputil_kernel_bridge_op_failed(struct stp_netlink_br_vlan_op_s* op, int err);
+
+/* stp_worker.c */
+extern __thread STP_BPDU_TMPL* g_stp_bpdu_tmpl;
+extern __thread STP_SM_STATS* g_stp_sm_local;
+extern int stp_worker_init(struct event_base* base, uint8_t count);
+extern void stp_worker_deinit();
+extern bool stp_worker_run(int8_t tick_id);
+extern void stp_worker_drain();
+extern bool stp_worker_enqueue_rx(STP_INDEX stp_index, PORT_ID port_number, STP_CONFIG_BPDU* bpdu, bool pvst);
+extern bool stp_worker_in_thread();
+extern bool stp_worker_defer_tx(uint32_t port_id, VLAN_ID vlan_id, char* buffer, uint16_t size, bool tagged);
+extern bool stp_worker_defer_port_state(STP_CLASS* stp_class, STP_PORT_CLASS* stp_port_class);
+extern bool stp_worker_defer_fastage(VLAN_ID vlan_id, bool enable);
+extern bool stp_worker_defer_port_fast(PORT_ID port_number);
+extern bool stp_worker_defer_dirty(STP_CLASS* stp_class);
+extern bool stp_worker_defer_wbos(STP_CLASS* stp_class);
+extern bool stp_worker_defer_hello(STP_CLASS* stp_class);
+extern UINT8 stp_worker_get_wheel_sets();
+extern uint8_t stp_worker_count();
+extern uint64_t stp_worker_get_busy_ns(uint8_t id);
+extern struct stp_worker_stats_s* stp_worker_get_stats();
+
+/* stp_bpdu.c */
+extern int stp_bpdu_decode(const UINT8* frame, bool pvst, STP_CONFIG_BPDU* bpdu);
+extern void stp_bpdu_build_hdr(UINT8* hdr, const void* tmpl, uint16_t hdr_len, const MAC_ADDRESS* src_mac);
+extern uint16_t stp_bpdu_encode_config(UINT8* frame, const STP_CONFIG_BPDU* bpdu, const UINT8* hdr, VLAN_ID tag_vlan);
+extern uint16_t stp_bpdu_encode_pvst_config(UINT8* frame, const STP_CONFIG_BPDU* bpdu, const UINT8* hdr,
+                                            const PVST_CONFIG_BPDU* pvst, VLAN_ID tag_vlan, VLAN_ID vlan_id);
+
+/* stp_snapshot.c */
+extern bool stp_snapshot_open();
+extern int stp_snapshot_restore();
+extern int stp_snapshot_save();
+extern bool stp_snapshot_claim(STP_INDEX stp_index, VLAN_ID vlan_id);
+extern UINT32 stp_snapshot_sweep();
+extern void stp_snapshot_tick();
+extern void stp_snapshot_close();
+extern bool stp_snapshot_enabled();
+extern struct stp_snapshot_stats_s* stp_snapshot_get_stats();
+
+/* stp_bpf.c */
+extern bool stp_bpf_attach(int sock);
+extern int stp_bpf_guard_set(uint32_t kif_index, uint32_t vlan_id, uint32_t pps, uint32_t burst);
+extern int stp_bpf_guard_set_master(uint32_t master_kif, uint32_t vlan_id, uint32_t pps, uint32_t burst);
+extern void stp_bpf_guard_member_update(uint32_t kif_index, uint32_t old_master, uint32_t new_master);
+extern void stp_bpf_guard_sync_stats();
+extern bool stp_bpf_guard_next_rule(STP_BPF_KEY* key, bool first, STP_BPF_RULE* rule);
+extern bool stp_bpf_guard_next_bucket(STP_BPF_KEY* key, bool first, STP_BPF_BUCKET* bucket);
+extern uint32_t stp_bpf_guard_rule_count();
+extern bool stp_bpf_guard_active();
+extern void stp_bpf_deinit();
+
+/* stp_capture.c */
+extern void stp_capture_frame(uint32_t port_id, VLAN_ID vlan_id, const char* pkt, uint16_t len, uint8_t flags);
+extern int stp_capture_select(uint32_t port_id, VLAN_ID vlan_id, STP_CAPTURE_REC*** recs);
+extern void stp_capture_decode(const STP_CAPTURE_REC* rec, char* buf, size_t size);
+extern int stp_capture_pcap_write(const char* file, uint32_t port_id, VLAN_ID vlan_id);
+extern void stp_capture_clear();
+extern void stp_capture_deinit();
+extern stp_capture_stats_t* stp_capture_get_stats();
+
+/* stp_export.c */
+extern int stp_export_open();
+extern int stp_export_publish();
+extern void stp_export_tick();
+extern void stp_export_close();
+extern stp_export_stats_t* stp_export_get_stats();
+
+/* stp_pace.c */
+extern void stp_pace_hello(STP_CLASS* stp_class);
+extern void stp_pace_generation(STP_CLASS* stp_class);
+extern void stp_pace_tick();
+extern void stp_pace_set(uint32_t pps, uint32_t burst);
+extern void stp_pace_deinit();
+extern stp_pace_stats_t* stp_pace_get_stats();
+
+/* stp_main.c */
+extern void stpd_startup_mark(uint8_t phase);
+extern const char* stpd_startup_phase_name(uint8_t phase);
 #endif //__STP_EXTERNS_H__
@@ -35,6 +35,13 @@
 #include "stp_common.h"
 #include "stp_ipc.h"
 #include "stp.h"
+#include "stp_bpdu.h"
+#include "stp_worker.h"
+#include "stp_snapshot.h"
+#include "stp_bpf.h"
+#include "stp_capture.h"
+#include "stp_export.h"
+#include "stp_pace.h"
 #include "stp_main.h"
 #include "stp_externs.h"
 #include "stp_dbsync.h"
@@ -62,6 +62,14 @@ typedef uint32_t PORT_ID;
 
 #define port_mask_get_next_port(_bmp, _port) bmp_get_next_set_bit(_bmp, _port)
 #define port_mask_get_first_port(_bmp) bmp_get_first_set_bit(_bmp)
+#define port_mask_count(_bmp) bmp_count_set_bits(_bmp)
+
+// Обход портов маски за один проход, _it - переменная типа PORT_MASK_ITER
+#define PORT_MASK_ITER BMP_ITER_T
+#define PORT_MASK_FOR_EACH_PORT(_bmp, _it, _port)                              \
+    for (bmp_iter_init(&(_it), (_bmp)), (_port) = bmp_iter_next(&(_it));        \
+         (_port) != BAD_PORT_ID;                                                \
+         (_port) = bmp_iter_next(&(_it)))
 
 #define stp_intf_allocate_po_id() (STP_BMP_PO_OFFSET + bmp_set_first_unset_bit(g_stpd_po_id_pool))
 #define stp_intf_release_po_id(_port_id) bmp_reset(g_stpd_po_id_pool, (_port_id - STP_BMP_PO_OFFSET))
@@ -126,8 +134,11 @@ typedef uint32_t PORT_ID;
  *
  * @var INTERFACE_NODE::ev
  * Указатель на libevent-объект для обработки событий на данном сокете.
+ *
+ * @var INTERFACE_NODE::name_next
+ * Следующий узел в цепочке хэш-индекса по имени интерфейса.
  */
-typedef struct
+typedef struct INTERFACE_NODE_S
 {
     char ifname[IFNAMSIZ + 1];  /**< Имя интерфейса. */
     uint32_t kif_index;         /**< Индекс интерфейса в ядре. */
@@ -142,8 +153,33 @@ typedef struct
     uint32_t path_cost;         /**< Стоимость пути интерфейса. */
     int sock;                   /**< Сокет, связанный с интерфейсом. */
     struct event *ev;           /**< Libevent для обработки событий сокета. */
+    uint8_t rx_enabled;         /**< Приём BPDU включён (stp_pkt_sock_enable). */
+    struct INTERFACE_NODE_S *name_next; /**< Цепочка хэш-индекса по имени. */
 } INTERFACE_NODE;
 
+// Indexes kept next to the AVL tree for O(1) lookups on hot paths.
+// AVL remains the owner of nodes and is used for ordered traversal only.
+#define STP_INTF_NAME_HASH_SIZE 256
+#define STP_INTF_KIF_TBL_MAX 65536
+#define STP_INTF_PORT_TBL_MAX 65536
+#define STP_INTF_TBL_MIN_SZ 64
+
+/**
+ * @struct STP_INTF_INDEX
+ * @brief Индексы прямого доступа к узлам базы данных интерфейсов.
+ *
+ * Таблицы по port_id и kernel ifindex растут по требованию, хэш по имени
+ * использует ту же регистронезависимую семантику, что и AVL-дерево.
+ */
+typedef struct
+{
+    INTERFACE_NODE **port_tbl;                          /**< Таблица узлов по port_id. */
+    uint32_t port_tbl_sz;                               /**< Размер таблицы port_tbl. */
+    INTERFACE_NODE **kif_tbl;                           /**< Таблица узлов по kernel ifindex. */
+    uint32_t kif_tbl_sz;                                /**< Размер таблицы kif_tbl. */
+    INTERFACE_NODE *name_hash[STP_INTF_NAME_HASH_SIZE]; /**< Хэш-цепочки по имени интерфейса. */
+} STP_INTF_INDEX;
+
 typedef struct
 {
     UINT32 m[L2_PROTO_INDEX_MASKS];
@@ -237,4 +273,5 @@ bool stp_intf_set_port_priority(PORT_ID port_id, uint16_t priority);
 uint16_t stp_intf_get_port_priority(PORT_ID port_id);
 bool stp_intf_set_path_cost(PORT_ID port_id, uint32_t path_cost);
 uint32_t stp_intf_get_path_cost(PORT_ID port_id);
+void stp_intf_set_port_id(INTERFACE_NODE *node, uint32_t port_id);
 #endif //__STP_INTF_H__
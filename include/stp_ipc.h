@@ -12,6 +12,11 @@
 
 #define STPD_SOCK_NAME "/var/run/stpipc.sock"
 
+// stpd receives IPC on this loopback UDP port, every datagram starts with STP_IPC_MAGIC
+#define STPD_IPC_UDP_PORT 6954
+#define STP_IPC_MAGIC "wbosb"
+#define STP_IPC_MAGIC_LEN 5
+
 /**
  * @enum L2_PROTO_MODE
  * @brief Определяет режимы работы протоколов уровня 2 (L2).
@@ -63,6 +68,15 @@ typedef enum L2_PROTO_MODE
  * @var STP_MSG_TYPE::STP_STPCTL_MSG
  * Сообщение, отправляемое через STPCTL для управления STP.
  *
+ * @var STP_MSG_TYPE::STP_VLAN_BULK_CONFIG
+ * Пакетная конфигурация VLAN: диапазоны VLAN с общим списком портов.
+ *
+ * @var STP_MSG_TYPE::STP_VLAN_MEM_BULK_CONFIG
+ * Пакетная конфигурация членов VLAN: диапазоны VLAN и список портов.
+ *
+ * @var STP_MSG_TYPE::STP_VLAN_GROUP_CONFIG
+ * Группировка VLAN в общие экземпляры STP.
+ *
  * @var STP_MSG_TYPE::STP_MAX_MSG
  * Максимальное значение для сообщений STP (служит для проверки границ).
  */
@@ -76,6 +90,10 @@ typedef enum STP_MSG_TYPE
     STP_PORT_CONFIG,      /**< Сообщение о конфигурации порта. */
     STP_VLAN_MEM_CONFIG,  /**< Сообщение о конфигурации членов VLAN. */
     STP_STPCTL_MSG,       /**< Сообщение через STPCTL для управления STP. */
+    STP_WBOS_STATUS_MODE, /**< Выбор формата периодического статуса для WBOS. */
+    STP_VLAN_BULK_CONFIG,     /**< Пакетная конфигурация VLAN. */
+    STP_VLAN_MEM_BULK_CONFIG, /**< Пакетная конфигурация членов VLAN. */
+    STP_VLAN_GROUP_CONFIG,    /**< Группировка VLAN в экземпляры STP. */
     STP_MAX_MSG           /**< Максимальное значение для сообщений STP. */
 } STP_MSG_TYPE;
 
@@ -131,6 +149,42 @@ typedef enum STP_MSG_TYPE
  * @var STP_CTL_TYPE::STP_CTL_CLEAR_VLAN_INTF
  * Очищает статистику для интерфейса в контексте VLAN.
  *
+ * @var STP_CTL_TYPE::STP_CTL_DUMP_LIBEV_PROF
+ * Вывод гистограмм времени выполнения обработчиков libevent и опоздания таймеров.
+ *
+ * @var STP_CTL_TYPE::STP_CTL_CLEAR_LIBEV_PROF
+ * Сброс гистограмм обработчиков libevent.
+ *
+ * @var STP_CTL_TYPE::STP_CTL_SET_STORM_GUARD
+ * Установка ограничения частоты BPDU на порт/VLAN (storm guard).
+ *
+ * @var STP_CTL_TYPE::STP_CTL_DUMP_STORM_GUARD
+ * Вывод правил и счётчиков storm guard.
+ *
+ * @var STP_CTL_TYPE::STP_CTL_DUMP_BPDU_CAPTURE
+ * Вывод захваченных BPDU порта/VLAN в текстовом виде.
+ *
+ * @var STP_CTL_TYPE::STP_CTL_PCAP_BPDU_CAPTURE
+ * Сохранение захваченных BPDU порта/VLAN в файл pcap.
+ *
+ * @var STP_CTL_TYPE::STP_CTL_CLEAR_BPDU_CAPTURE
+ * Очистка захваченных BPDU.
+ *
+ * @var STP_CTL_TYPE::STP_CTL_DUMP_SHM
+ * Вывод состояния из разделяемой памяти, выполняется stpctl без обращения к stpd.
+ *
+ * @var STP_CTL_TYPE::STP_CTL_STREAM_CLASS
+ * Постраничный вывод экземпляров и портов с фильтрами VLAN, порта и состояния.
+ *
+ * @var STP_CTL_TYPE::STP_CTL_STREAM_NL_DB
+ * Постраничный вывод базы интерфейсов.
+ *
+ * @var STP_CTL_TYPE::STP_CTL_DUMP_METRICS
+ * Счётчики из разделяемой памяти в текстовом формате Prometheus, без обращения к stpd.
+ *
+ * @var STP_CTL_TYPE::STP_CTL_SET_TX_PACE
+ * Установка потолка передачи hello на порт (stp_pace.c).
+ *
  * @var STP_CTL_TYPE::STP_CTL_MAX
  * Максимальное значение для проверок диапазона значений.
  */
@@ -151,6 +205,18 @@ typedef enum STP_CTL_TYPE
     STP_CTL_CLEAR_VLAN,       /**< Очистка статистики для VLAN. */
     STP_CTL_CLEAR_INTF,       /**< Очистка статистики для интерфейса. */
     STP_CTL_CLEAR_VLAN_INTF,  /**< Очистка статистики интерфейса в контексте VLAN. */
+    STP_CTL_DUMP_LIBEV_PROF,  /**< Вывод гистограмм задержек обработчиков libevent. */
+    STP_CTL_CLEAR_LIBEV_PROF, /**< Сброс гистограмм задержек обработчиков libevent. */
+    STP_CTL_SET_STORM_GUARD,  /**< Установка ограничения частоты BPDU. */
+    STP_CTL_DUMP_STORM_GUARD, /**< Вывод правил и счётчиков storm guard. */
+    STP_CTL_DUMP_BPDU_CAPTURE,  /**< Вывод захваченных BPDU. */
+    STP_CTL_PCAP_BPDU_CAPTURE,  /**< Сохранение захваченных BPDU в pcap. */
+    STP_CTL_CLEAR_BPDU_CAPTURE, /**< Очистка захваченных BPDU. */
+    STP_CTL_DUMP_SHM,           /**< Вывод состояния из разделяемой памяти без IPC. */
+    STP_CTL_STREAM_CLASS,       /**< Постраничный вывод экземпляров и портов. */
+    STP_CTL_STREAM_NL_DB,       /**< Постраничный вывод базы интерфейсов. */
+    STP_CTL_DUMP_METRICS,       /**< Счётчики для Prometheus из разделяемой памяти. */
+    STP_CTL_SET_TX_PACE,        /**< Установка потолка передачи hello на порт. */
     STP_CTL_MAX               /**< Максимальное значение для проверок диапазона. */
 } STP_CTL_TYPE;
 
@@ -182,6 +248,19 @@ typedef struct STP_IPC_MSG
 #define STP_SET_COMMAND 1
 #define STP_DEL_COMMAND 0
 
+// Largest IPC datagram accepted by stpmgr_recv_client_msg(), bulk messages included
+#define STP_IPC_MSG_MAX_LEN (16 * 1024)
+
+// Datagrams read by one recvmmsg() per IPC wakeup, the rest waits for the next loop iteration
+#ifndef STP_IPC_RX_BATCH
+#define STP_IPC_RX_BATCH 16
+#endif
+
+// BPDU rx batches after which one IPC batch is read even if rx keeps the loop busy
+#ifndef STP_IPC_STARVE_BATCHES
+#define STP_IPC_STARVE_BATCHES 64
+#endif
+
 /**
  * @struct STP_INIT_READY_MSG
  * @brief Сообщение для инициализации готовности STP.
@@ -516,6 +595,126 @@ typedef struct STP_VLAN_MEM_CONFIG_MSG
     int priority;                                                      /**< Приоритет интерфейса. */
 } __attribute__((packed)) STP_VLAN_MEM_CONFIG_MSG;
 
+/**
+ * @struct STP_VLAN_RANGE
+ * @brief Диапазон VLAN для пакетных сообщений конфигурации.
+ *
+ * VLAN диапазона получают последовательные экземпляры STP:
+ * `inst_id = inst_start + (vlan_id - vlan_start)`. В `STP_VLAN_GROUP_CONFIG`
+ * все VLAN диапазона входят в один экземпляр `inst_start`.
+ *
+ * @var STP_VLAN_RANGE::vlan_start
+ * Первый VLAN диапазона.
+ *
+ * @var STP_VLAN_RANGE::vlan_end
+ * Последний VLAN диапазона (включительно).
+ *
+ * @var STP_VLAN_RANGE::inst_start
+ * Экземпляр STP первого VLAN диапазона.
+ */
+typedef struct STP_VLAN_RANGE
+{
+    uint16_t vlan_start; /**< Первый VLAN диапазона. */
+    uint16_t vlan_end;   /**< Последний VLAN диапазона (включительно). */
+    uint16_t inst_start; /**< Экземпляр STP первого VLAN диапазона. */
+} __attribute__((packed)) STP_VLAN_RANGE;
+
+/**
+ * @struct STP_VLAN_BULK_CONFIG_MSG
+ * @brief Пакетное сообщение конфигурации VLAN.
+ *
+ * Равносильно набору `STP_VLAN_CONFIG_MSG` с одинаковыми параметрами и списком
+ * портов для каждого VLAN из диапазонов, но применяется одной транзакцией:
+ * имена портов разрешаются один раз, а пересчёт состояний портов выполняется
+ * один раз на экземпляр после применения всего сообщения.
+ *
+ * За заголовком следуют `range_count` структур `STP_VLAN_RANGE`, затем
+ * `port_count` структур `PORT_ATTR`.
+ *
+ * @var STP_VLAN_BULK_CONFIG_MSG::opcode
+ * `STP_SET_COMMAND` — включить, `STP_DEL_COMMAND` — отключить STP на VLAN.
+ *
+ * @var STP_VLAN_BULK_CONFIG_MSG::newInstance
+ * Новые экземпляры (см. `STP_VLAN_CONFIG_MSG::newInstance`).
+ *
+ * @var STP_VLAN_BULK_CONFIG_MSG::range_count
+ * Количество диапазонов VLAN.
+ *
+ * @var STP_VLAN_BULK_CONFIG_MSG::port_count
+ * Количество портов.
+ */
+typedef struct STP_VLAN_BULK_CONFIG_MSG
+{
+    uint8_t opcode;      /**< Операция: включение/отключение VLAN. */
+    uint8_t newInstance; /**< Новые экземпляры или существующие. */
+    int forward_delay;   /**< Задержка пересылки в секундах. */
+    int hello_time;      /**< Интервал Hello в секундах. */
+    int max_age;         /**< Максимальный возраст сообщений в секундах. */
+    int priority;        /**< Приоритет моста. */
+    uint16_t range_count; /**< Количество диапазонов VLAN. */
+    uint16_t port_count;  /**< Количество портов. */
+    uint8_t data[0];      /**< Диапазоны VLAN, затем список портов. */
+} __attribute__((packed)) STP_VLAN_BULK_CONFIG_MSG;
+
+/**
+ * @struct STP_VLAN_MEM_BULK_CONFIG_MSG
+ * @brief Пакетное сообщение конфигурации членов VLAN.
+ *
+ * Равносильно `STP_VLAN_MEM_CONFIG_MSG` для каждой пары (VLAN, порт) из
+ * диапазонов и списка портов, применяется одной транзакцией. Режим и статус
+ * берутся из `PORT_ATTR` каждого порта.
+ *
+ * За заголовком следуют `range_count` структур `STP_VLAN_RANGE`, затем
+ * `port_count` структур `PORT_ATTR`.
+ *
+ * @var STP_VLAN_MEM_BULK_CONFIG_MSG::opcode
+ * `STP_SET_COMMAND` — добавить, `STP_DEL_COMMAND` — удалить порты из VLAN.
+ *
+ * @var STP_VLAN_MEM_BULK_CONFIG_MSG::path_cost
+ * Стоимость пути, 0 — не менять.
+ *
+ * @var STP_VLAN_MEM_BULK_CONFIG_MSG::priority
+ * Приоритет порта, -1 — не менять.
+ */
+typedef struct STP_VLAN_MEM_BULK_CONFIG_MSG
+{
+    uint8_t opcode;       /**< Операция: добавление/удаление членов VLAN. */
+    int path_cost;        /**< Стоимость пути, 0 - не менять. */
+    int priority;         /**< Приоритет порта, -1 - не менять. */
+    uint16_t range_count; /**< Количество диапазонов VLAN. */
+    uint16_t port_count;  /**< Количество портов. */
+    uint8_t data[0];      /**< Диапазоны VLAN, затем список портов. */
+} __attribute__((packed)) STP_VLAN_MEM_BULK_CONFIG_MSG;
+
+/**
+ * @struct STP_VLAN_GROUP_CONFIG_MSG
+ * @brief Сообщение группировки VLAN в общие экземпляры STP.
+ *
+ * В отличие от PVST, где у каждого VLAN свой экземпляр, сгруппированные VLAN
+ * разделяют экземпляр основного VLAN (`STP_CLASS::vlan_id`): один автомат
+ * состояний, одни таймеры и BPDU только в основном VLAN. Состояние портов
+ * экземпляра применяется ко всем его VLAN: в ASIC через таблицу VLAN -> STG
+ * (`stpsync_add_vlan_to_instance`), в ядре - для каждого VLAN.
+ *
+ * За заголовком следуют `range_count` структур `STP_VLAN_RANGE`: все VLAN
+ * диапазона входят в экземпляр `inst_start`, который уже должен быть создан
+ * сообщением `STP_VLAN_CONFIG` основного VLAN. Собственный экземпляр VLAN,
+ * если он был, освобождается. На соседних мостах VLAN должны быть
+ * сгруппированы так же. Порты STP в сгруппированных VLAN - только тегированные.
+ *
+ * @var STP_VLAN_GROUP_CONFIG_MSG::opcode
+ * `STP_SET_COMMAND` — добавить VLAN в экземпляры, `STP_DEL_COMMAND` — исключить.
+ *
+ * @var STP_VLAN_GROUP_CONFIG_MSG::range_count
+ * Количество диапазонов VLAN.
+ */
+typedef struct STP_VLAN_GROUP_CONFIG_MSG
+{
+    uint8_t opcode;       /**< Операция: добавление/исключение VLAN. */
+    uint16_t range_count; /**< Количество диапазонов VLAN. */
+    uint8_t data[0];      /**< Диапазоны VLAN. */
+} __attribute__((packed)) STP_VLAN_GROUP_CONFIG_MSG;
+
 /**
  * @struct STP_DEBUG_OPT
  * @brief Опции отладки для STP (Spanning Tree Protocol).
@@ -596,6 +795,56 @@ typedef struct STP_DEBUG_OPT
     uint8_t spare : 1;   /**< Зарезервированное поле для выравнивания. */
 } STP_DEBUG_OPT;
 
+/**
+ * @struct STP_STORM_GUARD_OPT
+ * @brief Параметры команды stormguard.
+ */
+typedef struct STP_STORM_GUARD_OPT
+{
+    uint32_t pps;   /**< BPDU в секунду, 0 - удалить правило. */
+    uint32_t burst; /**< Допустимая пачка BPDU, 0 - STP_BPF_DEFAULT_BURST. */
+} __attribute__((packed)) STP_STORM_GUARD_OPT;
+
+/*
+ * Постраничный вывод (STP_CTL_STREAM_*).
+ *
+ * Клиент запрашивает страницу с курсором 0, stpd отвечает на адрес
+ * отправителя датаграммой STP_CTL_PAGE_HDR | текст не длиннее
+ * STP_CTL_PAGE_SIZE и курсором следующей страницы. Клиент повторяет запрос
+ * с этим курсором, пока не получит STP_CTL_CURSOR_END. На один запрос stpd
+ * формирует одну страницу, поэтому большой вывод не занимает цикл событий
+ * надолго. Курсор содержит всё состояние вывода, потерянную страницу можно
+ * запросить заново; данные между страницами могут измениться.
+ */
+#define STP_CTL_PAGE_SIZE (32 * 1024)
+#define STP_CTL_CURSOR_END 0xffffffff
+#define STP_CTL_STATE_ANY 0xff
+
+/**
+ * @struct STP_CTL_STREAM_OPT
+ * @brief Курсор и фильтры постраничного вывода.
+ */
+typedef struct STP_CTL_STREAM_OPT
+{
+    uint32_t cursor;  /**< 0 - первая страница, иначе STP_CTL_PAGE_HDR::next_cursor. */
+    uint16_t vlan_lo; /**< Диапазон VLAN, 0 - без ограничения снизу. */
+    uint16_t vlan_hi; /**< 0 - без ограничения сверху. */
+    uint8_t state;    /**< Состояние порта L2_PORT_STATE, STP_CTL_STATE_ANY - любое. */
+} __attribute__((packed)) STP_CTL_STREAM_OPT;
+
+/**
+ * @struct STP_CTL_PAGE_HDR
+ * @brief Заголовок страницы ответа, за ним len байт текста.
+ */
+typedef struct STP_CTL_PAGE_HDR
+{
+    int32_t cmd_type;     /**< Тип команды запроса. */
+    uint32_t cursor;      /**< Курсор запроса. */
+    uint32_t next_cursor; /**< Курсор следующей страницы или STP_CTL_CURSOR_END. */
+    uint32_t len;         /**< Длина текста. */
+    uint32_t records;     /**< Записей на странице. */
+} __attribute__((packed)) STP_CTL_PAGE_HDR;
+
 /**
  * @struct STP_CTL_MSG
  * @brief Сообщение управления для протокола STP.
@@ -620,6 +869,12 @@ typedef struct STP_DEBUG_OPT
  * @var STP_CTL_MSG::dbg
  * Параметры отладки. Использует структуру `STP_DEBUG_OPT`, которая включает настройки для различных
  * режимов отладки.
+ *
+ * @var STP_CTL_MSG::storm
+ * Параметры storm guard для STP_CTL_SET_STORM_GUARD, потолок и пачка hello для STP_CTL_SET_TX_PACE.
+ *
+ * @var STP_CTL_MSG::stream
+ * Курсор и фильтры для STP_CTL_STREAM_*, порт задаётся в intf_name.
  */
 typedef struct STP_CTL_MSG
 {
@@ -628,6 +883,223 @@ typedef struct STP_CTL_MSG
     char intf_name[IFNAMSIZ]; /**< Имя интерфейса. */
     int level;                /**< Уровень команды. */
     STP_DEBUG_OPT dbg;        /**< Параметры отладки. */
+    STP_STORM_GUARD_OPT storm; /**< Параметры storm guard. */
+    STP_CTL_STREAM_OPT stream; /**< Курсор и фильтры постраничного вывода. */
 } __attribute__((packed)) STP_CTL_MSG;
 
+/*
+ * WBOS status protocol.
+ *
+ * По умолчанию stpd раз в период отправляет в WBOS текстовый дамп
+ * (stpdm_global_wbos). Потребитель, понимающий двоичный формат, присылает
+ * STP_WBOS_STATUS_MODE с format = STP_WBOS_FORMAT_BINARY, после чего статус
+ * передаётся последовательностью датаграмм:
+ *
+ *   STP_WBOS_FRAME_HDR | TLV | TLV | ...
+ *
+ * Все датаграммы одного снимка имеют одинаковый seq и возрастающий frag_idx,
+ * у последней взведён STP_WBOS_FRAME_F_LAST. TLV никогда не разрываются между
+ * датаграммами. Многобайтные поля передаются в сетевом порядке байт.
+ *
+ * В режиме STP_WBOS_FORMAT_DELTA каждые STPD_WBOS_DELTA_TICKS * 100мс
+ * отправляются только изменившиеся экземпляры и порты (STP_WBOS_FRAME_F_DELTA),
+ * а полный снимок - раз в STPD_WBOS_FULL_PERIODS периодов статуса.
+ */
+#define STP_WBOS_MAGIC "wbos"
+#define STP_WBOS_MAGIC_LEN 4
+#define STP_WBOS_PROTO_VERSION 1
+
+#define STP_WBOS_FORMAT_TEXT 0
+#define STP_WBOS_FORMAT_BINARY 1
+#define STP_WBOS_FORMAT_DELTA 2 // двоичный формат: дельты изменений и периодические полные снимки
+
+#define STP_WBOS_FRAME_F_LAST 0x01
+#define STP_WBOS_FRAME_F_DELTA 0x02 // снимок содержит только изменения с предыдущего seq
+#define STP_WBOS_FRAME_MAX (8 * 1024) // максимальный размер датаграммы статуса
+
+/**
+ * @struct STP_WBOS_STATUS_MODE_MSG
+ * @brief Запрос формата периодического статуса от WBOS.
+ */
+typedef struct STP_WBOS_STATUS_MODE_MSG
+{
+    uint8_t format;  /**< STP_WBOS_FORMAT_TEXT или STP_WBOS_FORMAT_BINARY. */
+    uint8_t version; /**< Максимальная версия протокола, поддерживаемая потребителем. */
+} __attribute__((packed)) STP_WBOS_STATUS_MODE_MSG;
+
+/**
+ * @struct STP_WBOS_FRAME_HDR
+ * @brief Заголовок датаграммы двоичного статуса.
+ */
+typedef struct STP_WBOS_FRAME_HDR
+{
+    char magic[STP_WBOS_MAGIC_LEN]; /**< STP_WBOS_MAGIC. */
+    uint8_t version;                /**< Версия протокола. */
+    uint8_t flags;                  /**< STP_WBOS_FRAME_F_*. */
+    uint16_t frag_idx;              /**< Номер датаграммы в снимке, с 0. */
+    uint32_t seq;                   /**< Номер снимка. */
+    uint32_t payload_len;           /**< Длина TLV-данных после заголовка. */
+} __attribute__((packed)) STP_WBOS_FRAME_HDR;
+
+/**
+ * @struct STP_WBOS_TLV
+ * @brief Заголовок TLV, len - длина value без заголовка.
+ */
+typedef struct STP_WBOS_TLV
+{
+    uint16_t type;    /**< STP_WBOS_TLV_TYPE. */
+    uint16_t len;     /**< Длина значения. */
+    uint8_t value[0]; /**< Значение. */
+} __attribute__((packed)) STP_WBOS_TLV;
+
+typedef enum STP_WBOS_TLV_TYPE
+{
+    STP_WBOS_TLV_GLOBAL = 1, /**< STP_WBOS_GLOBAL_TLV. */
+    STP_WBOS_TLV_MASK,       /**< STP_WBOS_MASK_TLV. */
+    STP_WBOS_TLV_CLASS,      /**< STP_WBOS_CLASS_TLV. */
+    STP_WBOS_TLV_PORT,       /**< STP_WBOS_PORT_TLV. */
+    STP_WBOS_TLV_LIBEV_PROF, /**< STP_WBOS_LIBEV_PROF_TLV, только в полном снимке. */
+} STP_WBOS_TLV_TYPE;
+
+typedef enum STP_WBOS_MASK_ID
+{
+    STP_WBOS_MASK_ENABLE,
+    STP_WBOS_MASK_ENABLE_ADMIN,
+    STP_WBOS_MASK_PROTECT,
+    STP_WBOS_MASK_PROTECT_DO_DISABLE,
+    STP_WBOS_MASK_PROTECT_DISABLED,
+    STP_WBOS_MASK_ROOT_PROTECT,
+    STP_WBOS_MASK_FASTSPAN,
+    STP_WBOS_MASK_FASTSPAN_ADMIN,
+    STP_WBOS_MASK_FASTUPLINK_ADMIN,
+} STP_WBOS_MASK_ID;
+
+#define STP_WBOS_GLOBAL_F_FAST_SPAN 0x01
+#define STP_WBOS_GLOBAL_F_ENABLE 0x02
+#define STP_WBOS_GLOBAL_F_SSTP 0x04
+#define STP_WBOS_GLOBAL_F_PVST_PROTECT_DISABLE 0x08
+
+/**
+ * @struct STP_WBOS_GLOBAL_TLV
+ * @brief Глобальное состояние STP.
+ */
+typedef struct STP_WBOS_GLOBAL_TLV
+{
+    uint16_t max_instances;        /**< Максимальное количество экземпляров. */
+    uint16_t active_instances;     /**< Количество активных экземпляров. */
+    uint16_t max_port;             /**< g_max_stp_port. */
+    uint16_t root_protect_timeout; /**< Тайм-аут защиты корня. */
+    uint8_t tick_id;               /**< Текущая группа тика. */
+    uint8_t flags;                 /**< STP_WBOS_GLOBAL_F_*. */
+    uint8_t proto_mode;            /**< L2_PROTO_MODE. */
+    uint8_t pad;
+    uint32_t stp_drop_count;  /**< Отброшенные STP BPDU. */
+    uint32_t tcn_drop_count;  /**< Отброшенные TCN BPDU. */
+    uint32_t pvst_drop_count; /**< Отброшенные PVST BPDU. */
+} __attribute__((packed)) STP_WBOS_GLOBAL_TLV;
+
+/**
+ * @struct STP_WBOS_MASK_TLV
+ * @brief Глобальная маска портов.
+ */
+typedef struct STP_WBOS_MASK_TLV
+{
+    uint8_t mask_id;    /**< STP_WBOS_MASK_ID. */
+    uint8_t pad;
+    uint16_t nbits;     /**< Количество бит маски. */
+    uint32_t words[0];  /**< Слова маски, бит N - бит (N % 32) слова N / 32. */
+} __attribute__((packed)) STP_WBOS_MASK_TLV;
+
+/**
+ * @struct STP_WBOS_BRIDGE_ID
+ * @brief Идентификатор моста: приоритет (4 бита) | system id (12 бит), MAC.
+ */
+typedef struct STP_WBOS_BRIDGE_ID
+{
+    uint16_t prio_sysid;
+    uint8_t mac[6];
+} __attribute__((packed)) STP_WBOS_BRIDGE_ID;
+
+#define STP_WBOS_CLASS_F_TOPO_CHANGE 0x01
+#define STP_WBOS_CLASS_F_TOPO_CHANGE_DETECTED 0x02
+#define STP_WBOS_CLASS_F_FAST_AGING 0x04
+
+/**
+ * @struct STP_WBOS_CLASS_TLV
+ * @brief Состояние экземпляра STP.
+ */
+typedef struct STP_WBOS_CLASS_TLV
+{
+    uint16_t index;   /**< Индекс экземпляра. */
+    uint16_t vlan_id; /**< VLAN экземпляра. */
+    uint8_t state;    /**< STP_CLASS_STATE. */
+    uint8_t flags;    /**< STP_WBOS_CLASS_F_*. */
+    uint8_t max_age;
+    uint8_t hello_time;
+    uint8_t forward_delay;
+    uint8_t bridge_max_age;
+    uint8_t bridge_hello_time;
+    uint8_t bridge_forward_delay;
+    uint8_t hold_time;
+    uint8_t topology_change_time;
+    uint16_t pad;
+    STP_WBOS_BRIDGE_ID bridge_id;
+    STP_WBOS_BRIDGE_ID root_id;
+    uint32_t root_path_cost;
+    uint32_t root_port;
+    uint32_t topology_change_count;
+    uint32_t topology_change_tick;
+    uint32_t rx_drop_bpdu;
+} __attribute__((packed)) STP_WBOS_CLASS_TLV;
+
+#define STP_WBOS_PORT_F_SELF_LOOP 0x01
+#define STP_WBOS_PORT_F_OPER_EDGE 0x02
+#define STP_WBOS_PORT_F_ENABLED 0x04
+#define STP_WBOS_PORT_F_REMOVED 0x08 // порт удалён из экземпляра, остальные поля не заполнены
+
+/**
+ * @struct STP_WBOS_PORT_TLV
+ * @brief Состояние порта в экземпляре STP.
+ */
+typedef struct STP_WBOS_PORT_TLV
+{
+    uint16_t index;       /**< Индекс экземпляра. */
+    uint16_t port_number; /**< Номер порта. */
+    uint8_t state;        /**< Состояние порта. */
+    uint8_t priority;     /**< Приоритет порта. */
+    uint8_t flags;        /**< STP_WBOS_PORT_F_*. */
+    uint8_t kernel_state; /**< STP_KERNEL_STATE. */
+    uint32_t path_cost;
+    uint32_t designated_cost;
+    STP_WBOS_BRIDGE_ID designated_root;
+    STP_WBOS_BRIDGE_ID designated_bridge;
+    uint16_t designated_port;
+    uint16_t pad;
+    uint32_t forward_transitions;
+    uint32_t rx_config_bpdu;
+    uint32_t tx_config_bpdu;
+    uint32_t rx_tcn_bpdu;
+    uint32_t tx_tcn_bpdu;
+    uint32_t rx_drop_bpdu;
+} __attribute__((packed)) STP_WBOS_PORT_TLV;
+
+/**
+ * @struct STP_WBOS_LIBEV_PROF_TLV
+ * @brief Профиль обработчика libevent: время выполнения и опоздание таймера, в мкс.
+ */
+typedef struct STP_WBOS_LIBEV_PROF_TLV
+{
+    char name[16];     /**< Имя обработчика, дополнено нулями. */
+    uint64_t calls;    /**< Количество вызовов. */
+    uint32_t run_avg;  /**< Среднее время выполнения. */
+    uint32_t run_p50;
+    uint32_t run_p99;
+    uint32_t run_p999;
+    uint32_t run_max;
+    uint32_t interval; /**< Период таймера или 0 для событий сокетов. */
+    uint32_t lag_p50;
+    uint32_t lag_p99;
+    uint32_t lag_max;
+} __attribute__((packed)) STP_WBOS_LIBEV_PROF_TLV;
+
 #endif
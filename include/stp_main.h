@@ -33,10 +33,17 @@
 #define STP_LOG_NOTICE APP_LOG_NOTICE
 #define STP_LOG_INFO APP_LOG_INFO
 #define STP_LOG_INIT APP_LOG_INIT
+#define STP_LOG_DEINIT APP_LOG_DEINIT
 #define STP_LOG_SET_LEVEL APP_LOG_SET_LEVEL
 #define STP_LOG_LEVEL_DEBUG APP_LOG_LEVEL_DEBUG
 #define STP_LOG_LEVEL_INFO APP_LOG_LEVEL_INFO
 
+// Asynchronous log ring size, 0 keeps syslog() in the calling thread.
+// On overflow ERR and more severe messages are written synchronously, the rest are dropped.
+#ifndef STP_LOG_ASYNC_SLOTS
+#define STP_LOG_ASYNC_SLOTS 4096
+#endif
+
 /* Logs directed to /var/log/syslog */
 #define STP_SYSLOG(msg, ...) applog_write(APP_LOG_LEVEL_INFO, "STP_SYSLOG: " msg " ", ##__VA_ARGS__)
 
@@ -54,6 +61,7 @@ struct netlink_db_s;
 #define g_stpd_netlink_cbuf_sz stpd_context.netlink_curr_buf_sz
 #define g_stpd_port_init_done stpd_context.port_init_done
 #define g_stpd_intf_db stpd_context.intf_avl_tree
+#define g_stpd_intf_index stpd_context.intf_index
 #define g_stpd_po_id_pool stpd_context.po_id_pool
 #define g_stpd_ioctl_sock stpd_context.ioctl_sock
 #define g_stpd_sys_max_port stpd_context.sys_max_port
@@ -62,6 +70,9 @@ struct netlink_db_s;
 #define STPD_100MS_TIMEOUT 100000
 #define STPD_3SEC_TIMEOUT 3000000
 
+#define STPD_WBOS_DELTA_TICKS 5   // период дельта-отправки статуса в WBOS, в тиках 100мс
+#define STPD_WBOS_FULL_PERIODS 12 // полный снимок в дельта-режиме раз в столько периодов статуса
+
 #define STP_ETH_NAME_PREFIX_LEN 8
 
 /*
@@ -75,10 +86,13 @@ struct netlink_db_s;
  * - STP is a single threaded process. It relies on Sockets for all its communication.
  * - STP uses libevent to manage socket communication. (viz, get notified for READ/WRITE_READY state)
  *   Libevent Priority Mapping:
- *      - High Priority Q := 100ms Timer. Prio-0 queue.
- *      - Low Priority  Q := All others. Prio-1 queue.
- *   Whenever there is data in both the queues, Prio-0 gets executed first.
- * - We impose the below mentioned restrictions on the low-priority queue using "event_config".
+ *      - High Priority Q := 100ms Timer, BPDU tx flush. Prio-0 queue.
+ *      - Pkt Priority  Q := BPDU rx sockets/ring, worker rounds. Prio-1 queue.
+ *      - Low Priority  Q := IPC, Netlink, periodic WBOS sender. Prio-2 queue.
+ *   libevent only serves a queue when all higher priority queues are empty, so
+ *   a config push over IPC can not delay BPDU processing, and IPC is read in
+ *   batches (STP_IPC_RX_BATCH) to still drain quickly once rx is idle.
+ * - We impose the below mentioned restrictions on the pkt and low priority queues using "event_config".
  *
 // max_interval :
 // Restrict the libevent low-prio-queue processing time to less than 50ms.
@@ -98,9 +112,10 @@ struct netlink_db_s;
 // Lets restrict our libevent queue to process only 5 sockets at any given instance.
 //
 */
-#define STP_LIBEV_PRIO_QUEUES 2
+#define STP_LIBEV_PRIO_QUEUES 3
 #define STP_LIBEV_HIGH_PRI_Q 0
-#define STP_LIBEV_LOW_PRI_Q 1
+#define STP_LIBEV_PKT_PRI_Q 1
+#define STP_LIBEV_LOW_PRI_Q 2
 
 /**
  * @struct stp_if_avl_node_t
@@ -122,11 +137,72 @@ typedef struct
 #define g_stpd_stats_libev_pktrx stpd_context.dbg_stats.libev.pkt_rx
 #define g_stpd_stats_libev_ipc stpd_context.dbg_stats.libev.ipc
 #define g_stpd_stats_libev_netlink stpd_context.dbg_stats.libev.netlink
+#define g_stpd_stats_libev_netlink_fast stpd_context.dbg_stats.libev.netlink_fast
+#define g_stpd_stats_ipc_rx stpd_context.dbg_stats.libev.ipc_rx
 
 #define g_stpd_intf_stats stpd_context.dbg_stats.intf
 #define STPD_INCR_PKT_COUNT(x, y) (g_stpd_intf_stats[x]->y)++
 #define STPD_GET_PKT_COUNT(x, y) (g_stpd_intf_stats[x]->y)
 
+#define g_stpd_libev_prof stpd_context.dbg_stats.libev.prof
+#define g_stpd_libev_prof_count stpd_context.dbg_stats.libev.prof_count
+
+/*
+ * Гистограмма задержек в стиле HDR: значения (мкс) меньше
+ * STPD_LAT_HIST_SUB_BUCKETS считаются точно, дальше каждый интервал
+ * [2^m, 2^(m+1)) делится на STPD_LAT_HIST_SUB_BUCKETS равных корзин,
+ * т.е. относительная погрешность не хуже 1/8 во всём диапазоне до ~64с.
+ */
+#define STPD_LAT_HIST_SUB_BITS 3
+#define STPD_LAT_HIST_SUB_BUCKETS (1 << STPD_LAT_HIST_SUB_BITS)
+#define STPD_LAT_HIST_MAX_MAGNITUDE 26
+#define STPD_LAT_HIST_BUCKETS ((STPD_LAT_HIST_MAX_MAGNITUDE - STPD_LAT_HIST_SUB_BITS + 2) * STPD_LAT_HIST_SUB_BUCKETS)
+
+#define STPD_LIBEV_PROF_MAX 16     // максимум различных обработчиков libevent, для которых ведётся профиль
+#define STPD_LIBEV_PROF_NAME_LEN 16
+
+/**
+ * @struct STPD_LAT_HIST
+ * @brief Гистограмма задержек в микросекундах
+ */
+typedef struct STPD_LAT_HIST
+{
+    uint64_t count;                          // Количество измерений.
+    uint64_t total_us;                       // Сумма измерений, для среднего.
+    uint32_t max_us;                         // Максимальное измерение.
+    uint32_t bucket[STPD_LAT_HIST_BUCKETS];  // Корзины гистограммы.
+} STPD_LAT_HIST;
+
+/**
+ * @struct STPD_LIBEV_PROF
+ * @brief Профиль одного обработчика, зарегистрированного через stpmgr_libevent_create()
+ */
+typedef struct
+{
+    char name[STPD_LIBEV_PROF_NAME_LEN]; // Имя обработчика для вывода.
+    void (*cb)(evutil_socket_t, short, void*); // Обработчик; события с одним обработчиком (например, приём на всех портах) копятся вместе.
+    uint32_t interval_us;                // Период таймера, 0 для событий сокетов.
+    STPD_LAT_HIST run;                   // Время выполнения обработчика.
+    STPD_LAT_HIST lag;                   // Опоздание срабатывания таймера относительно расписания.
+} STPD_LIBEV_PROF;
+
+/**
+ * @struct STPD_IPC_RX_STATS
+ * @brief Статистика приёма сообщений IPC (stpmgr_recv_client_msg())
+ */
+typedef struct
+{
+    uint64_t msgs;            // Принятых сообщений.
+    uint64_t batches;         // Вызовов recvmmsg(), вернувших сообщения.
+    uint64_t full_batches;    // Из них заполненных целиком, в сокете оставались сообщения.
+    uint64_t truncated;       // Сообщений длиннее STP_IPC_MSG_MAX_LEN, отброшено.
+    uint32_t max_batch;       // Наибольшее число сообщений за вызов.
+    uint32_t queue_bytes;     // Байт в очереди сокета при последней проверке.
+    uint32_t max_queue_bytes; // Наибольшая очередь сокета.
+    uint32_t drops;           // Сообщений, отброшенных ядром при переполнении очереди сокета.
+    uint64_t kicks;           // Чтений IPC вне очереди после STP_IPC_STARVE_BATCHES пачек приёма BPDU.
+} STPD_IPC_RX_STATS;
+
 /**
  * @struct STPD_LIBEV_STATS
  * @brief Вектор статистики для библиотеки libevent
@@ -138,6 +214,10 @@ typedef struct
     uint64_t pkt_rx;        // Количество принятых пакетов через сокеты.
     uint64_t ipc;           // Счетчик, отслеживающий количество обработанных IPC-событий
     uint64_t netlink;       // Количество событий Netlink, обработанных демоном STP.
+    uint64_t netlink_fast;  // Из них обработано без перестроения базы интерфейсов (изменение oper state).
+    STPD_IPC_RX_STATS ipc_rx; // Пакетный приём IPC.
+    uint8_t prof_count;                      // Количество занятых записей в prof.
+    STPD_LIBEV_PROF prof[STPD_LIBEV_PROF_MAX]; // Профили обработчиков libevent.
 } STPD_LIBEV_STATS;
 
 /**
@@ -151,8 +231,48 @@ typedef struct
     uint64_t pkt_rx_err_trunc; // Количество пакетов, которые были усечены или повреждены при приеме (например, длина пакета меньше ожидаемой).
     uint64_t pkt_rx_err;       // Общее количество ошибок при приеме пакетов (включая ошибки усечения и другие).
     uint64_t pkt_tx_err;       // Общее количество ошибок при передаче пакетов.
+    uint64_t pkt_rx_storm_drop; // BPDU, отброшенные storm guard в ядре (обновляется по запросу статистики).
 } STPD_INTF_STATS;
 
+/**
+ * @enum STPD_STARTUP_PHASE
+ * @brief Этапы запуска stpd, по которым замеряется время до первого BPDU
+ */
+enum STPD_STARTUP_PHASE
+{
+    STPD_STARTUP_BEGIN,      // Вход в stpd_main()
+    STPD_STARTUP_APPDB,      // Таблицы APP_DB очищены или открыт снимок тёплого перезапуска
+    STPD_STARTUP_DISPATCH,   // Запущен цикл событий, stpd принимает IPC
+    STPD_STARTUP_INIT_READY, // Получено STP_INIT_READY
+    STPD_STARTUP_INTF_DB,    // Построена база интерфейсов по дампу netlink
+    STPD_STARTUP_STP_INIT,   // Выполнены stpmgr_init() и восстановление снимка
+    STPD_STARTUP_CONFIG,     // Получено первое сообщение конфигурации
+    STPD_STARTUP_BPDU_TX,    // Отправлен первый BPDU
+    STPD_STARTUP_BPDU_RX,    // Принят первый BPDU
+    STPD_STARTUP_MAX
+};
+
+/**
+ * @struct STPD_STARTUP_STATS
+ * @brief Времена этапов запуска stpd
+ */
+typedef struct
+{
+    uint64_t at_us[STPD_STARTUP_MAX]; // CLOCK_MONOTONIC достижения этапа, мкс; 0 - этап ещё не пройден.
+    uint32_t intf_count;              // Интерфейсов в базе после начального дампа netlink.
+    uint32_t speed_lookups;           // Запросов скорости портов в APP_DB при построении базы.
+} STPD_STARTUP_STATS;
+
+#define g_stpd_startup stpd_context.dbg_stats.startup
+
+// Этап отмечается один раз, повторные вызовы стоят одной проверки
+#define STPD_STARTUP_MARK(phase)             \
+    do                                       \
+    {                                        \
+        if (!g_stpd_startup.at_us[phase])    \
+            stpd_startup_mark(phase);        \
+    } while (0)
+
 /**
  * @struct STPD_DEBUG_STATS
  * @brief Вектор статистики для отладки демона stpd
@@ -161,6 +281,7 @@ typedef struct
 {
     STPD_INTF_STATS** intf; // Двумерный массив указателей на объекты типа STPD_INTF_STATS, где каждый элемент хранит статистику для конкретного интерфейса.
     STPD_LIBEV_STATS libev; // Статистика, связанная с работой библиотеки libevent. Включает данные о количестве активных сокетов, таймерах, обработанных пакетах, IPC, и событиях Netlink.
+    STPD_STARTUP_STATS startup; // Времена этапов запуска.
 } STPD_DEBUG_STATS;
 
 /**
@@ -189,10 +310,9 @@ typedef struct STPD_CONTEXT
     // PO node will be created only when 1st Member port is added to the system.
     struct avl_table* intf_avl_tree; // AVL-дерево, в котором хранятся данные об интерфейсах. Ключ — имя интерфейса (например, "Ethernet0").
 
-    // TODO : for performance optimization
-    // array of pointers to nodes in avl tree.
-    // for faster access by avoiding parsing avl tree.
-    int** intf_ptr_to_avl_node; // Массив указателей для быстрого доступа к узлам AVL-дерева, что позволяет избежать перебора дерева.
+    // Direct-indexed tables (port_id, kernel ifindex) and ifname hash
+    // pointing to nodes in avl tree, for faster access by avoiding parsing avl tree.
+    STP_INTF_INDEX intf_index; // Индексы для быстрого доступа к узлам AVL-дерева, что позволяет избежать перебора дерева.
 
     // Local port-id for Port-channel.
     struct BITMAP_S* po_id_pool; // Пул идентификаторов для управления агрегированными каналами (Port-Channel).
@@ -204,6 +324,11 @@ typedef struct STPD_CONTEXT
     struct sockaddr_in addr_resp_ipc; //структура для хранения адреса посылок для send_resp_ipc_packet
     int (*send_resp_ipc_packet)(struct STPD_CONTEXT*, const char*, size_t);  //функция для отправки пакета данных в ответ на команду или событие в WBOS
     uint8_t* buf_to_wbos;
+    uint8_t wbos_format;  // формат периодического статуса для WBOS (STP_WBOS_FORMAT_*)
+    uint8_t wbos_version; // согласованная версия двоичного протокола WBOS
+    uint32_t wbos_seq;    // номер последнего отправленного двоичного снимка
+    uint8_t wbos_delta_ticks;  // тики 100мс с последней дельта-отправки
+    uint8_t wbos_full_periods; // периоды статуса с последнего полного снимка в дельта-режиме
 } STPD_CONTEXT;
 
 extern char msgtype_str[][64];
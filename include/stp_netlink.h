@@ -27,6 +27,7 @@
 #include <linux/rtnetlink.h>
 #include <event2/event.h>
 #include <linux/if_arp.h>
+#include <linux/if_bridge.h>
 
 #include "stp_inc.h"
 
@@ -51,6 +52,9 @@
 // On kernel >= linux-4.9 netlink messages can go upto 32KB(1 Page size)
 #define STP_NETLINK_MSG_SIZE (32 * 1024)
 
+// Datagrams read per netlink event callback, the rest waits for the next loop
+#define STP_NETLINK_RX_BATCH 64
+
 // With MTU = 9000, sockets buffers are restricted to hold very less number of packets.
 //   sk_buff = any kernel-overhead + sizeof(sk_buff) + STP-pkt-size + padding + MTU.
 // Based on tests,
@@ -60,6 +64,56 @@
 //  - 2 MB socket is able to hold 253 pkts. yes it doesnt add up, but thats how it works.
 #define STP_PKT_RX_BUF_SZ (2 * 1024 * 1024) // 2 MB
 
+// Optional RX engine: a single PACKET_RX_RING (TPACKET_V3) socket for all ports,
+// instead of one PF_PACKET socket per phy-port. Build with -DSTP_PKT_RX_RING=1.
+// If the ring can not be set up at startup, per-port sockets are used.
+#ifndef STP_PKT_RX_RING
+#define STP_PKT_RX_RING 0
+#endif
+
+// Per-port RX sockets are created when the port first joins an STP instance
+// (or gets BPDU guard), not for every phy-port in the netlink dump.
+// Build with -DSTP_PKT_RX_LAZY=0 to open them all at startup.
+#ifndef STP_PKT_RX_LAZY
+#define STP_PKT_RX_LAZY 1
+#endif
+// Ring size matches STP_PKT_RX_BUF_SZ. Kernel hands over a block when it is full
+// or after STP_PKT_RX_RING_TMO_MS, whichever comes first.
+#define STP_PKT_RX_RING_BLOCK_SZ (64 * 1024)
+#define STP_PKT_RX_RING_BLOCK_NR (STP_PKT_RX_BUF_SZ / STP_PKT_RX_RING_BLOCK_SZ)
+#define STP_PKT_RX_RING_FRAME_SZ 2048
+#define STP_PKT_RX_RING_TMO_MS 10
+
+/**
+ * @struct stp_pkt_rx_ring_stats_t
+ * @brief Статистика приёма BPDU через кольцо TPACKET_V3
+ */
+typedef struct stp_pkt_rx_ring_stats_s
+{
+    uint64_t blocks;       // Количество обработанных блоков кольца
+    uint64_t frames;       // Количество обработанных кадров
+    uint64_t drop_intf;    // Кадры с неизвестного или не Ethernet интерфейса
+    uint64_t drop_out;     // Исходящие кадры (PACKET_OUTGOING)
+    uint64_t kernel_drops; // Потери в ядре (PACKET_STATISTICS tp_drops)
+} stp_pkt_rx_ring_stats_t;
+
+// BPDUs sent during one libevent callback (timer tick, BPDU, IPC message) are
+// queued and sent with a single sendmmsg() once the callback returns.
+// The queue is also flushed when it is full.
+#define STP_PKT_TX_BATCH_MAX 256
+
+/**
+ * @struct stp_pkt_tx_stats_t
+ * @brief Статистика пакетной передачи BPDU
+ */
+typedef struct stp_pkt_tx_stats_s
+{
+    uint64_t frames;    // Количество поставленных в очередь кадров
+    uint64_t flushes;   // Количество вызовов sendmmsg
+    uint64_t errors;    // Кадры, которые не удалось отправить
+    uint16_t max_batch; // Максимальный размер пакета за время работы
+} stp_pkt_tx_stats_t;
+
 #define L2_ETH_ADD_LEN 6
 
 // TODO: remove once linux version is upgraded
@@ -96,13 +150,83 @@ typedef struct netlink_db_s
 typedef void stp_netlink_cb_ptr(netlink_db_t *if_db, uint8_t add, bool init_in_prog);
 extern stp_netlink_cb_ptr *stp_netlink_cb;
 
+// Kernel bridge VLAN programming (replacement for "/sbin/bridge vlan add/del").
+// Ops are queued during an event-loop callback and flushed as one multi-part
+// netlink request; every op gets its own ACK so errors are reported per-op.
+#define STP_NETLINK_BR_BATCH_MAX 1024
+#define STP_NETLINK_BR_MSG_SIZE (NLMSG_SPACE(sizeof(struct ifinfomsg)) + RTA_SPACE(0) + RTA_SPACE(sizeof(struct bridge_vlan_info)))
+#define STP_NETLINK_BR_BUF_SIZE (STP_NETLINK_BR_BATCH_MAX * STP_NETLINK_BR_MSG_SIZE)
+// Receive buffer charge of one ACK: every ACK is a separate skb, its truesize
+// is far above the nlmsgerr itself. The batch is capped to the ACKs that fit
+// into the granted SO_RCVBUF, the rest of a queue goes in the next batch.
+#define STP_NETLINK_BR_ACK_TRUESIZE 1024
+#define STP_NETLINK_BR_ACK_BUF_SIZE (STP_NETLINK_BR_BATCH_MAX * STP_NETLINK_BR_ACK_TRUESIZE)
+
+/**
+ * @struct stp_netlink_br_vlan_op_t
+ * @brief Операция добавления/удаления VLAN на порту моста ядра
+ */
+typedef struct stp_netlink_br_vlan_op_s
+{
+    uint32_t kif_index;   // kernel if index порта моста (Ethernet/PortChannel)
+    uint16_t vlan_id;     // Идентификатор VLAN
+    uint8_t add : 1;      // 1 - vlan add (FORWARDING), 0 - vlan del (BLOCKING)
+    uint8_t untagged : 1; // Порт является untagged членом VLAN
+    uint8_t unused : 6;   // Резервное поле для будущего использования.
+    uint16_t stp_index;   // Экземпляр STP, инициировавший операцию
+    uint32_t port_id;     // Локальный идентификатор порта, инициировавшего операцию
+} stp_netlink_br_vlan_op_t;
+
+/**
+ * @brief Callback для отчёта об ошибке отдельной операции пакета
+ *
+ * @param op Операция, завершившаяся ошибкой.
+ * @param err Код ошибки (errno) из NLMSG_ERROR ядра.
+ */
+typedef void stp_netlink_br_err_cb_ptr(stp_netlink_br_vlan_op_t *op, int err);
+
+/**
+ * @struct stp_netlink_br_stats_t
+ * @brief Статистика программирования VLAN моста через netlink
+ */
+typedef struct
+{
+    uint64_t ops;     // Количество поставленных в очередь операций
+    uint64_t flushes; // Количество отправленных пакетов (sendmsg)
+    uint64_t errors;  // Количество операций, завершившихся ошибкой
+    uint16_t max_batch; // Максимальный размер пакета за время работы
+    uint16_t batch_cap; // Размер пакета, ACK которого помещаются в SO_RCVBUF
+    uint64_t late_acks; // ACK, прочитанные событием сокета после сброса
+    uint64_t lost_acks; // ACK, потерянные при переполнении сокета (ENOBUFS)
+} stp_netlink_br_stats_t;
+
+/**
+ * @struct stp_netlink_rx_stats_t
+ * @brief Статистика приёма событий интерфейсов через netlink
+ */
+typedef struct
+{
+    uint64_t reads;     // Прочитанных датаграмм (recvmsg)
+    uint64_t msgs;      // Разобранных сообщений NLMSG
+    uint64_t filtered;  // Сообщений об интерфейсах, которые STP не отслеживает
+    uint64_t truncated; // Датаграмм, не поместившихся в буфер
+    uint64_t overruns;  // Переполнений приёмного буфера сокета (ENOBUFS)
+    uint64_t resyncs;   // Повторных дампов интерфейсов после потери событий
+} stp_netlink_rx_stats_t;
+
 #define PRINT_MAC_FORMAT "%02hhx:%02hhx:%02hhx:%02hhx:%02hhx:%02hhx" // маска для вывода мак адреса
 #define PRINT_MAC_VAL(x) *(char *)x, *((char *)x) + 1, *((char *)x) + 2, *((char *)x) + 3, *((char *)x) + 4, *((char *)x) + 5
 
 int stp_netlink_init(stp_netlink_cb_ptr *fn); // инициализация stp
 int stp_netlink_recv_all(int fd);
 int stp_netlink_recv_msg(int fd);
+stp_netlink_rx_stats_t *stp_netlink_rx_get_stats(void);
 void stp_netlink_event_mgr_init();
 void stp_netlink_events_cb(evutil_socket_t fd, short what, void *arg);
+int stp_netlink_br_init(struct event_base *base, stp_netlink_br_err_cb_ptr *err_cb);
+bool stp_netlink_br_is_ready(void);
+bool stp_netlink_br_vlan_queue(const stp_netlink_br_vlan_op_t *op);
+int stp_netlink_br_flush(void);
+stp_netlink_br_stats_t *stp_netlink_br_get_stats(void);
 
 #endif //__STP_NETLINK_H__
@@ -0,0 +1,65 @@
+/**
+ * @file stp_pace.h
+ * @brief Распределение передачи hello BPDU по интервалу hello.
+ *
+ * @details
+ * После пересходимости или загрузки конфигурации таймеры hello экземпляров
+ * совпадают по фазе, и config_bpdu_generation() сотен VLAN выдаёт BPDU всех
+ * назначенных портов за один тик. stp_pace_hello() вместо этого учитывает
+ * нагрузку hello на каждом порту: пока порт укладывается в квоту слота
+ * (тик stptimer_tick(), 100 мс), BPDU уходит сразу, остальные ждут в очереди
+ * порта и отправляются в следующих слотах stp_pace_tick().
+ *
+ * Квота слота - не меньше STP_PACE_BURST и не меньше числа hello порта за
+ * прошлое окно STP_PACE_WINDOW_SLOTS, делённого на STP_PACE_DEADLINE_PCT
+ * слотов окна, то есть нагрузка порта выравнивается по интервалу hello.
+ * Сверху квота ограничена потолком pps порта. Срок hello - та же доля
+ * интервала hello экземпляра: hello, дождавшийся срока, отправляется без
+ * учёта выравнивания, но в пределах потолка; отправленные позже срока
+ * считаются опоздавшими.
+ *
+ * BPDU отправляются transmit_config() в момент отправки, поэтому содержат
+ * текущее состояние экземпляра. На каждый экземпляр в очереди порта не
+ * больше одной записи. BPDU, вызванные событиями протокола (ответы,
+ * изменение корня, изменение топологии), не откладываются.
+ */
+
+#ifndef _STP_PACE_H_
+#define _STP_PACE_H_
+
+// Per-port hello ceiling, 0 disables pacing (stpctl txpace)
+#ifndef STP_PACE_PPS
+#define STP_PACE_PPS 1000
+#endif
+
+// Hellos a port always sends in one slot
+#ifndef STP_PACE_BURST
+#define STP_PACE_BURST 8
+#endif
+
+#define STP_PACE_SLOTS_PER_SEC 10 // stptimer_tick() every 100 ms
+#define STP_PACE_WINDOW_SLOTS 20  // load window, the default hello interval
+#define STP_PACE_DEADLINE_PCT 75  // of the instance hello interval
+
+/**
+ * @struct stp_pace_stats_t
+ * @brief Статистика распределения hello
+ */
+typedef struct stp_pace_stats_s
+{
+    uint32_t pps;            // Потолок hello порта в секунду, 0 - распределение отключено
+    uint32_t burst;          // Hello порта, всегда отправляемые в слоте
+    uint64_t immediate;      // Отправлено сразу
+    uint64_t deferred;       // Поставлено в очередь
+    uint64_t merged;         // Уже было в очереди порта
+    uint64_t paced;          // Отправлено из очереди
+    uint64_t stale;          // Снято из очереди: экземпляр или порт больше не передаёт
+    uint64_t late;           // Отправлено после срока
+    uint64_t delay_ms;       // Суммарная задержка отправленных из очереди
+    uint32_t max_delay_ms;   // Наибольшая задержка
+    uint32_t queued;         // Сейчас в очередях
+    uint32_t max_queued;     // Наибольшая длина очереди порта
+    uint32_t ports;          // Портов с состоянием
+} stp_pace_stats_t;
+
+#endif
@@ -0,0 +1,176 @@
+/**
+ * @file stp_snapshot.h
+ * @brief Снимок состояния STP в отображаемом в память файле для тёплого перезапуска.
+ *
+ * @details
+ * stpd периодически сохраняет экземпляры STP, их порты и глобальные
+ * маски портов в файл STP_SNAPSHOT_FILE (по умолчанию в tmpfs, поэтому
+ * после перезагрузки системы снимка нет и выполняется холодный старт).
+ * При запуске снимок восстанавливается после построения базы интерфейсов,
+ * состояния портов сверяются с дампом netlink, а APP DB не очищается.
+ *
+ * Формат файла: STP_SNAPSHOT_HDR, затем записи STP_SNAPSHOT_CLASS, за каждой
+ * из которых идут её STP_SNAPSHOT_PORT и сгруппированные VLAN
+ * (STP_SNAPSHOT_GROUP со своими STP_SNAPSHOT_GROUP_PORT), затем
+ * STP_SNAPSHOT_GPORT и удерживаемые VLAN, вышедшие из группы (те же
+ * STP_SNAPSHOT_GROUP). Порты
+ * хранятся по именам интерфейсов, т.к. номера портов Port-channel при
+ * перезапуске могут измениться. Вместо тика старта таймеры хранят время,
+ * прошедшее с их запуска к моменту сохранения.
+ */
+
+#ifndef _STP_SNAPSHOT_H_
+#define _STP_SNAPSHOT_H_
+
+// Warm restart from the snapshot file. Build with -DSTP_WARM_RESTART=1,
+// 0 keeps the cold start with APP DB cleanup.
+#ifndef STP_WARM_RESTART
+#define STP_WARM_RESTART 0
+#endif
+
+#ifndef STP_SNAPSHOT_FILE
+#define STP_SNAPSHOT_FILE "/dev/shm/stpd.snap"
+#endif
+
+#define STP_SNAPSHOT_MAGIC "STPSNAP"
+#define STP_SNAPSHOT_VERSION 4
+
+#define STP_SNAPSHOT_CHECK_TICKS 10 // changed state is saved once a second
+#define STP_SNAPSHOT_FULL_TICKS 100 // and unchanged every 10 seconds (timers, counters)
+#define STP_SNAPSHOT_MAX_DOWN_MS (300 * 1000) // older snapshots are ignored
+
+// Restored instances not claimed by config within this many ticks
+// after the last claim are released (60 seconds by default)
+#ifndef STP_SNAPSHOT_CLAIM_TICKS
+#define STP_SNAPSHOT_CLAIM_TICKS 600
+#endif
+
+/**
+ * @enum STP_SNAPSHOT_GPORT_BITS
+ * @brief Биты глобальных масок порта в STP_SNAPSHOT_GPORT::masks
+ */
+enum STP_SNAPSHOT_GPORT_BITS
+{
+    STP_SNAPSHOT_ENABLE = 0x0001,
+    STP_SNAPSHOT_ENABLE_ADMIN = 0x0002,
+    STP_SNAPSHOT_FASTSPAN = 0x0004,
+    STP_SNAPSHOT_FASTSPAN_ADMIN = 0x0008,
+    STP_SNAPSHOT_FASTUPLINK_ADMIN = 0x0010,
+    STP_SNAPSHOT_PROTECT = 0x0020,
+    STP_SNAPSHOT_PROTECT_DO_DISABLE = 0x0040,
+    STP_SNAPSHOT_PROTECT_DISABLED = 0x0080,
+    STP_SNAPSHOT_ROOT_PROTECT = 0x0100,
+};
+
+/**
+ * @struct STP_SNAPSHOT_HDR
+ * @brief Заголовок файла снимка
+ */
+typedef struct STP_SNAPSHOT_HDR
+{
+    char magic[8];             // STP_SNAPSHOT_MAGIC
+    UINT32 version;            // STP_SNAPSHOT_VERSION
+    UINT16 class_size;         // sizeof(STP_SNAPSHOT_CLASS), защита от другой сборки
+    UINT16 port_size;          // sizeof(STP_SNAPSHOT_PORT)
+    volatile UINT32 seq;       // Нечётный, пока снимок записывается
+    UINT32 size;               // Байт снимка вместе с заголовком
+    UINT32 checksum;           // FNV-1a данных после заголовка
+    uint64_t saved_ms;         // CLOCK_MONOTONIC сохранения, мс
+    volatile uint64_t alive_ms; // CLOCK_MONOTONIC последнего тика stpd, мс
+    UINT16 max_instances;      // g_stp_instances
+    UINT16 max_port;           // g_max_stp_port
+    UINT32 class_count;        // Записей STP_SNAPSHOT_CLASS
+    UINT32 gport_count;        // Записей STP_SNAPSHOT_GPORT
+    UINT32 held_count;         // Записей STP_SNAPSHOT_GROUP удерживаемых VLAN после GPORT
+    UINT8 proto_mode;          // stp_global.proto_mode
+    UINT8 enable : 1;          // stp_global.enable
+    UINT8 fast_span : 1;       // stp_global.fast_span
+    UINT8 sstp_enabled : 1;    // stp_global.sstp_enabled
+    UINT8 pvst_protect_do_disable : 1;
+    UINT8 extend_mode : 1;     // g_stpd_extend_mode
+    UINT8 spare : 3;
+    UINT16 root_protect_timeout;
+    MAC_ADDRESS base_mac_addr; // g_stp_base_mac_addr
+} __attribute__((__packed__)) STP_SNAPSHOT_HDR;
+
+/**
+ * @struct STP_SNAPSHOT_CLASS
+ * @brief Экземпляр STP в снимке
+ */
+typedef struct STP_SNAPSHOT_CLASS
+{
+    STP_INDEX index;              // Индекс экземпляра
+    VLAN_ID vlan_id;              // VLAN
+    UINT8 state;                  // STP_CLASS_CONFIG или STP_CLASS_ACTIVE
+    UINT8 fast_aging;             // STP_CLASS::fast_aging
+    BRIDGE_DATA bridge_info;      // STP_CLASS::bridge_info
+    TIMER hello_timer;            // value - тиков с запуска
+    TIMER tcn_timer;
+    TIMER topology_change_timer;
+    UINT32 rx_drop_bpdu;
+    UINT32 port_count;            // Следующих записей STP_SNAPSHOT_PORT
+    UINT32 group_count;           // Записей STP_SNAPSHOT_GROUP после портов
+} __attribute__((__packed__)) STP_SNAPSHOT_CLASS;
+
+/**
+ * @struct STP_SNAPSHOT_PORT
+ * @brief Порт экземпляра STP в снимке (порт входит в control_mask)
+ */
+typedef struct STP_SNAPSHOT_PORT
+{
+    char intf_name[IFNAMSIZ];     // Имя интерфейса
+    UINT8 enabled;                // Порт в enable_mask
+    UINT8 untagged;               // Порт в untag_mask
+    STP_PORT_CLASS port;          // Таймеры: value - тиков с запуска
+} __attribute__((__packed__)) STP_SNAPSHOT_PORT;
+
+/**
+ * @struct STP_SNAPSHOT_GROUP
+ * @brief VLAN, сгруппированный в экземпляр STP или удерживаемый, в снимке
+ */
+typedef struct STP_SNAPSHOT_GROUP
+{
+    VLAN_ID vlan_id;              // Сгруппированный VLAN
+    UINT32 port_count;            // Следующих записей STP_SNAPSHOT_GROUP_PORT
+} __attribute__((__packed__)) STP_SNAPSHOT_GROUP;
+
+/**
+ * @struct STP_SNAPSHOT_GROUP_PORT
+ * @brief Порт сгруппированного VLAN в снимке (STP_GROUP_VLAN::member_mask)
+ */
+typedef struct STP_SNAPSHOT_GROUP_PORT
+{
+    char intf_name[IFNAMSIZ];     // Имя интерфейса
+    UINT8 untagged;               // Порт в untag_mask
+    UINT8 blocked;                // Порт в blocked_mask
+} __attribute__((__packed__)) STP_SNAPSHOT_GROUP_PORT;
+
+/**
+ * @struct STP_SNAPSHOT_GPORT
+ * @brief Глобальные маски порта в снимке
+ */
+typedef struct STP_SNAPSHOT_GPORT
+{
+    char intf_name[IFNAMSIZ];     // Имя интерфейса
+    UINT16 masks;                 // STP_SNAPSHOT_GPORT_BITS
+} __attribute__((__packed__)) STP_SNAPSHOT_GPORT;
+
+/**
+ * @struct stp_snapshot_stats_t
+ * @brief Статистика снимков
+ */
+typedef struct stp_snapshot_stats_s
+{
+    uint64_t saves;           // Сохранённых снимков
+    uint64_t save_us;         // Суммарное время сохранения
+    uint32_t last_size;       // Размер последнего снимка
+    uint32_t restored_classes; // Восстановлено при запуске
+    uint32_t restored_ports;
+    uint32_t dropped_ports;   // Порты снимка, которых больше нет
+    uint32_t reconciled_ports; // Порты, изменившие состояние при сверке с netlink
+    uint32_t capped_ages;     // Таймеры Message Age, ограниченные при восстановлении
+    uint32_t swept_classes;   // Экземпляры, не подтверждённые конфигурацией и освобождённые
+    uint32_t restored_held;   // Восстановлено удерживаемых VLAN
+} stp_snapshot_stats_t;
+
+#endif
@@ -32,14 +32,42 @@
 typedef struct TIMER
 {
 	UINT32 active : 1; // флаг статуса таймера
-	UINT32 value : 31; // поле тиков таймера
+	UINT32 value : 31; // тик часов таймеров, соответствующий моменту старта
 } TIMER;
 
+#define TIMER_VALUE_MASK 0x7fffffff
+
+/*
+ * Timers are stored as the absolute clock tick they were started at, so the
+ * caller no longer has to touch every timer on every tick. timer_clock_tick()
+ * must be called once per application tick before timers are examined;
+ * timer_expired() compares the elapsed ticks against the limit.
+ */
+
+/**
+ * @brief Продвигает часы таймеров на один тик
+ */
+void timer_clock_tick(void);
+
+/**
+ * @brief Возвращает текущее значение часов таймеров
+ *
+ * @return текущий тик (31 бит)
+ */
+UINT32 timer_clock_get(void);
+
+/**
+ * @brief Устанавливает часы таймеров (симуляция нескольких мостов в одном процессе)
+ *
+ * @param value значение часов
+ */
+void timer_clock_set(UINT32 value);
+
 uint32_t sys_get_seconds(); // функция для получения значения секунд из тиков?
 /*
  * start_timer()
  *		this function initializes the timer to the input start_value_in_ticks
- *		and marks it as an active timer.
+ *		(ticks already elapsed) and marks it as an active timer.
  */
 
 /**
@@ -61,20 +89,19 @@ void stop_timer(TIMER *timer);
  * timer_expired()
  *		can be called every system tick.
  *		- if the timer is inactive, this function will return FALSE
- *		- if the timer is active, this function increments the timer value
- *		  by 1. after incrementing, checks if the timer value exceeds the
- *		  timer_limit_in_ticks. if it exceeds or equal to the limit, stops the
- *		  timer and returns TRUE, other wise returns FALSE
+ *		- if the timer is active, this function checks if the ticks elapsed
+ *		  since the timer was started exceed the timer_limit_in_ticks. if it
+ *		  exceeds or equal to the limit, stops the timer and returns TRUE,
+ *		  other wise returns FALSE
  */
 
 /**
  * @brief вызывается каждый системный тик
  *
  * @param timer указатель на структуру таймера
- * @param timer_limit_in_ticks if the timer is active, this function increments the timer value
- * by 1. after incrementing, checks if the timer value exceeds the
- * timer_limit_in_ticks. if it exceeds or equal to the limit, stops the
- * timer and returns TRUE, other wise returns FALSE
+ * @param timer_limit_in_ticks if the timer is active, this function checks if the
+ * ticks elapsed since start exceed the timer_limit_in_ticks. if it exceeds or
+ * equal to the limit, stops the timer and returns TRUE, other wise returns FALSE
  * @return true
  * @return false if the timer is inactive, this function will return FALSE
  */
@@ -93,12 +120,77 @@ bool is_timer_active(TIMER *timer);
  * @brief Get the timer value object
  *
  * @param timer указатель на структуру таймера
- * @param value_in_ticks fills in the the current value of the timer in ticks
+ * @param value_in_ticks fills in the ticks elapsed since the timer was started
  * @return true
  * @return false return FALSE if the timer is inactive
  */
 bool get_timer_value(TIMER *timer, UINT32 *value_in_ticks);
 
+/**
+ * @brief возвращает число тиков, прошедших с момента запуска таймера
+ *
+ * @param timer указатель на структуру таймера
+ * @return прошедшие тики, 0 если таймер неактивен
+ */
+UINT32 timer_elapsed(TIMER *timer);
+
+/* Hashed Timer Wheel
+ * - Intrusive list of nodes hashed by absolute expiry tick. The owner embeds
+ *   a TIMER_WHEEL_NODE in its object and schedules it for the earliest tick
+ *   at which any of its TIMERs can expire.
+ * - timer_wheel_expire() only walks the slot of the current tick; nodes
+ *   hashed into the same slot for a later revolution are left in place.
+ */
+#define TIMER_WHEEL_SLOTS 1024
+
+/**
+ * @struct TIMER_WHEEL_NODE
+ * @brief Узел колеса таймеров, встраиваемый в объект-владелец.
+ */
+typedef struct TIMER_WHEEL_NODE
+{
+	struct TIMER_WHEEL_NODE *next; // следующий узел в слоте
+	struct TIMER_WHEEL_NODE *prev; // предыдущий узел в слоте
+	UINT32 expiry;				   // абсолютный тик срабатывания
+	UINT8 linked;				   // узел находится в колесе
+} __attribute__((__packed__)) TIMER_WHEEL_NODE;
+
+/**
+ * @struct TIMER_WHEEL
+ * @brief Колесо таймеров со слотами по абсолютному тику срабатывания.
+ */
+typedef struct TIMER_WHEEL
+{
+	TIMER_WHEEL_NODE *slot[TIMER_WHEEL_SLOTS]; // головы списков слотов
+	UINT32 count;							   // количество узлов в колесе
+} TIMER_WHEEL;
+
+/**
+ * @brief Ставит узел в колесо на указанный тик (переставляет, если уже стоит)
+ *
+ * @param wheel указатель на колесо
+ * @param node указатель на узел
+ * @param expiry абсолютный тик срабатывания
+ */
+void timer_wheel_add(TIMER_WHEEL *wheel, TIMER_WHEEL_NODE *node, UINT32 expiry);
+
+/**
+ * @brief Снимает узел с колеса
+ *
+ * @param wheel указатель на колесо
+ * @param node указатель на узел
+ */
+void timer_wheel_del(TIMER_WHEEL *wheel, TIMER_WHEEL_NODE *node);
+
+/**
+ * @brief Снимает с колеса один узел, срок которого наступил к тику now
+ *
+ * @param wheel указатель на колесо
+ * @param now текущий тик
+ * @return узел или NULL, если сработавших узлов больше нет
+ */
+TIMER_WHEEL_NODE *timer_wheel_expire(TIMER_WHEEL *wheel, UINT32 now);
+
 /* USAGE EXAMPLE
  * ---------------------------------------------------------------------------
  *
@@ -107,6 +199,8 @@ bool get_timer_value(TIMER *timer, UINT32 *value_in_ticks);
  *
  *	void app_tick()
  *	{
+ *		timer_clock_tick();
+ *
  *		if (timer_expired(&timer1, 10)) // timer expiry every second
  *		{
  *			// do timer expiry routine for timer1
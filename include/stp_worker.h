@@ -0,0 +1,45 @@
+/**
+ * @file stp_worker.h
+ * @brief Пул рабочих потоков для обработки экземпляров STP на нескольких ядрах.
+ *
+ * @details
+ * Экземпляры STP делятся между потоками по индексу (STP_WORKER_OF_INDEX).
+ * У каждого потока свой набор колёс таймеров и своя очередь принятых BPDU.
+ * Потоки работают раундами: главный поток раздаёт BPDU, запускает раунд
+ * и ждёт его окончания, после чего сам выполняет отложенные операции
+ * потоков (передачу BPDU, состояние портов в ядре, stpsync, очереди
+ * синхронизации), т.е. всё общее состояние меняется только в главном потоке.
+ */
+
+#ifndef _STP_WORKER_H_
+#define _STP_WORKER_H_
+
+// Number of worker threads. Build with -DSTP_WORKER_THREADS=N, 0 keeps all
+// STP instances on the main thread.
+#ifndef STP_WORKER_THREADS
+#define STP_WORKER_THREADS 0
+#endif
+#define STP_WORKER_MAX 16
+
+// Instances of one timer group are spread round robin over the workers,
+// so every 100ms tick keeps all of them busy.
+#define STP_WORKER_OF_INDEX(idx, n) (((idx) / STP_TIMER_GROUPS) % (n))
+
+// BPDUs queued per worker before a round is forced
+#define STP_WORKER_RX_MAX 1024
+
+/**
+ * @struct stp_worker_stats_t
+ * @brief Статистика пула рабочих потоков
+ */
+typedef struct stp_worker_stats_s
+{
+    uint64_t rounds;    // Количество раундов (тики таймера и пачки BPDU)
+    uint64_t rx;        // BPDU, переданных потокам
+    uint64_t ops;       // Отложенных операций, выполненных главным потоком
+    uint64_t wait_ns;   // Время ожидания главным потоком окончания раундов
+    uint64_t replay_ns; // Время выполнения отложенных операций
+    uint32_t max_batch; // Максимум BPDU в одном раунде
+} stp_worker_stats_t;
+
+#endif
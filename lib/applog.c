@@ -12,10 +12,14 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <syslog.h>
 #include <string.h>
+#include <signal.h>
+#include <pthread.h>
 
 #include "applog.h"
 
@@ -23,6 +27,81 @@ int applog_level_map[APP_LOG_LEVEL_MAX + 2];     // Массив для сопо
 int applog_config_level = APP_LOG_LEVEL_DEFAULT; // Хранит текущий конфигурационный уровень логирования.
 int applog_inited = 0;                           // Указывает, была ли подсистема логирования инициализирована
 
+/**
+ * @enum applog_arg_t
+ * @brief Тип аргумента спецификатора формата
+ */
+typedef enum
+{
+  APPLOG_ARG_NONE,    // %%
+  APPLOG_ARG_INT,     // d i u x X o c, с hh/h или без модификатора
+  APPLOG_ARG_LONG,    // то же с l/ll/z/j/t
+  APPLOG_ARG_DOUBLE,  // f e g a
+  APPLOG_ARG_LDOUBLE, // L f e g a
+  APPLOG_ARG_PTR,     // p
+  APPLOG_ARG_STR,     // s, строка копируется
+  APPLOG_ARG_BAD,     // %n, %ls и прочее: сообщение форматируется сразу
+} applog_arg_t;
+
+/**
+ * @struct applog_spec_t
+ * @brief Разобранный спецификатор формата
+ */
+typedef struct
+{
+  const char *start; // '%'
+  int len;           // Длина спецификатора вместе с '%'
+  int stars;         // Ширина/точность '*', 0..2
+  applog_arg_t type;
+} applog_spec_t;
+
+#define APPLOG_SPEC_MAX 32 // спецификаторы длиннее форматируются сразу
+
+enum
+{
+  APPLOG_SLOT_DEFERRED, // data: аргументы для fmt
+  APPLOG_SLOT_TEXT,     // data: готовая строка
+};
+
+#define APPLOG_SLOT_DATA (APP_LOG_ASYNC_SLOT_SIZE - 24)
+
+/**
+ * @struct applog_slot_t
+ * @brief Ячейка кольца. seq - номер позиции (ограниченная очередь Вьюкова):
+ * seq == pos - ячейка свободна для записи позиции pos, seq == pos + 1 - заполнена.
+ */
+typedef struct
+{
+  uint64_t seq;
+  const char *fmt;
+  int8_t level;
+  uint8_t kind;
+  uint16_t len;
+  uint32_t spare;
+  uint8_t data[APPLOG_SLOT_DATA] __attribute__((aligned(8)));
+} applog_slot_t;
+
+/**
+ * @struct applog_async_t
+ * @brief Кольцо асинхронного журнала: много писателей, один читатель (поток вывода)
+ */
+typedef struct
+{
+  applog_slot_t *slots;
+  uint32_t mask;
+  int sync_level;           // При переполнении уровни не ниже этого пишутся синхронно
+  volatile int running;
+  pthread_t thread;
+  pthread_mutex_t lock;     // Защищает ожидание потока вывода на wake
+  pthread_cond_t wake;      // Сигнал потоку вывода о новых сообщениях
+  int sleeping;             // Поток вывода ждёт на wake
+  uint64_t head __attribute__((aligned(64))); // Следующая позиция записи
+  uint64_t tail __attribute__((aligned(64))); // Следующая позиция чтения, только поток вывода
+  applog_async_stats_t stats;
+} applog_async_t;
+
+static applog_async_t applog_async = {0};
+
 /**
  * @brief Инициализирует подсистему логирования.
  * Заполняет массив applog_level_map, связывая уровни пользовательских логов с уровнями системного журнала (syslog).
@@ -96,6 +175,567 @@ int applog_get_config_level()
   return applog_config_level;
 }
 
+/**
+ * @brief Разбирает спецификатор формата.
+ *
+ * @param p Указатель на '%'.
+ * @param spec Результат.
+ * @return const char* Символ после спецификатора.
+ */
+static const char *applog_spec_parse(const char *p, applog_spec_t *spec)
+{
+  const char *q = p + 1;
+  int longs = 0, ldouble = 0;
+
+  spec->start = p;
+  spec->stars = 0;
+
+  while (*q && strchr("-+ #0'", *q))
+    q++;
+  if (*q == '*')
+  {
+    spec->stars++;
+    q++;
+  }
+  while (*q >= '0' && *q <= '9')
+    q++;
+  if (*q == '.')
+  {
+    q++;
+    if (*q == '*')
+    {
+      spec->stars++;
+      q++;
+    }
+    while (*q >= '0' && *q <= '9')
+      q++;
+  }
+  for (;; q++)
+  {
+    // hh/h: аргумент всё равно передаётся как int
+    if (*q == 'l' || *q == 'z' || *q == 'j' || *q == 't' || *q == 'q')
+      longs++;
+    else if (*q == 'h')
+      continue;
+    else if (*q == 'L')
+      ldouble++;
+    else
+      break;
+  }
+
+  switch (*q)
+  {
+  case '%':
+    spec->type = (q == p + 1) ? APPLOG_ARG_NONE : APPLOG_ARG_BAD;
+    break;
+  case 'd':
+  case 'i':
+  case 'u':
+  case 'x':
+  case 'X':
+  case 'o':
+    spec->type = longs ? APPLOG_ARG_LONG : APPLOG_ARG_INT;
+    break;
+  case 'c':
+    spec->type = longs ? APPLOG_ARG_BAD : APPLOG_ARG_INT;
+    break;
+  case 'f':
+  case 'F':
+  case 'e':
+  case 'E':
+  case 'g':
+  case 'G':
+  case 'a':
+  case 'A':
+    spec->type = ldouble ? APPLOG_ARG_LDOUBLE : APPLOG_ARG_DOUBLE;
+    break;
+  case 'p':
+    spec->type = APPLOG_ARG_PTR;
+    break;
+  case 's':
+    spec->type = longs ? APPLOG_ARG_BAD : APPLOG_ARG_STR;
+    break;
+  default:
+    spec->type = APPLOG_ARG_BAD;
+    break;
+  }
+  if (*q)
+    q++;
+  spec->len = q - p;
+  if (spec->len >= APPLOG_SPEC_MAX)
+    spec->type = APPLOG_ARG_BAD;
+  return q;
+}
+
+/**
+ * @brief Сохраняет аргументы сообщения в ячейку в двоичном виде.
+ *
+ * Слова по 8 байт, long double - 16, строка - длина (8 байт) и байты
+ * с выравниванием до 8.
+ *
+ * @return int Занято байт data, -1 - формат не поддержан или не помещается.
+ */
+static int applog_args_pack(uint8_t *data, const char *fmt, va_list ap)
+{
+  const char *p = fmt;
+  applog_spec_t spec;
+  size_t off = 0, n;
+  uint64_t word;
+  long double ld;
+  const char *str;
+  int i;
+
+  while ((p = strchr(p, '%')) != NULL)
+  {
+    p = applog_spec_parse(p, &spec);
+    if (spec.type == APPLOG_ARG_BAD)
+      return -1;
+    if (spec.type == APPLOG_ARG_NONE)
+      continue;
+
+    for (i = 0; i < spec.stars; i++)
+    {
+      if (off + 8 > APPLOG_SLOT_DATA)
+        return -1;
+      word = (uint64_t)(int64_t)va_arg(ap, int);
+      memcpy(data + off, &word, 8);
+      off += 8;
+    }
+
+    switch (spec.type)
+    {
+    case APPLOG_ARG_INT:
+      word = (uint64_t)(int64_t)va_arg(ap, int);
+      break;
+    case APPLOG_ARG_LONG:
+      word = (uint64_t)va_arg(ap, long long);
+      break;
+    case APPLOG_ARG_DOUBLE:
+    {
+      double d = va_arg(ap, double);
+      memcpy(&word, &d, 8);
+      break;
+    }
+    case APPLOG_ARG_PTR:
+      word = (uint64_t)(uintptr_t)va_arg(ap, void *);
+      break;
+    case APPLOG_ARG_LDOUBLE:
+      ld = va_arg(ap, long double);
+      if (off + sizeof(ld) > APPLOG_SLOT_DATA)
+        return -1;
+      memcpy(data + off, &ld, sizeof(ld));
+      off += sizeof(ld);
+      continue;
+    case APPLOG_ARG_STR:
+      str = va_arg(ap, const char *);
+      if (!str)
+        str = "(null)";
+      n = strlen(str);
+      if (off + 8 + n > APPLOG_SLOT_DATA)
+        return -1;
+      word = n;
+      memcpy(data + off, &word, 8);
+      memcpy(data + off + 8, str, n);
+      off += 8 + ((n + 7) & ~(size_t)7);
+      continue;
+    default:
+      return -1;
+    }
+
+    if (off + 8 > APPLOG_SLOT_DATA)
+      return -1;
+    memcpy(data + off, &word, 8);
+    off += 8;
+  }
+
+  return off;
+}
+
+/**
+ * @brief Форматирует ячейку с отложенным форматированием.
+ *
+ * Формат проходится так же, как при упаковке, каждый спецификатор
+ * форматируется отдельным snprintf() со своим аргументом.
+ */
+static void applog_args_format(char *out, size_t size, const char *fmt, const uint8_t *data)
+{
+  const char *p = fmt, *lit;
+  applog_spec_t spec;
+  char spec_buf[APPLOG_SPEC_MAX];
+  char str[APPLOG_SLOT_DATA + 1];
+  size_t off = 0, pos = 0, n;
+  uint64_t word;
+  int star[2] = {0, 0};
+  int i, ret = 0;
+
+#define APPLOG_EMIT(val)                                                                        \
+  (spec.stars == 0   ? snprintf(out + pos, size - pos, spec_buf, val)                           \
+   : spec.stars == 1 ? snprintf(out + pos, size - pos, spec_buf, star[0], val)                  \
+                     : snprintf(out + pos, size - pos, spec_buf, star[0], star[1], val))
+
+  out[0] = '\0';
+  while (pos + 1 < size && *p)
+  {
+    lit = strchr(p, '%');
+    n = lit ? (size_t)(lit - p) : strlen(p);
+    if (n > size - pos - 1)
+      n = size - pos - 1;
+    memcpy(out + pos, p, n);
+    pos += n;
+    out[pos] = '\0';
+    if (!lit)
+      break;
+
+    p = applog_spec_parse(lit, &spec);
+    if (spec.type == APPLOG_ARG_NONE)
+    {
+      if (pos + 1 < size)
+      {
+        out[pos++] = '%';
+        out[pos] = '\0';
+      }
+      continue;
+    }
+
+    memcpy(spec_buf, spec.start, spec.len);
+    spec_buf[spec.len] = '\0';
+    for (i = 0; i < spec.stars; i++)
+    {
+      memcpy(&word, data + off, 8);
+      star[i] = (int)word;
+      off += 8;
+    }
+
+    switch (spec.type)
+    {
+    case APPLOG_ARG_INT:
+      memcpy(&word, data + off, 8);
+      off += 8;
+      ret = APPLOG_EMIT((int)word);
+      break;
+    case APPLOG_ARG_LONG:
+      memcpy(&word, data + off, 8);
+      off += 8;
+      ret = APPLOG_EMIT((long long)word);
+      break;
+    case APPLOG_ARG_DOUBLE:
+    {
+      double d;
+      memcpy(&d, data + off, 8);
+      off += 8;
+      ret = APPLOG_EMIT(d);
+      break;
+    }
+    case APPLOG_ARG_LDOUBLE:
+    {
+      long double ld;
+      memcpy(&ld, data + off, sizeof(ld));
+      off += sizeof(ld);
+      ret = APPLOG_EMIT(ld);
+      break;
+    }
+    case APPLOG_ARG_PTR:
+      memcpy(&word, data + off, 8);
+      off += 8;
+      ret = APPLOG_EMIT((void *)(uintptr_t)word);
+      break;
+    case APPLOG_ARG_STR:
+      memcpy(&word, data + off, 8);
+      memcpy(str, data + off + 8, word);
+      str[word] = '\0';
+      off += 8 + ((word + 7) & ~(uint64_t)7);
+      ret = APPLOG_EMIT(str);
+      break;
+    default:
+      ret = 0;
+      break;
+    }
+
+    if (ret > 0)
+      pos += ((size_t)ret < size - pos) ? (size_t)ret : size - pos - 1;
+  }
+#undef APPLOG_EMIT
+}
+
+/**
+ * @brief Выводит сообщение ячейки в системный журнал.
+ */
+static void applog_slot_emit(applog_slot_t *slot)
+{
+  char buf[1024];
+
+  if (slot->kind == APPLOG_SLOT_TEXT)
+  {
+    syslog(applog_level_map[slot->level], "%.*s", (int)slot->len, (const char *)slot->data);
+    return;
+  }
+  applog_args_format(buf, sizeof(buf), slot->fmt, slot->data);
+  syslog(applog_level_map[slot->level], "%s", buf);
+}
+
+/**
+ * @brief Выводит все заполненные ячейки кольца.
+ *
+ * @return uint32_t Число выведенных сообщений.
+ */
+static uint32_t applog_async_drain()
+{
+  applog_slot_t *slot;
+  uint64_t depth;
+  uint32_t count = 0;
+
+  depth = __atomic_load_n(&applog_async.head, __ATOMIC_RELAXED) - applog_async.tail;
+  if (depth > applog_async.stats.max_depth)
+    applog_async.stats.max_depth = depth;
+
+  for (;;)
+  {
+    slot = &applog_async.slots[applog_async.tail & applog_async.mask];
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != applog_async.tail + 1)
+      break;
+    applog_slot_emit(slot);
+    __atomic_store_n(&slot->seq, applog_async.tail + applog_async.mask + 1, __ATOMIC_RELEASE);
+    applog_async.tail++;
+    count++;
+  }
+  __atomic_fetch_add(&applog_async.stats.emitted, count, __ATOMIC_RELAXED);
+  return count;
+}
+
+/**
+ * @brief Проверяет, есть ли в кольце сообщение для вывода.
+ */
+static bool applog_async_pending()
+{
+  applog_slot_t *slot = &applog_async.slots[applog_async.tail & applog_async.mask];
+
+  return __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == applog_async.tail + 1;
+}
+
+/**
+ * @brief Ждёт новых сообщений или остановки.
+ *
+ * Флаг sleeping выставляется до повторной проверки кольца, а писатель
+ * проверяет его после публикации ячейки (оба с полным барьером), поэтому
+ * сообщение, опубликованное во время засыпания, не теряется.
+ */
+static void applog_async_wait()
+{
+  pthread_mutex_lock(&applog_async.lock);
+  __atomic_store_n(&applog_async.sleeping, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  while (!applog_async_pending() && __atomic_load_n(&applog_async.running, __ATOMIC_ACQUIRE))
+    pthread_cond_wait(&applog_async.wake, &applog_async.lock);
+  __atomic_store_n(&applog_async.sleeping, 0, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&applog_async.lock);
+}
+
+/**
+ * @brief Будит поток вывода, если он ждёт.
+ */
+static void applog_async_wakeup()
+{
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (!__atomic_load_n(&applog_async.sleeping, __ATOMIC_RELAXED))
+    return;
+
+  pthread_mutex_lock(&applog_async.lock);
+  pthread_cond_signal(&applog_async.wake);
+  pthread_mutex_unlock(&applog_async.lock);
+  __atomic_fetch_add(&applog_async.stats.wakeups, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Поток вывода журнала.
+ */
+static void *applog_async_main(void *arg)
+{
+  (void)arg;
+
+  while (__atomic_load_n(&applog_async.running, __ATOMIC_ACQUIRE))
+  {
+    if (!applog_async_drain())
+      applog_async_wait();
+  }
+  // остаток после остановки
+  applog_async_drain();
+  return NULL;
+}
+
+/**
+ * @brief Занимает ячейку кольца для записи.
+ *
+ * @param pos Позиция занятой ячейки.
+ * @return applog_slot_t* Ячейка или NULL, если кольцо заполнено.
+ */
+static applog_slot_t *applog_async_reserve(uint64_t *pos)
+{
+  applog_slot_t *slot;
+  uint64_t seq;
+  int64_t diff;
+
+  *pos = __atomic_load_n(&applog_async.head, __ATOMIC_RELAXED);
+  for (;;)
+  {
+    slot = &applog_async.slots[*pos & applog_async.mask];
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    diff = (int64_t)(seq - *pos);
+    if (diff == 0)
+    {
+      if (__atomic_compare_exchange_n(&applog_async.head, pos, *pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return slot;
+    }
+    else if (diff < 0)
+      return NULL;
+    else
+      *pos = __atomic_load_n(&applog_async.head, __ATOMIC_RELAXED);
+  }
+}
+
+/**
+ * @brief Ставит сообщение в кольцо.
+ *
+ * @param level Уровень (уже проверен).
+ * @param fmt Формат.
+ * @param deferred Формат - строковая константа, форматирование откладывается.
+ * @param ap Аргументы.
+ * @return int APP_LOG_STATUS_OK или APP_LOG_STATUS_FAIL, если сообщение отброшено.
+ */
+static int applog_async_write(int level, const char *fmt, bool deferred, va_list ap)
+{
+  applog_slot_t *slot;
+  uint64_t pos;
+  va_list aq;
+  int len = -1;
+
+  slot = applog_async_reserve(&pos);
+  if (!slot)
+  {
+    if (level > applog_async.sync_level)
+    {
+      __atomic_fetch_add(&applog_async.stats.dropped, 1, __ATOMIC_RELAXED);
+      return APP_LOG_STATUS_FAIL;
+    }
+    __atomic_fetch_add(&applog_async.stats.sync, 1, __ATOMIC_RELAXED);
+    vsyslog(applog_level_map[level], fmt, ap);
+    return APP_LOG_STATUS_OK;
+  }
+
+  slot->fmt = fmt;
+  slot->level = level;
+  if (deferred)
+  {
+    va_copy(aq, ap);
+    len = applog_args_pack(slot->data, fmt, aq);
+    va_end(aq);
+  }
+  if (len >= 0)
+  {
+    slot->kind = APPLOG_SLOT_DEFERRED;
+    slot->len = len;
+    __atomic_fetch_add(&applog_async.stats.deferred, 1, __ATOMIC_RELAXED);
+  }
+  else
+  {
+    len = vsnprintf((char *)slot->data, APPLOG_SLOT_DATA, fmt, ap);
+    if (len >= APPLOG_SLOT_DATA)
+    {
+      len = APPLOG_SLOT_DATA - 1;
+      __atomic_fetch_add(&applog_async.stats.truncated, 1, __ATOMIC_RELAXED);
+    }
+    slot->kind = APPLOG_SLOT_TEXT;
+    slot->len = len < 0 ? 0 : len;
+  }
+  __atomic_fetch_add(&applog_async.stats.queued, 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+  applog_async_wakeup();
+  return APP_LOG_STATUS_OK;
+}
+
+/**
+ * @brief Включает асинхронный журнал.
+ *
+ * @param slots Размер кольца, округляется вверх до степени двойки.
+ * @param sync_level При заполненном кольце сообщения этого уровня и более
+ * важные пишутся синхронно, остальные отбрасываются. APP_LOG_LEVEL_NONE -
+ * отбрасывать все, APP_LOG_LEVEL_MAX - никогда не отбрасывать.
+ * @return int APP_LOG_STATUS_OK или APP_LOG_STATUS_FAIL (журнал остаётся синхронным).
+ */
+int applog_async_start(uint32_t slots, int sync_level)
+{
+  sigset_t all, old;
+  uint32_t size = 1;
+  uint32_t i;
+  int rc;
+
+  if (applog_async.slots || slots == 0)
+    return APP_LOG_STATUS_FAIL;
+
+  while (size < slots)
+    size <<= 1;
+  if (posix_memalign((void **)&applog_async.slots, 64, (size_t)size * sizeof(applog_slot_t)))
+  {
+    applog_async.slots = NULL;
+    return APP_LOG_STATUS_FAIL;
+  }
+  for (i = 0; i < size; i++)
+    applog_async.slots[i].seq = i;
+  applog_async.mask = size - 1;
+  applog_async.head = applog_async.tail = 0;
+  applog_async.sync_level = sync_level;
+  applog_async.sleeping = 0;
+  memset(&applog_async.stats, 0, sizeof(applog_async.stats));
+  pthread_mutex_init(&applog_async.lock, NULL);
+  pthread_cond_init(&applog_async.wake, NULL);
+
+  // сигналы обрабатывает главный поток
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  __atomic_store_n(&applog_async.running, 1, __ATOMIC_RELEASE);
+  rc = pthread_create(&applog_async.thread, NULL, applog_async_main, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (rc != 0)
+  {
+    applog_async.running = 0;
+    free(applog_async.slots);
+    applog_async.slots = NULL;
+    return APP_LOG_STATUS_FAIL;
+  }
+
+  applog_async.stats.slots = size;
+  return APP_LOG_STATUS_OK;
+}
+
+/**
+ * @brief Останавливает поток вывода, выводит остаток кольца и возвращает
+ * синхронный журнал. Вызывается, когда остальные пишущие потоки уже остановлены.
+ */
+void applog_async_stop()
+{
+  if (!applog_async.slots)
+    return;
+
+  // следующие сообщения пишутся синхронно
+  applog_async.stats.slots = 0;
+  __atomic_store_n(&applog_async.running, 0, __ATOMIC_RELEASE);
+  pthread_mutex_lock(&applog_async.lock);
+  pthread_cond_signal(&applog_async.wake);
+  pthread_mutex_unlock(&applog_async.lock);
+  pthread_join(applog_async.thread, NULL);
+  pthread_cond_destroy(&applog_async.wake);
+  pthread_mutex_destroy(&applog_async.lock);
+  free(applog_async.slots);
+  applog_async.slots = NULL;
+}
+
+/**
+ * @brief Возвращает счётчики асинхронного журнала.
+ */
+applog_async_stats_t *applog_async_get_stats()
+{
+  return &applog_async.stats;
+}
+
 /**
  * @brief Основная функция для записи в журнал
  * Проверяет, что переданный уровень валиден и не превышает текущий уровень конфигурации.
@@ -113,6 +753,7 @@ int applog_write(int level, const char *fmt, ...)
 {
   int priority;
   va_list ap;
+  int rc;
 
   if (level < APP_LOG_LEVEL_MIN || level > APP_LOG_LEVEL_MAX)
   {
@@ -124,15 +765,54 @@ int applog_write(int level, const char *fmt, ...)
     return APP_LOG_STATUS_LEVEL_DISABLED;
   }
 
-  priority = applog_level_map[level];
-
   va_start(ap, fmt);
+  if (__atomic_load_n(&applog_async.stats.slots, __ATOMIC_ACQUIRE))
+  {
+    rc = applog_async_write(level, fmt, false, ap);
+    va_end(ap);
+    return rc;
+  }
+  priority = applog_level_map[level];
   vsyslog(priority, fmt, ap);
   va_end(ap);
 
   return APP_LOG_STATUS_OK;
 }
 
+/**
+ * @brief Запись в журнал с отложенным форматированием.
+ *
+ * То же, что applog_write(), но fmt должен быть строковой константой (так
+ * вызывают макросы APP_LOG_*): в асинхронном режиме в кольцо кладутся
+ * указатель на fmt и аргументы, строка собирается потоком вывода.
+ *
+ * @return int См. applog_write().
+ */
+int applog_write_deferred(int level, const char *fmt, ...)
+{
+  va_list ap;
+  int rc = APP_LOG_STATUS_OK;
+
+  if (level < APP_LOG_LEVEL_MIN || level > APP_LOG_LEVEL_MAX)
+  {
+    return APP_LOG_STATUS_INVALID_LEVEL;
+  }
+
+  if (level > applog_config_level)
+  {
+    return APP_LOG_STATUS_LEVEL_DISABLED;
+  }
+
+  va_start(ap, fmt);
+  if (__atomic_load_n(&applog_async.stats.slots, __ATOMIC_ACQUIRE))
+    rc = applog_async_write(level, fmt, true, ap);
+  else
+    vsyslog(applog_level_map[level], fmt, ap);
+  va_end(ap);
+
+  return rc;
+}
+
 /**
  * @brief Закрывает подсистему логирования.
  * Сбрасывает уровень конфигурации на значение по умолчанию.
@@ -143,6 +823,7 @@ int applog_deinit()
 {
   int status = 0;
 
+  applog_async_stop();
   closelog();
 
   applog_inited = 0;
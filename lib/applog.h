@@ -13,15 +13,53 @@
 #define _APPLOG_H_
 
 #include <stdio.h>
+#include <stdint.h>
 #include <syslog.h>
 #include <stdarg.h>
 
+/**
+ * @defgroup APP_LOG_ASYNC Асинхронный журнал
+ * @brief Кольцо сообщений без блокировок, выводимое в syslog фоновым потоком.
+ *
+ * После applog_async_start() сообщения ставятся в очередь, а не пишутся
+ * вызывающим потоком. applog_write_deferred() сохраняет указатель на формат
+ * и двоичные аргументы, форматирует поток вывода непосредственно перед
+ * syslog(). applog_write() форматирует в вызывающем потоке, т.к. её формат
+ * может не пережить вызов. При заполненном кольце сообщения уровня
+ * sync_level и более важные пишутся синхронно, остальные отбрасываются и
+ * подсчитываются. Пустое кольцо поток вывода ждёт на условной переменной,
+ * писатель будит его, только если он спит.
+ * @{
+ */
+#define APP_LOG_ASYNC_SLOT_SIZE 256   /**< Байт на сообщение в очереди, длинные обрезаются. */
+
+/**
+ * @brief Счётчики асинхронного журнала.
+ */
+typedef struct applog_async_stats_s
+{
+  uint32_t slots;        /**< Размер кольца, 0 - асинхронный журнал выключен. */
+  uint64_t queued;       /**< Поставлено в очередь. */
+  uint64_t deferred;     /**< Из них с отложенным форматированием. */
+  uint64_t emitted;      /**< Выведено потоком вывода. */
+  uint64_t dropped;      /**< Отброшено при заполненном кольце. */
+  uint64_t sync;         /**< Записано синхронно при заполненном кольце. */
+  uint64_t truncated;    /**< Не поместилось в ячейку. */
+  uint64_t max_depth;    /**< Наибольшая заполненность кольца, замеченная потоком вывода. */
+  uint64_t wakeups;      /**< Пробуждений спящего потока вывода. */
+} applog_async_stats_t;
+/** @} */
+
 int applog_init();
 int applog_deinit();
 int applog_set_config_level(int level);
 int applog_get_config_level();
 int applog_get_init_status();
 int applog_write(int priority, const char *fmt, ...);
+int applog_write_deferred(int priority, const char *fmt, ...);
+int applog_async_start(uint32_t slots, int sync_level);
+void applog_async_stop();
+applog_async_stats_t *applog_async_get_stats();
 
 /**
  * @defgroup APP_LOG_LEVELS Log Levels
@@ -71,14 +109,14 @@ int applog_write(int priority, const char *fmt, ...);
 #define APP_LOG_NOTICE(...) applog_write(APP_LOG_LEVEL_NOTICE, __VA_ARGS__)
 #define APP_LOG_ALERT(...) applog_write(APP_LOG_LEVEL_ALERT, __VA_ARGS__)
 #else
-#define APP_LOG_DEBUG(MSG, ...) applog_write(APP_LOG_LEVEL_DEBUG, "%s:%u:" MSG " ", __func__, __LINE__, ##__VA_ARGS__)
-#define APP_LOG_INFO(MSG, ...) applog_write(APP_LOG_LEVEL_INFO, "%s:%u:" MSG " ", __func__, __LINE__, ##__VA_ARGS__)
-#define APP_LOG_ERR(MSG, ...) applog_write(APP_LOG_LEVEL_ERR, "%s:%u:" MSG " ", __func__, __LINE__, ##__VA_ARGS__)
-#define APP_LOG_WARNING(MSG, ...) applog_write(APP_LOG_LEVEL_WARNING, "%s:%u:" MSG " ", __func__, __LINE__, ##__VA_ARGS__)
-#define APP_LOG_EMERG(MSG, ...) applog_write(APP_LOG_LEVEL_EMERG, "%s:%u:" MSG " ", __func__, __LINE__, ##__VA_ARGS__)
-#define APP_LOG_CRITICAL(MSG, ...) applog_write(APP_LOG_LEVEL_CRIT, "%s:%u:" MSG " ", __func__, __LINE__, ##__VA_ARGS__)
-#define APP_LOG_NOTICE(MSG, ...) applog_write(APP_LOG_LEVEL_NOTICE, "%s:%u:" MSG " ", __func__, __LINE__, ##__VA_ARGS__)
-#define APP_LOG_ALERT(MSG, ...) applog_write(APP_LOG_LEVEL_ALERT, "%s:%u:" MSG " ", __func__, __LINE__, ##__VA_ARGS__)
+#define APP_LOG_DEBUG(MSG, ...) applog_write_deferred(APP_LOG_LEVEL_DEBUG, "%s:%u:" MSG " ", __func__, __LINE__, ##__VA_ARGS__)
+#define APP_LOG_INFO(MSG, ...) applog_write_deferred(APP_LOG_LEVEL_INFO, "%s:%u:" MSG " ", __func__, __LINE__, ##__VA_ARGS__)
+#define APP_LOG_ERR(MSG, ...) applog_write_deferred(APP_LOG_LEVEL_ERR, "%s:%u:" MSG " ", __func__, __LINE__, ##__VA_ARGS__)
+#define APP_LOG_WARNING(MSG, ...) applog_write_deferred(APP_LOG_LEVEL_WARNING, "%s:%u:" MSG " ", __func__, __LINE__, ##__VA_ARGS__)
+#define APP_LOG_EMERG(MSG, ...) applog_write_deferred(APP_LOG_LEVEL_EMERG, "%s:%u:" MSG " ", __func__, __LINE__, ##__VA_ARGS__)
+#define APP_LOG_CRITICAL(MSG, ...) applog_write_deferred(APP_LOG_LEVEL_CRIT, "%s:%u:" MSG " ", __func__, __LINE__, ##__VA_ARGS__)
+#define APP_LOG_NOTICE(MSG, ...) applog_write_deferred(APP_LOG_LEVEL_NOTICE, "%s:%u:" MSG " ", __func__, __LINE__, ##__VA_ARGS__)
+#define APP_LOG_ALERT(MSG, ...) applog_write_deferred(APP_LOG_LEVEL_ALERT, "%s:%u:" MSG " ", __func__, __LINE__, ##__VA_ARGS__)
 #endif
 
 /* Use below one for Syslog */
@@ -7,6 +7,12 @@
  */
 #include "bitmap.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 /*
  * STP indexing starts from 0 onwards
  * return :
@@ -22,12 +28,161 @@ int glibc_util_find_first_set_bit(uint32_t bmp)
     return (ret - 1);
 }
 
+/*
+ * Векторные ядра для операций над масками.
+ * Путь выбирается при сборке: AVX2 (-mavx2) обрабатывает по 8 слов,
+ * NEON - по 4, остаток идёт 64-битными и затем 32-битными словами.
+ */
+typedef enum
+{
+    BMP_OP_AND,
+    BMP_OP_AND_NOT,
+    BMP_OP_OR,
+    BMP_OP_XOR,
+} BMP_OP;
+
+static inline uint64_t bmp_get64(const unsigned int *arr, uint16_t i)
+{
+    uint64_t word;
+    memcpy(&word, &arr[i], sizeof(word));
+    return word;
+}
+
+static inline void bmp_put64(unsigned int *arr, uint16_t i, uint64_t word)
+{
+    memcpy(&arr[i], &word, sizeof(word));
+}
+
+static inline __attribute__((always_inline)) void bmp_binop(unsigned int *tgt, const unsigned int *a,
+                                                            const unsigned int *b, uint16_t size, BMP_OP op)
+{
+    uint16_t i = 0;
+
+#if defined(__AVX2__)
+    for (; i + 8 <= size; i += 8)
+    {
+        __m256i va = _mm256_loadu_si256((const __m256i *)&a[i]);
+        __m256i vb = _mm256_loadu_si256((const __m256i *)&b[i]);
+        __m256i vr;
+
+        switch (op)
+        {
+        case BMP_OP_AND:
+            vr = _mm256_and_si256(va, vb);
+            break;
+        case BMP_OP_AND_NOT:
+            vr = _mm256_andnot_si256(vb, va);
+            break;
+        case BMP_OP_OR:
+            vr = _mm256_or_si256(va, vb);
+            break;
+        default:
+            vr = _mm256_xor_si256(va, vb);
+            break;
+        }
+        _mm256_storeu_si256((__m256i *)&tgt[i], vr);
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= size; i += 4)
+    {
+        uint32x4_t va = vld1q_u32(&a[i]);
+        uint32x4_t vb = vld1q_u32(&b[i]);
+        uint32x4_t vr;
+
+        switch (op)
+        {
+        case BMP_OP_AND:
+            vr = vandq_u32(va, vb);
+            break;
+        case BMP_OP_AND_NOT:
+            vr = vbicq_u32(va, vb);
+            break;
+        case BMP_OP_OR:
+            vr = vorrq_u32(va, vb);
+            break;
+        default:
+            vr = veorq_u32(va, vb);
+            break;
+        }
+        vst1q_u32(&tgt[i], vr);
+    }
+#endif
+
+    for (; i + 2 <= size; i += 2)
+    {
+        uint64_t wa = bmp_get64(a, i);
+        uint64_t wb = bmp_get64(b, i);
+
+        switch (op)
+        {
+        case BMP_OP_AND:
+            bmp_put64(tgt, i, wa & wb);
+            break;
+        case BMP_OP_AND_NOT:
+            bmp_put64(tgt, i, wa & ~wb);
+            break;
+        case BMP_OP_OR:
+            bmp_put64(tgt, i, wa | wb);
+            break;
+        default:
+            bmp_put64(tgt, i, wa ^ wb);
+            break;
+        }
+    }
+
+    for (; i < size; i++)
+    {
+        switch (op)
+        {
+        case BMP_OP_AND:
+            tgt[i] = a[i] & b[i];
+            break;
+        case BMP_OP_AND_NOT:
+            tgt[i] = a[i] & ~b[i];
+            break;
+        case BMP_OP_OR:
+            tgt[i] = a[i] | b[i];
+            break;
+        default:
+            tgt[i] = a[i] ^ b[i];
+            break;
+        }
+    }
+}
+
+static inline uint16_t bmp_op_size(BITMAP_T *tgt, BITMAP_T *bmp1, BITMAP_T *bmp2)
+{
+    uint16_t size = (bmp1->size < bmp2->size) ? bmp1->size : bmp2->size;
+    return (tgt->size < size) ? tgt->size : size;
+}
+
 bool bmp_is_mask_equal(BITMAP_T *bmp1, BITMAP_T *bmp2)
 {
     uint16_t i = 0;
     if (bmp1->size != bmp2->size)
         return false;
 
+#if defined(__AVX2__)
+    for (; i + 8 <= bmp1->size; i += 8)
+    {
+        __m256i diff = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)&bmp1->arr[i]),
+                                        _mm256_loadu_si256((const __m256i *)&bmp2->arr[i]));
+        if (!_mm256_testz_si256(diff, diff))
+            return false;
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= bmp1->size; i += 4)
+    {
+        uint64x2_t diff = vreinterpretq_u64_u32(veorq_u32(vld1q_u32(&bmp1->arr[i]), vld1q_u32(&bmp2->arr[i])));
+        if (vgetq_lane_u64(diff, 0) | vgetq_lane_u64(diff, 1))
+            return false;
+    }
+#endif
+
+    for (; i + 2 <= bmp1->size; i += 2)
+        if (bmp_get64(bmp1->arr, i) != bmp_get64(bmp2->arr, i))
+            return false;
+
     for (; i < bmp1->size; i++)
         if (bmp1->arr[i] != bmp2->arr[i])
             return false;
@@ -37,12 +192,10 @@ bool bmp_is_mask_equal(BITMAP_T *bmp1, BITMAP_T *bmp2)
 
 void bmp_copy_mask(BITMAP_T *dst, BITMAP_T *src)
 {
-    uint16_t i = 0;
     uint16_t size = 0;
     size = (dst->size < src->size) ? dst->size : src->size;
 
-    for (; i < size; i++)
-        dst->arr[i] = src->arr[i];
+    memcpy(dst->arr, src->arr, size * sizeof(unsigned int));
 }
 
 void bmp_not_mask(BITMAP_T *dst, BITMAP_T *src)
@@ -51,52 +204,56 @@ void bmp_not_mask(BITMAP_T *dst, BITMAP_T *src)
     uint16_t size = 0;
     size = (dst->size < src->size) ? dst->size : src->size;
 
+    for (; i + 2 <= size; i += 2)
+        bmp_put64(dst->arr, i, ~bmp_get64(src->arr, i));
+
     for (; i < size; i++)
         dst->arr[i] = ~(src->arr[i]);
 }
 
 void bmp_and_masks(BITMAP_T *tgt, BITMAP_T *bmp1, BITMAP_T *bmp2)
 {
-    uint16_t i = 0;
-    uint16_t size = 0;
-    size = (bmp1->size < bmp2->size) ? bmp1->size : bmp2->size;
-    size = (tgt->size < size) ? tgt->size : size;
-
-    for (; i < size; i++)
-        tgt->arr[i] = (bmp1->arr[i] & bmp2->arr[i]);
+    bmp_binop(tgt->arr, bmp1->arr, bmp2->arr, bmp_op_size(tgt, bmp1, bmp2), BMP_OP_AND);
 }
 
 void bmp_and_not_masks(BITMAP_T *tgt, BITMAP_T *bmp1, BITMAP_T *bmp2)
 {
-    uint16_t i = 0;
-    uint16_t size = 0;
-    size = (bmp1->size < bmp2->size) ? bmp1->size : bmp2->size;
-    size = (tgt->size < size) ? tgt->size : size;
-
-    for (; i < size; i++)
-        tgt->arr[i] = (bmp1->arr[i] & (~(bmp2->arr[i])));
+    bmp_binop(tgt->arr, bmp1->arr, bmp2->arr, bmp_op_size(tgt, bmp1, bmp2), BMP_OP_AND_NOT);
 }
 
 void bmp_or_masks(BITMAP_T *tgt, BITMAP_T *bmp1, BITMAP_T *bmp2)
 {
-    uint16_t i = 0;
-    uint16_t size = 0;
-    size = (bmp1->size < bmp2->size) ? bmp1->size : bmp2->size;
-    size = (tgt->size < size) ? tgt->size : size;
-
-    for (; i < size; i++)
-        tgt->arr[i] = (bmp1->arr[i] | bmp2->arr[i]);
+    bmp_binop(tgt->arr, bmp1->arr, bmp2->arr, bmp_op_size(tgt, bmp1, bmp2), BMP_OP_OR);
 }
 
 void bmp_xor_masks(BITMAP_T *tgt, BITMAP_T *bmp1, BITMAP_T *bmp2)
+{
+    bmp_binop(tgt->arr, bmp1->arr, bmp2->arr, bmp_op_size(tgt, bmp1, bmp2), BMP_OP_XOR);
+}
+
+/**
+ * @brief Подсчитывает количество установленных битов в битовой маске.
+ *
+ * @param bmp Битовая маска.
+ * @return Количество установленных битов.
+ */
+uint32_t bmp_count_set_bits(BITMAP_T *bmp)
 {
     uint16_t i = 0;
-    uint16_t size = 0;
-    size = (bmp1->size < bmp2->size) ? bmp1->size : bmp2->size;
-    size = (tgt->size < size) ? tgt->size : size;
+    uint32_t count = 0;
 
-    for (; i < size; i++)
-        tgt->arr[i] = (bmp1->arr[i] ^ bmp2->arr[i]);
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 4 <= bmp->size; i += 4)
+        count += vaddlvq_u8(vcntq_u8(vreinterpretq_u8_u32(vld1q_u32(&bmp->arr[i]))));
+#endif
+
+    for (; i + 2 <= bmp->size; i += 2)
+        count += __builtin_popcountll(bmp_get64(bmp->arr, i));
+
+    for (; i < bmp->size; i++)
+        count += __builtin_popcount(bmp->arr[i]);
+
+    return count;
 }
 
 /**
@@ -108,30 +265,10 @@ void bmp_xor_masks(BITMAP_T *tgt, BITMAP_T *bmp1, BITMAP_T *bmp2)
  */
 BMP_ID bmp_find_first_set_bit_after_offset(BITMAP_T *bmp, uint16_t offset)
 {
-    offset += 1;
-
-    BMP_ID bmp_id = BMP_INVALID_ID;
-    uint16_t offset_index = offset >> BMP_MASK_LEN;
-    uint16_t offset_pos = offset & BMP_MASK;
-
-    unsigned int offset_bmp = bmp->arr[offset_index];
-    int16_t first_set_bit = BMP_INVALID_ID;
-    // mask-out0(set 0) to all bits before offset
-    offset_bmp = offset_bmp & (-1U << offset_pos);
-
-    do
-    {
-        first_set_bit = glibc_util_find_first_set_bit(offset_bmp);
-        if (first_set_bit != BMP_INVALID_ID)
-        {
-            bmp_id = (offset_index * BMP_MASK_BITS) + first_set_bit;
-            return bmp_id;
-        }
-        offset_index++;
-        offset_bmp = bmp->arr[offset_index];
-    } while (offset_index < bmp->size);
+    BMP_ITER_T it;
 
-    return BMP_INVALID_ID;
+    bmp_iter_init_from(&it, bmp, (uint16_t)(offset + 1));
+    return bmp_iter_next(&it);
 }
 
 /**
@@ -237,7 +374,10 @@ BMP_ID bmp_set_first_unset_bit(BITMAP_T *bmp)
  */
 BMP_ID bmp_get_next_set_bit(BITMAP_T *bmp, BMP_ID bmp_id)
 {
-    return bmp_find_first_set_bit_after_offset(bmp, bmp_id);
+    BMP_ITER_T it;
+
+    bmp_iter_init_from(&it, bmp, bmp_id + 1);
+    return bmp_iter_next(&it);
 }
 
 /**
@@ -259,8 +399,15 @@ BMP_ID bmp_get_first_set_bit(BITMAP_T *bmp)
  */
 bool bmp_isset_any(BITMAP_T *bmp)
 {
-    uint16_t i;
-    for (i = 0; i < bmp->size; i++)
+    uint16_t i = 0;
+
+    for (; i + 2 <= bmp->size; i += 2)
+    {
+        if (bmp_get64(bmp->arr, i))
+            return true;
+    }
+
+    for (; i < bmp->size; i++)
     {
         if (bmp->arr[i])
             return true;
@@ -53,6 +53,88 @@ typedef struct BITMAP_S
  */
 typedef int32_t BMP_ID;
 
+/**
+ * @brief Итератор по установленным битам битовой маски.
+ *
+ * Маска читается 64-битными словами, следующий бит находится через ctz
+ * от запомненной позиции. Текущее слово перечитывается на каждом шаге,
+ * поэтому биты, сброшенные в теле цикла, не возвращаются.
+ */
+typedef struct BMP_ITER_S
+{
+    BITMAP_T *bmp; /**< Обходимая битовая маска. */
+    BMP_ID pos;    /**< Позиция, с которой начинается поиск следующего бита. */
+} BMP_ITER_T;
+
+/**
+ * @brief Читает 64-битное слово маски, начиная с 32-битного слова idx.
+ */
+static inline uint64_t bmp_load64(const BITMAP_T *bmp, uint16_t idx)
+{
+    uint64_t word = bmp->arr[idx];
+
+    if ((uint32_t)idx + 1 < bmp->size)
+        word |= ((uint64_t)bmp->arr[idx + 1]) << BMP_MASK_BITS;
+
+    return word;
+}
+
+/**
+ * @brief Инициализирует итератор, начиная с бита start.
+ */
+static inline void bmp_iter_init_from(BMP_ITER_T *it, BITMAP_T *bmp, BMP_ID start)
+{
+    it->bmp = bmp;
+    it->pos = (start < 0) ? 0 : start;
+}
+
+/**
+ * @brief Инициализирует итератор с начала маски.
+ */
+static inline void bmp_iter_init(BMP_ITER_T *it, BITMAP_T *bmp)
+{
+    bmp_iter_init_from(it, bmp, 0);
+}
+
+/**
+ * @brief Возвращает следующий установленный бит.
+ * @return Индекс бита или BMP_INVALID_ID, если установленных битов больше нет.
+ */
+static inline BMP_ID bmp_iter_next(BMP_ITER_T *it)
+{
+    uint32_t idx;
+    uint64_t word;
+    BMP_ID bmp_id;
+
+    if (it->pos < 0)
+        return BMP_INVALID_ID;
+
+    idx = ((uint32_t)it->pos >> 6) << 1;
+    while (idx < it->bmp->size)
+    {
+        word = bmp_load64(it->bmp, idx) & (~0ULL << (it->pos & 63));
+        if (word)
+        {
+            bmp_id = (BMP_ID)((idx << BMP_MASK_LEN) + __builtin_ctzll(word));
+            it->pos = bmp_id + 1;
+            return bmp_id;
+        }
+        idx += 2;
+        it->pos = (BMP_ID)(idx << BMP_MASK_LEN);
+    }
+
+    it->pos = BMP_INVALID_ID;
+    return BMP_INVALID_ID;
+}
+
+// Обход всех установленных битов за один проход:
+// BMP_ITER_T it; BMP_ID id;
+// BMP_FOR_EACH_SET_BIT(bmp, it, id) { ... }
+#define BMP_FOR_EACH_SET_BIT(_bmp, _it, _id)                                    \
+    for (bmp_iter_init(&(_it), (_bmp)), (_id) = bmp_iter_next(&(_it));          \
+         (_id) != BMP_INVALID_ID;                                                \
+         (_id) = bmp_iter_next(&(_it)))
+
 //
 // For static allocation ,
 // ex:
@@ -130,6 +212,13 @@ void bmp_xor_masks(BITMAP_T *tgt, BITMAP_T *bmp1, BITMAP_T *bmp2);
  */
 bool bmp_isset_any(BITMAP_T *bmp);
 
+/**
+ * @brief Подсчитывает количество установленных битов в битовой маске.
+ * @param bmp Битовая маска.
+ * @return Количество установленных битов.
+ */
+uint32_t bmp_count_set_bits(BITMAP_T *bmp);
+
 /**
  * @brief Проверяет, установлен ли конкретный бит в битовой маске.
  * @param bmp Битовая маска.
@@ -42,6 +42,8 @@ void transmit_config(STP_CLASS *stp_class, PORT_ID port_number)
 	STP_PORT_CLASS *stp_port_class, *stp_root_port_class;
 	UINT32 val = 0;
 
+	STP_SM_INCR(transmit_config);
+
 	stp_port_class = GET_STP_PORT_CLASS(stp_class, port_number);
 
 	if (stp_port_class->hold_timer.active)
@@ -79,6 +81,7 @@ void transmit_config(STP_CLASS *stp_class, PORT_ID port_number)
 		stp_port_class->config_pending = false;
 		send_config_bpdu(stp_class, port_number);
 		stptimer_start(&stp_port_class->hold_timer, 0);
+		stptimer_class_wakeup(stp_class);
 	}
 }
 
@@ -164,38 +167,45 @@ bool supercedes_port_info(STP_CLASS *stp_class, PORT_ID port_number, STP_CONFIG_
  * @param port_number Номер порта, для которого сохраняется конфигурационная информация.
  * @param bpdu Указатель на структуру BPDU с конфигурационными данными.
  *
- * @return void
+ * @return bool `true`, если вектор приоритетов порта изменился.
  */
-void record_config_information(STP_CLASS *stp_class, PORT_ID port_number, STP_CONFIG_BPDU *bpdu)
+bool record_config_information(STP_CLASS *stp_class, PORT_ID port_number, STP_CONFIG_BPDU *bpdu)
 {
 	STP_PORT_CLASS *stp_port_class = GET_STP_PORT_CLASS(stp_class, port_number);
-	;
+	bool changed = false;
 
 	if (stputil_compare_bridge_id(&stp_port_class->designated_root, &bpdu->root_id) != 0)
 	{
 		stp_port_class->designated_root = bpdu->root_id;
-		SET_BIT(stp_port_class->modified_fields, STP_PORT_CLASS_MEMBER_DESIGN_ROOT_BIT);
+		STP_SET_PORT_MODIFIED(stp_class, stp_port_class, STP_PORT_CLASS_MEMBER_DESIGN_ROOT_BIT);
+		changed = true;
 	}
 
 	if (stp_port_class->designated_cost != bpdu->root_path_cost)
 	{
 		stp_port_class->designated_cost = bpdu->root_path_cost;
-		SET_BIT(stp_port_class->modified_fields, STP_PORT_CLASS_MEMBER_DESIGN_COST_BIT);
+		STP_SET_PORT_MODIFIED(stp_class, stp_port_class, STP_PORT_CLASS_MEMBER_DESIGN_COST_BIT);
+		changed = true;
 	}
 
 	if (stputil_compare_bridge_id(&stp_port_class->designated_bridge, &bpdu->bridge_id) != 0)
 	{
 		stp_port_class->designated_bridge = bpdu->bridge_id;
-		SET_BIT(stp_port_class->modified_fields, STP_PORT_CLASS_MEMBER_DESIGN_BRIDGE_BIT);
+		STP_SET_PORT_MODIFIED(stp_class, stp_port_class, STP_PORT_CLASS_MEMBER_DESIGN_BRIDGE_BIT);
+		changed = true;
 	}
 
 	if (stputil_compare_port_id(&stp_port_class->designated_port, &bpdu->port_id))
 	{
 		stp_port_class->designated_port = bpdu->port_id;
-		SET_BIT(stp_port_class->modified_fields, STP_PORT_CLASS_MEMBER_DESIGN_PORT_BIT);
+		STP_SET_PORT_MODIFIED(stp_class, stp_port_class, STP_PORT_CLASS_MEMBER_DESIGN_PORT_BIT);
+		changed = true;
 	}
 
 	stptimer_start(&stp_port_class->message_age_timer, bpdu->message_age);
+	stptimer_class_wakeup(stp_class);
+
+	return changed;
 }
 
 /**
@@ -214,19 +224,19 @@ void record_config_timeout_values(STP_CLASS *stp_class, STP_CONFIG_BPDU *bpdu)
 	if (stp_class->bridge_info.max_age != (UINT8)bpdu->max_age)
 	{
 		stp_class->bridge_info.max_age = (UINT8)bpdu->max_age;
-		SET_BIT(stp_class->bridge_info.modified_fields, STP_BRIDGE_DATA_MEMBER_MAX_AGE_BIT);
+		STP_SET_BRIDGE_MODIFIED(stp_class, STP_BRIDGE_DATA_MEMBER_MAX_AGE_BIT);
 	}
 
 	if (stp_class->bridge_info.hello_time != (UINT8)bpdu->hello_time)
 	{
 		stp_class->bridge_info.hello_time = (UINT8)bpdu->hello_time;
-		SET_BIT(stp_class->bridge_info.modified_fields, STP_BRIDGE_DATA_MEMBER_HELLO_TIME_BIT);
+		STP_SET_BRIDGE_MODIFIED(stp_class, STP_BRIDGE_DATA_MEMBER_HELLO_TIME_BIT);
 	}
 
 	if (stp_class->bridge_info.forward_delay != (UINT8)bpdu->forward_delay)
 	{
 		stp_class->bridge_info.forward_delay = (UINT8)bpdu->forward_delay;
-		SET_BIT(stp_class->bridge_info.modified_fields, STP_BRIDGE_DATA_MEMBER_FWD_DELAY_BIT);
+		STP_SET_BRIDGE_MODIFIED(stp_class, STP_BRIDGE_DATA_MEMBER_FWD_DELAY_BIT);
 	}
 
 	stp_class->bridge_info.topology_change = bpdu->flags.topology_change;
@@ -246,6 +256,8 @@ void config_bpdu_generation(STP_CLASS *stp_class)
 {
 	PORT_ID port_number;
 
+	STP_SM_INCR(config_bpdu_generation);
+
 	port_number = port_mask_get_first_port(stp_class->enable_mask);
 	while (port_number != BAD_PORT_ID)
 	{
@@ -306,10 +318,50 @@ void transmit_tcn(STP_CLASS *stp_class)
  */
 void configuration_update(STP_CLASS *stp_class)
 {
+	STP_SM_INCR(configuration_update);
 	root_selection(stp_class);
 	designated_port_selection(stp_class);
 }
 
+/**
+ * @brief Сравнивает порт-кандидат с текущим корневым портом при выборе корневого порта.
+ *
+ * Порядок сравнения: корневой мост, стоимость пути до корня, назначенный мост,
+ * назначенный порт, идентификатор собственного порта.
+ *
+ * @param stp_port_class Порт-кандидат.
+ * @param root_port_class Текущий лучший (корневой) порт.
+ *
+ * @return bool `true`, если кандидат лучше.
+ */
+static bool better_root_port(STP_PORT_CLASS *stp_port_class, STP_PORT_CLASS *root_port_class)
+{
+	enum SORT_RETURN result;
+
+	result = stputil_compare_bridge_id(&stp_port_class->designated_root,
+									   &root_port_class->designated_root);
+	if (result != EQUAL_TO)
+		return (result == LESS_THAN);
+
+	if (stp_port_class->path_cost + stp_port_class->designated_cost !=
+		root_port_class->path_cost + root_port_class->designated_cost)
+		return (stp_port_class->path_cost + stp_port_class->designated_cost <
+				root_port_class->path_cost + root_port_class->designated_cost);
+
+	result = stputil_compare_bridge_id(&stp_port_class->designated_bridge,
+									   &root_port_class->designated_bridge);
+	if (result != EQUAL_TO)
+		return (result == LESS_THAN);
+
+	result = stputil_compare_port_id(&stp_port_class->designated_port,
+									 &root_port_class->designated_port);
+	if (result != EQUAL_TO)
+		return (result == LESS_THAN);
+
+	return (stputil_compare_port_id(&stp_port_class->port_id,
+									&root_port_class->port_id) == LESS_THAN);
+}
+
 /**
  * @brief Выполняет выбор корневого моста для экземпляра STP.
  *
@@ -323,10 +375,11 @@ void configuration_update(STP_CLASS *stp_class)
  */
 void root_selection(STP_CLASS *stp_class)
 {
-	enum SORT_RETURN result;
 	PORT_ID port_number, root_port;
 	STP_PORT_CLASS *stp_port_class, *root_port_class;
 
+	STP_SM_INCR(root_selection);
+
 	root_port = STP_INVALID_PORT;
 
 	for (
@@ -347,57 +400,8 @@ void root_selection(STP_CLASS *stp_class)
 			(stputil_compare_bridge_id(&stp_port_class->designated_root,
 									   &stp_class->bridge_info.bridge_id) == LESS_THAN))
 		{
-			if (root_port == STP_INVALID_PORT)
-			{
-				root_port = port_number;
-				continue;
-			}
-
-			root_port_class = GET_STP_PORT_CLASS(stp_class, root_port);
-
-			result = stputil_compare_bridge_id(&stp_port_class->designated_root,
-											   &root_port_class->designated_root);
-			if (result == LESS_THAN)
-			{
-				root_port = port_number;
-				continue;
-			}
-			if (result == GREATER_THAN)
-				continue;
-
-			if (stp_port_class->path_cost + stp_port_class->designated_cost <
-				root_port_class->path_cost + root_port_class->designated_cost)
-			{
-				root_port = port_number;
-				continue;
-			}
-
-			if (stp_port_class->path_cost + stp_port_class->designated_cost >
-				root_port_class->path_cost + root_port_class->designated_cost)
-				continue;
-
-			result = stputil_compare_bridge_id(&stp_port_class->designated_bridge,
-											   &root_port_class->designated_bridge);
-			if (result == LESS_THAN)
-			{
-				root_port = port_number;
-				continue;
-			}
-			if (result == GREATER_THAN)
-				continue;
-
-			result = stputil_compare_port_id(&stp_port_class->designated_port,
-											 &root_port_class->designated_port);
-			if (result == LESS_THAN)
-			{
-				root_port = port_number;
-				continue;
-			}
-			if (result == GREATER_THAN)
-				continue;
-
-			if (stputil_compare_port_id(&stp_port_class->port_id,
-										&root_port_class->port_id) == LESS_THAN)
+			if ((root_port == STP_INVALID_PORT) ||
+				better_root_port(stp_port_class, GET_STP_PORT_CLASS(stp_class, root_port)))
 			{
 				root_port = port_number;
 			}
@@ -409,9 +413,9 @@ void root_selection(STP_CLASS *stp_class)
 		stp_class->bridge_info.root_id = stp_class->bridge_info.bridge_id;
 		stp_class->bridge_info.root_path_cost = 0;
 		stpmgr_set_bridge_params(stp_class);
-		SET_BIT(stp_class->bridge_info.modified_fields, STP_BRIDGE_DATA_MEMBER_ROOT_ID_BIT);
-		SET_BIT(stp_class->bridge_info.modified_fields, STP_BRIDGE_DATA_MEMBER_ROOT_PATH_COST_BIT);
-		SET_BIT(stp_class->bridge_info.modified_fields, STP_BRIDGE_DATA_MEMBER_ROOT_PORT_BIT);
+		STP_SET_BRIDGE_MODIFIED(stp_class, STP_BRIDGE_DATA_MEMBER_ROOT_ID_BIT);
+		STP_SET_BRIDGE_MODIFIED(stp_class, STP_BRIDGE_DATA_MEMBER_ROOT_PATH_COST_BIT);
+		STP_SET_BRIDGE_MODIFIED(stp_class, STP_BRIDGE_DATA_MEMBER_ROOT_PORT_BIT);
 	}
 	else
 	{
@@ -419,7 +423,7 @@ void root_selection(STP_CLASS *stp_class)
 		if (stputil_compare_bridge_id(&stp_class->bridge_info.root_id, &root_port_class->designated_root) != 0)
 		{
 			stp_class->bridge_info.root_id = root_port_class->designated_root;
-			SET_BIT(stp_class->bridge_info.modified_fields, STP_BRIDGE_DATA_MEMBER_ROOT_ID_BIT);
+			STP_SET_BRIDGE_MODIFIED(stp_class, STP_BRIDGE_DATA_MEMBER_ROOT_ID_BIT);
 		}
 
 		if (stp_class->bridge_info.root_path_cost !=
@@ -427,19 +431,66 @@ void root_selection(STP_CLASS *stp_class)
 		{
 			stp_class->bridge_info.root_path_cost =
 				root_port_class->designated_cost + root_port_class->path_cost;
-			SET_BIT(stp_class->bridge_info.modified_fields, STP_BRIDGE_DATA_MEMBER_ROOT_PATH_COST_BIT);
+			STP_SET_BRIDGE_MODIFIED(stp_class, STP_BRIDGE_DATA_MEMBER_ROOT_PATH_COST_BIT);
 		}
 
 		if (stp_class->bridge_info.root_port != root_port)
 		{
 			STP_LOG_INFO("STP_RAS_ROOT_ROLE I:%lu P:%lu V:%u", GET_STP_INDEX(stp_class), root_port, stp_class->vlan_id);
-			SET_BIT(stp_class->bridge_info.modified_fields, STP_BRIDGE_DATA_MEMBER_ROOT_PORT_BIT);
+			STP_SET_BRIDGE_MODIFIED(stp_class, STP_BRIDGE_DATA_MEMBER_ROOT_PORT_BIT);
 		}
 	}
 
 	stp_class->bridge_info.root_port = root_port;
 }
 
+/**
+ * @brief Определяет, должен ли порт стать назначенным при выборе назначенных портов.
+ *
+ * @param stp_class Указатель на экземпляр класса STP (Spanning Tree Protocol).
+ * @param port_number Номер порта.
+ *
+ * @return int Номер сработавшего условия 802.1D (1-5) или 0, если порт не назначенный.
+ */
+static int designated_port_reason(STP_CLASS *stp_class, PORT_ID port_number)
+{
+	STP_PORT_CLASS *stp_port_class = GET_STP_PORT_CLASS(stp_class, port_number);
+	enum SORT_RETURN result;
+
+	// case 1
+	if (designated_port(stp_class, port_number))
+		return 1;
+
+	// case 2
+	if (stputil_compare_bridge_id(&stp_port_class->designated_root,
+								  &stp_class->bridge_info.root_id) != EQUAL_TO)
+		return 2;
+
+	// case 3
+	if (stp_class->bridge_info.root_path_cost < stp_port_class->designated_cost)
+		return 3;
+
+	if (stp_class->bridge_info.root_path_cost > stp_port_class->designated_cost)
+		return 0;
+
+	result = stputil_compare_bridge_id(&stp_class->bridge_info.bridge_id,
+									   &stp_port_class->designated_bridge);
+
+	// case 4
+	if (result == LESS_THAN)
+		return 4;
+
+	if (result == GREATER_THAN)
+		return 0;
+
+	// case 5
+	if ((stputil_compare_port_id(&stp_port_class->port_id,
+								 &stp_port_class->designated_port) != GREATER_THAN))
+		return 5;
+
+	return 0;
+}
+
 /**
  * @brief Выполняет выбор назначенных (designated) портов для экземпляра STP.
  *
@@ -454,8 +505,9 @@ void root_selection(STP_CLASS *stp_class)
 void designated_port_selection(STP_CLASS *stp_class)
 {
 	PORT_ID port_number;
-	STP_PORT_CLASS *stp_port_class;
-	enum SORT_RETURN result;
+	int reason;
+
+	STP_SM_INCR(designated_port_selection);
 
 	for (
 		port_number = port_mask_get_first_port(stp_class->enable_mask);
@@ -465,52 +517,12 @@ void designated_port_selection(STP_CLASS *stp_class)
 		if (STP_DEBUG_EVENT(stp_class->vlan_id, port_number))
 			STP_LOG_DEBUG("vlan %d port %d", stp_class->vlan_id, port_number);
 
-		stp_port_class = GET_STP_PORT_CLASS(stp_class, port_number);
-
-		// case 1
-		if (designated_port(stp_class, port_number))
-		{
-			become_designated_port(stp_class, port_number);
-			continue;
-		}
-
-		// case 2
-		if (stputil_compare_bridge_id(&stp_port_class->designated_root,
-									  &stp_class->bridge_info.root_id) != EQUAL_TO)
-		{
-			become_designated_port(stp_class, port_number);
-			continue;
-		}
-
-		// case 3
-		if (stp_class->bridge_info.root_path_cost < stp_port_class->designated_cost)
-		{
-			become_designated_port(stp_class, port_number);
-			continue;
-		}
-
-		if (stp_class->bridge_info.root_path_cost > stp_port_class->designated_cost)
-			continue;
-
-		result = stputil_compare_bridge_id(&stp_class->bridge_info.bridge_id,
-										   &stp_port_class->designated_bridge);
-
-		// case 4
-		if (result == LESS_THAN)
-		{
-			become_designated_port(stp_class, port_number);
-			continue;
-		}
-
-		if (result == GREATER_THAN)
-			continue;
-
-		// case 5
-		if ((stputil_compare_port_id(&stp_port_class->port_id,
-									 &stp_port_class->designated_port) != GREATER_THAN))
+		reason = designated_port_reason(stp_class, port_number);
+		if (reason)
 		{
 			become_designated_port(stp_class, port_number);
-			STP_LOG_INFO("STP_RAS_DESIGNATED_ROLE I:%lu P:%lu V:%lu", GET_STP_INDEX(stp_class), port_number, stp_class->vlan_id);
+			if (reason == 5)
+				STP_LOG_INFO("STP_RAS_DESIGNATED_ROLE I:%lu P:%lu V:%lu", GET_STP_INDEX(stp_class), port_number, stp_class->vlan_id);
 		}
 	}
 }
@@ -537,25 +549,25 @@ void become_designated_port(STP_CLASS *stp_class, PORT_ID port_number)
 	if (stputil_compare_bridge_id(&stp_class->bridge_info.root_id, &stp_port_class->designated_root) != 0)
 	{
 		stp_port_class->designated_root = stp_class->bridge_info.root_id;
-		SET_BIT(stp_port_class->modified_fields, STP_PORT_CLASS_MEMBER_DESIGN_ROOT_BIT);
+		STP_SET_PORT_MODIFIED(stp_class, stp_port_class, STP_PORT_CLASS_MEMBER_DESIGN_ROOT_BIT);
 	}
 
 	if (stp_port_class->designated_cost != stp_class->bridge_info.root_path_cost)
 	{
 		stp_port_class->designated_cost = stp_class->bridge_info.root_path_cost;
-		SET_BIT(stp_port_class->modified_fields, STP_PORT_CLASS_MEMBER_DESIGN_COST_BIT);
+		STP_SET_PORT_MODIFIED(stp_class, stp_port_class, STP_PORT_CLASS_MEMBER_DESIGN_COST_BIT);
 	}
 
 	if (stputil_compare_bridge_id(&stp_class->bridge_info.bridge_id, &stp_port_class->designated_bridge) != 0)
 	{
 		stp_port_class->designated_bridge = stp_class->bridge_info.bridge_id;
-		SET_BIT(stp_port_class->modified_fields, STP_PORT_CLASS_MEMBER_DESIGN_BRIDGE_BIT);
+		STP_SET_PORT_MODIFIED(stp_class, stp_port_class, STP_PORT_CLASS_MEMBER_DESIGN_BRIDGE_BIT);
 	}
 
 	if (stputil_compare_port_id(&stp_port_class->designated_port, &stp_port_class->port_id) != 0)
 	{
 		stp_port_class->designated_port = stp_port_class->port_id;
-		SET_BIT(stp_port_class->modified_fields, STP_PORT_CLASS_MEMBER_DESIGN_PORT_BIT);
+		STP_SET_PORT_MODIFIED(stp_class, stp_port_class, STP_PORT_CLASS_MEMBER_DESIGN_PORT_BIT);
 	}
 }
 
@@ -573,10 +585,12 @@ void port_state_selection(STP_CLASS *stp_class)
 {
 	STP_PORT_CLASS *stp_port_class;
 	PORT_ID port_number;
+	PORT_MASK_ITER it;
 	UINT8 prev_state = 0;
 
-	port_number = port_mask_get_first_port(stp_class->enable_mask);
-	while (port_number != BAD_PORT_ID)
+	STP_SM_INCR(port_state_selection);
+
+	PORT_MASK_FOR_EACH_PORT(stp_class->enable_mask, it, port_number)
 	{
 		if (STP_DEBUG_EVENT(stp_class->vlan_id, port_number))
 			STP_LOG_DEBUG("vlan %d port %d", stp_class->vlan_id, port_number);
@@ -609,8 +623,6 @@ void port_state_selection(STP_CLASS *stp_class)
 		}
 
 		prev_state = 0;
-
-		port_number = port_mask_get_next_port(stp_class->enable_mask, port_number);
 	}
 }
 
@@ -630,6 +642,8 @@ void make_forwarding(STP_CLASS *stp_class, PORT_ID port_number)
 {
 	STP_PORT_CLASS *stp_port_class = GET_STP_PORT_CLASS(stp_class, port_number);
 
+	STP_SM_INCR(make_forwarding);
+
 	if ((stp_port_class->state == BLOCKING) && (!is_timer_active(&stp_port_class->root_protect_timer)))
 	{
 
@@ -637,13 +651,14 @@ void make_forwarding(STP_CLASS *stp_class, PORT_ID port_number)
 
 		stputil_set_port_state(stp_class, stp_port_class);
 		stptimer_start(&stp_port_class->forward_delay_timer, 0);
+		stptimer_class_wakeup(stp_class);
 
 		stplog_port_state_change(stp_class, port_number, STP_MAKE_FORWARDING);
 		if (STP_DEBUG_EVENT(stp_class->vlan_id, port_number))
 		{
 			STP_LOG_DEBUG("LISTENING Vlan:%d Port:%d", stp_class->vlan_id, port_number);
 		}
-		SET_BIT(stp_port_class->modified_fields, STP_PORT_CLASS_MEMBER_PORT_STATE_BIT);
+		STP_SET_PORT_MODIFIED(stp_class, stp_port_class, STP_PORT_CLASS_MEMBER_PORT_STATE_BIT);
 	}
 }
 
@@ -663,6 +678,8 @@ void make_blocking(STP_CLASS *stp_class, PORT_ID port_number)
 {
 	STP_PORT_CLASS *stp_port_class;
 
+	STP_SM_INCR(make_blocking);
+
 	stp_port_class = GET_STP_PORT_CLASS(stp_class, port_number);
 
 	switch (stp_port_class->state)
@@ -689,7 +706,7 @@ void make_blocking(STP_CLASS *stp_class, PORT_ID port_number)
 	case LISTENING:
 		stp_port_class->state = BLOCKING;
 		stputil_set_port_state(stp_class, stp_port_class);
-		SET_BIT(stp_port_class->modified_fields, STP_PORT_CLASS_MEMBER_PORT_STATE_BIT);
+		STP_SET_PORT_MODIFIED(stp_class, stp_port_class, STP_PORT_CLASS_MEMBER_PORT_STATE_BIT);
 		stptimer_stop(&stp_port_class->forward_delay_timer);
 		break;
 
@@ -716,23 +733,26 @@ void make_blocking(STP_CLASS *stp_class, PORT_ID port_number)
  */
 void topology_change_detection(STP_CLASS *stp_class)
 {
+	STP_SM_INCR(topology_change_detection);
 	if (root_bridge(stp_class))
 	{
 		stp_class->bridge_info.topology_change = true;
 		stp_class->bridge_info.topology_change_time =
 			stp_class->bridge_info.forward_delay + stp_class->bridge_info.max_age;
 		stptimer_start(&stp_class->topology_change_timer, 0);
+		stptimer_class_wakeup(stp_class);
 	}
 	else if (!stp_class->bridge_info.topology_change_detected)
 	{
 		transmit_tcn(stp_class);
 		stptimer_start(&stp_class->tcn_timer, 0);
+		stptimer_class_wakeup(stp_class);
 	}
 
 	stp_class->bridge_info.topology_change_detected = true;
 	stp_class->bridge_info.topology_change_tick = sys_get_seconds();
 	(stp_class->bridge_info.topology_change_count)++;
-	SET_BIT(stp_class->bridge_info.modified_fields, STP_BRIDGE_DATA_MEMBER_TOPO_CHNG_COUNT_BIT);
+	STP_SET_BRIDGE_MODIFIED(stp_class, STP_BRIDGE_DATA_MEMBER_TOPO_CHNG_COUNT_BIT);
 }
 
 /**
@@ -775,6 +795,41 @@ void acknowledge_topology_change(STP_CLASS *stp_class, PORT_ID port_number)
 	transmit_config(stp_class, port_number);
 }
 
+/**
+ * @brief Проверяет, что принятый BPDU не меняет результат configuration_update().
+ *
+ * После каждого события выбор корневого и назначенных портов актуален, а
+ * корневой порт хранит лучший вектор приоритетов экземпляра. Если порт не был
+ * назначенным и вектор порта не изменился, или изменился, но не вытесняет
+ * корневой порт и не делает порт назначенным, полный пересчёт по всем портам
+ * даст тот же результат и пропускается.
+ *
+ * @param stp_class Указатель на экземпляр класса STP (Spanning Tree Protocol).
+ * @param port_number Номер порта, на котором был получен BPDU.
+ * @param changed Вектор приоритетов порта изменился (record_config_information()).
+ *
+ * @return bool `true`, если пересчёт можно пропустить.
+ */
+static bool selection_unchanged(STP_CLASS *stp_class, PORT_ID port_number, bool changed)
+{
+	STP_PORT_CLASS *stp_port_class = GET_STP_PORT_CLASS(stp_class, port_number);
+	PORT_ID root_port = stp_class->bridge_info.root_port;
+
+	if (!STP_SELECTION_CACHE || g_stp_batch_depth || stp_port_class->self_loop)
+		return false;
+
+	if (!changed)
+		return true;
+
+	if (root_port == STP_INVALID_PORT || root_port == port_number)
+		return false;
+
+	if (designated_port_reason(stp_class, port_number))
+		return false;
+
+	return !better_root_port(stp_port_class, GET_STP_PORT_CLASS(stp_class, root_port));
+}
+
 /**
  * @brief Обрабатывает полученный конфигурационный BPDU.
  *
@@ -793,22 +848,32 @@ void received_config_bpdu(STP_CLASS *stp_class, PORT_ID port_number, STP_CONFIG_
 	bool root;
 	STP_PORT_CLASS *stp_port_class, *ccep_stp_port_class;
 	bool result;
+	bool changed, prev_self_loop, prev_designated;
 	PORT_ID root_port = stp_class->bridge_info.root_port;
 
+	STP_SM_INCR(received_config_bpdu);
+
 	stp_port_class = GET_STP_PORT_CLASS(stp_class, port_number);
 	if (stp_port_class->state == DISABLED)
 		return;
 
 	root = root_bridge(stp_class);
+	prev_self_loop = stp_port_class->self_loop;
+	prev_designated = designated_port(stp_class, port_number);
 	result = supercedes_port_info(stp_class, port_number, bpdu);
 
 	if (result)
 	{
-
-		record_config_information(stp_class, port_number, bpdu);
-		configuration_update(stp_class);
-
-		port_state_selection(stp_class);
+		changed = record_config_information(stp_class, port_number, bpdu);
+		if (!prev_self_loop && !prev_designated && selection_unchanged(stp_class, port_number, changed))
+		{
+			STP_SM_INCR(selection_skipped);
+		}
+		else
+		{
+			configuration_update(stp_class);
+			port_state_selection(stp_class);
+		}
 
 		if (!root_bridge(stp_class) && root)
 		{
@@ -819,6 +884,7 @@ void received_config_bpdu(STP_CLASS *stp_class, PORT_ID port_number, STP_CONFIG_
 				stptimer_stop(&stp_class->topology_change_timer);
 				transmit_tcn(stp_class);
 				stptimer_start(&stp_class->tcn_timer, 0);
+				stptimer_class_wakeup(stp_class);
 			}
 
 			stplog_root_change(stp_class, STP_BPDU_RECEIVED);
@@ -871,6 +937,8 @@ void received_tcn_bpdu(STP_CLASS *stp_class, PORT_ID port_number, STP_TCN_BPDU *
 	bool root;
 	STP_PORT_CLASS *stp_port_class;
 
+	STP_SM_INCR(received_tcn_bpdu);
+
 	stp_port_class = GET_STP_PORT_CLASS(stp_class, port_number);
 	if (stp_port_class->state == DISABLED)
 		return;
@@ -931,8 +999,9 @@ void hello_timer_expiry(STP_CLASS *stp_class)
 		}
 	}
 
-	config_bpdu_generation(stp_class);
+	stp_pace_hello(stp_class);
 	stptimer_start(&stp_class->hello_timer, 0);
+	stptimer_class_wakeup(stp_class);
 }
 
 /**
@@ -971,6 +1040,7 @@ void message_age_timer_expiry(STP_CLASS *stp_class, PORT_ID port_number)
 		stptimer_stop(&stp_class->tcn_timer);
 		config_bpdu_generation(stp_class);
 		stptimer_start(&stp_class->hello_timer, 0);
+		stptimer_class_wakeup(stp_class);
 
 		stplog_topo_change(stp_class, port_number, STP_MESSAGE_AGE_EXPIRY);
 		stplog_new_root(stp_class, STP_MESSAGE_AGE_EXPIRY);
@@ -1000,6 +1070,7 @@ void forwarding_delay_timer_expiry(STP_CLASS *stp_class, PORT_ID port_number)
 	case LISTENING:
 		stp_port_class->state = LEARNING;
 		stptimer_start(&stp_port_class->forward_delay_timer, 0);
+		stptimer_class_wakeup(stp_class);
 		break;
 
 	case LEARNING:
@@ -1025,7 +1096,7 @@ void forwarding_delay_timer_expiry(STP_CLASS *stp_class, PORT_ID port_number)
 		return;
 	}
 
-	SET_BIT(stp_port_class->modified_fields, STP_PORT_CLASS_MEMBER_PORT_STATE_BIT);
+	STP_SET_PORT_MODIFIED(stp_class, stp_port_class, STP_PORT_CLASS_MEMBER_PORT_STATE_BIT);
 	stputil_set_port_state(stp_class, stp_port_class);
 	stplog_port_state_change(stp_class, port_number, STP_FWD_DLY_EXPIRY);
 	if (STP_DEBUG_EVENT(stp_class->vlan_id, port_number))
@@ -1049,6 +1120,7 @@ void tcn_timer_expiry(STP_CLASS *stp_class)
 {
 	transmit_tcn(stp_class);
 	stptimer_start(&stp_class->tcn_timer, 0);
+	stptimer_class_wakeup(stp_class);
 }
 
 /**
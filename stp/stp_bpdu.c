@@ -0,0 +1,254 @@
+/**
+ * @file stp_bpdu.c
+ * @brief Разбор и формирование BPDU за один проход по кадру.
+ *
+ * @details
+ * Раньше приём проверял кадр (stputil_validate_bpdu), переставлял байты на
+ * месте (stputil_decode_bpdu) и копировал кадр в очередь рабочего потока, а
+ * передача кодировала общий шаблон на месте, копировала тело в шаблон PVST и
+ * ещё раз копировала кадр в очередь sendmmsg. Здесь каждое поле читается или
+ * пишется ровно один раз по постоянному смещению.
+ */
+
+#include "stp_inc.h"
+
+_Static_assert(sizeof(MAC_HEADER) == 14, "MAC_HEADER layout");
+_Static_assert(sizeof(LLC_HEADER) == 3, "LLC_HEADER layout");
+_Static_assert(sizeof(SNAP_HEADER) == 8, "SNAP_HEADER layout");
+_Static_assert(sizeof(STP_CONFIG_BPDU) == STP_BPDU_OFFSET + STP_SIZEOF_CONFIG_BPDU, "STP_CONFIG_BPDU layout");
+_Static_assert(sizeof(PVST_CONFIG_BPDU) == PVST_BPDU_OFFSET + STP_BPDU_OFS_PVST_BODY_LEN, "PVST_CONFIG_BPDU layout");
+_Static_assert(offsetof(STP_CONFIG_BPDU, forward_delay) == STP_BPDU_OFFSET + STP_BPDU_OFS_FORWARD_DELAY, "STP_CONFIG_BPDU offsets");
+_Static_assert(offsetof(PVST_CONFIG_BPDU, vlan_id) == PVST_BPDU_OFFSET + STP_BPDU_OFS_PVST_VLAN_ID, "PVST_CONFIG_BPDU offsets");
+_Static_assert(sizeof(PVST_CONFIG_BPDU) + VLAN_HEADER_LEN <= STP_MAX_PKT_LEN, "tagged PVST BPDU fits a tx slot");
+
+static const UINT8 g_stp_bpdu_llc[] = {LSAP_BRIDGE_SPANNING_TREE_PROTOCOL, LSAP_BRIDGE_SPANNING_TREE_PROTOCOL,
+                                       UNNUMBERED_INFORMATION};
+static const UINT8 g_stp_bpdu_snap[] = {LSAP_SNAP_LLC, LSAP_SNAP_LLC, UNNUMBERED_INFORMATION, 0x00, 0x00, 0x0c,
+                                        SNAP_CISCO_PVST_ID >> 8, SNAP_CISCO_PVST_ID & 0xff};
+
+static inline uint16_t stp_bpdu_get16(const UINT8 *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static inline uint32_t stp_bpdu_get32(const UINT8 *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void stp_bpdu_put16(UINT8 *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xff;
+}
+
+static inline void stp_bpdu_put32(UINT8 *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+// priority/system id and port id are bitfields packed over one UINT16 in host order
+static inline UINT16 stp_bpdu_load16(const void *field)
+{
+    UINT16 v;
+
+    memcpy(&v, field, sizeof(v));
+    return v;
+}
+
+static inline void stp_bpdu_store16(void *field, UINT16 v)
+{
+    memcpy(field, &v, sizeof(v));
+}
+
+static inline void stp_bpdu_get_bridge_id(const UINT8 *p, BRIDGE_IDENTIFIER *id)
+{
+    stp_bpdu_store16(id, stp_bpdu_get16(p));
+    id->address._ulong = stp_bpdu_get32(p + 2);
+    id->address._ushort = stp_bpdu_get16(p + 6);
+}
+
+static inline void stp_bpdu_put_bridge_id(UINT8 *p, const BRIDGE_IDENTIFIER *id)
+{
+    stp_bpdu_put16(p, stp_bpdu_load16(id));
+    stp_bpdu_put32(p + 2, id->address._ulong);
+    stp_bpdu_put16(p + 6, id->address._ushort);
+}
+
+/**
+ * @brief Пишет тело конфигурационного BPDU в порядке байт сети.
+ *
+ * @param p Начало тела (protocol id).
+ * @param bpdu BPDU в порядке байт хоста, таймеры в 1/256 с.
+ */
+static void stp_bpdu_put_body(UINT8 *p, const STP_CONFIG_BPDU *bpdu)
+{
+    stp_bpdu_put16(p + STP_BPDU_OFS_PROTOCOL_ID, bpdu->protocol_id);
+    p[STP_BPDU_OFS_VERSION] = bpdu->protocol_version_id;
+    p[STP_BPDU_OFS_TYPE] = bpdu->type;
+    p[STP_BPDU_OFS_FLAGS] = *((const UINT8 *)&bpdu->flags);
+    stp_bpdu_put_bridge_id(p + STP_BPDU_OFS_ROOT_ID, &bpdu->root_id);
+    stp_bpdu_put32(p + STP_BPDU_OFS_ROOT_PATH_COST, bpdu->root_path_cost);
+    stp_bpdu_put_bridge_id(p + STP_BPDU_OFS_BRIDGE_ID, &bpdu->bridge_id);
+    stp_bpdu_put16(p + STP_BPDU_OFS_PORT_ID, stp_bpdu_load16(&bpdu->port_id));
+    stp_bpdu_put16(p + STP_BPDU_OFS_MESSAGE_AGE, bpdu->message_age);
+    stp_bpdu_put16(p + STP_BPDU_OFS_MAX_AGE, bpdu->max_age);
+    stp_bpdu_put16(p + STP_BPDU_OFS_HELLO_TIME, bpdu->hello_time);
+    stp_bpdu_put16(p + STP_BPDU_OFS_FORWARD_DELAY, bpdu->forward_delay);
+}
+
+/**
+ * @brief Пишет готовый заголовок кадра и, если нужно, тег 802.1Q после MAC-адресов.
+ *
+ * @param hdr Заголовок stp_bpdu_build_hdr().
+ * @param hdr_len STP_BPDU_OFFSET или PVST_BPDU_OFFSET.
+ * @return Указатель на начало тела BPDU.
+ */
+static UINT8 *stp_bpdu_put_hdr(UINT8 *frame, const UINT8 *hdr, uint16_t hdr_len, VLAN_ID tag_vlan)
+{
+    memcpy(frame, hdr, L2_ETH_ADD_LEN * 2);
+    frame += L2_ETH_ADD_LEN * 2;
+
+    if (tag_vlan)
+    {
+        frame[0] = 0x81;
+        frame[1] = 0x00;
+        stp_bpdu_put16(frame + 2, (7 << 13) | (tag_vlan & 0xfff));
+        frame += VLAN_HEADER_LEN;
+    }
+
+    memcpy(frame, hdr + L2_ETH_ADD_LEN * 2, hdr_len - L2_ETH_ADD_LEN * 2);
+    return frame + hdr_len - L2_ETH_ADD_LEN * 2;
+}
+
+/**
+ * @brief Проверяет и разбирает принятый BPDU.
+ *
+ * Поля BPDU переводятся в порядок байт хоста, таймеры - в секунды. Заголовки
+ * MAC и LLC/SNAP в @p bpdu не заполняются. Для TCN заполняются только
+ * protocol id, версия и тип.
+ *
+ * @param frame Кадр без тега 802.1Q, как его отдаёт raw-сокет.
+ * @param pvst Кадр PVST+ (SNAP), иначе 802.1D (LLC).
+ * @param bpdu Разобранный BPDU.
+ * @return STP_BPDU_RX_RESULT.
+ */
+int stp_bpdu_decode(const UINT8 *frame, bool pvst, STP_CONFIG_BPDU *bpdu)
+{
+    const UINT8 *p;
+    UINT16 vlan_id, hello_time, message_age, max_age;
+
+    if (pvst)
+    {
+        if (memcmp(frame + sizeof(MAC_HEADER), g_stp_bpdu_snap, sizeof(g_stp_bpdu_snap)))
+            return STP_BPDU_RX_INVALID;
+        p = frame + PVST_BPDU_OFFSET;
+        if (stp_bpdu_get16(p + STP_BPDU_OFS_PROTOCOL_ID) != 0)
+            return STP_BPDU_RX_INVALID;
+    }
+    else
+    {
+        if (memcmp(frame + sizeof(MAC_HEADER), g_stp_bpdu_llc, sizeof(g_stp_bpdu_llc)))
+            return STP_BPDU_RX_INVALID;
+        p = frame + STP_BPDU_OFFSET;
+    }
+
+    bpdu->protocol_id = stp_bpdu_get16(p + STP_BPDU_OFS_PROTOCOL_ID);
+    bpdu->protocol_version_id = p[STP_BPDU_OFS_VERSION];
+    bpdu->type = p[STP_BPDU_OFS_TYPE];
+
+    if (bpdu->type == TCN_BPDU_TYPE)
+        return STP_BPDU_RX_OK;
+    if (bpdu->type != CONFIG_BPDU_TYPE)
+        return STP_BPDU_RX_INVALID;
+
+    if (pvst)
+    {
+        vlan_id = stp_bpdu_get16(p + STP_BPDU_OFS_PVST_VLAN_ID);
+        if (stp_bpdu_get16(p + STP_BPDU_OFS_PVST_TAG_LENGTH) != 2 ||
+            vlan_id < MIN_VLAN_ID || vlan_id > MAX_VLAN_ID)
+            return STP_BPDU_RX_INVALID;
+    }
+
+    *((UINT8 *)&bpdu->flags) = p[STP_BPDU_OFS_FLAGS];
+    stp_bpdu_get_bridge_id(p + STP_BPDU_OFS_ROOT_ID, &bpdu->root_id);
+    bpdu->root_path_cost = stp_bpdu_get32(p + STP_BPDU_OFS_ROOT_PATH_COST);
+    stp_bpdu_get_bridge_id(p + STP_BPDU_OFS_BRIDGE_ID, &bpdu->bridge_id);
+    stp_bpdu_store16(&bpdu->port_id, stp_bpdu_get16(p + STP_BPDU_OFS_PORT_ID));
+
+    message_age = stp_bpdu_get16(p + STP_BPDU_OFS_MESSAGE_AGE);
+    max_age = stp_bpdu_get16(p + STP_BPDU_OFS_MAX_AGE);
+    hello_time = stp_bpdu_get16(p + STP_BPDU_OFS_HELLO_TIME);
+    // reset to default if received bpdu is incorrect.
+    if (hello_time < (STP_MIN_HELLO_TIME << 8))
+        hello_time = STP_DFLT_HELLO_TIME << 8;
+
+    bpdu->message_age = message_age >> 8;
+    bpdu->max_age = max_age >> 8;
+    bpdu->hello_time = hello_time >> 8;
+    bpdu->forward_delay = stp_bpdu_get16(p + STP_BPDU_OFS_FORWARD_DELAY) >> 8;
+
+    // ieee 802.1d 9.3.4 validation of bpdus.
+    return (message_age >= max_age) ? STP_BPDU_RX_AGED : STP_BPDU_RX_OK;
+}
+
+/**
+ * @brief Собирает заголовок кадра BPDU без тега: MAC-адреса, длину 802.3 и LLC/SNAP.
+ *
+ * Заголовок зависит только от порта, поэтому stp_pkt.c хранит его в шаблоне
+ * передачи порта, а кодирование кадра копирует его целиком.
+ *
+ * @param hdr Буфер заголовка, hdr_len байт.
+ * @param tmpl Шаблон кадра: g_stp_config_bpdu (LLC) или g_stp_pvst_config_bpdu (SNAP).
+ * @param hdr_len STP_BPDU_OFFSET или PVST_BPDU_OFFSET.
+ * @param src_mac MAC-адрес порта.
+ */
+void stp_bpdu_build_hdr(UINT8 *hdr, const void *tmpl, uint16_t hdr_len, const MAC_ADDRESS *src_mac)
+{
+    memcpy(hdr, tmpl, hdr_len);
+    memcpy(hdr + L2_ETH_ADD_LEN, src_mac, L2_ETH_ADD_LEN);
+}
+
+/**
+ * @brief Формирует кадр конфигурационного 802.1D BPDU.
+ *
+ * Поля BPDU берутся в порядке байт хоста (как их заполняет transmit_config()).
+ *
+ * @param frame Буфер кадра, не меньше STP_MAX_PKT_LEN.
+ * @param bpdu Поля BPDU.
+ * @param hdr Заголовок порта (MAC, длина, LLC) из stp_bpdu_build_hdr().
+ * @param tag_vlan VLAN тега 802.1Q, 0 - без тега.
+ * @return Длина кадра.
+ */
+uint16_t stp_bpdu_encode_config(UINT8 *frame, const STP_CONFIG_BPDU *bpdu, const UINT8 *hdr, VLAN_ID tag_vlan)
+{
+    stp_bpdu_put_body(stp_bpdu_put_hdr(frame, hdr, STP_BPDU_OFFSET, tag_vlan), bpdu);
+
+    return sizeof(STP_CONFIG_BPDU) + (tag_vlan ? VLAN_HEADER_LEN : 0);
+}
+
+/**
+ * @brief Формирует кадр конфигурационного PVST+ BPDU.
+ *
+ * @param frame Буфер кадра, не меньше STP_MAX_PKT_LEN.
+ * @param bpdu Поля BPDU в порядке байт хоста.
+ * @param hdr Заголовок порта (MAC, длина, SNAP) из stp_bpdu_build_hdr().
+ * @param pvst Шаблон PVST+: padding и tag length.
+ * @param tag_vlan VLAN тега 802.1Q, 0 - без тега.
+ * @param vlan_id VLAN в теле PVST+ BPDU.
+ * @return Длина кадра.
+ */
+uint16_t stp_bpdu_encode_pvst_config(UINT8 *frame, const STP_CONFIG_BPDU *bpdu, const UINT8 *hdr,
+                                     const PVST_CONFIG_BPDU *pvst, VLAN_ID tag_vlan, VLAN_ID vlan_id)
+{
+    UINT8 *p = stp_bpdu_put_hdr(frame, hdr, PVST_BPDU_OFFSET, tag_vlan);
+
+    stp_bpdu_put_body(p, bpdu);
+    memcpy(p + STP_SIZEOF_CONFIG_BPDU, pvst->padding, STP_BPDU_OFS_PVST_VLAN_ID - STP_SIZEOF_CONFIG_BPDU);
+    stp_bpdu_put16(p + STP_BPDU_OFS_PVST_VLAN_ID, GET_VLAN_ID_TAG(vlan_id));
+
+    return sizeof(PVST_CONFIG_BPDU) + (tag_vlan ? VLAN_HEADER_LEN : 0);
+}
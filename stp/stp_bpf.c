@@ -0,0 +1,756 @@
+/**
+ * @file stp_bpf.c
+ * @brief Ограничение частоты BPDU в ядре (storm guard): eBPF фильтр сокетов приёма.
+ *
+ * @details
+ * Программа собирается при первом правиле и загружается через bpf(2) без
+ * libbpf. Отброшенные в ядре BPDU не будят цикл событий stpd, поэтому шторм
+ * на одном порту не задерживает hello на остальных. Счётчики отброшенных
+ * BPDU читаются из карты по запросу (stpctl lstats, stpctl stormstats) и
+ * складываются в статистику порта pkt_rx_storm_drop.
+ */
+
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include "stp_inc.h"
+
+#define STP_BPF_PROG_MAX 128 // инструкций в программе
+#define STP_BPF_FIX_MAX 32   // переходов на метки
+
+#define STP_BPF_INSN(_code, _dst, _src, _off, _imm) \
+    ((struct bpf_insn){.code = (_code), .dst_reg = (_dst), .src_reg = (_src), .off = (int16_t)(_off), .imm = (_imm)})
+
+#define STP_BPF_MOV64_REG(_dst, _src) STP_BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_X, _dst, _src, 0, 0)
+#define STP_BPF_MOV64_IMM(_dst, _imm) STP_BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_K, _dst, 0, 0, _imm)
+#define STP_BPF_ALU64_IMM(_op, _dst, _imm) STP_BPF_INSN(BPF_ALU64 | (_op) | BPF_K, _dst, 0, 0, _imm)
+#define STP_BPF_ALU64_REG(_op, _dst, _src) STP_BPF_INSN(BPF_ALU64 | (_op) | BPF_X, _dst, _src, 0, 0)
+#define STP_BPF_LDX(_size, _dst, _src, _off) STP_BPF_INSN(BPF_LDX | (_size) | BPF_MEM, _dst, _src, _off, 0)
+#define STP_BPF_STX(_size, _dst, _src, _off) STP_BPF_INSN(BPF_STX | (_size) | BPF_MEM, _dst, _src, _off, 0)
+#define STP_BPF_ST(_size, _dst, _off, _imm) STP_BPF_INSN(BPF_ST | (_size) | BPF_MEM, _dst, 0, _off, _imm)
+#define STP_BPF_LD_ABS(_size, _off) STP_BPF_INSN(BPF_LD | (_size) | BPF_ABS, 0, 0, 0, _off)
+#define STP_BPF_ATOMIC_ADD64(_dst, _src, _off) STP_BPF_INSN(BPF_STX | BPF_DW | BPF_ATOMIC, _dst, _src, _off, BPF_ADD)
+#define STP_BPF_CALL(_fn) STP_BPF_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, _fn)
+#define STP_BPF_EXIT() STP_BPF_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+
+// registers: r6 ctx, r7 ifindex then bucket, r8 vlan, r9 rule
+#define R0 BPF_REG_0
+#define R1 BPF_REG_1
+#define R2 BPF_REG_2
+#define R3 BPF_REG_3
+#define R4 BPF_REG_4
+#define R5 BPF_REG_5
+#define R6 BPF_REG_6
+#define R7 BPF_REG_7
+#define R8 BPF_REG_8
+#define R9 BPF_REG_9
+#define R10 BPF_REG_10
+
+#define STP_BPF_STACK_KEY (-8)     // STP_BPF_KEY
+#define STP_BPF_STACK_BUCKET (-40) // STP_BPF_BUCKET нового счётчика
+
+/**
+ * @enum STP_BPF_LABEL
+ * @brief Метки переходов программы
+ */
+enum STP_BPF_LABEL
+{
+    STP_BPF_L_STP,
+    STP_BPF_L_MATCH,
+    STP_BPF_L_RULE,
+    STP_BPF_L_BUCKET,
+    STP_BPF_L_PASS,
+    STP_BPF_L_OVER,
+    STP_BPF_L_DROP,
+    STP_BPF_L_MAX
+};
+
+/**
+ * @struct stp_bpf_prog_t
+ * @brief Собираемая программа с неразрешёнными переходами на метки
+ */
+typedef struct
+{
+    struct bpf_insn insn[STP_BPF_PROG_MAX];
+    uint16_t cnt;
+    int16_t label[STP_BPF_L_MAX];
+    uint16_t fix_at[STP_BPF_FIX_MAX];
+    uint8_t fix_label[STP_BPF_FIX_MAX];
+    uint8_t fix_cnt;
+    bool overflow;
+} stp_bpf_prog_t;
+
+/**
+ * @struct stp_bpf_ctx_t
+ * @brief Контекст storm guard
+ */
+typedef struct
+{
+    int prog_fd;     // -1, пока нет ни одного правила
+    int rule_fd;     // Карта STP_BPF_KEY -> STP_BPF_RULE
+    int bucket_fd;   // Карта STP_BPF_KEY -> STP_BPF_BUCKET
+    uint32_t rules;  // Задано правил
+    uint64_t *retired; // Отброшено BPDU счётчиками удалённых правил, по портам
+} stp_bpf_ctx_t;
+
+static stp_bpf_ctx_t g_stp_bpf = {.prog_fd = -1, .rule_fd = -1, .bucket_fd = -1};
+
+static int stp_bpf_sys(enum bpf_cmd cmd, union bpf_attr *attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+static void stp_bpf_emit(stp_bpf_prog_t *p, struct bpf_insn insn)
+{
+    if (p->cnt >= STP_BPF_PROG_MAX)
+    {
+        p->overflow = true;
+        return;
+    }
+    p->insn[p->cnt++] = insn;
+}
+
+/**
+ * @brief Условный (или безусловный для BPF_JA) переход на метку; _src < 0 - сравнение с imm.
+ */
+static void stp_bpf_jmp(stp_bpf_prog_t *p, uint8_t op, uint8_t dst, int src, int32_t imm, enum STP_BPF_LABEL label)
+{
+    if (p->fix_cnt >= STP_BPF_FIX_MAX)
+    {
+        p->overflow = true;
+        return;
+    }
+    p->fix_at[p->fix_cnt] = p->cnt;
+    p->fix_label[p->fix_cnt++] = label;
+    if (src < 0)
+        stp_bpf_emit(p, STP_BPF_INSN(BPF_JMP | op | BPF_K, dst, 0, 0, imm));
+    else
+        stp_bpf_emit(p, STP_BPF_INSN(BPF_JMP | op | BPF_X, dst, src, 0, 0));
+}
+
+static void stp_bpf_label(stp_bpf_prog_t *p, enum STP_BPF_LABEL label)
+{
+    p->label[label] = p->cnt;
+}
+
+static void stp_bpf_ld_map(stp_bpf_prog_t *p, uint8_t dst, int map_fd)
+{
+    stp_bpf_emit(p, STP_BPF_INSN(BPF_LD | BPF_DW | BPF_IMM, dst, BPF_PSEUDO_MAP_FD, 0, map_fd));
+    stp_bpf_emit(p, STP_BPF_INSN(0, 0, 0, 0, 0));
+}
+
+/**
+ * @brief Вызов bpf_map_lookup_elem(map, r10 + STP_BPF_STACK_KEY), результат в r0.
+ */
+static void stp_bpf_lookup(stp_bpf_prog_t *p, int map_fd)
+{
+    stp_bpf_ld_map(p, R1, map_fd);
+    stp_bpf_emit(p, STP_BPF_MOV64_REG(R2, R10));
+    stp_bpf_emit(p, STP_BPF_ALU64_IMM(BPF_ADD, R2, STP_BPF_STACK_KEY));
+    stp_bpf_emit(p, STP_BPF_CALL(BPF_FUNC_map_lookup_elem));
+}
+
+/**
+ * @brief Разрешает переходы на метки.
+ *
+ * @return bool false, если программа не поместилась или метка не задана.
+ */
+static bool stp_bpf_link(stp_bpf_prog_t *p)
+{
+    uint8_t i;
+
+    if (p->overflow)
+        return false;
+
+    for (i = 0; i < p->fix_cnt; i++)
+    {
+        if (p->label[p->fix_label[i]] < 0)
+            return false;
+        p->insn[p->fix_at[i]].off = p->label[p->fix_label[i]] - p->fix_at[i] - 1;
+    }
+    return true;
+}
+
+/**
+ * @brief Собирает программу фильтра.
+ *
+ * Проверки MAC/длины повторяют g_stp_filter. Для BPDU ищется правило, затем
+ * счётчик пары (порт, VLAN) (создаётся при первом BPDU), кредит пополняется
+ * на время с прошлого BPDU и ограничивается max_ns. BPDU без правила
+ * пропускаются. Карта счётчиков LRU: при заполнении новый счётчик вытесняет
+ * давно не использованный, а не пропускает BPDU без ограничения.
+ */
+static bool stp_bpf_build(stp_bpf_prog_t *p, int rule_fd, int bucket_fd)
+{
+    int i;
+
+    memset(p, 0, sizeof(*p));
+    memset(p->label, 0xff, sizeof(p->label));
+
+    stp_bpf_emit(p, STP_BPF_MOV64_REG(R6, R1));
+
+    // g_stp_filter: 802.3 length, PVST MAC or STP MAC with LLC 0x42
+    stp_bpf_emit(p, STP_BPF_LD_ABS(BPF_H, 0xc));
+    stp_bpf_jmp(p, BPF_JGT, R0, -1, 0x5dc, STP_BPF_L_DROP);
+    stp_bpf_emit(p, STP_BPF_LD_ABS(BPF_W, 0x0));
+    stp_bpf_jmp(p, BPF_JNE, R0, -1, 0x01000ccc, STP_BPF_L_STP);
+    stp_bpf_emit(p, STP_BPF_LD_ABS(BPF_H, 0x4));
+    stp_bpf_jmp(p, BPF_JEQ, R0, -1, 0xcccd, STP_BPF_L_MATCH);
+    stp_bpf_label(p, STP_BPF_L_STP);
+    stp_bpf_emit(p, STP_BPF_LD_ABS(BPF_B, 0xe));
+    stp_bpf_jmp(p, BPF_JNE, R0, -1, 0x42, STP_BPF_L_DROP);
+
+    stp_bpf_label(p, STP_BPF_L_MATCH);
+    stp_bpf_emit(p, STP_BPF_LDX(BPF_W, R7, R6, offsetof(struct __sk_buff, ifindex)));
+    stp_bpf_emit(p, STP_BPF_LDX(BPF_W, R8, R6, offsetof(struct __sk_buff, vlan_tci)));
+    stp_bpf_emit(p, STP_BPF_ALU64_IMM(BPF_AND, R8, MAX_VLAN_ID));
+
+    // rule: (port, vlan), (port, any), (all, vlan), (all, any)
+    for (i = 0; i < 4; i++)
+    {
+        if (i & 2)
+            stp_bpf_emit(p, STP_BPF_ST(BPF_W, R10, STP_BPF_STACK_KEY, STP_BPF_PORT_ALL));
+        else
+            stp_bpf_emit(p, STP_BPF_STX(BPF_W, R10, R7, STP_BPF_STACK_KEY));
+        if (i & 1)
+            stp_bpf_emit(p, STP_BPF_ST(BPF_W, R10, STP_BPF_STACK_KEY + 4, STP_BPF_VLAN_ANY));
+        else
+            stp_bpf_emit(p, STP_BPF_STX(BPF_W, R10, R8, STP_BPF_STACK_KEY + 4));
+        stp_bpf_lookup(p, rule_fd);
+        stp_bpf_jmp(p, BPF_JNE, R0, -1, 0, STP_BPF_L_RULE);
+    }
+    stp_bpf_jmp(p, BPF_JA, 0, -1, 0, STP_BPF_L_PASS);
+
+    stp_bpf_label(p, STP_BPF_L_RULE);
+    stp_bpf_emit(p, STP_BPF_MOV64_REG(R9, R0));
+    stp_bpf_emit(p, STP_BPF_STX(BPF_W, R10, R7, STP_BPF_STACK_KEY));
+    stp_bpf_emit(p, STP_BPF_STX(BPF_W, R10, R8, STP_BPF_STACK_KEY + 4));
+    stp_bpf_lookup(p, bucket_fd);
+    stp_bpf_jmp(p, BPF_JNE, R0, -1, 0, STP_BPF_L_BUCKET);
+
+    // first BPDU of the pair: a full bucket
+    stp_bpf_emit(p, STP_BPF_LDX(BPF_DW, R1, R9, offsetof(STP_BPF_RULE, max_ns)));
+    stp_bpf_emit(p, STP_BPF_STX(BPF_DW, R10, R1, STP_BPF_STACK_BUCKET + offsetof(STP_BPF_BUCKET, credit_ns)));
+    stp_bpf_emit(p, STP_BPF_CALL(BPF_FUNC_ktime_get_ns));
+    stp_bpf_emit(p, STP_BPF_STX(BPF_DW, R10, R0, STP_BPF_STACK_BUCKET + offsetof(STP_BPF_BUCKET, last_ns)));
+    stp_bpf_emit(p, STP_BPF_ST(BPF_DW, R10, STP_BPF_STACK_BUCKET + offsetof(STP_BPF_BUCKET, passed), 0));
+    stp_bpf_emit(p, STP_BPF_ST(BPF_DW, R10, STP_BPF_STACK_BUCKET + offsetof(STP_BPF_BUCKET, dropped), 0));
+    stp_bpf_ld_map(p, R1, bucket_fd);
+    stp_bpf_emit(p, STP_BPF_MOV64_REG(R2, R10));
+    stp_bpf_emit(p, STP_BPF_ALU64_IMM(BPF_ADD, R2, STP_BPF_STACK_KEY));
+    stp_bpf_emit(p, STP_BPF_MOV64_REG(R3, R10));
+    stp_bpf_emit(p, STP_BPF_ALU64_IMM(BPF_ADD, R3, STP_BPF_STACK_BUCKET));
+    stp_bpf_emit(p, STP_BPF_MOV64_IMM(R4, BPF_NOEXIST));
+    stp_bpf_emit(p, STP_BPF_CALL(BPF_FUNC_map_update_elem));
+    stp_bpf_lookup(p, bucket_fd);
+    stp_bpf_jmp(p, BPF_JEQ, R0, -1, 0, STP_BPF_L_PASS);
+
+    // credit = min(credit + (now - last), max); pass if credit >= cost
+    stp_bpf_label(p, STP_BPF_L_BUCKET);
+    stp_bpf_emit(p, STP_BPF_MOV64_REG(R7, R0));
+    stp_bpf_emit(p, STP_BPF_CALL(BPF_FUNC_ktime_get_ns));
+    stp_bpf_emit(p, STP_BPF_LDX(BPF_DW, R1, R7, offsetof(STP_BPF_BUCKET, last_ns)));
+    stp_bpf_emit(p, STP_BPF_STX(BPF_DW, R7, R0, offsetof(STP_BPF_BUCKET, last_ns)));
+    stp_bpf_emit(p, STP_BPF_ALU64_REG(BPF_SUB, R0, R1));
+    stp_bpf_emit(p, STP_BPF_LDX(BPF_DW, R3, R7, offsetof(STP_BPF_BUCKET, credit_ns)));
+    stp_bpf_emit(p, STP_BPF_ALU64_REG(BPF_ADD, R3, R0));
+    stp_bpf_emit(p, STP_BPF_LDX(BPF_DW, R4, R9, offsetof(STP_BPF_RULE, max_ns)));
+    stp_bpf_emit(p, STP_BPF_INSN(BPF_JMP | BPF_JLE | BPF_X, R3, R4, 1, 0));
+    stp_bpf_emit(p, STP_BPF_MOV64_REG(R3, R4));
+    stp_bpf_emit(p, STP_BPF_LDX(BPF_DW, R5, R9, offsetof(STP_BPF_RULE, cost_ns)));
+    stp_bpf_jmp(p, BPF_JLT, R3, R5, 0, STP_BPF_L_OVER);
+    stp_bpf_emit(p, STP_BPF_ALU64_REG(BPF_SUB, R3, R5));
+    stp_bpf_emit(p, STP_BPF_STX(BPF_DW, R7, R3, offsetof(STP_BPF_BUCKET, credit_ns)));
+    stp_bpf_emit(p, STP_BPF_MOV64_IMM(R1, 1));
+    stp_bpf_emit(p, STP_BPF_ATOMIC_ADD64(R7, R1, offsetof(STP_BPF_BUCKET, passed)));
+
+    stp_bpf_label(p, STP_BPF_L_PASS);
+    stp_bpf_emit(p, STP_BPF_MOV64_IMM(R0, 0xffff));
+    stp_bpf_emit(p, STP_BPF_EXIT());
+
+    stp_bpf_label(p, STP_BPF_L_OVER);
+    stp_bpf_emit(p, STP_BPF_STX(BPF_DW, R7, R3, offsetof(STP_BPF_BUCKET, credit_ns)));
+    stp_bpf_emit(p, STP_BPF_MOV64_IMM(R1, 1));
+    stp_bpf_emit(p, STP_BPF_ATOMIC_ADD64(R7, R1, offsetof(STP_BPF_BUCKET, dropped)));
+
+    stp_bpf_label(p, STP_BPF_L_DROP);
+    stp_bpf_emit(p, STP_BPF_MOV64_IMM(R0, 0));
+    stp_bpf_emit(p, STP_BPF_EXIT());
+
+    return stp_bpf_link(p);
+}
+
+static int stp_bpf_map_create(enum bpf_map_type type, uint32_t value_size, uint32_t max_entries)
+{
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = type;
+    attr.key_size = sizeof(STP_BPF_KEY);
+    attr.value_size = value_size;
+    attr.max_entries = max_entries;
+    return stp_bpf_sys(BPF_MAP_CREATE, &attr);
+}
+
+/**
+ * @brief Создаёт карты и загружает программу.
+ *
+ * @return int 0 при успехе, -1 при ошибке (остаётся классический фильтр).
+ */
+static int stp_bpf_load()
+{
+    static stp_bpf_prog_t prog;
+    static char log_buf[4096];
+    union bpf_attr attr;
+
+    g_stp_bpf.rule_fd = stp_bpf_map_create(BPF_MAP_TYPE_HASH, sizeof(STP_BPF_RULE), STP_BPF_MAX_RULES);
+    // tags rotated by a neighbor evict stale buckets instead of filling the map
+    g_stp_bpf.bucket_fd = stp_bpf_map_create(BPF_MAP_TYPE_LRU_HASH, sizeof(STP_BPF_BUCKET), STP_BPF_MAX_BUCKETS);
+    if (g_stp_bpf.rule_fd == -1 || g_stp_bpf.bucket_fd == -1)
+    {
+        STP_LOG_ERR("bpf map create Failed : %s", strerror(errno));
+        goto fail;
+    }
+
+    g_stp_bpf.retired = (uint64_t *)calloc(g_max_stp_port, sizeof(uint64_t));
+    if (!g_stp_bpf.retired)
+    {
+        STP_LOG_ERR("bpf retired counters alloc Failed");
+        goto fail;
+    }
+
+    if (!stp_bpf_build(&prog, g_stp_bpf.rule_fd, g_stp_bpf.bucket_fd))
+    {
+        STP_LOG_ERR("bpf program build Failed");
+        goto fail;
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_SOCKET_FILTER;
+    attr.insns = (uint64_t)(uintptr_t)prog.insn;
+    attr.insn_cnt = prog.cnt;
+    attr.license = (uint64_t)(uintptr_t) "Apache-2.0";
+    g_stp_bpf.prog_fd = stp_bpf_sys(BPF_PROG_LOAD, &attr);
+    if (g_stp_bpf.prog_fd == -1)
+    {
+        // the verifier log is only for the error message: a full log fails the load with ENOSPC
+        attr.log_buf = (uint64_t)(uintptr_t)log_buf;
+        attr.log_size = sizeof(log_buf);
+        attr.log_level = 1;
+        log_buf[0] = '\0';
+        stp_bpf_sys(BPF_PROG_LOAD, &attr);
+        STP_LOG_ERR("bpf prog load Failed : %s, %s", strerror(errno), log_buf);
+        goto fail;
+    }
+
+    STP_LOG_INFO("BPDU storm guard loaded, %u insns", prog.cnt);
+    return 0;
+
+fail:
+    stp_bpf_deinit();
+    return -1;
+}
+
+/**
+ * @brief Ставит eBPF фильтр на сокет приёма, если storm guard загружен.
+ *
+ * @param sock Сокет приёма BPDU.
+ * @return bool true, если фильтр установлен; иначе вызывающий ставит g_stp_filter.
+ */
+bool stp_bpf_attach(int sock)
+{
+    if (g_stp_bpf.prog_fd == -1)
+        return false;
+
+    if (-1 == setsockopt(sock, SOL_SOCKET, SO_ATTACH_BPF, &g_stp_bpf.prog_fd, sizeof(g_stp_bpf.prog_fd)))
+    {
+        STP_LOG_ERR("setsockopt SO_ATTACH_BPF for sock %d Failed, errno : %s", sock, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Перебирает записи карты.
+ *
+ * @param fd Карта.
+ * @param key Текущий ключ, на выходе - следующий.
+ * @param first Начать с первой записи.
+ * @param value Значение следующей записи.
+ * @param size Размер значения.
+ * @return bool false, если записей больше нет.
+ */
+static bool stp_bpf_map_next(int fd, STP_BPF_KEY *key, bool first, void *value, size_t size)
+{
+    union bpf_attr attr;
+    STP_BPF_KEY next;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = fd;
+    attr.key = first ? 0 : (uint64_t)(uintptr_t)key;
+    attr.next_key = (uint64_t)(uintptr_t)&next;
+    if (stp_bpf_sys(BPF_MAP_GET_NEXT_KEY, &attr) == -1)
+        return false;
+
+    *key = next;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = fd;
+    attr.key = (uint64_t)(uintptr_t)key;
+    attr.value = (uint64_t)(uintptr_t)value;
+    // deleted in between
+    if (stp_bpf_sys(BPF_MAP_LOOKUP_ELEM, &attr) == -1)
+        memset(value, 0, size);
+    return true;
+}
+
+/**
+ * @brief Возвращает порт, в статистику которого идут BPDU интерфейса ядра.
+ *
+ * Как и при приёме, BPDU порта-участника учитываются на Port-channel.
+ */
+static uint32_t stp_bpf_stats_port(uint32_t kif_index)
+{
+    INTERFACE_NODE *node = stp_intf_get_node_by_kif_index(kif_index);
+
+    if (node && node->master_ifindex)
+        node = stp_intf_get_node_by_kif_index(node->master_ifindex);
+
+    return node ? node->port_id : BAD_PORT_ID;
+}
+
+/**
+ * @brief Удаляет запись карты.
+ */
+static void stp_bpf_map_delete(int fd, STP_BPF_KEY *key)
+{
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = fd;
+    attr.key = (uint64_t)(uintptr_t)key;
+    stp_bpf_sys(BPF_MAP_DELETE_ELEM, &attr);
+}
+
+/**
+ * @brief Проверяет, что счётчик пары ограничивался правилом rule_key.
+ *
+ * Правила перебираются в том же порядке, что и в программе: если раньше
+ * находится другое заданное правило, счётчик остаётся ему.
+ */
+static bool stp_bpf_rule_owns(const STP_BPF_KEY *rule_key, const STP_BPF_KEY *bucket_key)
+{
+    union bpf_attr attr;
+    STP_BPF_RULE rule;
+    STP_BPF_KEY key;
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        key.kif_index = (i & 2) ? STP_BPF_PORT_ALL : bucket_key->kif_index;
+        key.vlan_id = (i & 1) ? STP_BPF_VLAN_ANY : bucket_key->vlan_id;
+        if (key.kif_index == rule_key->kif_index && key.vlan_id == rule_key->vlan_id)
+            return true;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.map_fd = g_stp_bpf.rule_fd;
+        attr.key = (uint64_t)(uintptr_t)&key;
+        attr.value = (uint64_t)(uintptr_t)&rule;
+        if (stp_bpf_sys(BPF_MAP_LOOKUP_ELEM, &attr) == 0)
+            return false;
+    }
+    return false;
+}
+
+/**
+ * @brief Удаляет счётчики пар, которые ограничивались удалённым правилом.
+ *
+ * Отброшенные ими BPDU остаются в статистике портов. Запись удаляется
+ * после перехода к следующей, чтобы не начинать перебор карты заново.
+ */
+static void stp_bpf_rule_flush_buckets(const STP_BPF_KEY *rule_key)
+{
+    STP_BPF_KEY key, del;
+    STP_BPF_BUCKET bucket;
+    uint32_t port_id;
+    bool first = true, pending = false;
+
+    while (stp_bpf_map_next(g_stp_bpf.bucket_fd, &key, first, &bucket, sizeof(bucket)))
+    {
+        first = false;
+        if (pending)
+        {
+            stp_bpf_map_delete(g_stp_bpf.bucket_fd, &del);
+            pending = false;
+        }
+        if (!stp_bpf_rule_owns(rule_key, &key))
+            continue;
+
+        port_id = stp_bpf_stats_port(key.kif_index);
+        if (port_id < g_max_stp_port)
+            g_stp_bpf.retired[port_id] += bucket.dropped;
+        del = key;
+        pending = true;
+    }
+    if (pending)
+        stp_bpf_map_delete(g_stp_bpf.bucket_fd, &del);
+}
+
+/**
+ * @brief Задаёт или удаляет правило в карте правил.
+ *
+ * @param master ifindex Port-channel, с которого скопировано правило участника, или 0.
+ */
+static int stp_bpf_rule_set(uint32_t kif_index, uint32_t vlan_id, uint32_t pps, uint32_t burst, uint32_t master)
+{
+    union bpf_attr attr;
+    STP_BPF_KEY key;
+    STP_BPF_RULE rule;
+    int ret;
+
+    if (pps == 0)
+    {
+        if (g_stp_bpf.rule_fd == -1)
+            return 0;
+
+        key.kif_index = kif_index;
+        key.vlan_id = vlan_id;
+        memset(&attr, 0, sizeof(attr));
+        attr.map_fd = g_stp_bpf.rule_fd;
+        attr.key = (uint64_t)(uintptr_t)&key;
+        if (stp_bpf_sys(BPF_MAP_DELETE_ELEM, &attr) == 0)
+        {
+            if (g_stp_bpf.rules)
+                g_stp_bpf.rules--;
+            stp_bpf_rule_flush_buckets(&key);
+        }
+        return 0;
+    }
+
+    if (g_stp_bpf.prog_fd == -1)
+    {
+        if (stp_bpf_load() == -1)
+            return -1;
+        stp_pkt_sock_refilter();
+    }
+
+    if (burst == 0)
+        burst = STP_BPF_DEFAULT_BURST;
+
+    key.kif_index = kif_index;
+    key.vlan_id = vlan_id;
+    memset(&rule, 0, sizeof(rule));
+    rule.cost_ns = 1000000000ull / pps;
+    rule.max_ns = rule.cost_ns * burst;
+    rule.pps = pps;
+    rule.burst = burst;
+    rule.master = master;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = g_stp_bpf.rule_fd;
+    attr.key = (uint64_t)(uintptr_t)&key;
+    attr.flags = BPF_NOEXIST;
+    attr.value = (uint64_t)(uintptr_t)&rule;
+    ret = stp_bpf_sys(BPF_MAP_UPDATE_ELEM, &attr);
+    if (ret == 0)
+        g_stp_bpf.rules++;
+    else if (errno == EEXIST)
+    {
+        attr.flags = BPF_EXIST;
+        ret = stp_bpf_sys(BPF_MAP_UPDATE_ELEM, &attr);
+    }
+    if (ret == -1)
+    {
+        STP_LOG_ERR("bpf rule kif %u vlan %u update Failed : %s", kif_index, vlan_id, strerror(errno));
+        return -1;
+    }
+
+    STP_LOG_INFO("BPDU storm guard kif %u vlan %u pps %u burst %u", kif_index, vlan_id, pps, burst);
+    return 0;
+}
+
+/**
+ * @brief Задаёт или удаляет правило ограничения BPDU.
+ *
+ * Первое правило загружает программу и переустанавливает фильтр на
+ * открытых сокетах приёма.
+ *
+ * @param kif_index ifindex ядра либо STP_BPF_PORT_ALL.
+ * @param vlan_id VLAN либо STP_BPF_VLAN_ANY.
+ * @param pps Допустимое число BPDU в секунду, 0 - удалить правило вместе
+ *            с его счётчиками.
+ * @param burst Допустимая пачка BPDU, 0 - STP_BPF_DEFAULT_BURST.
+ * @return int 0 при успехе, -1 при ошибке.
+ */
+int stp_bpf_guard_set(uint32_t kif_index, uint32_t vlan_id, uint32_t pps, uint32_t burst)
+{
+    return stp_bpf_rule_set(kif_index, vlan_id, pps, burst, 0);
+}
+
+/**
+ * @brief Задаёт или удаляет правило ограничения BPDU Port-channel.
+ *
+ * BPDU Port-channel приходят на его участники. Правило хранится под
+ * ifindex Port-channel и копируется на текущих участников, а
+ * stp_bpf_guard_member_update() переносит его при смене состава.
+ *
+ * @param master_kif ifindex Port-channel.
+ * @param vlan_id VLAN либо STP_BPF_VLAN_ANY.
+ * @param pps Допустимое число BPDU в секунду, 0 - удалить правило.
+ * @param burst Допустимая пачка BPDU, 0 - STP_BPF_DEFAULT_BURST.
+ * @return int Число участников или -1 при ошибке.
+ */
+int stp_bpf_guard_set_master(uint32_t master_kif, uint32_t vlan_id, uint32_t pps, uint32_t burst)
+{
+    struct avl_traverser trav;
+    INTERFACE_NODE *member;
+    int count = 0;
+
+    if (stp_bpf_rule_set(master_kif, vlan_id, pps, burst, 0) == -1)
+        return -1;
+
+    avl_t_init(&trav, g_stpd_intf_db);
+    while (NULL != (member = avl_t_next(&trav)))
+    {
+        if (member->master_ifindex != master_kif)
+            continue;
+        if (stp_bpf_rule_set(member->kif_index, vlan_id, pps, burst, master_kif) == -1)
+            return -1;
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief Переносит правила Port-channel при смене его состава.
+ *
+ * Участник, покинувший Port-channel, теряет скопированные с него правила,
+ * новый участник получает все правила Port-channel.
+ *
+ * @param kif_index ifindex участника.
+ * @param old_master ifindex прежнего Port-channel или 0.
+ * @param new_master ifindex нового Port-channel или 0.
+ * @return void
+ */
+void stp_bpf_guard_member_update(uint32_t kif_index, uint32_t old_master, uint32_t new_master)
+{
+    STP_BPF_KEY key, del;
+    STP_BPF_RULE rule;
+    bool first = true, pending = false;
+
+    if (g_stp_bpf.rule_fd == -1 || old_master == new_master)
+        return;
+
+    while (stp_bpf_map_next(g_stp_bpf.rule_fd, &key, first, &rule, sizeof(rule)))
+    {
+        first = false;
+        if (pending)
+        {
+            stp_bpf_rule_set(del.kif_index, del.vlan_id, 0, 0, 0);
+            pending = false;
+        }
+
+        if (old_master && key.kif_index == kif_index && rule.master == old_master)
+        {
+            del = key;
+            pending = true;
+        }
+        else if (new_master && key.kif_index == new_master && rule.pps)
+            stp_bpf_rule_set(kif_index, key.vlan_id, rule.pps, rule.burst, new_master);
+    }
+    if (pending)
+        stp_bpf_rule_set(del.kif_index, del.vlan_id, 0, 0, 0);
+}
+
+/**
+ * @brief Переносит счётчики отброшенных в ядре BPDU в статистику портов.
+ *
+ * pkt_rx_storm_drop порта - сумма по всем его VLAN с момента загрузки,
+ * включая счётчики удалённых правил. Счётчики, вытесненные из LRU карты,
+ * из суммы выпадают.
+ */
+void stp_bpf_guard_sync_stats()
+{
+    STP_BPF_KEY key;
+    STP_BPF_BUCKET bucket;
+    uint32_t port_id;
+    bool first = true;
+    int i;
+
+    if (g_stp_bpf.bucket_fd == -1 || !g_stpd_intf_stats)
+        return;
+
+    for (i = 0; i < g_max_stp_port; i++)
+        STPD_GET_PKT_COUNT(i, pkt_rx_storm_drop) = g_stp_bpf.retired[i];
+
+    while (stp_bpf_map_next(g_stp_bpf.bucket_fd, &key, first, &bucket, sizeof(bucket)))
+    {
+        first = false;
+        port_id = stp_bpf_stats_port(key.kif_index);
+        if (port_id < g_max_stp_port)
+            STPD_GET_PKT_COUNT(port_id, pkt_rx_storm_drop) += bucket.dropped;
+    }
+}
+
+/**
+ * @brief Перебирает правила storm guard.
+ *
+ * @param key Текущий ключ, на выходе - следующий.
+ * @param first Начать с первого правила.
+ * @param rule Следующее правило.
+ * @return bool false, если правил больше нет.
+ */
+bool stp_bpf_guard_next_rule(STP_BPF_KEY *key, bool first, STP_BPF_RULE *rule)
+{
+    if (g_stp_bpf.rule_fd == -1)
+        return false;
+    return stp_bpf_map_next(g_stp_bpf.rule_fd, key, first, rule, sizeof(*rule));
+}
+
+/**
+ * @brief Перебирает счётчики пар (порт, VLAN) storm guard.
+ *
+ * @param key Текущий ключ, на выходе - следующий.
+ * @param first Начать с первого счётчика.
+ * @param bucket Следующий счётчик.
+ * @return bool false, если счётчиков больше нет.
+ */
+bool stp_bpf_guard_next_bucket(STP_BPF_KEY *key, bool first, STP_BPF_BUCKET *bucket)
+{
+    if (g_stp_bpf.bucket_fd == -1)
+        return false;
+    return stp_bpf_map_next(g_stp_bpf.bucket_fd, key, first, bucket, sizeof(*bucket));
+}
+
+/**
+ * @brief Возвращает число правил storm guard.
+ */
+uint32_t stp_bpf_guard_rule_count()
+{
+    return g_stp_bpf.rules;
+}
+
+/**
+ * @brief Возвращает true, если storm guard загружен.
+ */
+bool stp_bpf_guard_active()
+{
+    return g_stp_bpf.prog_fd != -1;
+}
+
+/**
+ * @brief Закрывает программу и карты. Установленные фильтры остаются на сокетах до их закрытия.
+ */
+void stp_bpf_deinit()
+{
+    if (g_stp_bpf.prog_fd != -1)
+        close(g_stp_bpf.prog_fd);
+    if (g_stp_bpf.rule_fd != -1)
+        close(g_stp_bpf.rule_fd);
+    if (g_stp_bpf.bucket_fd != -1)
+        close(g_stp_bpf.bucket_fd);
+    g_stp_bpf.prog_fd = g_stp_bpf.rule_fd = g_stp_bpf.bucket_fd = -1;
+    g_stp_bpf.rules = 0;
+    free(g_stp_bpf.retired);
+    g_stp_bpf.retired = NULL;
+}
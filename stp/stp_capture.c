@@ -0,0 +1,385 @@
+/**
+ * @file stp_capture.c
+ * @brief Постоянно включённый захват последних BPDU в памяти.
+ *
+ * @details
+ * Кольцо порта выделяется при первом BPDU на нём. Запись и выборка
+ * выполняются главным потоком (рабочие потоки передают свои кадры главному
+ * через stp_worker_defer_tx()), поэтому блокировки не нужны.
+ */
+
+#include "stp_inc.h"
+
+/**
+ * @struct stp_capture_ring_t
+ * @brief Кольцо захвата порта
+ */
+typedef struct
+{
+    uint32_t next;  // Следующая запись
+    uint32_t count; // Заполнено записей
+    STP_CAPTURE_REC rec[STP_CAPTURE_PORT_SLOTS ? STP_CAPTURE_PORT_SLOTS : 1];
+} stp_capture_ring_t;
+
+/**
+ * @struct stp_capture_t
+ * @brief Контекст захвата
+ */
+typedef struct
+{
+    stp_capture_ring_t **rings; // По port_id, g_max_stp_port записей
+    uint32_t max_port;
+    bool disabled;              // Не удалось выделить таблицу колец
+    stp_capture_stats_t stats;
+} stp_capture_t;
+
+static stp_capture_t g_stp_capture;
+
+/**
+ * @brief Записывает BPDU в кольцо порта.
+ *
+ * @param port_id Порт STP.
+ * @param vlan_id VLAN.
+ * @param pkt Кадр.
+ * @param len Длина кадра.
+ * @param flags STP_CAPTURE_FLAGS.
+ * @return void
+ */
+void stp_capture_frame(uint32_t port_id, VLAN_ID vlan_id, const char *pkt, uint16_t len, uint8_t flags)
+{
+    stp_capture_ring_t *ring;
+    STP_CAPTURE_REC *rec;
+    struct timespec ts;
+
+    if (!STP_CAPTURE_PORT_SLOTS || g_stp_capture.disabled)
+        return;
+
+    if (!g_stp_capture.rings)
+    {
+        g_stp_capture.rings = calloc(g_max_stp_port, sizeof(stp_capture_ring_t *));
+        if (!g_stp_capture.rings)
+        {
+            STP_LOG_ERR("bpdu capture alloc Failed");
+            g_stp_capture.disabled = true;
+            return;
+        }
+        g_stp_capture.max_port = g_max_stp_port;
+    }
+
+    if (port_id >= g_stp_capture.max_port)
+        return;
+
+    ring = g_stp_capture.rings[port_id];
+    if (!ring)
+    {
+        ring = calloc(1, sizeof(stp_capture_ring_t));
+        if (!ring)
+            return;
+        g_stp_capture.rings[port_id] = ring;
+        g_stp_capture.stats.ports++;
+    }
+
+    rec = &ring->rec[ring->next];
+    if (++ring->next == STP_CAPTURE_PORT_SLOTS)
+        ring->next = 0;
+    if (ring->count < STP_CAPTURE_PORT_SLOTS)
+        ring->count++;
+    else
+        g_stp_capture.stats.overwrites++;
+    g_stp_capture.stats.frames++;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    rec->ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    rec->port_id = port_id;
+    rec->vlan_id = vlan_id;
+    rec->len = len;
+    rec->caplen = (len < STP_CAPTURE_SNAPLEN) ? len : STP_CAPTURE_SNAPLEN;
+    rec->flags = flags;
+    memcpy(rec->data, pkt, rec->caplen);
+}
+
+static int stp_capture_rec_cmp(const void *a, const void *b)
+{
+    const STP_CAPTURE_REC *ra = *(const STP_CAPTURE_REC *const *)a;
+    const STP_CAPTURE_REC *rb = *(const STP_CAPTURE_REC *const *)b;
+
+    return (ra->ts_ns > rb->ts_ns) - (ra->ts_ns < rb->ts_ns);
+}
+
+/**
+ * @brief Выбирает записи захвата в порядке времени.
+ *
+ * @param port_id Порт или BAD_PORT_ID для всех портов.
+ * @param vlan_id VLAN или VLAN_ID_INVALID для всех VLAN.
+ * @param recs Массив указателей на записи, освобождается вызывающим через free().
+ * @return int Число записей, -1 при ошибке выделения памяти.
+ */
+int stp_capture_select(uint32_t port_id, VLAN_ID vlan_id, STP_CAPTURE_REC ***recs)
+{
+    stp_capture_ring_t *ring;
+    STP_CAPTURE_REC **out;
+    uint32_t first, last, p, i;
+    int count = 0;
+
+    *recs = NULL;
+    if (!g_stp_capture.rings)
+        return 0;
+
+    first = (port_id == BAD_PORT_ID) ? 0 : port_id;
+    last = (port_id == BAD_PORT_ID) ? g_stp_capture.max_port : port_id + 1;
+    if (last > g_stp_capture.max_port)
+        return 0;
+
+    out = malloc((size_t)(g_stp_capture.stats.ports ? g_stp_capture.stats.ports : 1) * STP_CAPTURE_PORT_SLOTS * sizeof(*out));
+    if (!out)
+        return -1;
+
+    for (p = first; p < last; p++)
+    {
+        ring = g_stp_capture.rings[p];
+        if (!ring)
+            continue;
+        for (i = 0; i < ring->count; i++)
+        {
+            if (vlan_id == VLAN_ID_INVALID || ring->rec[i].vlan_id == vlan_id)
+                out[count++] = &ring->rec[i];
+        }
+    }
+
+    qsort(out, count, sizeof(*out), stp_capture_rec_cmp);
+    *recs = out;
+    return count;
+}
+
+/**
+ * @brief Очищает кольца захвата.
+ *
+ * @return void
+ */
+void stp_capture_clear()
+{
+    uint32_t p;
+
+    if (!g_stp_capture.rings)
+        return;
+
+    for (p = 0; p < g_stp_capture.max_port; p++)
+    {
+        if (g_stp_capture.rings[p])
+            g_stp_capture.rings[p]->next = g_stp_capture.rings[p]->count = 0;
+    }
+    g_stp_capture.stats.frames = g_stp_capture.stats.overwrites = 0;
+}
+
+/**
+ * @brief Освобождает кольца захвата.
+ *
+ * @return void
+ */
+void stp_capture_deinit()
+{
+    uint32_t p;
+
+    if (!g_stp_capture.rings)
+        return;
+
+    for (p = 0; p < g_stp_capture.max_port; p++)
+        free(g_stp_capture.rings[p]);
+    free(g_stp_capture.rings);
+    memset(&g_stp_capture, 0, sizeof(g_stp_capture));
+}
+
+/**
+ * @brief Возвращает статистику захвата.
+ */
+stp_capture_stats_t *stp_capture_get_stats()
+{
+    return &g_stp_capture.stats;
+}
+
+static inline uint16_t stp_capture_get16(const UINT8 *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+/**
+ * @brief Форматирует идентификатор моста: приоритет с system id и MAC.
+ */
+static int stp_capture_bridge_id(char *buf, size_t size, const UINT8 *p)
+{
+    return snprintf(buf, size, "%u/%02x:%02x:%02x:%02x:%02x:%02x",
+                    stp_capture_get16(p), p[2], p[3], p[4], p[5], p[6], p[7]);
+}
+
+/**
+ * @brief Разбирает запись захвата в одну строку.
+ *
+ * Разбор по байтам кадра, без STP_CONFIG_BPDU: кадр может быть
+ * некорректным, а передаваемые кадры содержат тег 802.1Q.
+ *
+ * @param rec Запись.
+ * @param buf Буфер строки.
+ * @param size Размер буфера.
+ * @return void
+ */
+void stp_capture_decode(const STP_CAPTURE_REC *rec, char *buf, size_t size)
+{
+    const UINT8 *p = rec->data;
+    const UINT8 *end = rec->data + rec->caplen;
+    const char *proto;
+    const char *name;
+    char root[32], bridge[32];
+    struct tm tm;
+    time_t sec = rec->ts_ns / 1000000000ULL;
+    size_t pos;
+    UINT8 type, flags;
+    int i;
+
+    localtime_r(&sec, &tm);
+    name = stp_intf_get_port_name(rec->port_id);
+    pos = snprintf(buf, size, "%02d:%02d:%02d.%06lu %s %-14s vlan %4u len %3u ",
+                   tm.tm_hour, tm.tm_min, tm.tm_sec, (unsigned long)(rec->ts_ns % 1000000000ULL) / 1000,
+                   (rec->flags & STP_CAPTURE_RX) ? "RX" : "TX", name ? name : "-", rec->vlan_id, rec->len);
+    if (pos >= size)
+        return;
+
+    p += L2_ETH_ADD_LEN * 2;
+    if (p + 2 <= end && stp_capture_get16(p) == 0x8100)
+        p += VLAN_HEADER_LEN;
+    p += 2; // 802.3 length
+
+    if (p + 8 <= end && p[0] == 0xaa && p[1] == 0xaa && p[2] == 0x03)
+    {
+        proto = "PVST";
+        p += 8; // SNAP
+    }
+    else if (p + 3 <= end && p[0] == 0x42 && p[1] == 0x42)
+    {
+        proto = "STP";
+        p += 3; // LLC
+    }
+    else
+        goto raw;
+
+    if (p + 4 > end)
+        goto raw;
+    type = p[3];
+    if (type == TCN_BPDU_TYPE)
+    {
+        snprintf(buf + pos, size - pos, "%s TCN", proto);
+        return;
+    }
+    // config and RST BPDUs share the layout up to forward delay
+    if (p + 35 > end)
+        goto raw;
+
+    flags = p[4];
+    stp_capture_bridge_id(root, sizeof(root), p + 5);
+    stp_capture_bridge_id(bridge, sizeof(bridge), p + 17);
+    snprintf(buf + pos, size - pos,
+             "%s %s%s%s root %s cost %u bridge %s port 0x%04x age %u.%02u max %u hello %u fwd %u",
+             proto, (type == CONFIG_BPDU_TYPE) ? "Config" : (type == RSTP_BPDU_TYPE) ? "RST" : "type?",
+             (flags & 0x01) ? " TC" : "", (flags & 0x80) ? " TCA" : "", root,
+             ((UINT32)p[13] << 24) | ((UINT32)p[14] << 16) | ((UINT32)p[15] << 8) | p[16], bridge,
+             stp_capture_get16(p + 25), stp_capture_get16(p + 27) >> 8, ((stp_capture_get16(p + 27) & 0xff) * 100) >> 8,
+             stp_capture_get16(p + 29) >> 8, stp_capture_get16(p + 31) >> 8, stp_capture_get16(p + 33) >> 8);
+    return;
+
+raw:
+    pos += snprintf(buf + pos, size - pos, "unknown");
+    for (i = 0; i < rec->caplen && pos + 3 < size; i++)
+        pos += snprintf(buf + pos, size - pos, "%s%02x", (i % 4) ? "" : " ", rec->data[i]);
+}
+
+/**
+ * @struct stp_capture_pcap_hdr_t
+ * @brief Заголовок файла pcap
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+} stp_capture_pcap_hdr_t;
+
+/**
+ * @struct stp_capture_pcap_rec_t
+ * @brief Заголовок кадра pcap
+ */
+typedef struct
+{
+    uint32_t ts_sec;
+    uint32_t ts_usec;
+    uint32_t incl_len;
+    uint32_t orig_len;
+} stp_capture_pcap_rec_t;
+
+/**
+ * @brief Сохраняет выбранные записи захвата в файл pcap.
+ *
+ * Принятым кадрам с VLAN возвращается снятый ядром тег 802.1Q.
+ *
+ * @param file Файл.
+ * @param port_id Порт или BAD_PORT_ID для всех портов.
+ * @param vlan_id VLAN или VLAN_ID_INVALID для всех VLAN.
+ * @return int Число сохранённых кадров, -1 при ошибке.
+ */
+int stp_capture_pcap_write(const char *file, uint32_t port_id, VLAN_ID vlan_id)
+{
+    stp_capture_pcap_hdr_t hdr = {0xa1b2c3d4, 2, 4, 0, 0, 65535, 1 /* LINKTYPE_ETHERNET */};
+    stp_capture_pcap_rec_t prec;
+    STP_CAPTURE_REC **recs;
+    STP_CAPTURE_REC *rec;
+    UINT8 frame[STP_CAPTURE_SNAPLEN + VLAN_HEADER_LEN];
+    uint32_t caplen, extra;
+    FILE *fp;
+    int count, i;
+
+    count = stp_capture_select(port_id, vlan_id, &recs);
+    if (count < 0)
+        return -1;
+
+    fp = fopen(file, "w");
+    if (!fp)
+    {
+        STP_LOG_ERR("%s open Failed : %s", file, strerror(errno));
+        free(recs);
+        return -1;
+    }
+
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    for (i = 0; i < count; i++)
+    {
+        rec = recs[i];
+        caplen = rec->caplen;
+        extra = 0;
+        if ((rec->flags & STP_CAPTURE_RX) && !(rec->flags & STP_CAPTURE_TAGGED) && rec->vlan_id && caplen >= L2_ETH_ADD_LEN * 2)
+        {
+            memcpy(frame, rec->data, L2_ETH_ADD_LEN * 2);
+            frame[12] = 0x81;
+            frame[13] = 0x00;
+            frame[14] = (rec->vlan_id >> 8) & 0x0f;
+            frame[15] = rec->vlan_id & 0xff;
+            memcpy(frame + 16, rec->data + L2_ETH_ADD_LEN * 2, caplen - L2_ETH_ADD_LEN * 2);
+            extra = VLAN_HEADER_LEN;
+        }
+        else
+            memcpy(frame, rec->data, caplen);
+
+        prec.ts_sec = rec->ts_ns / 1000000000ULL;
+        prec.ts_usec = (rec->ts_ns % 1000000000ULL) / 1000;
+        prec.incl_len = caplen + extra;
+        prec.orig_len = rec->len + extra;
+        fwrite(&prec, sizeof(prec), 1, fp);
+        fwrite(frame, prec.incl_len, 1, fp);
+    }
+
+    if (fclose(fp) != 0)
+        count = -1;
+    free(recs);
+    return count;
+}
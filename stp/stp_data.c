@@ -75,6 +75,8 @@ int8_t stpdata_init_stp_class_port_mask(STP_INDEX stp_index)
 	ret |= bmp_alloc(&stp_class->enable_mask, g_max_stp_port);
 	ret |= bmp_alloc(&stp_class->control_mask, g_max_stp_port);
 	ret |= bmp_alloc(&stp_class->untag_mask, g_max_stp_port);
+	ret |= bmp_alloc(&stp_class->dirty_port_mask, g_max_stp_port);
+	ret |= bmp_alloc(&stp_class->wbos_port_mask, g_max_stp_port);
 
 	return ret;
 }
@@ -103,6 +105,35 @@ bool stpdata_init_global_structures(UINT16 max_instances)
 
 	g_stp_instances = max_instances;
 
+	if (bmp_alloc(&g_stp_wbos_class_mask, g_stp_instances) == -1)
+	{
+		STP_LOG_ERR("wbos class mask alloc Failed");
+		return false;
+	}
+
+	if (bmp_alloc(&g_stp_batch_class_mask, g_stp_instances) == -1)
+	{
+		STP_LOG_ERR("batch class mask alloc Failed");
+		return false;
+	}
+
+	if (bmp_alloc(&g_stp_fastage_vlan_mask, MAX_VLAN_ID + 1) == -1 ||
+		bmp_alloc(&g_stp_fastage_state_mask, MAX_VLAN_ID + 1) == -1)
+	{
+		STP_LOG_ERR("fastage vlan mask alloc Failed");
+		return false;
+	}
+
+	g_stp_group_vlan = (STP_GROUP_VLAN **)calloc(MAX_VLAN_ID + 1, sizeof(STP_GROUP_VLAN *));
+	if (g_stp_group_vlan == NULL)
+	{
+		STP_LOG_ERR("group vlan table alloc Failed");
+		return false;
+	}
+
+	for (i = 0; i <= MAX_VLAN_ID; i++)
+		g_stp_vlan_index_map[i] = STP_INDEX_INVALID;
+
 	mem_size = g_stp_instances * sizeof(STP_CLASS);
 	g_stp_class_array = (STP_CLASS *)calloc(1, mem_size);
 	if (g_stp_class_array == NULL)
@@ -113,9 +144,20 @@ bool stpdata_init_global_structures(UINT16 max_instances)
 
 	memset(g_stp_class_array, 0, mem_size);
 
+	/* one set of wheels per worker thread */
+	g_stp_timer_wheel_sets = stp_worker_get_wheel_sets();
+	g_stp_timer_wheel = (TIMER_WHEEL *)calloc(STP_TIMER_GROUPS * g_stp_timer_wheel_sets, sizeof(TIMER_WHEEL));
+	if (g_stp_timer_wheel == NULL)
+	{
+		STP_LOG_CRITICAL("Memory allocation %lu bytes failed", STP_TIMER_GROUPS * g_stp_timer_wheel_sets * sizeof(TIMER_WHEEL));
+		free(g_stp_class_array);
+		return false;
+	}
+
 	if (stpdata_malloc_port_structures() == false)
 	{
 		free(g_stp_class_array);
+		free(g_stp_timer_wheel);
 		return false;
 	}
 
@@ -125,9 +167,10 @@ bool stpdata_init_global_structures(UINT16 max_instances)
 		{
 			STP_LOG_ERR("stpdata_init_stp_class_port_mask Failed");
 			free(g_stp_class_array);
-			free(g_stp_port_array);
+			free(g_stp_timer_wheel);
 			g_stp_instances = 0;
 			g_stp_class_array = 0;
+			g_stp_timer_wheel = 0;
 			return false;
 		}
 	}
@@ -153,27 +196,20 @@ bool stpdata_init_global_structures(UINT16 max_instances)
 }
 
 /**
- * @brief Выделяет память для структуры данных портов STP.
+ * @brief Подготавливает пул классов портов STP.
  *
- * Функция выделяет память для массива портов STP, если она ещё не
- * была выделена.
+ * Память под классы портов выделяется блоками по мере добавления портов
+ * в экземпляры (см. stpdata_get_port_class()), здесь только сбрасывается
+ * состояние пула.
  *
- * @return bool Возвращает true при успешной аллокации, иначе false.
+ * @return bool Возвращает true, если пул ещё не был инициализирован, иначе false.
  */
 bool stpdata_malloc_port_structures()
 {
-	UINT32 num_ports, mem_size;
-
-	if (g_stp_port_array == NULL)
+	if (g_stp_port_slab == NULL)
 	{
-		mem_size = sizeof(STP_PORT_CLASS) * g_max_stp_port * g_stp_instances;
-		g_stp_port_array = (STP_PORT_CLASS *)calloc(1, mem_size);
-		if (g_stp_port_array == NULL)
-		{
-			STP_LOG_CRITICAL("Memory allocation %d bytes failed for port_class", mem_size);
-			return false;
-		}
-		memset(g_stp_port_array, 0, mem_size);
+		g_stp_port_free_list = NULL;
+		g_stp_port_in_use = 0;
 		return true;
 	}
 
@@ -181,19 +217,85 @@ bool stpdata_malloc_port_structures()
 }
 
 /**
- * @brief Освобождает память, выделенную для структуры данных портов STP.
+ * @brief Освобождает память, выделенную для классов портов STP.
  *
- * Функция освобождает массив портов STP, если он был ранее выделен.
+ * Функция освобождает все блоки пула классов портов.
  *
  * @return void
  */
 void stpdata_free_port_structures()
 {
-	if (g_stp_port_array != NULL)
+	STP_PORT_SLAB *slab;
+
+	while (g_stp_port_slab != NULL)
+	{
+		slab = g_stp_port_slab;
+		g_stp_port_slab = slab->next;
+		free(slab);
+	}
+	g_stp_port_free_list = NULL;
+	g_stp_port_in_use = 0;
+}
+
+/**
+ * @brief Берёт обнулённый класс порта из пула, при необходимости выделяя новый блок.
+ *
+ * @return STP_PORT_CLASS* Указатель на класс порта или NULL при нехватке памяти.
+ */
+static STP_PORT_CLASS *stpdata_port_class_alloc(void)
+{
+	STP_PORT_SLAB *slab;
+	STP_PORT_CLASS *port_class;
+	UINT32 i;
+
+	if (g_stp_port_free_list == NULL)
 	{
-		free((void *)g_stp_port_array);
-		g_stp_port_array = NULL;
+		slab = (STP_PORT_SLAB *)malloc(sizeof(STP_PORT_SLAB));
+		if (slab == NULL)
+		{
+			STP_LOG_CRITICAL("Memory allocation %lu bytes failed for port_class", sizeof(STP_PORT_SLAB));
+			return NULL;
+		}
+		slab->next = g_stp_port_slab;
+		g_stp_port_slab = slab;
+
+		for (i = 0; i < STP_PORT_SLAB_SIZE; i++)
+		{
+			*(STP_PORT_CLASS **)&slab->port[i] = g_stp_port_free_list;
+			g_stp_port_free_list = &slab->port[i];
+		}
 	}
+
+	port_class = g_stp_port_free_list;
+	g_stp_port_free_list = *(STP_PORT_CLASS **)port_class;
+	memset(port_class, 0, sizeof(STP_PORT_CLASS));
+	g_stp_port_in_use++;
+
+	return port_class;
+}
+
+/**
+ * @brief Возвращает класс порта экземпляра STP в пул.
+ *
+ * @param stp_class Указатель на структуру экземпляра STP.
+ * @param port_number Номер порта.
+ * @return void
+ */
+void stpdata_release_port_class(STP_CLASS *stp_class, PORT_ID port_number)
+{
+	STP_PORT_CLASS *port_class;
+
+	if (stp_class->port_tbl == NULL || port_number >= g_max_stp_port)
+		return;
+
+	port_class = stp_class->port_tbl[port_number];
+	if (port_class == NULL)
+		return;
+
+	stp_class->port_tbl[port_number] = NULL;
+	*(STP_PORT_CLASS **)port_class = g_stp_port_free_list;
+	g_stp_port_free_list = port_class;
+	g_stp_port_in_use--;
 }
 
 /**
@@ -222,6 +324,9 @@ int stpdata_init_class(STP_INDEX stp_index, VLAN_ID vlan_id)
 		stp_class->state = STP_CLASS_CONFIG;
 		g_stp_active_instances++;
 		stpmgr_initialize_stp_class(stp_class, vlan_id);
+
+		if (vlan_id <= MAX_VLAN_ID)
+			g_stp_vlan_index_map[vlan_id] = stp_index;
 	}
 
 	return 0;
@@ -239,8 +344,33 @@ int stpdata_init_class(STP_INDEX stp_index, VLAN_ID vlan_id)
 void stpdata_class_free(STP_INDEX stp_index)
 {
 	STP_CLASS *stp_class;
+	PORT_ID port_number;
 
 	stp_class = GET_STP_CLASS(stp_index);
+	timer_wheel_del(STP_TIMER_WHEEL(stp_class), &stp_class->timer_node);
+	if (stp_class->port_tbl != NULL)
+	{
+		for (port_number = 0; port_number < g_max_stp_port; port_number++)
+			stpdata_release_port_class(stp_class, port_number);
+		free(stp_class->port_tbl);
+		stp_class->port_tbl = NULL;
+	}
+	if (stp_class->vlan_id <= MAX_VLAN_ID && g_stp_vlan_index_map[stp_class->vlan_id] == stp_index)
+		g_stp_vlan_index_map[stp_class->vlan_id] = STP_INDEX_INVALID;
+	if (stp_class->group_vlan_mask != NULL)
+	{
+		BMP_ITER_T it;
+		BMP_ID vlan_id;
+
+		BMP_FOR_EACH_SET_BIT(stp_class->group_vlan_mask, it, vlan_id)
+		{
+			if (g_stp_vlan_index_map[vlan_id] == stp_index)
+				g_stp_vlan_index_map[vlan_id] = STP_INDEX_INVALID;
+		}
+		bmp_free(stp_class->group_vlan_mask);
+		stp_class->group_vlan_mask = NULL;
+		stp_class->group_vlan_count = 0;
+	}
 	stp_class->vlan_id = 0;
 	stp_class->fast_aging = 0;
 	stp_class->state = STP_CLASS_FREE;
@@ -251,6 +381,9 @@ void stpdata_class_free(STP_INDEX stp_index)
 	stp_class->last_expiry_time = 0;
 	stp_class->last_bpdu_rx_time = 0;
 	stp_class->modified_fields = 0;
+	clear_mask(stp_class->dirty_port_mask);
+	clear_mask(stp_class->wbos_port_mask);
+	bmp_set(g_stp_wbos_class_mask, stp_index);
 
 	g_stp_active_instances--;
 }
@@ -341,24 +474,130 @@ int stpdata_init_debug_structures(void)
 /**
  * @brief Возвращает структуру порта STP.
  *
- * Функция получает структуру порта, связанную с заданным экземпляром STP
- * и номером порта.
+ * Только поиск: класс порта создаётся stpdata_ensure_port_class() при
+ * добавлении порта в экземпляр, поэтому функция безопасна в рабочих потоках.
  *
  * @param stp_class Указатель на структуру экземпляра STP.
  * @param port_number Номер порта.
- * @return STP_PORT_CLASS* Указатель на структуру порта или NULL в случае ошибки.
+ * @return STP_PORT_CLASS* Указатель на структуру порта или NULL, если порт не создан.
  */
 STP_PORT_CLASS *stpdata_get_port_class(STP_CLASS *stp_class, PORT_ID port_number)
 {
+	if (stp_class->port_tbl != NULL && port_number < g_max_stp_port && stp_class->port_tbl[port_number] != NULL)
+		return stp_class->port_tbl[port_number];
+
+	// workers only touch control ports, those always have a class
+	if (stp_worker_in_thread())
+		STP_LOG_CRITICAL("port class inst:%d port:%d missing in worker thread", GET_STP_INDEX(stp_class), port_number);
+	return NULL;
+}
+
+/**
+ * @brief Возвращает структуру порта STP, создавая её при необходимости.
+ *
+ * Таблица портов экземпляра и сам класс порта создаются при первом
+ * обращении из общего пула без блокировок, поэтому вызывается только из
+ * главного потока (stpmgr_add_control_port() и восстановление снимка).
+ *
+ * @param stp_class Указатель на структуру экземпляра STP.
+ * @param port_number Номер порта.
+ * @return STP_PORT_CLASS* Указатель на структуру порта или NULL в случае ошибки.
+ */
+STP_PORT_CLASS *stpdata_ensure_port_class(STP_CLASS *stp_class, PORT_ID port_number)
+{
+	STP_PORT_CLASS *stp_port_class;
 	UINT16 stp_index;
 
+	stp_port_class = stpdata_get_port_class(stp_class, port_number);
+	if (stp_port_class != NULL)
+		return stp_port_class;
+
 	stp_index = GET_STP_INDEX(stp_class);
 
-	if (g_stp_port_array == NULL)
+	if (port_number >= g_max_stp_port)
+	{
+		STP_LOG_ERR("error - invalid port inst:%d port:%d", stp_index, port_number);
+		return NULL;
+	}
+
+	if (stp_worker_in_thread())
+	{
+		STP_LOG_CRITICAL("port class inst:%d port:%d allocated in worker thread", stp_index, port_number);
+		return NULL;
+	}
+
+	if (stp_class->port_tbl == NULL)
 	{
-		STP_LOG_ERR("error - port array null inst:%d port:%d", stp_index, port_number);
+		stp_class->port_tbl = (STP_PORT_CLASS **)calloc(g_max_stp_port, sizeof(STP_PORT_CLASS *));
+		if (stp_class->port_tbl == NULL)
+		{
+			STP_LOG_CRITICAL("Memory allocation failed for port table inst:%d", stp_index);
+			return NULL;
+		}
+	}
+
+	stp_class->port_tbl[port_number] = stpdata_port_class_alloc();
+	return stp_class->port_tbl[port_number];
+}
+
+/**
+ * @brief Возвращает порты сгруппированного VLAN.
+ *
+ * @param vlan_id Идентификатор VLAN.
+ * @param create Создать запись, если её нет.
+ * @return STP_GROUP_VLAN* Запись VLAN или NULL, если её нет или не удалось выделить память.
+ */
+STP_GROUP_VLAN *stpdata_group_vlan_get(VLAN_ID vlan_id, bool create)
+{
+	STP_GROUP_VLAN *group;
+
+	if (vlan_id > MAX_VLAN_ID || g_stp_group_vlan == NULL)
+		return NULL;
+
+	group = g_stp_group_vlan[vlan_id];
+	if (group != NULL || !create)
+		return group;
+
+	group = (STP_GROUP_VLAN *)calloc(1, sizeof(STP_GROUP_VLAN));
+	if (group == NULL)
+	{
+		STP_LOG_CRITICAL("Memory allocation failed for group vlan %u", vlan_id);
+		return NULL;
+	}
+
+	group->stp_index = STP_INDEX_INVALID;
+	g_stp_group_vlan[vlan_id] = group;
+
+	if (bmp_alloc(&group->member_mask, g_max_stp_port) != 0 ||
+		bmp_alloc(&group->untag_mask, g_max_stp_port) != 0 ||
+		bmp_alloc(&group->blocked_mask, g_max_stp_port) != 0)
+	{
+		STP_LOG_CRITICAL("Memory allocation failed for group vlan %u masks", vlan_id);
+		stpdata_group_vlan_free(vlan_id);
 		return NULL;
 	}
+	return group;
+}
 
-	return &g_stp_port_array[(stp_index + (port_number * g_stp_instances))];
+/**
+ * @brief Освобождает запись портов сгруппированного VLAN.
+ *
+ * @param vlan_id Идентификатор VLAN.
+ * @return void
+ */
+void stpdata_group_vlan_free(VLAN_ID vlan_id)
+{
+	STP_GROUP_VLAN *group = stpdata_group_vlan_get(vlan_id, false);
+
+	if (group == NULL)
+		return;
+
+	if (group->member_mask)
+		bmp_free(group->member_mask);
+	if (group->untag_mask)
+		bmp_free(group->untag_mask);
+	if (group->blocked_mask)
+		bmp_free(group->blocked_mask);
+	free(group);
+	g_stp_group_vlan[vlan_id] = NULL;
 }
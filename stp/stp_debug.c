@@ -113,6 +113,48 @@ void stpdbg_dump_nl_db()
         stpdbg_dump_nl_db_node(node);
 }
 
+/**
+ * @brief Выводит гистограммы задержек обработчиков libevent.
+ *
+ * Для каждого обработчика, зарегистрированного через stpmgr_libevent_create(),
+ * выводятся перцентили времени выполнения, а для таймеров - опоздание
+ * срабатывания относительно расписания. Все значения в микросекундах.
+ *
+ * @return void
+ */
+void stpdbg_dump_libev_prof()
+{
+    STPD_LIBEV_PROF* prof;
+    uint8_t i;
+
+    STP_DUMP("------------------------------------------------------------------------------\n");
+    STP_DUMP(" Callback        |   Calls    |  Avg  |  p50  |  p99  | p99.9 |   Max   (us)\n");
+    STP_DUMP("------------------------------------------------------------------------------\n");
+    for (i = 0; i < g_stpd_libev_prof_count; i++)
+    {
+        prof = &g_stpd_libev_prof[i];
+        STP_DUMP(" %-15s | %10lu | %5lu | %5u | %5u | %5u | %8u\n", prof->name, prof->run.count,
+                 prof->run.count ? prof->run.total_us / prof->run.count : 0,
+                 stpd_lat_hist_percentile(&prof->run, 500), stpd_lat_hist_percentile(&prof->run, 990),
+                 stpd_lat_hist_percentile(&prof->run, 999), prof->run.max_us);
+    }
+
+    STP_DUMP("\n");
+    STP_DUMP("------------------------------------------------------------------------------\n");
+    STP_DUMP(" Timer lag       |  Period us |  Avg  |  p50  |  p99  | p99.9 |   Max   (us)\n");
+    STP_DUMP("------------------------------------------------------------------------------\n");
+    for (i = 0; i < g_stpd_libev_prof_count; i++)
+    {
+        prof = &g_stpd_libev_prof[i];
+        if (prof->interval_us == 0)
+            continue;
+        STP_DUMP(" %-15s | %10u | %5lu | %5u | %5u | %5u | %8u\n", prof->name, prof->interval_us,
+                 prof->lag.count ? prof->lag.total_us / prof->lag.count : 0,
+                 stpd_lat_hist_percentile(&prof->lag, 500), stpd_lat_hist_percentile(&prof->lag, 990),
+                 stpd_lat_hist_percentile(&prof->lag, 999), prof->lag.max_us);
+    }
+}
+
 /**
  * @brief Выводит глобальную статистику работы STP.
  *
@@ -134,17 +176,109 @@ void stpdbg_dump_stp_stats()
     STP_DUMP("Timer   : %lu\n", g_stpd_stats_libev_timer);
     STP_DUMP("Pkt-rx  : %lu\n", g_stpd_stats_libev_pktrx);
     STP_DUMP("IPC     : %lu\n", g_stpd_stats_libev_ipc);
-    STP_DUMP("Netlink : %lu\n", g_stpd_stats_libev_netlink);
+    stpmgr_ipc_rx_sample();
+    STP_DUMP("IPC-rx  : msgs %lu batches %lu full %lu max-batch %u truncated %lu queue-bytes %u max %u drops %u"
+             " kicks %lu\n",
+             g_stpd_stats_ipc_rx.msgs, g_stpd_stats_ipc_rx.batches, g_stpd_stats_ipc_rx.full_batches,
+             g_stpd_stats_ipc_rx.max_batch, g_stpd_stats_ipc_rx.truncated, g_stpd_stats_ipc_rx.queue_bytes,
+             g_stpd_stats_ipc_rx.max_queue_bytes, g_stpd_stats_ipc_rx.drops, g_stpd_stats_ipc_rx.kicks);
+    STP_DUMP("Netlink : %lu fast-path %lu\n", g_stpd_stats_libev_netlink, g_stpd_stats_libev_netlink_fast);
+    STP_DUMP("Nl-rx   : reads %lu msgs %lu filtered %lu truncated %lu overruns %lu resyncs %lu\n",
+             stp_netlink_rx_get_stats()->reads, stp_netlink_rx_get_stats()->msgs,
+             stp_netlink_rx_get_stats()->filtered, stp_netlink_rx_get_stats()->truncated,
+             stp_netlink_rx_get_stats()->overruns, stp_netlink_rx_get_stats()->resyncs);
+    STP_DUMP("Tx-batch: frames %lu flushes %lu errors %lu max-batch %u\n",
+             stp_pkt_tx_get_stats()->frames, stp_pkt_tx_get_stats()->flushes,
+             stp_pkt_tx_get_stats()->errors, stp_pkt_tx_get_stats()->max_batch);
+    if (stp_pkt_rx_ring_is_active())
+    {
+        stp_pkt_rx_ring_stats_t *ring = stp_pkt_rx_ring_get_stats();
+        STP_DUMP("Rx-ring : blocks %lu frames %lu drop-intf %lu drop-out %lu kernel-drops %lu\n",
+                 ring->blocks, ring->frames, ring->drop_intf, ring->drop_out, ring->kernel_drops);
+    }
+    STP_DUMP("SM      : rx-cfg %lu rx-tcn %lu cfg-update %lu root-sel %lu desig-sel %lu port-state-sel %lu\n",
+             stp_global.sm_stats.received_config_bpdu, stp_global.sm_stats.received_tcn_bpdu,
+             stp_global.sm_stats.configuration_update, stp_global.sm_stats.root_selection,
+             stp_global.sm_stats.designated_port_selection, stp_global.sm_stats.port_state_selection);
+    STP_DUMP("SM      : cfg-gen %lu tx-cfg %lu tc-detect %lu make-fwd %lu make-blk %lu sel-skip %lu\n",
+             stp_global.sm_stats.config_bpdu_generation, stp_global.sm_stats.transmit_config,
+             stp_global.sm_stats.topology_change_detection, stp_global.sm_stats.make_forwarding,
+             stp_global.sm_stats.make_blocking, stp_global.sm_stats.selection_skipped);
+    if (stp_global.fastage_stats.requests)
+        STP_DUMP("Fastage : requests %lu merged %lu vlans %lu batches %lu max-batch %u\n",
+                 stp_global.fastage_stats.requests, stp_global.fastage_stats.merged, stp_global.fastage_stats.vlans,
+                 stp_global.fastage_stats.batches, stp_global.fastage_stats.max_batch);
+    if (stp_worker_count())
+    {
+        stp_worker_stats_t *work = stp_worker_get_stats();
+        STP_DUMP("Workers : threads %u rounds %lu rx %lu ops %lu max-batch %u wait-us %lu replay-us %lu\n",
+                 stp_worker_count(), work->rounds, work->rx, work->ops, work->max_batch,
+                 work->wait_ns / 1000, work->replay_ns / 1000);
+        for (i = 0; i < stp_worker_count(); i++)
+            STP_DUMP("Worker %-2u: busy-us %lu\n", i, stp_worker_get_busy_ns(i) / 1000);
+    }
+    if (stp_pace_get_stats()->ports)
+    {
+        stp_pace_stats_t *pace = stp_pace_get_stats();
+        STP_DUMP("Tx-pace : pps %u burst %u immediate %lu deferred %lu merged %lu paced %lu stale %lu late %lu\n",
+                 pace->pps, pace->burst, pace->immediate, pace->deferred, pace->merged, pace->paced, pace->stale,
+                 pace->late);
+        STP_DUMP("Tx-pace : queued %u max-queue %u delay-ms avg %lu max %u ports %u\n", pace->queued,
+                 pace->max_queued, pace->paced ? pace->delay_ms / pace->paced : 0, pace->max_delay_ms, pace->ports);
+    }
+    if (stp_capture_get_stats()->frames)
+    {
+        stp_capture_stats_t *cap = stp_capture_get_stats();
+        STP_DUMP("BPDU capture : frames %lu overwritten %lu ports %u\n", cap->frames, cap->overwrites, cap->ports);
+    }
+    if (applog_async_get_stats()->slots)
+    {
+        applog_async_stats_t *log = applog_async_get_stats();
+        STP_DUMP("Log : slots %u queued %lu deferred %lu emitted %lu dropped %lu sync %lu truncated %lu max-depth %lu wakeups %lu\n",
+                 log->slots, log->queued, log->deferred, log->emitted, log->dropped, log->sync, log->truncated, log->max_depth,
+                 log->wakeups);
+    }
+    if (stp_snapshot_enabled())
+    {
+        stp_snapshot_stats_t *snap = stp_snapshot_get_stats();
+        STP_DUMP("Snapshot : saves %lu size %u save-us %lu restored inst %u ports %u dropped %u reconciled %u"
+                 " capped %u swept %u held %u\n",
+                 snap->saves, snap->last_size, snap->save_us, snap->restored_classes, snap->restored_ports,
+                 snap->dropped_ports, snap->reconciled_ports, snap->capped_ages, snap->swept_classes,
+                 snap->restored_held);
+    }
+    if (stp_export_get_stats())
+    {
+        stp_export_stats_t *exp = stp_export_get_stats();
+        STP_DUMP("Export : publishes %lu size %u publish-us %lu\n", exp->publishes, exp->last_size, exp->publish_us);
+    }
+
+    if (g_stpd_startup.at_us[STPD_STARTUP_BEGIN])
+    {
+        STP_DUMP("Startup : ");
+        for (i = STPD_STARTUP_APPDB; i < STPD_STARTUP_MAX; i++)
+        {
+            if (g_stpd_startup.at_us[i])
+                STP_DUMP("%s %lu ", stpd_startup_phase_name(i),
+                         (g_stpd_startup.at_us[i] - g_stpd_startup.at_us[STPD_STARTUP_BEGIN]) / 1000);
+            else
+                STP_DUMP("%s - ", stpd_startup_phase_name(i));
+        }
+        STP_DUMP("ms, interfaces %u speed-lookups %u\n", g_stpd_startup.intf_count, g_stpd_startup.speed_lookups);
+    }
+
+    if (stp_bpf_guard_active())
+        stp_bpf_guard_sync_stats();
 
     STP_DUMP("\n");
-    STP_DUMP("-----------------------------------------\n");
-    STP_DUMP(" Port |   Rx   |   Tx   | Rx-Err | Tx-Err \n");
-    STP_DUMP("-----------------------------------------\n");
+    STP_DUMP("--------------------------------------------------\n");
+    STP_DUMP(" Port |   Rx   |   Tx   | Rx-Err | Tx-Err | Storm  \n");
+    STP_DUMP("--------------------------------------------------\n");
     for (i = 0; i < g_max_stp_port; i++)
     {
-        if (STPD_GET_PKT_COUNT(i, pkt_rx) || STPD_GET_PKT_COUNT(i, pkt_tx) || STPD_GET_PKT_COUNT(i, pkt_rx_err_trunc) || STPD_GET_PKT_COUNT(i, pkt_rx_err) || STPD_GET_PKT_COUNT(i, pkt_tx_err))
+        if (STPD_GET_PKT_COUNT(i, pkt_rx) || STPD_GET_PKT_COUNT(i, pkt_tx) || STPD_GET_PKT_COUNT(i, pkt_rx_err_trunc) || STPD_GET_PKT_COUNT(i, pkt_rx_err) || STPD_GET_PKT_COUNT(i, pkt_tx_err) || STPD_GET_PKT_COUNT(i, pkt_rx_storm_drop))
         {
-            STP_DUMP("%4u  | %6lu | %6lu | %6lu | %6lu \n", i, STPD_GET_PKT_COUNT(i, pkt_rx), STPD_GET_PKT_COUNT(i, pkt_tx), STPD_GET_PKT_COUNT(i, pkt_rx_err) + STPD_GET_PKT_COUNT(i, pkt_rx_err_trunc), STPD_GET_PKT_COUNT(i, pkt_tx_err));
+            STP_DUMP("%4u  | %6lu | %6lu | %6lu | %6lu | %6lu \n", i, STPD_GET_PKT_COUNT(i, pkt_rx), STPD_GET_PKT_COUNT(i, pkt_tx), STPD_GET_PKT_COUNT(i, pkt_rx_err) + STPD_GET_PKT_COUNT(i, pkt_rx_err_trunc), STPD_GET_PKT_COUNT(i, pkt_tx_err), STPD_GET_PKT_COUNT(i, pkt_rx_storm_drop));
         }
     }
 }
@@ -210,10 +344,10 @@ void stpdm_global()
         stp_global.tick_id,
         stp_global.fast_span,
         stp_global.class_array,
-        &stp_global.config_bpdu,
-        &stp_global.tcn_bpdu,
-        &stp_global.pvst_config_bpdu,
-        &stp_global.pvst_tcn_bpdu,
+        &stp_global.tmpl.config_bpdu,
+        &stp_global.tmpl.tcn_bpdu,
+        &stp_global.tmpl.pvst_config_bpdu,
+        &stp_global.tmpl.pvst_tcn_bpdu,
         enable_string,
         enable_admin_string,
         protect_string,
@@ -283,10 +417,10 @@ int stpdm_global_wbos(char* buffer, size_t buffer_size)
                           stp_global.tick_id,
                           stp_global.fast_span,
                           stp_global.class_array,
-                          &stp_global.config_bpdu,
-                          &stp_global.tcn_bpdu,
-                          &stp_global.pvst_config_bpdu,
-                          &stp_global.pvst_tcn_bpdu,
+                          &stp_global.tmpl.config_bpdu,
+                          &stp_global.tmpl.tcn_bpdu,
+                          &stp_global.tmpl.pvst_config_bpdu,
+                          &stp_global.tmpl.pvst_tcn_bpdu,
                           stp_global.stp_drop_count,
                           stp_global.tcn_drop_count,
                           g_max_stp_port,
@@ -444,6 +578,359 @@ int stpdm_global_wbos(char* buffer, size_t buffer_size)
     return -2;
 }
 
+/* Состояние кодировщика двоичного статуса WBOS */
+typedef struct
+{
+    STPD_CONTEXT* ctx;
+    uint8_t* buf;
+    size_t size;
+    size_t len;
+    uint16_t frag_idx;
+    uint32_t seq;
+    int err;
+} STP_WBOS_ENC;
+
+static void stpdm_wbos_frame_start(STP_WBOS_ENC* enc)
+{
+    enc->len = sizeof(STP_WBOS_FRAME_HDR);
+}
+
+static void stpdm_wbos_frame_send(STP_WBOS_ENC* enc, uint8_t flags)
+{
+    STP_WBOS_FRAME_HDR* hdr = (STP_WBOS_FRAME_HDR*)enc->buf;
+
+    memcpy(hdr->magic, STP_WBOS_MAGIC, STP_WBOS_MAGIC_LEN);
+    hdr->version = enc->ctx->wbos_version;
+    hdr->flags = flags;
+    hdr->frag_idx = htons(enc->frag_idx);
+    hdr->seq = htonl(enc->seq);
+    hdr->payload_len = htonl(enc->len - sizeof(STP_WBOS_FRAME_HDR));
+
+    if (enc->ctx->send_resp_ipc_packet(enc->ctx, (char*)enc->buf, enc->len) != 0)
+        enc->err = -1;
+
+    enc->frag_idx++;
+    stpdm_wbos_frame_start(enc);
+}
+
+/* резервирует TLV в текущей датаграмме, отправляя её, если TLV не помещается */
+static void* stpdm_wbos_tlv(STP_WBOS_ENC* enc, uint16_t type, uint16_t len)
+{
+    STP_WBOS_TLV* tlv;
+
+    if (sizeof(STP_WBOS_FRAME_HDR) + sizeof(STP_WBOS_TLV) + len > enc->size)
+    {
+        enc->err = -1;
+        return NULL;
+    }
+
+    if (enc->len + sizeof(STP_WBOS_TLV) + len > enc->size)
+        stpdm_wbos_frame_send(enc, 0);
+
+    tlv = (STP_WBOS_TLV*)(enc->buf + enc->len);
+    tlv->type = htons(type);
+    tlv->len = htons(len);
+    memset(tlv->value, 0, len);
+    enc->len += sizeof(STP_WBOS_TLV) + len;
+
+    return tlv->value;
+}
+
+static void stpdm_wbos_bridge_id(STP_WBOS_BRIDGE_ID* dst, BRIDGE_IDENTIFIER* src)
+{
+    MAC_ADDRESS mac;
+
+    dst->prio_sysid = htons((uint16_t)((src->priority << 12) | src->system_id));
+    HOST_TO_NET_MAC(&mac, &src->address);
+    memcpy(dst->mac, &mac, sizeof(dst->mac));
+}
+
+static void stpdm_wbos_mask(STP_WBOS_ENC* enc, uint8_t mask_id, BITMAP_T* mask)
+{
+    STP_WBOS_MASK_TLV* tlv;
+    uint16_t i;
+
+    if (mask == NULL)
+        return;
+
+    tlv = stpdm_wbos_tlv(enc, STP_WBOS_TLV_MASK, sizeof(STP_WBOS_MASK_TLV) + mask->size * sizeof(uint32_t));
+    if (tlv == NULL)
+        return;
+
+    tlv->mask_id = mask_id;
+    tlv->nbits = htons(mask->nbits);
+    for (i = 0; i < mask->size; i++)
+        tlv->words[i] = htonl(mask->arr[i]);
+}
+
+static void stpdm_wbos_class(STP_WBOS_ENC* enc, STP_CLASS* stp_class)
+{
+    STP_WBOS_CLASS_TLV* tlv;
+    BRIDGE_DATA* br = &stp_class->bridge_info;
+
+    tlv = stpdm_wbos_tlv(enc, STP_WBOS_TLV_CLASS, sizeof(STP_WBOS_CLASS_TLV));
+    if (tlv == NULL)
+        return;
+
+    tlv->index = htons(GET_STP_INDEX(stp_class));
+    tlv->vlan_id = htons(stp_class->vlan_id);
+    tlv->state = stp_class->state;
+    tlv->flags = (br->topology_change ? STP_WBOS_CLASS_F_TOPO_CHANGE : 0) |
+                 (br->topology_change_detected ? STP_WBOS_CLASS_F_TOPO_CHANGE_DETECTED : 0) |
+                 (stp_class->fast_aging ? STP_WBOS_CLASS_F_FAST_AGING : 0);
+    tlv->max_age = br->max_age;
+    tlv->hello_time = br->hello_time;
+    tlv->forward_delay = br->forward_delay;
+    tlv->bridge_max_age = br->bridge_max_age;
+    tlv->bridge_hello_time = br->bridge_hello_time;
+    tlv->bridge_forward_delay = br->bridge_forward_delay;
+    tlv->hold_time = br->hold_time;
+    tlv->topology_change_time = br->topology_change_time;
+    stpdm_wbos_bridge_id(&tlv->bridge_id, &br->bridge_id);
+    stpdm_wbos_bridge_id(&tlv->root_id, &br->root_id);
+    tlv->root_path_cost = htonl(br->root_path_cost);
+    tlv->root_port = htonl(br->root_port);
+    tlv->topology_change_count = htonl(br->topology_change_count);
+    tlv->topology_change_tick = htonl(br->topology_change_tick);
+    tlv->rx_drop_bpdu = htonl(stp_class->rx_drop_bpdu);
+}
+
+static void stpdm_wbos_port(STP_WBOS_ENC* enc, STP_CLASS* stp_class, PORT_ID port_number)
+{
+    STP_WBOS_PORT_TLV* tlv;
+    STP_PORT_CLASS* stp_port;
+
+    tlv = stpdm_wbos_tlv(enc, STP_WBOS_TLV_PORT, sizeof(STP_WBOS_PORT_TLV));
+    if (tlv == NULL)
+        return;
+
+    tlv->index = htons(GET_STP_INDEX(stp_class));
+    tlv->port_number = htons(port_number);
+
+    // порт удалён из экземпляра после предыдущей отправки
+    if (stp_class->state == STP_CLASS_FREE || !is_member(stp_class->control_mask, port_number))
+    {
+        tlv->flags = STP_WBOS_PORT_F_REMOVED;
+        return;
+    }
+
+    stp_port = GET_STP_PORT_CLASS(stp_class, port_number);
+    if (stp_port == NULL)
+        return;
+
+    tlv->state = stp_port->state;
+    tlv->priority = stp_port->port_id.priority;
+    tlv->flags = (stp_port->self_loop ? STP_WBOS_PORT_F_SELF_LOOP : 0) |
+                 (stp_port->operEdge ? STP_WBOS_PORT_F_OPER_EDGE : 0) |
+                 (is_member(stp_class->enable_mask, port_number) ? STP_WBOS_PORT_F_ENABLED : 0);
+    tlv->kernel_state = stp_port->kernel_state;
+    tlv->path_cost = htonl(stp_port->path_cost);
+    tlv->designated_cost = htonl(stp_port->designated_cost);
+    stpdm_wbos_bridge_id(&tlv->designated_root, &stp_port->designated_root);
+    stpdm_wbos_bridge_id(&tlv->designated_bridge, &stp_port->designated_bridge);
+    tlv->designated_port = htons((uint16_t)((stp_port->designated_port.priority << 12) | stp_port->designated_port.number));
+    tlv->forward_transitions = htonl(stp_port->forward_transitions);
+    tlv->rx_config_bpdu = htonl(stp_port->rx_config_bpdu);
+    tlv->tx_config_bpdu = htonl(stp_port->tx_config_bpdu);
+    tlv->rx_tcn_bpdu = htonl(stp_port->rx_tcn_bpdu);
+    tlv->tx_tcn_bpdu = htonl(stp_port->tx_tcn_bpdu);
+    tlv->rx_drop_bpdu = htonl(stp_port->rx_drop_bpdu);
+}
+
+static void stpdm_wbos_libev_prof(STP_WBOS_ENC* enc)
+{
+    STP_WBOS_LIBEV_PROF_TLV* tlv;
+    STPD_LIBEV_PROF* prof;
+    uint8_t i;
+
+    for (i = 0; i < g_stpd_libev_prof_count; i++)
+    {
+        prof = &g_stpd_libev_prof[i];
+        tlv = stpdm_wbos_tlv(enc, STP_WBOS_TLV_LIBEV_PROF, sizeof(STP_WBOS_LIBEV_PROF_TLV));
+        if (tlv == NULL)
+            return;
+
+        strncpy(tlv->name, prof->name, sizeof(tlv->name));
+        tlv->calls = htobe64(prof->run.count);
+        tlv->run_avg = htonl(prof->run.count ? prof->run.total_us / prof->run.count : 0);
+        tlv->run_p50 = htonl(stpd_lat_hist_percentile(&prof->run, 500));
+        tlv->run_p99 = htonl(stpd_lat_hist_percentile(&prof->run, 990));
+        tlv->run_p999 = htonl(stpd_lat_hist_percentile(&prof->run, 999));
+        tlv->run_max = htonl(prof->run.max_us);
+        tlv->interval = htonl(prof->interval_us);
+        tlv->lag_p50 = htonl(stpd_lat_hist_percentile(&prof->lag, 500));
+        tlv->lag_p99 = htonl(stpd_lat_hist_percentile(&prof->lag, 990));
+        tlv->lag_max = htonl(prof->lag.max_us);
+    }
+}
+
+static int stpdm_wbos_begin(STP_WBOS_ENC* enc, STPD_CONTEXT* ctx, uint8_t* buffer, size_t buffer_size)
+{
+    if (ctx == NULL || buffer == NULL || buffer_size <= sizeof(STP_WBOS_FRAME_HDR))
+        return -1;
+
+    memset(enc, 0, sizeof(*enc));
+    enc->ctx = ctx;
+    enc->buf = buffer;
+    enc->size = buffer_size;
+    enc->seq = ++ctx->wbos_seq;
+    stpdm_wbos_frame_start(enc);
+
+    return 0;
+}
+
+static void stpdm_wbos_global(STP_WBOS_ENC* enc)
+{
+    STP_WBOS_GLOBAL_TLV* glob;
+
+    glob = stpdm_wbos_tlv(enc, STP_WBOS_TLV_GLOBAL, sizeof(STP_WBOS_GLOBAL_TLV));
+    if (glob == NULL)
+        return;
+
+    glob->max_instances = htons(stp_global.max_instances);
+    glob->active_instances = htons(stp_global.active_instances);
+    glob->max_port = htons(g_max_stp_port);
+    glob->root_protect_timeout = htons(stp_global.root_protect_timeout);
+    glob->tick_id = stp_global.tick_id;
+    glob->flags = (stp_global.fast_span ? STP_WBOS_GLOBAL_F_FAST_SPAN : 0) |
+                  (stp_global.enable ? STP_WBOS_GLOBAL_F_ENABLE : 0) |
+                  (stp_global.sstp_enabled ? STP_WBOS_GLOBAL_F_SSTP : 0) |
+                  (stp_global.pvst_protect_do_disable ? STP_WBOS_GLOBAL_F_PVST_PROTECT_DISABLE : 0);
+    glob->proto_mode = stp_global.proto_mode;
+    glob->stp_drop_count = htonl(stp_global.stp_drop_count);
+    glob->tcn_drop_count = htonl(stp_global.tcn_drop_count);
+    glob->pvst_drop_count = htonl(stp_global.pvst_drop_count);
+}
+
+/**
+ * @brief Отправляет в WBOS полный снимок состояния stpd в двоичном виде.
+ *
+ * Снимок кодируется TLV (см. STP_WBOS_FRAME_HDR в stp_ipc.h) и при нехватке
+ * места разбивается на несколько датаграмм, так что состояние передаётся
+ * целиком при любом количестве экземпляров. Накопленные для дельты
+ * изменения сбрасываются.
+ *
+ * @param ctx Контекст stpd, через который отправляются датаграммы.
+ * @param buffer Буфер для одной датаграммы.
+ * @param buffer_size Размер буфера.
+ * @return int 0 при успехе, <0 -> error
+ */
+int stpdm_global_wbos_bin(STPD_CONTEXT* ctx, uint8_t* buffer, size_t buffer_size)
+{
+    STP_WBOS_ENC enc;
+    STP_CLASS* stp_class;
+    PORT_MASK_ITER it;
+    PORT_ID port_number;
+    UINT16 i;
+
+    if (stpdm_wbos_begin(&enc, ctx, buffer, buffer_size) != 0)
+        return -1;
+
+    stpdm_wbos_global(&enc);
+
+    stpdm_wbos_mask(&enc, STP_WBOS_MASK_ENABLE, g_stp_enable_mask);
+    stpdm_wbos_mask(&enc, STP_WBOS_MASK_ENABLE_ADMIN, g_stp_enable_config_mask);
+    stpdm_wbos_mask(&enc, STP_WBOS_MASK_PROTECT, stp_global.protect_mask);
+    stpdm_wbos_mask(&enc, STP_WBOS_MASK_PROTECT_DO_DISABLE, stp_global.protect_do_disable_mask);
+    stpdm_wbos_mask(&enc, STP_WBOS_MASK_PROTECT_DISABLED, stp_global.protect_disabled_mask);
+    stpdm_wbos_mask(&enc, STP_WBOS_MASK_ROOT_PROTECT, stp_global.root_protect_mask);
+    stpdm_wbos_mask(&enc, STP_WBOS_MASK_FASTSPAN, g_fastspan_mask);
+    stpdm_wbos_mask(&enc, STP_WBOS_MASK_FASTSPAN_ADMIN, g_fastspan_config_mask);
+    stpdm_wbos_mask(&enc, STP_WBOS_MASK_FASTUPLINK_ADMIN, g_fastuplink_mask);
+    stpdm_wbos_libev_prof(&enc);
+
+    for (i = 0; g_stp_class_array && i < g_stp_instances; i++)
+    {
+        stp_class = GET_STP_CLASS(i);
+        clear_mask(stp_class->wbos_port_mask);
+        if (stp_class->state == STP_CLASS_FREE)
+            continue;
+
+        stpdm_wbos_class(&enc, stp_class);
+        PORT_MASK_FOR_EACH_PORT(stp_class->control_mask, it, port_number)
+        {
+            stpdm_wbos_port(&enc, stp_class, port_number);
+        }
+    }
+    if (g_stp_wbos_class_mask)
+        bmp_reset_all(g_stp_wbos_class_mask);
+
+    stpdm_wbos_frame_send(&enc, STP_WBOS_FRAME_F_LAST);
+
+    return enc.err;
+}
+
+/**
+ * @brief Отправляет в WBOS только изменения с предыдущей отправки.
+ *
+ * В дельту попадают экземпляры и порты, чьи поля для APP DB менялись или
+ * которые были добавлены/удалены (экземпляр со state FREE или порт с
+ * STP_WBOS_PORT_F_REMOVED). Датаграммы помечены STP_WBOS_FRAME_F_DELTA и
+ * нумеруются общим с полными снимками seq: пропуск номера означает потерю,
+ * и потребитель должен дождаться полного снимка или запросить его
+ * повторным STP_WBOS_STATUS_MODE.
+ *
+ * @param ctx Контекст stpd, через который отправляются датаграммы.
+ * @param buffer Буфер для одной датаграммы.
+ * @param buffer_size Размер буфера.
+ * @return int 1 если дельта отправлена, 0 если изменений нет, <0 -> error
+ */
+int stpdm_global_wbos_delta(STPD_CONTEXT* ctx, uint8_t* buffer, size_t buffer_size)
+{
+    STP_WBOS_ENC enc;
+    STP_CLASS* stp_class;
+    BMP_ITER_T cit;
+    PORT_MASK_ITER it;
+    BMP_ID index;
+    PORT_ID port_number;
+
+    if (g_stp_wbos_class_mask == NULL || !bmp_isset_any(g_stp_wbos_class_mask))
+        return 0;
+
+    if (stpdm_wbos_begin(&enc, ctx, buffer, buffer_size) != 0)
+        return -1;
+
+    stpdm_wbos_global(&enc);
+
+    BMP_FOR_EACH_SET_BIT(g_stp_wbos_class_mask, cit, index)
+    {
+        bmp_reset(g_stp_wbos_class_mask, index);
+        if (index >= g_stp_instances)
+            continue;
+
+        stp_class = GET_STP_CLASS(index);
+        stpdm_wbos_class(&enc, stp_class);
+        PORT_MASK_FOR_EACH_PORT(stp_class->wbos_port_mask, it, port_number)
+        {
+            clear_mask_bit(stp_class->wbos_port_mask, port_number);
+            stpdm_wbos_port(&enc, stp_class, port_number);
+        }
+    }
+
+    stpdm_wbos_frame_send(&enc, STP_WBOS_FRAME_F_LAST | STP_WBOS_FRAME_F_DELTA);
+
+    return (enc.err < 0) ? enc.err : 1;
+}
+
+/**
+ * @brief Вызывается из 100мс таймера, отправляет дельту статуса раз в STPD_WBOS_DELTA_TICKS.
+ *
+ * @param ctx Контекст stpd.
+ * @return void
+ */
+void stpdm_wbos_delta_tick(STPD_CONTEXT* ctx)
+{
+    if (ctx->wbos_format != STP_WBOS_FORMAT_DELTA)
+        return;
+
+    if (++ctx->wbos_delta_ticks < STPD_WBOS_DELTA_TICKS)
+        return;
+    ctx->wbos_delta_ticks = 0;
+
+    if (stpdm_global_wbos_delta(ctx, ctx->buf_to_wbos, STP_WBOS_FRAME_MAX) < 0)
+        STP_LOG_ERR("stpdm_global_wbos_delta processing error, sending");
+}
+
 /**
  * @brief Выводит данные о заданной структуре класса STP.
  *
@@ -484,11 +971,17 @@ void stpdm_class(STP_CLASS* stp_class)
              s2,
              s3,
              STP_TIMER_STRING(&stp_class->hello_timer),
-             stp_class->hello_timer.value,
+             timer_elapsed(&stp_class->hello_timer),
              STP_TIMER_STRING(&stp_class->tcn_timer),
-             stp_class->tcn_timer.value,
+             timer_elapsed(&stp_class->tcn_timer),
              STP_TIMER_STRING(&stp_class->topology_change_timer),
-             stp_class->topology_change_timer.value);
+             timer_elapsed(&stp_class->topology_change_timer));
+
+    if (stp_class->group_vlan_count)
+    {
+        mask_to_string(stp_class->group_vlan_mask, s1, 256);
+        STP_DUMP("group_vlans           = %u (%s)\n\t", stp_class->group_vlan_count, s1);
+    }
 
     stputil_bridge_to_string(&stp_class->bridge_info.root_id, s1, 256);
     stputil_bridge_to_string(&stp_class->bridge_info.bridge_id, s2, 256);
@@ -540,6 +1033,8 @@ void stpdm_port_class(STP_CLASS* stp_class, PORT_ID port_number)
     UINT8 s1[50], s2[50];
 
     stp_port = GET_STP_PORT_CLASS(stp_class, port_number);
+    if (stp_port == NULL)
+        return;
     STP_DUMP("PORT CLASS - VLAN %u PORT %u(%s)\n", stp_class->vlan_id, port_number, stp_intf_get_port_name(port_number));
     STP_DUMP("==================================\n");
 
@@ -583,13 +1078,13 @@ void stpdm_port_class(STP_CLASS* stp_class, PORT_ID port_number)
              stp_port->self_loop,
              stp_port->auto_config,
              STP_TIMER_STRING(&stp_port->message_age_timer),
-             stp_port->message_age_timer.value,
+             timer_elapsed(&stp_port->message_age_timer),
              STP_TIMER_STRING(&stp_port->forward_delay_timer),
-             stp_port->forward_delay_timer.value,
+             timer_elapsed(&stp_port->forward_delay_timer),
              STP_TIMER_STRING(&stp_port->hold_timer),
-             stp_port->hold_timer.value,
+             timer_elapsed(&stp_port->hold_timer),
              STP_TIMER_STRING(&stp_port->root_protect_timer),
-             stp_port->root_protect_timer.value,
+             timer_elapsed(&stp_port->root_protect_timer),
              stp_port->forward_transitions,
              stp_port->rx_config_bpdu,
              stp_port->tx_config_bpdu,
@@ -736,6 +1231,357 @@ void stp_debug_global_enable_vlan(uint16_t vlan_id, uint8_t flag)
     }
 }
 
+/**
+ * @brief Выводит правила и счётчики storm guard (stpctl stormstats).
+ *
+ * @return void
+ */
+static void stpdbg_dump_storm_guard()
+{
+    STP_BPF_KEY key;
+    STP_BPF_RULE rule;
+    STP_BPF_BUCKET bucket;
+    INTERFACE_NODE* node;
+    bool first = true;
+
+    if (!stp_bpf_guard_active())
+    {
+        STP_DUMP("BPDU storm guard not configured\n");
+        return;
+    }
+
+    STP_DUMP("Rules : %u\n", stp_bpf_guard_rule_count());
+    STP_DUMP("  Interface        | Vlan | pps    | burst\n");
+    while (stp_bpf_guard_next_rule(&key, first, &rule))
+    {
+        first = false;
+        node = stp_intf_get_node_by_kif_index(key.kif_index);
+        if (key.vlan_id == STP_BPF_VLAN_ANY)
+            STP_DUMP("  %-16s | all  | %6u | %u\n", node ? node->ifname : (key.kif_index == STP_BPF_PORT_ALL ? "all" : "-"), rule.pps, rule.burst);
+        else
+            STP_DUMP("  %-16s | %4u | %6u | %u\n", node ? node->ifname : (key.kif_index == STP_BPF_PORT_ALL ? "all" : "-"), key.vlan_id, rule.pps, rule.burst);
+    }
+
+    STP_DUMP("\n  Interface        | Vlan | Passed     | Dropped\n");
+    first = true;
+    while (stp_bpf_guard_next_bucket(&key, first, &bucket))
+    {
+        first = false;
+        node = stp_intf_get_node_by_kif_index(key.kif_index);
+        STP_DUMP("  %-16s | %4u | %10lu | %lu\n", node ? node->ifname : "-", key.vlan_id, bucket.passed, bucket.dropped);
+    }
+
+    stp_bpf_guard_sync_stats();
+}
+
+/**
+ * @brief Выводит захваченные BPDU или сохраняет их в pcap (stpctl bpducap/bpdupcap).
+ *
+ * @param pmsg Сообщение с фильтром: intf_name (пусто - все порты) и vlan_id (0 - все VLAN).
+ * @return void
+ */
+static void stpdbg_bpdu_capture(STP_CTL_MSG* pmsg)
+{
+    STP_CAPTURE_REC** recs;
+    stp_capture_stats_t* stats = stp_capture_get_stats();
+    uint32_t port_id = BAD_PORT_ID;
+    VLAN_ID vlan_id = pmsg->vlan_id ? pmsg->vlan_id : VLAN_ID_INVALID;
+    char line[256];
+    int count, i;
+
+    if (pmsg->intf_name[0] != '\0')
+    {
+        port_id = stp_intf_get_port_id_by_name(pmsg->intf_name);
+        if (port_id == BAD_PORT_ID)
+        {
+            STP_DUMP("unknown interface %s\n", pmsg->intf_name);
+            return;
+        }
+    }
+
+    if (pmsg->cmd_type == STP_CTL_PCAP_BPDU_CAPTURE)
+    {
+        count = stp_capture_pcap_write(STP_CAPTURE_PCAP_FILE, port_id, vlan_id);
+        if (count < 0)
+            STP_DUMP("pcap write failed\n");
+        else
+            STP_DUMP("%d BPDUs written to %s\n", count, STP_CAPTURE_PCAP_FILE);
+        return;
+    }
+
+    count = stp_capture_select(port_id, vlan_id, &recs);
+    if (count < 0)
+    {
+        STP_DUMP("no memory\n");
+        return;
+    }
+
+    STP_DUMP("BPDU capture : frames %lu overwritten %lu ports %u, %d matching\n",
+             stats->frames, stats->overwrites, stats->ports, count);
+    for (i = 0; i < count; i++)
+    {
+        stp_capture_decode(recs[i], line, sizeof(line));
+        STP_DUMP("%s\n", line);
+    }
+    free(recs);
+}
+
+/**
+ * @brief Применяет команду stormguard.
+ *
+ * BPDU Port-channel приходят на его участники, поэтому правило для
+ * Port-channel ставится на его участники и следует за составом.
+ *
+ * @param pmsg Сообщение STP_CTL_SET_STORM_GUARD.
+ * @return void
+ */
+static void stpdbg_storm_guard_set(STP_CTL_MSG* pmsg)
+{
+    INTERFACE_NODE* node;
+    int count;
+
+    if (pmsg->intf_name[0] == '\0')
+    {
+        if (stp_bpf_guard_set(STP_BPF_PORT_ALL, pmsg->vlan_id, pmsg->storm.pps, pmsg->storm.burst) == -1)
+            STP_DUMP("storm guard update failed\n");
+        else
+            STP_DUMP("storm guard all vlan %d pps %u\n", pmsg->vlan_id, pmsg->storm.pps);
+        return;
+    }
+
+    node = stp_intf_get_node_by_name(pmsg->intf_name);
+    if (!node)
+    {
+        STP_DUMP("unknown interface %s\n", pmsg->intf_name);
+        return;
+    }
+
+    if (!STP_IS_PO_PORT(pmsg->intf_name))
+    {
+        if (stp_bpf_guard_set(node->kif_index, pmsg->vlan_id, pmsg->storm.pps, pmsg->storm.burst) == -1)
+            STP_DUMP("storm guard update failed\n");
+        else
+            STP_DUMP("storm guard %s vlan %d pps %u\n", pmsg->intf_name, pmsg->vlan_id, pmsg->storm.pps);
+        return;
+    }
+
+    count = stp_bpf_guard_set_master(node->kif_index, pmsg->vlan_id, pmsg->storm.pps, pmsg->storm.burst);
+    if (count == -1)
+        STP_DUMP("storm guard update failed\n");
+    else
+        STP_DUMP("storm guard %s vlan %d pps %u on %d members\n", pmsg->intf_name, pmsg->vlan_id, pmsg->storm.pps,
+                 count);
+}
+
+// STP_CTL_STREAM_CLASS cursor: instance index and 0 for its header or port number + 1
+#define STPDBG_CURSOR(index, slot) (((uint32_t)(index) << 16) | (slot))
+
+/**
+ * @struct STPDBG_PAGE
+ * @brief Страница постраничного вывода, формируется в dbgfp (open_memstream)
+ */
+typedef struct
+{
+    long start;       // Позиция начала текущей записи
+    uint32_t len;     // Длина текста страницы
+    uint32_t records; // Записей на странице
+} STPDBG_PAGE;
+
+/**
+ * @brief Отмечает начало записи страницы.
+ */
+static void stpdbg_page_begin(STPDBG_PAGE* page)
+{
+    page->start = ftell(dbgfp);
+}
+
+/**
+ * @brief Завершает запись страницы.
+ *
+ * Запись, не поместившаяся в STP_CTL_PAGE_SIZE, отбрасывается и выводится на
+ * следующей странице; первая запись страницы остаётся в любом случае.
+ *
+ * @return `false`, если страница заполнена.
+ */
+static bool stpdbg_page_end(STPDBG_PAGE* page)
+{
+    long pos = ftell(dbgfp);
+
+    if (page->records && pos > STP_CTL_PAGE_SIZE)
+    {
+        page->len = page->start;
+        return false;
+    }
+    page->len = pos;
+    page->records++;
+    return true;
+}
+
+/**
+ * @brief Формирует страницу STP_CTL_STREAM_CLASS: экземпляры и их порты.
+ *
+ * Экземпляры выбираются по диапазону VLAN. Если задан порт или состояние,
+ * выводятся только подходящие порты, а заголовок экземпляра - вместе с
+ * первым из них.
+ *
+ * @return Курсор следующей страницы или STP_CTL_CURSOR_END.
+ */
+static uint32_t stpdbg_stream_class(STP_CTL_MSG* pmsg, STPDBG_PAGE* page)
+{
+    STP_CTL_STREAM_OPT* opt = &pmsg->stream;
+    STP_CLASS* stp_class;
+    STP_PORT_CLASS* stp_port;
+    PORT_ID filter_port = BAD_PORT_ID;
+    PORT_ID port_number;
+    uint32_t index = opt->cursor >> 16;
+    uint32_t slot = opt->cursor & 0xffff;
+    uint16_t vlan_lo = opt->vlan_lo ? opt->vlan_lo : 1;
+    uint16_t vlan_hi = opt->vlan_hi ? opt->vlan_hi : MAX_VLAN_ID;
+    bool filtered, header;
+
+    if (pmsg->intf_name[0] != '\0')
+    {
+        filter_port = stp_intf_get_port_id_by_name(pmsg->intf_name);
+        if (filter_port == BAD_PORT_ID)
+        {
+            STP_DUMP("Interface : %s not Found\n", pmsg->intf_name);
+            page->len = ftell(dbgfp);
+            return STP_CTL_CURSOR_END;
+        }
+    }
+    filtered = filter_port != BAD_PORT_ID || opt->state != STP_CTL_STATE_ANY;
+
+    for (; g_stp_class_array && index < g_stp_instances; index++, slot = 0)
+    {
+        stp_class = GET_STP_CLASS(index);
+        if (stp_class->state == STP_CLASS_FREE || stp_class->vlan_id < vlan_lo || stp_class->vlan_id > vlan_hi)
+            continue;
+
+        header = (slot == 0);
+        if (header && !filtered)
+        {
+            stpdbg_page_begin(page);
+            stpdm_class(stp_class);
+            if (!stpdbg_page_end(page))
+                return STPDBG_CURSOR(index, 0);
+            header = false;
+        }
+
+        port_number = slot ? slot - 1 : 0;
+        if (filter_port != BAD_PORT_ID)
+        {
+            if (port_number > filter_port)
+                continue;
+            port_number = filter_port;
+        }
+
+        for (port_number = port_mask_get_next_port(stp_class->control_mask, (BMP_ID)port_number - 1);
+             port_number != BAD_PORT_ID && (filter_port == BAD_PORT_ID || port_number == filter_port);
+             port_number = port_mask_get_next_port(stp_class->control_mask, port_number))
+        {
+            stp_port = GET_STP_PORT_CLASS(stp_class, port_number);
+            if (stp_port == NULL || (opt->state != STP_CTL_STATE_ANY && stp_port->state != opt->state))
+                continue;
+
+            stpdbg_page_begin(page);
+            if (header)
+                stpdm_class(stp_class);
+            stpdm_port_class(stp_class, port_number);
+            if (!stpdbg_page_end(page))
+                return header ? STPDBG_CURSOR(index, 0) : STPDBG_CURSOR(index, port_number + 1);
+            header = false;
+        }
+    }
+    return STP_CTL_CURSOR_END;
+}
+
+/**
+ * @brief Формирует страницу STP_CTL_STREAM_NL_DB: интерфейсы в порядке имён.
+ *
+ * Курсор - количество уже пройденных интерфейсов, фильтр по имени задаётся
+ * в intf_name.
+ *
+ * @return Курсор следующей страницы или STP_CTL_CURSOR_END.
+ */
+static uint32_t stpdbg_stream_nl_db(STP_CTL_MSG* pmsg, STPDBG_PAGE* page)
+{
+    INTERFACE_NODE* node;
+    struct avl_traverser trav;
+    uint32_t pos = 0;
+
+    avl_t_init(&trav, g_stpd_intf_db);
+    while (NULL != (node = avl_t_next(&trav)))
+    {
+        if (pos++ < pmsg->stream.cursor)
+            continue;
+        if (pmsg->intf_name[0] != '\0' && strncmp(node->ifname, pmsg->intf_name, IFNAMSIZ) != 0)
+            continue;
+
+        stpdbg_page_begin(page);
+        stpdbg_dump_nl_db_node(node);
+        if (!stpdbg_page_end(page))
+            return pos - 1;
+    }
+    return STP_CTL_CURSOR_END;
+}
+
+/**
+ * @brief Формирует и отправляет одну страницу постраничного вывода.
+ *
+ * Страница пишется теми же функциями stpdm_*, что и дамп в файл, но в
+ * буфер в памяти, и отправляется на адрес клиента через сокет IPC.
+ *
+ * @param msg Сообщение STP_CTL_STREAM_*.
+ * @param addr Адрес клиента.
+ * @param addr_len Длина адреса.
+ *
+ * @return void
+ */
+void stpdbg_process_ctl_stream(void* msg, struct sockaddr* addr, socklen_t addr_len)
+{
+    STP_CTL_MSG* pmsg = (STP_CTL_MSG*)msg;
+    STP_CTL_PAGE_HDR hdr;
+    STPDBG_PAGE page = {0};
+    struct iovec iov[2];
+    struct msghdr mh;
+    char* buf = NULL;
+    size_t size = 0;
+    FILE* saved_fp = dbgfp;
+
+    dbgfp = open_memstream(&buf, &size);
+    if (!dbgfp)
+    {
+        STP_LOG_ERR("open_memstream failed %s", strerror(errno));
+        dbgfp = saved_fp;
+        return;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.cmd_type = pmsg->cmd_type;
+    hdr.cursor = pmsg->stream.cursor;
+    if (pmsg->cmd_type == STP_CTL_STREAM_CLASS)
+        hdr.next_cursor = stpdbg_stream_class(pmsg, &page);
+    else
+        hdr.next_cursor = stpdbg_stream_nl_db(pmsg, &page);
+    fclose(dbgfp);
+    dbgfp = saved_fp;
+
+    hdr.len = page.len;
+    hdr.records = page.records;
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = buf;
+    iov[1].iov_len = hdr.len;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_name = addr;
+    mh.msg_namelen = addr_len;
+    mh.msg_iov = iov;
+    mh.msg_iovlen = 2;
+    if (sendmsg(g_stpd_ipc_handle, &mh, 0) == -1)
+        STP_LOG_ERR("stream page send error %s", strerror(errno));
+    free(buf);
+}
+
 /**
  * @brief Обрабатывает управляющее сообщение, связанное с отладкой STP.
  *
@@ -811,7 +1657,8 @@ void stpdbg_process_ctl_msg(void* msg)
         for (i = 0; i < g_stp_instances; i++)
         {
             stp_class = GET_STP_CLASS(i);
-            if (stp_class->state != STP_CLASS_FREE && stp_class->vlan_id == vlan_id)
+            if (stp_class->state != STP_CLASS_FREE &&
+                (stp_class->vlan_id == vlan_id || STP_IS_GROUP_VLAN(stp_class, vlan_id)))
             {
                 stpdm_class(stp_class);
 
@@ -834,7 +1681,8 @@ void stpdbg_process_ctl_msg(void* msg)
         for (i = 0; i < g_stp_instances; i++)
         {
             stp_class = GET_STP_CLASS(i);
-            if (stp_class->state != STP_CLASS_FREE && stp_class->vlan_id == vlan_id)
+            if (stp_class->state != STP_CLASS_FREE &&
+                (stp_class->vlan_id == vlan_id || STP_IS_GROUP_VLAN(stp_class, vlan_id)))
                 stpdm_port_class(stp_class, port_id);
         }
 
@@ -912,6 +1760,45 @@ void stpdbg_process_ctl_msg(void* msg)
         stpdbg_dump_stp_stats();
         break;
     }
+    case STP_CTL_DUMP_LIBEV_PROF:
+    {
+        stpdbg_dump_libev_prof();
+        break;
+    }
+    case STP_CTL_CLEAR_LIBEV_PROF:
+    {
+        stpmgr_libevent_prof_clear();
+        STP_DUMP("Libevent profile cleared\n");
+        break;
+    }
+    case STP_CTL_SET_STORM_GUARD:
+    {
+        stpdbg_storm_guard_set(pmsg);
+        break;
+    }
+    case STP_CTL_DUMP_STORM_GUARD:
+    {
+        stpdbg_dump_storm_guard();
+        break;
+    }
+    case STP_CTL_SET_TX_PACE:
+    {
+        stp_pace_set(pmsg->storm.pps, pmsg->storm.burst);
+        STP_DUMP("tx pace pps %u burst %u\n", stp_pace_get_stats()->pps, stp_pace_get_stats()->burst);
+        break;
+    }
+    case STP_CTL_DUMP_BPDU_CAPTURE:
+    case STP_CTL_PCAP_BPDU_CAPTURE:
+    {
+        stpdbg_bpdu_capture(pmsg);
+        break;
+    }
+    case STP_CTL_CLEAR_BPDU_CAPTURE:
+    {
+        stp_capture_clear();
+        STP_DUMP("BPDU capture cleared\n");
+        break;
+    }
     case STP_CTL_CLEAR_ALL:
     {
         stpmgr_clear_statistics(VLAN_ID_INVALID, BAD_PORT_ID);
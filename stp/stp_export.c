@@ -0,0 +1,453 @@
+/**
+ * @file stp_export.c
+ * @brief Экспорт состояния STP в разделяемую память только для чтения.
+ *
+ * @details
+ * Данные пишутся прямо в отображение файла (MAP_SHARED) из таймера 100 мс
+ * в потоке демона: изменённое состояние (g_stp_snapshot_gen) публикуется не
+ * чаще STP_EXPORT_CHECK_TICKS, таймеры и счётчики обновляются каждые
+ * STP_EXPORT_FULL_TICKS. Читатели только отображают файл и в поток демона
+ * не обращаются. Файл только растёт, поэтому отображение читателя остаётся
+ * корректным, пока он не увидит больший size. Новый файл при запуске
+ * заменяет старый через rename(), а не усекается на месте.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "stp_inc.h"
+
+/**
+ * @struct stp_export_t
+ * @brief Контекст экспорта
+ */
+typedef struct
+{
+    int fd;                        // Файл экспорта, -1 - экспорт выключен
+    STP_EXPORT_HDR *hdr;           // Отображение файла
+    size_t map_size;               // Размер отображения
+    UINT32 published_gen;          // g_stp_snapshot_gen последней публикации
+    UINT32 ticks;                  // Тиков с последней проверки
+    UINT32 full_ticks;             // Тиков с последней публикации
+    stp_export_stats_t stats;      // Статистика
+} stp_export_t;
+
+static stp_export_t g_stp_export = {.fd = -1};
+
+/**
+ * @brief Текущее время CLOCK_MONOTONIC в микросекундах.
+ */
+static uint64_t stp_export_now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Отображает файл экспорта размером не меньше size.
+ *
+ * @return 0 при успехе, -1 при ошибке.
+ */
+static int stp_export_map(size_t size)
+{
+    void *addr;
+
+    if (g_stp_export.hdr && g_stp_export.map_size >= size)
+        return 0;
+
+    // grow by a quarter to avoid remapping on every added port
+    size += size / 4;
+    if (ftruncate(g_stp_export.fd, size) == -1)
+    {
+        STP_LOG_ERR("export ftruncate %zu failed %s", size, strerror(errno));
+        return -1;
+    }
+
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, g_stp_export.fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        STP_LOG_ERR("export mmap %zu failed %s", size, strerror(errno));
+        return -1;
+    }
+
+    // the old mapping already holds the previous seq, the new one shares the same pages
+    if (g_stp_export.hdr)
+        munmap(g_stp_export.hdr, g_stp_export.map_size);
+    g_stp_export.hdr = (STP_EXPORT_HDR *)addr;
+    g_stp_export.map_size = size;
+    return 0;
+}
+
+/**
+ * @brief Снимает отображение и закрывает файл экспорта.
+ */
+static void stp_export_release()
+{
+    if (g_stp_export.hdr)
+        munmap(g_stp_export.hdr, g_stp_export.map_size);
+    g_stp_export.hdr = NULL;
+    g_stp_export.map_size = 0;
+    close(g_stp_export.fd);
+    g_stp_export.fd = -1;
+}
+
+/**
+ * @brief Создаёт файл экспорта.
+ *
+ * Файл собирается под временным именем и переименовывается поверх
+ * STP_EXPORT_FILE: читатель, отобразивший файл прошлого запуска stpd,
+ * сохраняет старый inode и не получает SIGBUS от его усечения.
+ *
+ * @return 0 при успехе, -1 при ошибке или если экспорт выключен.
+ */
+int stp_export_open()
+{
+    if (!STP_EXPORT_STATE || g_stp_export.fd != -1)
+        return -1;
+
+    g_stp_export.fd = open(STP_EXPORT_TMP_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (g_stp_export.fd == -1)
+    {
+        STP_LOG_ERR("export open %s failed %s", STP_EXPORT_TMP_FILE, strerror(errno));
+        return -1;
+    }
+
+    // a valid empty header right away, so that readers can tell stpd is up
+    g_stp_export.published_gen = g_stp_snapshot_gen - 1;
+    if (stp_export_publish() == -1)
+        goto fail;
+
+    if (rename(STP_EXPORT_TMP_FILE, STP_EXPORT_FILE) == -1)
+    {
+        STP_LOG_ERR("export rename %s failed %s", STP_EXPORT_FILE, strerror(errno));
+        goto fail;
+    }
+    return 0;
+
+fail:
+    stp_export_release();
+    unlink(STP_EXPORT_TMP_FILE);
+    return -1;
+}
+
+/**
+ * @brief Тиков, прошедших с запуска таймера, или STP_EXPORT_TIMER_OFF.
+ */
+static UINT16 stp_export_timer(TIMER *timer)
+{
+    UINT32 elapsed;
+
+    if (!is_timer_active(timer))
+        return STP_EXPORT_TIMER_OFF;
+    elapsed = timer_elapsed(timer);
+    return elapsed < STP_EXPORT_TIMER_OFF ? elapsed : STP_EXPORT_TIMER_OFF - 1;
+}
+
+/**
+ * @brief Идентификатор моста одним числом: приоритет, system id, MAC.
+ */
+static uint64_t stp_export_bridge_id(BRIDGE_IDENTIFIER *id)
+{
+    MAC_ADDRESS address;
+    uint8_t *mac = (uint8_t *)&address;
+    uint64_t value;
+    int i;
+
+    // bridge identifiers keep the MAC in host order
+    HOST_TO_NET_MAC(&address, &id->address);
+    value = ((uint64_t)id->priority << 12) | id->system_id;
+    for (i = 0; i < L2_ETH_ADD_LEN; i++)
+        value = (value << 8) | mac[i];
+    return value;
+}
+
+/**
+ * @brief Заполняет запись порта экземпляра.
+ */
+static void stp_export_port(STP_EXPORT_PORT *rec, STP_CLASS *stp_class, STP_PORT_CLASS *stp_port_class,
+                            PORT_ID port_number)
+{
+    UINT16 flags = 0;
+
+    if (is_member(stp_class->enable_mask, port_number))
+        flags |= STP_EXPORT_PORT_ENABLED;
+    if (is_member(stp_class->untag_mask, port_number))
+        flags |= STP_EXPORT_PORT_UNTAGGED;
+    if (stp_port_class->topology_change_acknowledge)
+        flags |= STP_EXPORT_PORT_TC_ACK;
+    if (stp_port_class->config_pending)
+        flags |= STP_EXPORT_PORT_CONFIG_PENDING;
+    if (stp_port_class->self_loop)
+        flags |= STP_EXPORT_PORT_SELF_LOOP;
+    if (stp_port_class->operEdge)
+        flags |= STP_EXPORT_PORT_OPER_EDGE;
+    if (is_timer_active(&stp_port_class->root_protect_timer))
+        flags |= STP_EXPORT_PORT_ROOT_INCONSISTENT;
+
+    rec->port_number = port_number;
+    rec->priority = stp_port_class->port_id.priority;
+    rec->state = stp_port_class->state;
+    rec->flags = flags;
+    rec->designated_port = (stp_port_class->designated_port.priority << 12) | stp_port_class->designated_port.number;
+    rec->path_cost = stp_port_class->path_cost;
+    rec->designated_cost = stp_port_class->designated_cost;
+    rec->designated_root = stp_export_bridge_id(&stp_port_class->designated_root);
+    rec->designated_bridge = stp_export_bridge_id(&stp_port_class->designated_bridge);
+    rec->message_age_timer = stp_export_timer(&stp_port_class->message_age_timer);
+    rec->forward_delay_timer = stp_export_timer(&stp_port_class->forward_delay_timer);
+    rec->hold_timer = stp_export_timer(&stp_port_class->hold_timer);
+    rec->root_protect_timer = stp_export_timer(&stp_port_class->root_protect_timer);
+    rec->forward_transitions = stp_port_class->forward_transitions;
+    rec->rx_config_bpdu = stp_port_class->cleared.rx_config_bpdu + stp_port_class->rx_config_bpdu;
+    rec->tx_config_bpdu = stp_port_class->cleared.tx_config_bpdu + stp_port_class->tx_config_bpdu;
+    rec->rx_tcn_bpdu = stp_port_class->cleared.rx_tcn_bpdu + stp_port_class->rx_tcn_bpdu;
+    rec->tx_tcn_bpdu = stp_port_class->cleared.tx_tcn_bpdu + stp_port_class->tx_tcn_bpdu;
+    rec->rx_delayed_bpdu = stp_port_class->rx_delayed_bpdu;
+    rec->rx_drop_bpdu = stp_port_class->rx_drop_bpdu;
+}
+
+/**
+ * @brief Заполняет запись экземпляра, кроме port_first и port_count.
+ */
+static void stp_export_class(STP_EXPORT_CLASS *rec, STP_CLASS *stp_class, STP_INDEX index)
+{
+    BRIDGE_DATA *bridge_info = &stp_class->bridge_info;
+
+    rec->index = index;
+    rec->vlan_id = stp_class->vlan_id;
+    rec->state = stp_class->state;
+    rec->topology_change = bridge_info->topology_change;
+    rec->max_age = bridge_info->max_age;
+    rec->hello_time = bridge_info->hello_time;
+    rec->forward_delay = bridge_info->forward_delay;
+    rec->bridge_max_age = bridge_info->bridge_max_age;
+    rec->bridge_hello_time = bridge_info->bridge_hello_time;
+    rec->bridge_forward_delay = bridge_info->bridge_forward_delay;
+    rec->hold_time = bridge_info->hold_time;
+    rec->spare = 0;
+    rec->root_port = bridge_info->root_port;
+    rec->bridge_id = stp_export_bridge_id(&bridge_info->bridge_id);
+    rec->root_id = stp_export_bridge_id(&bridge_info->root_id);
+    rec->root_path_cost = bridge_info->root_path_cost;
+    rec->topology_change_count = bridge_info->topology_change_count;
+    rec->rx_drop_bpdu = stp_class->rx_drop_bpdu;
+    rec->hello_timer = stp_export_timer(&stp_class->hello_timer);
+    rec->tcn_timer = stp_export_timer(&stp_class->tcn_timer);
+    rec->topology_change_timer = stp_export_timer(&stp_class->topology_change_timer);
+    rec->group_vlans = stp_class->group_vlan_count;
+}
+
+/**
+ * @brief Заполняет запись интерфейса.
+ *
+ * @return `false`, если порта нет в базе интерфейсов.
+ */
+static bool stp_export_intf(STP_EXPORT_INTF *rec, PORT_ID port_number)
+{
+    INTERFACE_NODE *node = stp_intf_get_node(port_number);
+    STPD_INTF_STATS *stats;
+    UINT16 flags = 0;
+
+    if (node == NULL)
+        return false;
+
+    if (node->oper_state)
+        flags |= STP_EXPORT_INTF_OPER_UP;
+    if (is_member(g_stp_enable_mask, port_number))
+        flags |= STP_EXPORT_INTF_STP_ENABLE;
+    if (is_member(g_fastspan_mask, port_number))
+        flags |= STP_EXPORT_INTF_PORT_FAST;
+    if (is_member(g_fastuplink_mask, port_number))
+        flags |= STP_EXPORT_INTF_UPLINK_FAST;
+    if (is_member(g_stp_protect_mask, port_number))
+        flags |= STP_EXPORT_INTF_BPDU_PROTECT;
+    if (is_member(g_stp_protect_disabled_mask, port_number))
+        flags |= STP_EXPORT_INTF_BPDU_DISABLED;
+    if (is_member(g_stp_root_protect_mask, port_number))
+        flags |= STP_EXPORT_INTF_ROOT_PROTECT;
+    if (STP_IS_PO_PORT(node->ifname))
+        flags |= STP_EXPORT_INTF_PORTCHANNEL;
+
+    // the record name is zero padded and always terminated, longer names are cut
+    memset(rec->name, 0, sizeof(rec->name));
+    memcpy(rec->name, node->ifname, strnlen(node->ifname, sizeof(rec->name) - 1));
+    rec->port_number = port_number;
+    rec->flags = flags;
+    rec->kif_index = node->kif_index;
+    rec->speed = node->speed;
+    rec->path_cost = node->path_cost;
+
+    stats = g_stpd_intf_stats ? g_stpd_intf_stats[port_number] : NULL;
+    rec->pkt_rx = stats ? stats->pkt_rx : 0;
+    rec->pkt_tx = stats ? stats->pkt_tx : 0;
+    rec->pkt_rx_err = stats ? stats->pkt_rx_err : 0;
+    rec->pkt_rx_err_trunc = stats ? stats->pkt_rx_err_trunc : 0;
+    rec->pkt_tx_err = stats ? stats->pkt_tx_err : 0;
+    rec->pkt_rx_storm_drop = stats ? stats->pkt_rx_storm_drop : 0;
+    return true;
+}
+
+/**
+ * @brief Публикует текущее состояние STP в файл экспорта.
+ *
+ * Запись выполняется под seqlock: seq нечётный от начала до конца записи.
+ *
+ * @return 0 при успехе, -1 при ошибке.
+ */
+int stp_export_publish()
+{
+    STP_EXPORT_HDR *hdr;
+    STP_EXPORT_CLASS *class_rec;
+    STP_EXPORT_PORT *port_rec;
+    STP_EXPORT_INTF *intf_rec;
+    STP_CLASS *stp_class;
+    STP_PORT_CLASS *stp_port_class;
+    PORT_MASK_ITER it;
+    PORT_ID port_number;
+    uint64_t start_us;
+    UINT32 class_count = 0, port_count = 0, port_total = 0, intf_count = 0;
+    size_t size;
+    UINT16 i;
+
+    if (g_stp_export.fd == -1)
+        return -1;
+
+    start_us = stp_export_now_us();
+
+    for (i = 0; g_stp_class_array && i < g_stp_instances; i++)
+    {
+        stp_class = GET_STP_CLASS(i);
+        if (stp_class->state == STP_CLASS_FREE)
+            continue;
+        class_count++;
+        port_total += bmp_count_set_bits(stp_class->control_mask);
+    }
+
+    size = sizeof(STP_EXPORT_HDR) + class_count * sizeof(STP_EXPORT_CLASS) + port_total * sizeof(STP_EXPORT_PORT) +
+           g_max_stp_port * sizeof(STP_EXPORT_INTF);
+    if (stp_export_map(size) == -1)
+        return -1;
+
+    hdr = g_stp_export.hdr;
+    hdr->seq |= 1;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    memcpy(hdr->magic, STP_EXPORT_MAGIC, sizeof(STP_EXPORT_MAGIC));
+    hdr->version = STP_EXPORT_VERSION;
+    hdr->hdr_size = sizeof(STP_EXPORT_HDR);
+    hdr->class_size = sizeof(STP_EXPORT_CLASS);
+    hdr->port_size = sizeof(STP_EXPORT_PORT);
+    hdr->intf_size = sizeof(STP_EXPORT_INTF);
+    hdr->pid = getpid();
+    hdr->tick_ms = 1000 / STP_SECONDS_TO_TICKS(1);
+    hdr->state_gen = g_stp_snapshot_gen;
+    hdr->enable = stp_global.enable;
+    hdr->proto_mode = stp_global.proto_mode;
+    hdr->fast_span = stp_global.fast_span;
+    hdr->extend_mode = g_stpd_extend_mode;
+    hdr->root_protect_timeout = stp_global.root_protect_timeout;
+    memcpy(hdr->base_mac, &g_stp_base_mac_addr, sizeof(hdr->base_mac));
+    hdr->max_instances = g_stp_instances;
+    hdr->active_instances = g_stp_active_instances;
+    hdr->max_port = g_max_stp_port;
+    hdr->ev_timer = g_stpd_stats_libev_timer;
+    hdr->ev_pkt_rx = g_stpd_stats_libev_pktrx;
+    hdr->ev_ipc = g_stpd_stats_libev_ipc;
+    hdr->ev_netlink = g_stpd_stats_libev_netlink;
+
+    hdr->class_offset = sizeof(STP_EXPORT_HDR);
+    hdr->port_offset = hdr->class_offset + class_count * sizeof(STP_EXPORT_CLASS);
+    hdr->intf_offset = hdr->port_offset + port_total * sizeof(STP_EXPORT_PORT);
+    class_rec = (STP_EXPORT_CLASS *)((uint8_t *)hdr + hdr->class_offset);
+    port_rec = (STP_EXPORT_PORT *)((uint8_t *)hdr + hdr->port_offset);
+    intf_rec = (STP_EXPORT_INTF *)((uint8_t *)hdr + hdr->intf_offset);
+
+    for (i = 0; g_stp_class_array && i < g_stp_instances; i++)
+    {
+        stp_class = GET_STP_CLASS(i);
+        if (stp_class->state == STP_CLASS_FREE)
+            continue;
+
+        stp_export_class(class_rec, stp_class, i);
+        class_rec->port_first = port_count;
+        class_rec->port_count = 0;
+        PORT_MASK_FOR_EACH_PORT(stp_class->control_mask, it, port_number)
+        {
+            stp_port_class = GET_STP_PORT_CLASS(stp_class, port_number);
+            if (stp_port_class == NULL)
+                continue;
+            stp_export_port(&port_rec[port_count++], stp_class, stp_port_class, port_number);
+            class_rec->port_count++;
+        }
+        class_rec++;
+    }
+
+    for (port_number = 0; port_number < g_max_stp_port; port_number++)
+    {
+        if (stp_export_intf(&intf_rec[intf_count], port_number))
+            intf_count++;
+    }
+
+    hdr->class_count = class_count;
+    hdr->port_count = port_count;
+    hdr->intf_count = intf_count;
+    hdr->size = hdr->intf_offset + intf_count * sizeof(STP_EXPORT_INTF);
+    hdr->publish_count++;
+    hdr->published_ms = stp_export_now_us() / 1000;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    hdr->seq++;
+
+    g_stp_export.published_gen = g_stp_snapshot_gen;
+    g_stp_export.full_ticks = 0;
+    g_stp_export.stats.publishes++;
+    g_stp_export.stats.last_size = hdr->size;
+    g_stp_export.stats.publish_us += stp_export_now_us() - start_us;
+    return 0;
+}
+
+/**
+ * @brief Публикует изменённое состояние и периодически обновляет счётчики.
+ *
+ * Вызывается из таймера 100 мс.
+ *
+ * @return void
+ */
+void stp_export_tick()
+{
+    if (g_stp_export.fd == -1)
+        return;
+
+    g_stp_export.full_ticks++;
+    if (++g_stp_export.ticks < STP_EXPORT_CHECK_TICKS)
+        return;
+
+    g_stp_export.ticks = 0;
+    if (g_stp_export.published_gen != g_stp_snapshot_gen || g_stp_export.full_ticks >= STP_EXPORT_FULL_TICKS)
+        stp_export_publish();
+}
+
+/**
+ * @brief Закрывает файл экспорта при остановке stpd.
+ *
+ * Файл удаляется, чтобы читатели не показывали состояние остановленного демона.
+ *
+ * @return void
+ */
+void stp_export_close()
+{
+    if (g_stp_export.fd == -1)
+        return;
+
+    stp_export_release();
+    unlink(STP_EXPORT_FILE);
+}
+
+/**
+ * @brief Возвращает статистику экспорта, NULL если экспорт выключен.
+ */
+stp_export_stats_t *stp_export_get_stats()
+{
+    return g_stp_export.fd != -1 ? &g_stp_export.stats : NULL;
+}
@@ -20,6 +20,7 @@
  * Apache License 2.0
  */
 
+#include <ctype.h>
 #include "stp_inc.h"
 
 /**
@@ -50,6 +51,153 @@ struct event_base *stp_intf_get_evbase()
     return stpd_context.evbase;
 }
 
+/**
+ * @brief Вычисляет хэш имени интерфейса для индекса по имени.
+ *
+ * Хэш нечувствителен к регистру, как и сравнение в `stp_intf_avl_compare`.
+ *
+ * @param ifname Имя интерфейса.
+ *
+ * @return uint32_t
+ *         Номер цепочки в `name_hash`.
+ */
+static uint32_t stp_intf_name_hash(const char *ifname)
+{
+    uint32_t hash = 5381;
+    int i;
+
+    for (i = 0; i < IFNAMSIZ && ifname[i]; i++)
+        hash = ((hash << 5) + hash) + (uint8_t)tolower((uint8_t)ifname[i]);
+
+    return (hash % STP_INTF_NAME_HASH_SIZE);
+}
+
+/**
+ * @brief Гарантирует, что таблица прямого доступа вмещает указанный индекс.
+ *
+ * Таблица увеличивается вдвое до нужного размера, новые элементы обнуляются.
+ *
+ * @param tbl Указатель на таблицу узлов.
+ * @param tbl_sz Указатель на текущий размер таблицы.
+ * @param idx Индекс, который должен поместиться в таблицу.
+ * @param max_sz Максимально допустимый размер таблицы.
+ *
+ * @return bool
+ *         - `true`, если индекс помещается в таблицу.
+ *         - `false`, если индекс превышает `max_sz` или не удалось выделить память.
+ */
+static bool stp_intf_index_tbl_fit(INTERFACE_NODE ***tbl, uint32_t *tbl_sz, uint32_t idx, uint32_t max_sz)
+{
+    INTERFACE_NODE **new_tbl = NULL;
+    uint32_t new_sz;
+
+    if (idx < *tbl_sz)
+        return true;
+
+    if (idx >= max_sz)
+        return false;
+
+    new_sz = (*tbl_sz) ? (*tbl_sz) : STP_INTF_TBL_MIN_SZ;
+    while (new_sz <= idx)
+        new_sz <<= 1;
+    if (new_sz > max_sz)
+        new_sz = max_sz;
+
+    new_tbl = realloc(*tbl, new_sz * sizeof(INTERFACE_NODE *));
+    if (!new_tbl)
+    {
+        STP_LOG_CRITICAL("Realloc Failed, intf index size %u", new_sz);
+        return false;
+    }
+
+    memset(&new_tbl[*tbl_sz], 0, (new_sz - *tbl_sz) * sizeof(INTERFACE_NODE *));
+    *tbl = new_tbl;
+    *tbl_sz = new_sz;
+    return true;
+}
+
+/**
+ * @brief Добавляет узел во все индексы быстрого доступа.
+ *
+ * @param node Указатель на узел интерфейса, уже добавленный в AVL-дерево.
+ *
+ * @return void
+ */
+static void stp_intf_index_add(INTERFACE_NODE *node)
+{
+    STP_INTF_INDEX *idx = &g_stpd_intf_index;
+    uint32_t hash = stp_intf_name_hash(node->ifname);
+
+    node->name_next = idx->name_hash[hash];
+    idx->name_hash[hash] = node;
+
+    if (node->kif_index != BAD_PORT_ID &&
+        stp_intf_index_tbl_fit(&idx->kif_tbl, &idx->kif_tbl_sz, node->kif_index, STP_INTF_KIF_TBL_MAX))
+        idx->kif_tbl[node->kif_index] = node;
+
+    if (node->port_id != BAD_PORT_ID &&
+        stp_intf_index_tbl_fit(&idx->port_tbl, &idx->port_tbl_sz, node->port_id, STP_INTF_PORT_TBL_MAX))
+        idx->port_tbl[node->port_id] = node;
+}
+
+/**
+ * @brief Удаляет узел из всех индексов быстрого доступа.
+ *
+ * @param node Указатель на узел интерфейса, удаляемый из AVL-дерева.
+ *
+ * @return void
+ */
+static void stp_intf_index_del(INTERFACE_NODE *node)
+{
+    STP_INTF_INDEX *idx = &g_stpd_intf_index;
+    INTERFACE_NODE **pp = &idx->name_hash[stp_intf_name_hash(node->ifname)];
+
+    while (*pp)
+    {
+        if (*pp == node)
+        {
+            *pp = node->name_next;
+            break;
+        }
+        pp = &(*pp)->name_next;
+    }
+    node->name_next = NULL;
+
+    if (node->kif_index < idx->kif_tbl_sz && idx->kif_tbl[node->kif_index] == node)
+        idx->kif_tbl[node->kif_index] = NULL;
+
+    if (node->port_id < idx->port_tbl_sz && idx->port_tbl[node->port_id] == node)
+        idx->port_tbl[node->port_id] = NULL;
+}
+
+/**
+ * @brief Назначает идентификатор порта узлу интерфейса.
+ *
+ * Все изменения `port_id` у узлов, уже находящихся в базе данных интерфейсов,
+ * должны выполняться через эту функцию, чтобы индекс по port_id оставался
+ * согласованным.
+ *
+ * @param node Указатель на узел интерфейса.
+ * @param port_id Новый идентификатор порта или `BAD_PORT_ID`.
+ *
+ * @return void
+ */
+void stp_intf_set_port_id(INTERFACE_NODE *node, uint32_t port_id)
+{
+    STP_INTF_INDEX *idx = &g_stpd_intf_index;
+
+    if (node->port_id < idx->port_tbl_sz && idx->port_tbl[node->port_id] == node)
+        idx->port_tbl[node->port_id] = NULL;
+
+    stp_pkt_tx_port_invalidate(node->port_id);
+    stp_pkt_tx_port_invalidate(port_id);
+    node->port_id = port_id;
+
+    if (port_id != BAD_PORT_ID &&
+        stp_intf_index_tbl_fit(&idx->port_tbl, &idx->port_tbl_sz, port_id, STP_INTF_PORT_TBL_MAX))
+        idx->port_tbl[port_id] = node;
+}
+
 /**
  * @brief Получает имя интерфейса по идентификатору порта.
  *
@@ -63,16 +211,9 @@ struct event_base *stp_intf_get_evbase()
  */
 char *stp_intf_get_port_name(uint32_t port_id)
 {
-    struct avl_traverser trav;
-    INTERFACE_NODE *node = 0;
-    avl_t_init(&trav, g_stpd_intf_db);
+    INTERFACE_NODE *node = stp_intf_get_node(port_id);
 
-    while (NULL != (node = avl_t_next(&trav)))
-    {
-        if (node->port_id == port_id)
-            return node->ifname;
-    }
-    return NULL;
+    return node ? node->ifname : NULL;
 }
 
 /**
@@ -88,16 +229,9 @@ char *stp_intf_get_port_name(uint32_t port_id)
  */
 bool stp_intf_is_port_up(int port_id)
 {
-    struct avl_traverser trav;
-    INTERFACE_NODE *node = 0;
-    avl_t_init(&trav, g_stpd_intf_db);
+    INTERFACE_NODE *node = stp_intf_get_node(port_id);
 
-    while (NULL != (node = avl_t_next(&trav)))
-    {
-        if (node->port_id == port_id)
-            return node->oper_state ? true : false;
-    }
-    return false;
+    return (node && node->oper_state) ? true : false;
 }
 
 /**
@@ -112,16 +246,9 @@ bool stp_intf_is_port_up(int port_id)
  */
 uint32_t stp_intf_get_speed(int port_id)
 {
-    struct avl_traverser trav;
-    INTERFACE_NODE *node = 0;
-    avl_t_init(&trav, g_stpd_intf_db);
+    INTERFACE_NODE *node = stp_intf_get_node(port_id);
 
-    while (NULL != (node = avl_t_next(&trav)))
-    {
-        if (node->port_id == port_id)
-            return node->speed;
-    }
-    return 0;
+    return node ? node->speed : 0;
 }
 
 /**
@@ -137,15 +264,8 @@ uint32_t stp_intf_get_speed(int port_id)
  */
 INTERFACE_NODE *stp_intf_get_node(uint32_t port_id)
 {
-    struct avl_traverser trav;
-    INTERFACE_NODE *node = 0;
-    avl_t_init(&trav, g_stpd_intf_db);
-
-    while (NULL != (node = avl_t_next(&trav)))
-    {
-        if (node->port_id == port_id)
-            return node;
-    }
+    if (port_id < g_stpd_intf_index.port_tbl_sz)
+        return g_stpd_intf_index.port_tbl[port_id];
 
     return NULL;
 }
@@ -165,8 +285,15 @@ INTERFACE_NODE *stp_intf_get_node_by_kif_index(uint32_t kif_index)
 {
     struct avl_traverser trav;
     INTERFACE_NODE *node = 0;
-    avl_t_init(&trav, g_stpd_intf_db);
 
+    if (kif_index < g_stpd_intf_index.kif_tbl_sz)
+        return g_stpd_intf_index.kif_tbl[kif_index];
+
+    // ifindex beyond the direct table (never expected on SONiC), walk the tree
+    if (kif_index < STP_INTF_KIF_TBL_MAX)
+        return NULL;
+
+    avl_t_init(&trav, g_stpd_intf_db);
     while (NULL != (node = avl_t_next(&trav)))
     {
         if (node->kif_index == kif_index)
@@ -333,15 +460,18 @@ uint32_t stp_intf_get_port_id_by_name(char *ifname)
  */
 INTERFACE_NODE *stp_intf_get_node_by_name(char *ifname)
 {
-    INTERFACE_NODE search_node;
+    INTERFACE_NODE *node = NULL;
 
     if (!ifname)
         return NULL;
 
-    memset(&search_node, 0, sizeof(INTERFACE_NODE));
-    memcpy(search_node.ifname, ifname, IFNAMSIZ);
+    for (node = g_stpd_intf_index.name_hash[stp_intf_name_hash(ifname)]; node; node = node->name_next)
+    {
+        if (0 == strncasecmp(node->ifname, ifname, IFNAMSIZ))
+            return node;
+    }
 
-    return avl_find(g_stpd_intf_db, &search_node);
+    return NULL;
 }
 
 /**
@@ -386,12 +516,44 @@ void stp_intf_del_from_intf_db(INTERFACE_NODE *node)
     if (STP_IS_ETH_PORT(node->ifname))
         stp_pkt_sock_close(node);
 
+    stp_intf_index_del(node);
+    stp_pkt_tx_port_invalidate(node->port_id);
     avl_delete(g_stpd_intf_db, node);
     free(node);
 
     return;
 }
 
+/**
+ * @brief Проверяет, нужен ли порту приём BPDU.
+ *
+ * Приём включён на портах, входящих в control_mask какого-либо экземпляра
+ * или с настроенным BPDU guard (g_stp_protect_mask).
+ *
+ * @param port_id Идентификатор порта STP.
+ *
+ * @return `true`, если на порту нужен сокет приёма.
+ */
+static bool stp_intf_is_rx_port(PORT_ID port_id)
+{
+    STP_CLASS *stp_class;
+    UINT16 i;
+
+    if (port_id == BAD_PORT_ID || port_id >= g_max_stp_port || g_stp_class_array == NULL)
+        return false;
+
+    if (g_stp_protect_mask && is_member(g_stp_protect_mask, port_id))
+        return true;
+
+    for (i = 0; i < g_stp_instances; i++)
+    {
+        stp_class = GET_STP_CLASS(i);
+        if (stp_class->state != STP_CLASS_FREE && is_member(stp_class->control_mask, port_id))
+            return true;
+    }
+    return false;
+}
+
 /**
  * @brief Добавляет указанный интерфейс в базу данных интерфейсов STP.
  *
@@ -420,8 +582,10 @@ uint32_t stp_intf_add_to_intf_db(INTERFACE_NODE *node)
     {
         STP_LOG_INFO("AVL Insert :  %s %d %u", node->ifname, node->kif_index, node->port_id);
 
-        // create socket only for Ethernet ports
-        if (STP_IS_ETH_PORT(node->ifname))
+        stp_intf_index_add(node);
+
+        // create socket only for Ethernet ports, in lazy mode on stp_pkt_sock_enable()
+        if (!STP_PKT_RX_LAZY && STP_IS_ETH_PORT(node->ifname))
             stp_pkt_sock_create(node);
 
         return node->port_id;
@@ -573,7 +737,7 @@ PORT_ID stp_intf_handle_po_preconfig(char *ifname)
     /* Allocate port id for PO if not yet done */
     if (node->port_id == BAD_PORT_ID && g_stpd_port_init_done)
     {
-        node->port_id = stp_intf_allocate_po_id();
+        stp_intf_set_port_id(node, stp_intf_allocate_po_id());
         if (node->port_id == BAD_PORT_ID)
             sys_assert(0);
     }
@@ -619,11 +783,15 @@ void stp_intf_add_po_member(INTERFACE_NODE *if_node)
     /* Allocate port id for PO if not yet done */
     if (node->port_id == BAD_PORT_ID && g_stpd_port_init_done)
     {
-        node->port_id = stp_intf_allocate_po_id();
+        stp_intf_set_port_id(node, stp_intf_allocate_po_id());
         if (node->port_id == BAD_PORT_ID)
             sys_assert(0);
     }
 
+    /* BPDUs of the PO are received on member sockets */
+    if (node->rx_enabled && if_node->sock <= 0)
+        stp_pkt_sock_create(if_node);
+
     STP_LOG_INFO("Add PO member kernel_if - %u member_if - %u kif_index - %u", if_node->master_ifindex, if_node->port_id, if_node->kif_index);
 }
 
@@ -690,11 +858,13 @@ bool stp_intf_update_po_members(netlink_db_t *if_db, INTERFACE_NODE *node)
     {
         node->master_ifindex = if_db->master_ifindex;
         stp_intf_add_po_member(node);
+        stp_bpf_guard_member_update(node->kif_index, 0, node->master_ifindex);
     }
 
     /* Delete member port from PO */
     if (node->master_ifindex && !if_db->master_ifindex)
     {
+        stp_bpf_guard_member_update(node->kif_index, node->master_ifindex, 0);
         stp_intf_del_po_member(node->master_ifindex, node->port_id);
         node->master_ifindex = 0;
     }
@@ -741,7 +911,11 @@ INTERFACE_NODE *stp_intf_update_intf_db(netlink_db_t *if_db, uint8_t is_add, boo
             if (eth_if)
             {
                 port_id = strtol(((char *)if_db->ifname + STP_ETH_NAME_PREFIX_LEN), NULL, 10);
-                node->port_id = port_id;
+                stp_intf_set_port_id(node, port_id);
+
+                // a port deleted and re-added by netlink keeps its STP config and needs its socket again
+                if (STP_PKT_RX_LAZY && !init_in_prog && stp_intf_is_rx_port(port_id))
+                    stp_pkt_sock_enable(port_id);
 
                 /* Derive Max Port */
                 if (init_in_prog)
@@ -755,10 +929,10 @@ INTERFACE_NODE *stp_intf_update_intf_db(netlink_db_t *if_db, uint8_t is_add, boo
             STP_LOG_INFO("Add Kernel ifindex %d name %s", if_db->kif_index, if_db->ifname);
         }
 
-        /* Update the port speed */
+        /* Update the port speed, initial dump reads all speeds in stp_intf_init_port_speeds() */
         if (eth_if)
         {
-            if (!node->speed)
+            if (!node->speed && !init_in_prog)
             {
                 node->speed = stpsync_get_port_speed(if_db->ifname);
 
@@ -782,6 +956,8 @@ INTERFACE_NODE *stp_intf_update_intf_db(netlink_db_t *if_db, uint8_t is_add, boo
             return NULL;
         }
 
+        if (node->master_ifindex)
+            stp_bpf_guard_member_update(node->kif_index, node->master_ifindex, 0);
         stp_intf_del_from_intf_db(node);
         STP_LOG_INFO("Del Kernel ifindex %x name %s", if_db->kif_index, if_db->ifname);
     }
@@ -820,7 +996,29 @@ void stp_intf_netlink_cb(netlink_db_t *if_db, uint8_t is_add, bool init_in_prog)
     else
         return;
 
-    node = stp_intf_update_intf_db(if_db, is_add, init_in_prog, eth_if);
+    /* Fast path: known interface, only oper state may have changed */
+    if (is_add && !init_in_prog)
+    {
+        node = stp_intf_get_node_by_kif_index(if_db->kif_index);
+        if (node && (node->master_ifindex != if_db->master_ifindex || (eth_if && !node->speed) ||
+                     strncmp(node->ifname, if_db->ifname, IFNAMSIZ) != 0))
+            node = NULL;
+    }
+
+    if (node)
+    {
+        g_stpd_stats_libev_netlink_fast++;
+        if (if_db->oper_state == node->oper_state)
+            return;
+
+        // queued BPDUs must not see the interface DB change under them
+        stp_worker_drain();
+    }
+    else
+    {
+        stp_worker_drain();
+        node = stp_intf_update_intf_db(if_db, is_add, init_in_prog, eth_if);
+    }
 
     /* Handle oper data change */
     if (node)
@@ -829,7 +1027,7 @@ void stp_intf_netlink_cb(netlink_db_t *if_db, uint8_t is_add, bool init_in_prog)
         if (if_db->oper_state != node->oper_state)
         {
             node->oper_state = if_db->oper_state;
-            if (eth_if)
+            if (eth_if && !init_in_prog)
             {
                 node->speed = stpsync_get_port_speed(if_db->ifname);
                 /* Calculate default Path cost */
@@ -889,6 +1087,43 @@ int stp_intf_init_port_stats()
     return 0;
 }
 
+/**
+ * @brief Читает скорости портов после начального дампа netlink.
+ *
+ * Во время дампа скорость не запрашивается, иначе APP_DB опрашивается на
+ * каждое сообщение порта (добавление и смена oper state). Здесь скорость
+ * каждого Ethernet-порта читается один раз, Port-channel получает скорость
+ * первого участника, как и в stp_intf_add_po_member().
+ *
+ * @return void
+ */
+void stp_intf_init_port_speeds()
+{
+    struct avl_traverser trav;
+    INTERFACE_NODE *node = 0, *po_node = 0;
+
+    avl_t_init(&trav, g_stpd_intf_db);
+    while (NULL != (node = avl_t_next(&trav)))
+    {
+        if (!STP_IS_ETH_PORT(node->ifname))
+            continue;
+
+        node->speed = stpsync_get_port_speed(node->ifname);
+        node->path_cost = stputil_get_path_cost(node->speed, g_stpd_extend_mode);
+        g_stpd_startup.speed_lookups++;
+
+        if (node->master_ifindex)
+        {
+            po_node = stp_intf_get_node_by_kif_index(node->master_ifindex);
+            if (po_node && !po_node->speed)
+            {
+                po_node->speed = node->speed;
+                po_node->path_cost = node->path_cost;
+            }
+        }
+    }
+}
+
 /**
  * @brief Инициализирует пул идентификаторов Port-Channel (PO ID Pool).
  *
@@ -919,7 +1154,7 @@ int stp_intf_init_po_id_pool()
     {
         if (node->port_id == BAD_PORT_ID && STP_IS_PO_PORT(node->ifname))
         {
-            node->port_id = stp_intf_allocate_po_id();
+            stp_intf_set_port_id(node, stp_intf_allocate_po_id());
             STP_LOG_INFO("Allocated PO port id %d name %s", node->port_id, node->ifname);
         }
     }
@@ -960,6 +1195,14 @@ int stp_intf_event_mgr_init(void)
         sys_assert(0);
     }
 
+    stp_intf_init_port_speeds();
+    g_stpd_startup.intf_count = avl_count(g_stpd_intf_db);
+    STPD_STARTUP_MARK(STPD_STARTUP_INTF_DB);
+
+    /* Kernel bridge VLAN programming, falls back to /sbin/bridge when unavailable */
+    if (-1 == stp_netlink_br_init(stp_intf_get_evbase(), stputil_kernel_bridge_op_failed))
+        STP_LOG_ERR("bridge netlink init failed, using /sbin/bridge");
+
     g_max_stp_port = g_max_stp_port * 2; // Phy Ports + LAG
     STP_LOG_INFO("intf db done. max port %d", g_max_stp_port);
 
@@ -977,7 +1220,9 @@ int stp_intf_event_mgr_init(void)
     g_stpd_port_init_done = 1;
 
     /* Add libevent to monitor interface events */
-    nl_event = stpmgr_libevent_create(stp_intf_get_evbase(), stp_intf_get_netlink_fd(), EV_READ | EV_PERSIST, stp_netlink_events_cb, (char *)"NETLINK", NULL);
+    /* Link up/down is served with BPDU rx, not after it */
+    nl_event = stpmgr_libevent_create_prio(stp_intf_get_evbase(), stp_intf_get_netlink_fd(), EV_READ | EV_PERSIST,
+                                           stp_netlink_events_cb, (char *)"NETLINK", NULL, "NETLINK", STP_LIBEV_PKT_PRI_Q);
     if (!nl_event)
     {
         STP_LOG_ERR("Netlink Event create Failed");
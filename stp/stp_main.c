@@ -17,12 +17,12 @@ int send_resp_ipc_packet(STPD_CONTEXT* ctx, const char* message, size_t len);
 /* Глобальная структура контекста STP */
 STPD_CONTEXT stpd_context;
 
-#define UDP_PORT_SND 6954     // для отправки в wbos msg
+#define UDP_PORT_SND STPD_IPC_UDP_PORT // для отправки в wbos msg
 #define UDP_PORT_RCV 6945     // для приема wbos msg
 #define BUFFER_SIZE 64 * 1024 // максимальное значениедлинны пакета данных
 #define RECV_BUF_SIZE 212992  // размер буфера приема от соника
 // #define MAX_RETRIES 3         // количество попыток на отправку
-#define SEND_STATIC_BUF_SIZE 8 * 1024
+#define SEND_STATIC_BUF_SIZE STP_WBOS_FRAME_MAX
 
 #ifndef STPD_WBOS_RELEASE
 #define STPD_WBOS_DEBUG 1
@@ -30,8 +30,87 @@ STPD_CONTEXT stpd_context;
 #define STPD_WBOS_DEBUG 0
 #endif // !STPD_WBOS_RELEASE
 
+// SIGINT/SIGTERM are delivered through the event loop, cleanup() runs after it returns
+static struct event* g_stpd_sigint_ev;
+static struct event* g_stpd_sigterm_ev;
+
+/**
+ * @brief Обработчик SIGINT/SIGTERM в цикле событий libevent.
+ *
+ * Выполняется вне контекста сигнала, поэтому только останавливает цикл:
+ * ресурсы освобождает cleanup() после возврата из event_base_dispatch().
+ */
+static void stpd_signal_cb(evutil_socket_t sig, short events, void* arg)
+{
+    STP_LOG_INFO("signal %d, shutting down", (int)sig);
+    event_base_loopbreak((struct event_base*)arg);
+}
+
+/**
+ * @brief Обработчик SIGSEGV.
+ *
+ * В контексте сигнала допустимы только async-signal-safe вызовы: сообщение
+ * пишется в stderr через write(), затем сигнал повторяется с действием по
+ * умолчанию, чтобы получить дамп памяти.
+ */
+static void stpd_fatal_signal_handler(int sig)
+{
+    static const char msg[] = "stpd: fatal signal, aborting\n";
+    ssize_t rc;
+
+    rc = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+    (void)rc;
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+/**
+ * @brief Подписывает цикл событий на SIGINT и SIGTERM.
+ *
+ * @return 0 при успехе, -1 при ошибке.
+ */
+static int stpd_signal_init(struct event_base* base)
+{
+    g_stpd_sigint_ev = evsignal_new(base, SIGINT, stpd_signal_cb, base);
+    g_stpd_sigterm_ev = evsignal_new(base, SIGTERM, stpd_signal_cb, base);
+    if (!g_stpd_sigint_ev || !g_stpd_sigterm_ev)
+        return -1;
+
+    event_priority_set(g_stpd_sigint_ev, STP_LIBEV_HIGH_PRI_Q);
+    event_priority_set(g_stpd_sigterm_ev, STP_LIBEV_HIGH_PRI_Q);
+    if (event_add(g_stpd_sigint_ev, NULL) == -1 || event_add(g_stpd_sigterm_ev, NULL) == -1)
+        return -1;
+    return 0;
+}
+
+/**
+ * @brief Освобождает события сигналов до освобождения event_base.
+ */
+static void stpd_signal_deinit()
+{
+    if (g_stpd_sigint_ev)
+    {
+        event_free(g_stpd_sigint_ev);
+        g_stpd_sigint_ev = NULL;
+    }
+    if (g_stpd_sigterm_ev)
+    {
+        event_free(g_stpd_sigterm_ev);
+        g_stpd_sigterm_ev = NULL;
+    }
+}
+
 void cleanup()
 {
+    // releases its libevent event, so before the event base
+    stpd_signal_deinit();
+    stp_pkt_rx_ring_deinit();
+    stp_worker_deinit();
+    stp_snapshot_close();
+    stp_bpf_deinit();
+    stp_capture_deinit();
+    stp_pace_deinit();
+    stp_export_close();
     if (g_stpd_ipc_handle != -1)
     {
         close(g_stpd_ipc_handle);
@@ -68,18 +147,12 @@ void cleanup()
         g_stpd_response_ipc_handle = -1;
     }
 
-#ifdef STPD_WBOS_DEBUG
-    printf("Ресурсы g_stpd_ipc_handle g_stpd_evbase освобождены.\n");
-#endif // STPD_WBOS_DEBUG
-}
+    // flushes the log ring, after the worker threads are stopped
+    STP_LOG_DEINIT();
 
-void signal_handler(int sig)
-{
 #ifdef STPD_WBOS_DEBUG
-    fprintf(stderr, "Получен сигнал %d. Завершение...\n", sig);
+    printf("Ресурсы g_stpd_ipc_handle g_stpd_evbase освобождены.\n");
 #endif // STPD_WBOS_DEBUG
-    cleanup();
-    exit(0);
 }
 
 /**
@@ -150,7 +223,7 @@ int stpd_ipc_init()
 
     /* Создание события для обработки сообщений через IPC */
     ipc_event = stpmgr_libevent_create(g_stpd_evbase, g_stpd_ipc_handle,
-                                       EV_READ | EV_PERSIST, stpmgr_recv_client_msg, (char*)"IPC", NULL);
+                                       EV_READ | EV_PERSIST, stpmgr_recv_client_msg, (char*)"IPC", NULL, "IPC");
     if (!ipc_event)
     {
         STP_LOG_ERR("ipc_event Create failed");
@@ -218,7 +291,7 @@ int stpd_ipc_wbos_init(int PORT_UDP_R_WBOS)
 
     /* Создание события для обработки сообщений через IPC */
     ipc_event = stpmgr_libevent_create(g_stpd_evbase, g_stpd_ipc_handle,
-                                       EV_READ | EV_PERSIST, stpmgr_recv_client_msg, (char*)"IPC", NULL);
+                                       EV_READ | EV_PERSIST, stpmgr_recv_client_msg, (char*)"IPC", NULL, "IPC");
     if (!ipc_event)
     {
         STP_LOG_ERR("ipc_event Create failed");
@@ -285,8 +358,23 @@ void stpmgr_3000ms_timer(evutil_socket_t fd, short what, void* arg)
     // const char test_messages_periodic[] = {
     //     "stpd periodic 3000 message"};
 
+    if (ctx->wbos_format == STP_WBOS_FORMAT_DELTA)
+    {
+        // изменения уходят дельтами из 100мс таймера, здесь только периодический полный снимок для ресинхронизации
+        if (++ctx->wbos_full_periods < STPD_WBOS_FULL_PERIODS)
+            return;
+        ctx->wbos_full_periods = 0;
+    }
+
+    if (ctx->wbos_format != STP_WBOS_FORMAT_TEXT)
+    {
+        if (stpdm_global_wbos_bin(ctx, ctx->buf_to_wbos, SEND_STATIC_BUF_SIZE) != 0)
+            STP_LOG_ERR("stpdm_global_wbos_bin processing error, sending");
+        return;
+    }
+
     state = stpdm_global_wbos((char*)ctx->buf_to_wbos, SEND_STATIC_BUF_SIZE);
-    if (state)
+    if (state > 0)
     {
         ctx->send_resp_ipc_packet(ctx, (char*)ctx->buf_to_wbos, state);
     }
@@ -355,6 +443,50 @@ void stpd_log_init()
     {
         STP_LOG_SET_LEVEL(STP_LOG_LEVEL_INFO);
     }
+
+    if (STP_LOG_ASYNC_SLOTS && applog_async_start(STP_LOG_ASYNC_SLOTS, APP_LOG_LEVEL_ERR) != APP_LOG_STATUS_OK)
+        STP_LOG_ERR("async log start failed, logging synchronously");
+}
+
+/**
+ * @brief Возвращает имя этапа запуска для журнала и stpctl.
+ *
+ * @param phase Этап STPD_STARTUP_PHASE.
+ * @return Имя этапа.
+ */
+const char* stpd_startup_phase_name(uint8_t phase)
+{
+    static const char* names[STPD_STARTUP_MAX] = {
+        "begin", "appdb", "dispatch", "init-ready", "intf-db", "stp-init", "config", "bpdu-tx", "bpdu-rx"};
+
+    return phase < STPD_STARTUP_MAX ? names[phase] : "unknown";
+}
+
+/**
+ * @brief Отмечает достижение этапа запуска.
+ *
+ * Запоминается только первое достижение этапа, время в журнал пишется
+ * относительно входа в stpd_main(). Вызывается через STPD_STARTUP_MARK().
+ *
+ * @param phase Этап STPD_STARTUP_PHASE.
+ */
+void stpd_startup_mark(uint8_t phase)
+{
+    struct timespec ts;
+
+    if (phase >= STPD_STARTUP_MAX || g_stpd_startup.at_us[phase])
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    g_stpd_startup.at_us[phase] = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+    if (phase == STPD_STARTUP_INTF_DB)
+        STP_LOG_INFO("startup %s +%lu ms, interfaces %u speed lookups %u", stpd_startup_phase_name(phase),
+                     (g_stpd_startup.at_us[phase] - g_stpd_startup.at_us[STPD_STARTUP_BEGIN]) / 1000,
+                     g_stpd_startup.intf_count, g_stpd_startup.speed_lookups);
+    else
+        STP_LOG_INFO("startup %s +%lu ms", stpd_startup_phase_name(phase),
+                     (g_stpd_startup.at_us[phase] - g_stpd_startup.at_us[STPD_STARTUP_BEGIN]) / 1000);
 }
 
 int stpd_main()
@@ -373,23 +505,27 @@ int stpd_main()
 
     // Регистрация обработчиков
     atexit(cleanup);
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
-    signal(SIGSEGV, signal_handler); // Segmentation Fault
+    signal(SIGSEGV, stpd_fatal_signal_handler); // Segmentation Fault
 
     /* Игнорирование сигнала SIGPIPE */
     signal(SIGPIPE, SIG_IGN);
 
+    /* Обнуление структуры контекста STP, до первой отметки этапа запуска */
+    memset(&stpd_context, 0, sizeof(STPD_CONTEXT));
+    stpd_context.buf_to_wbos = send_msg_to_wbos_buffer; // глобальный статический буфер на стеке
+
     /* Инициализация системы логирования */
     stpd_log_init();
+    STPD_STARTUP_MARK(STPD_STARTUP_BEGIN);
 
     // TODO - убрать при отлучении от swss
-    /* Очистка таблиц STP в APP_DB */
-    stpsync_clear_appdb_stp_tables();
+    /* Очистка таблиц STP в APP_DB, при тёплом перезапуске из снимка таблицы сохраняются */
+    if (!stp_snapshot_open())
+        stpsync_clear_appdb_stp_tables();
+    STPD_STARTUP_MARK(STPD_STARTUP_APPDB);
 
-    /* Обнуление структуры контекста STP */
-    memset(&stpd_context, 0, sizeof(STPD_CONTEXT));
-    stpd_context.buf_to_wbos = send_msg_to_wbos_buffer; // глобальный статический буфер на стеке
+    /* Экспорт состояния в разделяемую память для show без IPC */
+    stp_export_open();
 
     /* Установка расширенного режима */
     stpmgr_set_extend_mode(true); // STP<->RSTP?
@@ -405,7 +541,7 @@ int stpd_main()
     STP_LOG_INFO("LIBEVENT VER : 0x%x", event_get_version_number());
 
     /* Настройка максимального интервала диспетчеризации событий */
-    event_config_set_max_dispatch_interval(cfg, &msec_50 /*max_interval*/, 5 /*max_callbacks*/, 1 /*min-prio*/);
+    event_config_set_max_dispatch_interval(cfg, &msec_50 /*max_interval*/, 5 /*max_callbacks*/, STP_LIBEV_PKT_PRI_Q /*min-prio*/);
 
     /* Создание нового event_base с заданной конфигурацией */
     g_stpd_evbase = event_base_new_with_config(cfg);
@@ -418,15 +554,26 @@ int stpd_main()
     /* Инициализация приоритетов очередей событий */
     event_base_priority_init(g_stpd_evbase, STP_LIBEV_PRIO_QUEUES);
 
+    /* Завершение по SIGINT/SIGTERM через цикл событий */
+    if (-1 == stpd_signal_init(g_stpd_evbase))
+    {
+        STP_LOG_ERR("signal events create failed");
+        return -1;
+    }
+
     /* Создание высокоприоритетного таймера с интервалом 100 мс */
     evtimer_100ms = stpmgr_libevent_create(g_stpd_evbase, -1, EV_PERSIST,
-                                           stpmgr_100ms_timer, (char*)"100MS_TIMER", &stp_100ms_tv);
+                                           stpmgr_100ms_timer, (char*)"100MS_TIMER", &stp_100ms_tv, "TIMER_100MS");
     if (!evtimer_100ms)
     {
         STP_LOG_ERR("evtimer_100ms Create failed");
         return -1;
     }
 
+    /* Пул рабочих потоков, до первого сообщения IPC (stpmgr_init) */
+    if (-1 == stp_worker_init(g_stpd_evbase, STP_WORKER_THREADS))
+        STP_LOG_ERR("worker pool init failed, running on the main thread");
+
     /* Инициализация IPC для взаимодействия с менеджером STP <- WBOS_CLI */
     // rc = stpd_ipc_init();
     rc = stpd_ipc_wbos_init(UDP_PORT_SND);
@@ -456,7 +603,7 @@ int stpd_main()
      * @brief инициализация функции переодической отправки статуса в wbos для статистики и контроля состояния
      *
      */
-    evtimer_3000ms = stpmgr_libevent_create_periodic_sender(g_stpd_evbase, -1, EV_PERSIST, stpmgr_3000ms_timer, (void*)&stpd_context, &stp_3000ms_tv);
+    evtimer_3000ms = stpmgr_libevent_create_periodic_sender(g_stpd_evbase, -1, EV_PERSIST, stpmgr_3000ms_timer, (void*)&stpd_context, &stp_3000ms_tv, "TIMER_3000MS");
     if (!evtimer_3000ms)
     {
         STP_LOG_ERR("evtimer_3000ms for periodic send Create failed");
@@ -492,11 +639,25 @@ int stpd_main()
         return -1;
     }
 
+    // BPDUs are queued and sent with sendmmsg after each event callback
+    if (-1 == stp_pkt_tx_init(g_stpd_evbase))
+        STP_LOG_ERR("pkt tx batching init failed, sending per frame");
+
+#if STP_PKT_RX_RING
+    /* Single TPACKET_V3 ring for RX on all phy-ports, must be set up before
+     * the interface DB is populated. */
+    if (-1 == stp_pkt_rx_ring_init(g_stpd_evbase))
+        STP_LOG_ERR("pkt rx ring init failed, using per-port sockets");
+#endif
+
     // создаем ассинхонный
 
     STP_LOG_INFO("-------------------------------STP wbos Daemon Started-----------------------------------------------");
+    STPD_STARTUP_MARK(STPD_STARTUP_DISPATCH);
 
     event_base_dispatch(g_stpd_evbase);
 
+    // loop stopped by SIGINT/SIGTERM
+    cleanup();
     return 0;
 }
@@ -17,6 +17,10 @@
  * @see stp_mgr.h
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // recvmmsg
+#endif
+#include <linux/sock_diag.h>
 #include "stp_inc.h"
 #include "stp_main.h"
 
@@ -31,35 +35,200 @@ char msgtype_str[][64] = {
     "STP_PORT_CONFIG",
     "STP_VLAN_MEM_CONFIG",
     "STP_STPCTL_MSG",
+    "STP_WBOS_STATUS_MODE",
+    "STP_VLAN_BULK_CONFIG",
+    "STP_VLAN_MEM_BULK_CONFIG",
+    "STP_VLAN_GROUP_CONFIG",
     "STP_MAX_MSG"};
 
+/**
+ * @struct STPD_LIBEV_HOOK
+ * @brief Обёртка события libevent: исходный аргумент и расписание таймера.
+ */
+typedef struct
+{
+    STPD_LIBEV_PROF* prof; // Профиль обработчика.
+    void* arg;             // Аргумент, переданный в stpmgr_libevent_create().
+    uint64_t sched_us;     // Ожидаемое время следующего срабатывания таймера.
+} STPD_LIBEV_HOOK;
+
+/**
+ * @brief Возвращает монотонное время в микросекундах.
+ *
+ * CLOCK_MONOTONIC читается через vDSO без системного вызова и, в отличие
+ * от TSC, не требует калибровки частоты.
+ *
+ * @return uint64_t время в мкс
+ */
+static inline uint64_t stpmgr_mono_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static inline uint32_t stpd_lat_hist_index(uint64_t us)
+{
+    uint32_t magnitude;
+
+    if (us < STPD_LAT_HIST_SUB_BUCKETS)
+        return (uint32_t)us;
+
+    magnitude = 63 - __builtin_clzll(us);
+    if (magnitude > STPD_LAT_HIST_MAX_MAGNITUDE)
+        return STPD_LAT_HIST_BUCKETS - 1;
+
+    return (magnitude - STPD_LAT_HIST_SUB_BITS + 1) * STPD_LAT_HIST_SUB_BUCKETS +
+           ((us >> (magnitude - STPD_LAT_HIST_SUB_BITS)) & (STPD_LAT_HIST_SUB_BUCKETS - 1));
+}
+
+static inline void stpd_lat_hist_record(STPD_LAT_HIST* hist, uint64_t us)
+{
+    hist->count++;
+    hist->total_us += us;
+    if (us > hist->max_us)
+        hist->max_us = (us > UINT32_MAX) ? UINT32_MAX : (uint32_t)us;
+    hist->bucket[stpd_lat_hist_index(us)]++;
+}
+
+/**
+ * @brief Возвращает верхнюю границу корзины, в которую попадает заданный перцентиль.
+ *
+ * @param hist Гистограмма.
+ * @param permille Перцентиль в десятых долях процента (500 - медиана, 999 - p99.9).
+ * @return uint32_t значение перцентиля в мкс, не больше максимального измерения
+ */
+uint32_t stpd_lat_hist_percentile(const STPD_LAT_HIST* hist, uint32_t permille)
+{
+    uint64_t target, seen = 0;
+    uint32_t i, magnitude, upper;
+
+    if (hist->count == 0)
+        return 0;
+
+    target = (hist->count * permille + 999) / 1000;
+    for (i = 0; i < STPD_LAT_HIST_BUCKETS; i++)
+    {
+        seen += hist->bucket[i];
+        if (seen >= target)
+            break;
+    }
+
+    if (i < STPD_LAT_HIST_SUB_BUCKETS)
+        upper = i;
+    else
+    {
+        magnitude = i / STPD_LAT_HIST_SUB_BUCKETS + STPD_LAT_HIST_SUB_BITS - 1;
+        upper = (((i % STPD_LAT_HIST_SUB_BUCKETS) + STPD_LAT_HIST_SUB_BUCKETS + 1) << (magnitude - STPD_LAT_HIST_SUB_BITS)) - 1;
+    }
+
+    return (upper < hist->max_us) ? upper : hist->max_us;
+}
+
+/**
+ * @brief Сбрасывает накопленные гистограммы всех обработчиков libevent.
+ *
+ * @return void
+ */
+void stpmgr_libevent_prof_clear(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < g_stpd_libev_prof_count; i++)
+    {
+        memset(&g_stpd_libev_prof[i].run, 0, sizeof(STPD_LAT_HIST));
+        memset(&g_stpd_libev_prof[i].lag, 0, sizeof(STPD_LAT_HIST));
+    }
+}
+
+static STPD_LIBEV_PROF* stpmgr_libevent_prof_get(void* cb_fn, const char* name, const struct timeval* tv)
+{
+    STPD_LIBEV_PROF* prof;
+    uint8_t i;
+
+    for (i = 0; i < g_stpd_libev_prof_count; i++)
+    {
+        if (g_stpd_libev_prof[i].cb == cb_fn)
+            return &g_stpd_libev_prof[i];
+    }
+
+    if (g_stpd_libev_prof_count >= STPD_LIBEV_PROF_MAX)
+        return NULL;
+
+    prof = &g_stpd_libev_prof[g_stpd_libev_prof_count++];
+    memset(prof, 0, sizeof(*prof));
+    prof->cb = cb_fn;
+    snprintf(prof->name, sizeof(prof->name), "%s", name ? name : "-");
+    if (tv)
+        prof->interval_us = tv->tv_sec * 1000000 + tv->tv_usec;
+
+    return prof;
+}
+
+/**
+ * @brief Общий обработчик событий: замеряет опоздание таймера и время выполнения обработчика.
+ */
+static void stpmgr_libevent_prof_cb(evutil_socket_t fd, short what, void* arg)
+{
+    STPD_LIBEV_HOOK* hook = (STPD_LIBEV_HOOK*)arg;
+    STPD_LIBEV_PROF* prof = hook->prof; // обработчик может удалить своё событие вместе с hook
+    uint64_t start = stpmgr_mono_us();
+
+    if (prof->interval_us)
+    {
+        stpd_lat_hist_record(&prof->lag, (start > hook->sched_us) ? start - hook->sched_us : 0);
+        // libevent переносит EV_PERSIST таймер от расписания, а при отставании - от текущего времени
+        hook->sched_us += prof->interval_us;
+        if (hook->sched_us <= start)
+            hook->sched_us = start + prof->interval_us;
+    }
+
+    prof->cb(fd, what, hook->arg);
+
+    stpd_lat_hist_record(&prof->run, stpmgr_mono_us() - start);
+}
+
 void stpmgr_libevent_destroy(struct event* ev)
 {
     g_stpd_stats_libev_no_of_sockets--;
     event_del(ev);
+    if (event_get_callback(ev) == stpmgr_libevent_prof_cb)
+        free(event_get_callback_arg(ev));
 }
 
-struct event* stpmgr_libevent_create(struct event_base* base,
-                                     evutil_socket_t sock,
-                                     short flags,
-                                     void* cb_fn,
-                                     void* arg,
-                                     const struct timeval* tv)
+static struct event* stpmgr_libevent_new(struct event_base* base,
+                                         evutil_socket_t sock,
+                                         short flags,
+                                         void* cb_fn,
+                                         void* arg,
+                                         const struct timeval* tv,
+                                         const char* name,
+                                         int prio)
 {
     struct event* ev = 0;
-    int prio;
-
-    g_stpd_stats_libev_no_of_sockets++;
+    STPD_LIBEV_HOOK* hook;
+    STPD_LIBEV_PROF* prof;
 
-    if (-1 == sock) // 100ms timer
-        prio = STP_LIBEV_HIGH_PRI_Q;
+    prof = stpmgr_libevent_prof_get(cb_fn, name, (-1 == sock) ? tv : NULL);
+    if (prof)
+    {
+        hook = (STPD_LIBEV_HOOK*)calloc(1, sizeof(STPD_LIBEV_HOOK));
+        if (hook == NULL)
+            return NULL;
+        hook->prof = prof;
+        hook->arg = arg;
+        hook->sched_us = stpmgr_mono_us() + prof->interval_us;
+        ev = event_new(base, sock, flags, stpmgr_libevent_prof_cb, hook);
+        if (!ev)
+            free(hook);
+    }
     else
     {
-        prio = STP_LIBEV_LOW_PRI_Q;
-        evutil_make_socket_nonblocking(sock);
+        STP_LOG_INFO("libevent profile table full, %s is not profiled", name ? name : "-");
+        ev = event_new(base, sock, flags, cb_fn, arg);
     }
 
-    ev = event_new(base, sock, flags, cb_fn, arg);
     if (ev)
     {
         if (-1 == event_priority_set(ev, prio))
@@ -70,7 +239,7 @@ struct event* stpmgr_libevent_create(struct event_base* base,
 
         if (-1 != event_add(ev, tv))
         {
-            STP_LOG_DEBUG("Event Added : ev-%p, arg : %s", ev, (char*)arg);
+            STP_LOG_DEBUG("Event Added : ev-%p, name : %s", ev, name ? name : "-");
             STP_LOG_DEBUG("base : %p, sock : %d, flags : %x, cb_fn : %p", base, sock, flags, cb_fn);
             if (tv)
                 STP_LOG_DEBUG("tv.sec : %u, tv.usec : %u", tv->tv_sec, tv->tv_usec);
@@ -81,38 +250,55 @@ struct event* stpmgr_libevent_create(struct event_base* base,
     return NULL;
 }
 
+struct event* stpmgr_libevent_create(struct event_base* base,
+                                     evutil_socket_t sock,
+                                     short flags,
+                                     void* cb_fn,
+                                     void* arg,
+                                     const struct timeval* tv,
+                                     const char* name)
+{
+    // 100ms timer first, IPC sockets after BPDU rx and netlink
+    return stpmgr_libevent_create_prio(base, sock, flags, cb_fn, arg, tv, name,
+                                       (-1 == sock) ? STP_LIBEV_HIGH_PRI_Q : STP_LIBEV_LOW_PRI_Q);
+}
+
+/**
+ * @brief Регистрирует событие libevent в заданной очереди приоритета.
+ *
+ * Используется для приёма BPDU и Netlink (STP_LIBEV_PKT_PRI_Q), чтобы они
+ * обслуживались раньше IPC.
+ *
+ * @param prio Очередь приоритета STP_LIBEV_*_PRI_Q.
+ *
+ * @return Событие или NULL при ошибке.
+ */
+struct event* stpmgr_libevent_create_prio(struct event_base* base,
+                                          evutil_socket_t sock,
+                                          short flags,
+                                          void* cb_fn,
+                                          void* arg,
+                                          const struct timeval* tv,
+                                          const char* name,
+                                          int prio)
+{
+    g_stpd_stats_libev_no_of_sockets++;
+
+    if (-1 != sock)
+        evutil_make_socket_nonblocking(sock);
+
+    return stpmgr_libevent_new(base, sock, flags, cb_fn, arg, tv, name, prio);
+}
+
 struct event* stpmgr_libevent_create_periodic_sender(struct event_base* base,
                                                      evutil_socket_t sock,
                                                      short flags,
                                                      void* cb_fn,
                                                      void* arg,
-                                                     const struct timeval* tv)
+                                                     const struct timeval* tv,
+                                                     const char* name)
 {
-    struct event* ev = 0;
-    int prio;
-
-    prio = STP_LIBEV_LOW_PRI_Q;
-
-    ev = event_new(base, sock, flags, cb_fn, arg);
-    if (ev)
-    {
-        if (-1 == event_priority_set(ev, prio))
-        {
-            STP_LOG_ERR("event_priority_set failed");
-            return NULL;
-        }
-
-        if (-1 != event_add(ev, tv))
-        {
-            STP_LOG_DEBUG("Event Added for periodic sender : ev-%p, arg", ev);
-            STP_LOG_DEBUG("base : %p, sock : %d, flags : %x, cb_fn : %p", base, sock, flags, cb_fn);
-            if (tv)
-                STP_LOG_DEBUG("tv.sec : %u, tv.usec : %u", tv->tv_sec, tv->tv_usec);
-
-            return ev;
-        }
-    }
-    return NULL;
+    return stpmgr_libevent_new(base, sock, flags, cb_fn, arg, tv, name, STP_LIBEV_LOW_PRI_Q);
 }
 
 /**
@@ -180,8 +366,7 @@ void stpmgr_initialize_stp_class(STP_CLASS* stp_class, VLAN_ID vlan_id)
     stp_class->bridge_info.max_age = stp_class->bridge_info.bridge_max_age;
     stp_class->bridge_info.hello_time = stp_class->bridge_info.bridge_hello_time;
     stp_class->bridge_info.forward_delay = stp_class->bridge_info.bridge_forward_delay;
-    SET_ALL_BITS(stp_class->bridge_info.modified_fields);
-    SET_ALL_BITS(stp_class->modified_fields);
+    STP_SET_CLASS_MODIFIED_ALL(stp_class);
 }
 
 /**
@@ -211,6 +396,69 @@ void stpmgr_initialize_control_port(STP_CLASS* stp_class, PORT_ID port_number)
     stp_port_class->auto_config = true;
 }
 
+/**
+ * @brief Начинает пакетное изменение конфигурации.
+ *
+ * До парного вызова stpmgr_batch_end() пересчёт состояний портов
+ * (configuration_update() и port_state_selection()) при добавлении портов и
+ * изменении их стоимости или приоритета откладывается и выполняется один раз
+ * на экземпляр. Вызовы могут быть вложенными.
+ *
+ * @return void
+ */
+void stpmgr_batch_begin()
+{
+    g_stp_batch_depth++;
+}
+
+/**
+ * @brief Завершает пакетное изменение конфигурации и выполняет отложенный пересчёт.
+ *
+ * @return void
+ */
+void stpmgr_batch_end()
+{
+    STP_CLASS* stp_class;
+    BMP_ITER_T it;
+    BMP_ID index;
+
+    if (g_stp_batch_depth == 0 || --g_stp_batch_depth)
+        return;
+
+    if (g_stp_batch_class_mask == NULL || !bmp_isset_any(g_stp_batch_class_mask))
+        return;
+
+    BMP_FOR_EACH_SET_BIT(g_stp_batch_class_mask, it, index)
+    {
+        bmp_reset(g_stp_batch_class_mask, index);
+        if (index >= g_stp_instances)
+            continue;
+
+        stp_class = GET_STP_CLASS(index);
+        if (stp_class->state != STP_CLASS_ACTIVE)
+            continue;
+
+        configuration_update(stp_class);
+        port_state_selection(stp_class);
+    }
+}
+
+/**
+ * @brief Откладывает пересчёт состояний портов экземпляра до конца пакета.
+ *
+ * @param stp_class Указатель на структуру `STP_CLASS`.
+ *
+ * @return `true`, если идёт пакетное изменение и пересчёт отложен.
+ */
+static bool stpmgr_batch_defer(STP_CLASS* stp_class)
+{
+    if (!g_stp_batch_depth || !g_stp_batch_class_mask)
+        return false;
+
+    bmp_set(g_stp_batch_class_mask, GET_STP_INDEX(stp_class));
+    return true;
+}
+
 /**
  * @brief Активирует указанный экземпляр STP.
  *
@@ -234,6 +482,7 @@ void stpmgr_activate_stp_class(STP_CLASS* stp_class)
     port_state_selection(stp_class);
     config_bpdu_generation(stp_class);
     stptimer_start(&stp_class->hello_timer, 0);
+    stptimer_class_wakeup(stp_class);
 }
 
 /**
@@ -256,6 +505,7 @@ void stpmgr_deactivate_stp_class(STP_CLASS* stp_class)
     stptimer_stop(&stp_class->tcn_timer);
     stptimer_stop(&stp_class->topology_change_timer);
     stptimer_stop(&stp_class->hello_timer);
+    stptimer_unschedule_class(stp_class);
 
     if (stp_class->bridge_info.topology_change)
     {
@@ -331,7 +581,8 @@ void stpmgr_enable_port(STP_CLASS* stp_class, PORT_ID port_number)
 
     stpmgr_initialize_port(stp_class, port_number);
 
-    port_state_selection(stp_class);
+    if (!stpmgr_batch_defer(stp_class))
+        port_state_selection(stp_class);
 }
 
 /* 8.8.3 */
@@ -400,6 +651,7 @@ void stpmgr_disable_port(STP_CLASS* stp_class, PORT_ID port_number)
         stptimer_stop(&stp_class->tcn_timer);
         config_bpdu_generation(stp_class);
         stptimer_start(&stp_class->hello_timer, 0);
+        stptimer_class_wakeup(stp_class);
 
         stplog_topo_change(stp_class, port_number, STP_DISABLE_PORT);
         stplog_new_root(stp_class, STP_DISABLE_PORT);
@@ -434,7 +686,7 @@ void stpmgr_set_bridge_priority(STP_CLASS* stp_class, BRIDGE_IDENTIFIER* bridge_
         if (designated_port(stp_class, port_number))
         {
             stp_port_class->designated_bridge = *bridge_id;
-            SET_BIT(stp_port_class->modified_fields, STP_PORT_CLASS_MEMBER_DESIGN_BRIDGE_BIT);
+            STP_SET_PORT_MODIFIED(stp_class, stp_port_class, STP_PORT_CLASS_MEMBER_DESIGN_BRIDGE_BIT);
         }
 
         port_number = port_mask_get_next_port(stp_class->enable_mask, port_number);
@@ -457,6 +709,7 @@ void stpmgr_set_bridge_priority(STP_CLASS* stp_class, BRIDGE_IDENTIFIER* bridge_
             stptimer_stop(&stp_class->tcn_timer);
             config_bpdu_generation(stp_class);
             stptimer_start(&stp_class->hello_timer, 0);
+            stptimer_class_wakeup(stp_class);
 
             stplog_new_root(stp_class, STP_CHANGE_PRIORITY);
         }
@@ -494,15 +747,16 @@ void stpmgr_set_port_priority(STP_CLASS* stp_class, PORT_ID port_number, UINT16
     }
 
     stp_port_class->port_id.priority = priority >> 4;
-    SET_BIT(stp_port_class->modified_fields, STP_PORT_CLASS_MEMBER_PORT_PRIORITY_BIT);
+    STP_SET_PORT_MODIFIED(stp_class, stp_port_class, STP_PORT_CLASS_MEMBER_PORT_PRIORITY_BIT);
 
     if (stputil_compare_bridge_id(&stp_class->bridge_info.bridge_id, &stp_port_class->designated_bridge) == EQUAL_TO &&
         stputil_compare_port_id(&stp_port_class->port_id, &stp_port_class->designated_port) == LESS_THAN)
     {
         become_designated_port(stp_class, port_number);
-        port_state_selection(stp_class);
+        if (!stpmgr_batch_defer(stp_class))
+            port_state_selection(stp_class);
 
-        SET_BIT(stp_port_class->modified_fields, STP_PORT_CLASS_MEMBER_DESIGN_PORT_BIT);
+        STP_SET_PORT_MODIFIED(stp_class, stp_port_class, STP_PORT_CLASS_MEMBER_DESIGN_PORT_BIT);
     }
 }
 
@@ -530,6 +784,9 @@ void stpmgr_set_path_cost(STP_CLASS* stp_class, PORT_ID port_number, bool auto_c
     stp_port_class->path_cost = path_cost;
     stp_port_class->auto_config = auto_config;
 
+    if (stpmgr_batch_defer(stp_class))
+        return;
+
     configuration_update(stp_class);
     port_state_selection(stp_class);
 }
@@ -596,9 +853,10 @@ void stpmgr_set_bridge_params(STP_CLASS* stp_class)
         stp_class->bridge_info.max_age = stp_class->bridge_info.bridge_max_age;
         stp_class->bridge_info.hello_time = stp_class->bridge_info.bridge_hello_time;
         stp_class->bridge_info.forward_delay = stp_class->bridge_info.bridge_forward_delay;
-        SET_BIT(stp_class->bridge_info.modified_fields, STP_BRIDGE_DATA_MEMBER_MAX_AGE_BIT);
-        SET_BIT(stp_class->bridge_info.modified_fields, STP_BRIDGE_DATA_MEMBER_HELLO_TIME_BIT);
-        SET_BIT(stp_class->bridge_info.modified_fields, STP_BRIDGE_DATA_MEMBER_FWD_DELAY_BIT);
+        STP_SET_BRIDGE_MODIFIED(stp_class, STP_BRIDGE_DATA_MEMBER_MAX_AGE_BIT);
+        STP_SET_BRIDGE_MODIFIED(stp_class, STP_BRIDGE_DATA_MEMBER_HELLO_TIME_BIT);
+        STP_SET_BRIDGE_MODIFIED(stp_class, STP_BRIDGE_DATA_MEMBER_FWD_DELAY_BIT);
+        stptimer_class_wakeup(stp_class);
     }
 }
 
@@ -641,15 +899,14 @@ bool stpmgr_config_bridge_priority(STP_INDEX stp_index, UINT16 priority)
         {
             stpmgr_set_bridge_priority(stp_class, &bridge_id);
             /* Sync to APP DB */
-            SET_ALL_BITS(stp_class->bridge_info.modified_fields);
-            SET_ALL_BITS(stp_class->modified_fields);
+            STP_SET_CLASS_MODIFIED_ALL(stp_class);
         }
         else
         {
             stp_class->bridge_info.bridge_id = bridge_id;
             stp_class->bridge_info.root_id = bridge_id;
-            SET_BIT(stp_class->bridge_info.modified_fields, STP_BRIDGE_DATA_MEMBER_BRIDGE_ID_BIT);
-            SET_BIT(stp_class->bridge_info.modified_fields, STP_BRIDGE_DATA_MEMBER_ROOT_ID_BIT);
+            STP_SET_BRIDGE_MODIFIED(stp_class, STP_BRIDGE_DATA_MEMBER_BRIDGE_ID_BIT);
+            STP_SET_BRIDGE_MODIFIED(stp_class, STP_BRIDGE_DATA_MEMBER_ROOT_ID_BIT);
         }
     }
 
@@ -688,7 +945,7 @@ bool stpmgr_config_bridge_max_age(STP_INDEX stp_index, UINT16 max_age)
     if (max_age && stp_class->bridge_info.bridge_max_age != max_age)
     {
         stp_class->bridge_info.bridge_max_age = (UINT8)max_age;
-        SET_BIT(stp_class->bridge_info.modified_fields, STP_BRIDGE_DATA_MEMBER_BRIDGE_MAX_AGE_BIT);
+        STP_SET_BRIDGE_MODIFIED(stp_class, STP_BRIDGE_DATA_MEMBER_BRIDGE_MAX_AGE_BIT);
         stpmgr_set_bridge_params(stp_class);
     }
     return true;
@@ -726,7 +983,7 @@ bool stpmgr_config_bridge_hello_time(STP_INDEX stp_index, UINT16 hello_time)
     if (hello_time && stp_class->bridge_info.bridge_hello_time != hello_time)
     {
         stp_class->bridge_info.bridge_hello_time = (UINT8)hello_time;
-        SET_BIT(stp_class->bridge_info.modified_fields, STP_BRIDGE_DATA_MEMBER_BRIDGE_HELLO_TIME_BIT);
+        STP_SET_BRIDGE_MODIFIED(stp_class, STP_BRIDGE_DATA_MEMBER_BRIDGE_HELLO_TIME_BIT);
         stpmgr_set_bridge_params(stp_class);
     }
     return true;
@@ -765,7 +1022,7 @@ bool stpmgr_config_bridge_forward_delay(STP_INDEX stp_index, UINT16 fwd_delay)
     if (fwd_delay && stp_class->bridge_info.bridge_forward_delay != fwd_delay)
     {
         stp_class->bridge_info.bridge_forward_delay = (UINT8)fwd_delay;
-        SET_BIT(stp_class->bridge_info.modified_fields, STP_BRIDGE_DATA_MEMBER_BRIDGE_FWD_DELAY_BIT);
+        STP_SET_BRIDGE_MODIFIED(stp_class, STP_BRIDGE_DATA_MEMBER_BRIDGE_FWD_DELAY_BIT);
         stpmgr_set_bridge_params(stp_class);
     }
 
@@ -831,7 +1088,7 @@ bool stpmgr_config_port_priority(STP_INDEX stp_index, PORT_ID port_number, UINT1
     {
         stp_port->port_id.priority = priority >> 4;
     }
-    SET_BIT(stp_port->modified_fields, STP_PORT_CLASS_MEMBER_PORT_PRIORITY_BIT);
+    STP_SET_PORT_MODIFIED(stp_class, stp_port, STP_PORT_CLASS_MEMBER_PORT_PRIORITY_BIT);
     return true;
 }
 
@@ -908,11 +1165,34 @@ bool stpmgr_config_port_path_cost(STP_INDEX stp_index, PORT_ID port_number, bool
         stp_port->path_cost = path_cost;
         stp_port->auto_config = auto_config;
     }
-    SET_BIT(stp_port->modified_fields, STP_PORT_CLASS_MEMBER_PATH_COST_BIT);
+    STP_SET_PORT_MODIFIED(stp_class, stp_port, STP_PORT_CLASS_MEMBER_PATH_COST_BIT);
 
     return true;
 }
 
+/**
+ * @brief Обнуляет счётчики BPDU порта.
+ *
+ * Значения сначала добавляются в STP_PORT_CLASS::cleared, поэтому
+ * счётчики экспорта продолжают расти после очистки статистики.
+ *
+ * @param stp_port Порт экземпляра STP.
+ *
+ * @return void
+ */
+static void stpmgr_reset_port_counters(STP_PORT_CLASS* stp_port)
+{
+    stp_port->cleared.rx_config_bpdu += stp_port->rx_config_bpdu;
+    stp_port->cleared.tx_config_bpdu += stp_port->tx_config_bpdu;
+    stp_port->cleared.rx_tcn_bpdu += stp_port->rx_tcn_bpdu;
+    stp_port->cleared.tx_tcn_bpdu += stp_port->tx_tcn_bpdu;
+
+    stp_port->rx_config_bpdu =
+        stp_port->rx_tcn_bpdu =
+            stp_port->tx_config_bpdu =
+                stp_port->tx_tcn_bpdu = 0;
+}
+
 /*****************************************************************************/
 /* stpmgr_clear_port_statistics: clears the bpdu statistics associated with  */
 /* input port.                                                               */
@@ -941,13 +1221,8 @@ static void stpmgr_clear_port_statistics(STP_CLASS* stp_class, PORT_ID port_numb
         {
             stp_port = GET_STP_PORT_CLASS(stp_class, port_number);
             if (stp_port != NULL)
-            {
-                stp_port->rx_config_bpdu =
-                    stp_port->rx_tcn_bpdu =
-                        stp_port->tx_config_bpdu =
-                            stp_port->tx_tcn_bpdu = 0;
-            }
-            SET_BIT(stp_port->modified_fields, STP_PORT_CLASS_CLEAR_STATS_BIT);
+                stpmgr_reset_port_counters(stp_port);
+            STP_SET_PORT_MODIFIED(stp_class, stp_port, STP_PORT_CLASS_CLEAR_STATS_BIT);
             stputil_sync_port_counters(stp_class, stp_port);
             port_number = port_mask_get_next_port(stp_class->control_mask, port_number);
         }
@@ -957,11 +1232,8 @@ static void stpmgr_clear_port_statistics(STP_CLASS* stp_class, PORT_ID port_numb
         stp_port = GET_STP_PORT_CLASS(stp_class, port_number);
         if (stp_port != NULL)
         {
-            stp_port->rx_config_bpdu =
-                stp_port->rx_tcn_bpdu =
-                    stp_port->tx_config_bpdu =
-                        stp_port->tx_tcn_bpdu = 0;
-            SET_BIT(stp_port->modified_fields, STP_PORT_CLASS_CLEAR_STATS_BIT);
+            stpmgr_reset_port_counters(stp_port);
+            STP_SET_PORT_MODIFIED(stp_class, stp_port, STP_PORT_CLASS_CLEAR_STATS_BIT);
             stputil_sync_port_counters(stp_class, stp_port);
         }
     }
@@ -1010,6 +1282,142 @@ void stpmgr_clear_statistics(VLAN_ID vlan_id, PORT_ID port_number)
     }
 }
 
+/**
+ * @brief Возвращает экземпляр, в который сгруппирован VLAN.
+ *
+ * @param vlan_id Идентификатор VLAN.
+ *
+ * @return Экземпляр STP или NULL, если VLAN не сгруппирован (в том числе
+ *         если он основной VLAN своего экземпляра).
+ */
+static STP_CLASS* stpmgr_get_group_class(VLAN_ID vlan_id)
+{
+    STP_CLASS* stp_class = stputil_get_class_from_vlan(vlan_id);
+
+    if (stp_class && STP_IS_GROUP_VLAN(stp_class, vlan_id))
+        return stp_class;
+    return NULL;
+}
+
+/**
+ * @brief Исключает VLAN из общего экземпляра STP.
+ *
+ * VLAN возвращается в STG по умолчанию. Заблокированные порты VLAN остаются
+ * заблокированными в ядре, пока VLAN не получит свой экземпляр или STP на
+ * нём не будет выключен.
+ *
+ * @param stp_index Индекс экземпляра STP.
+ * @param vlan_id Сгруппированный VLAN.
+ *
+ * @return void
+ */
+static void stpmgr_group_del_vlan(STP_INDEX stp_index, VLAN_ID vlan_id)
+{
+    STP_CLASS* stp_class = GET_STP_CLASS(stp_index);
+
+    if (!STP_IS_GROUP_VLAN(stp_class, vlan_id))
+        return;
+
+    bmp_reset(stp_class->group_vlan_mask, vlan_id);
+    stp_class->group_vlan_count--;
+    if (g_stp_vlan_index_map[vlan_id] == stp_index)
+        g_stp_vlan_index_map[vlan_id] = STP_INDEX_INVALID;
+
+    stpsync_del_vlan_from_instance(vlan_id, stp_index);
+    stputil_group_vlan_leave(stp_class, vlan_id);
+}
+
+/**
+ * @brief Переносит порты VLAN из его собственного экземпляра перед группировкой.
+ *
+ * Порты запоминаются с режимом тегирования и состоянием в ядре, а кэш
+ * `kernel_state` отмечается FORWARDING, чтобы освобождение экземпляра не
+ * открыло заблокированные порты до их перепрограммирования группой.
+ *
+ * @param stp_class Собственный экземпляр VLAN.
+ *
+ * @return void
+ */
+static void stpmgr_group_hold_vlan_ports(STP_CLASS* stp_class)
+{
+    STP_GROUP_VLAN* group = stpdata_group_vlan_get(stp_class->vlan_id, true);
+    STP_PORT_CLASS* stp_port_class;
+    PORT_MASK_ITER it;
+    PORT_ID port_number;
+
+    if (!group)
+        return;
+
+    group->stp_index = STP_INDEX_INVALID;
+    PORT_MASK_FOR_EACH_PORT(stp_class->control_mask, it, port_number)
+    {
+        stp_port_class = GET_STP_PORT_CLASS(stp_class, port_number);
+        set_mask_bit(group->member_mask, port_number);
+        if (is_member(stp_class->untag_mask, port_number))
+            set_mask_bit(group->untag_mask, port_number);
+        if (stp_port_class->kernel_state == STP_KERNEL_STATE_BLOCKING)
+            set_mask_bit(group->blocked_mask, port_number);
+        stp_port_class->kernel_state = STP_KERNEL_STATE_FORWARD;
+    }
+}
+
+/**
+ * @brief Добавляет VLAN в общий экземпляр STP.
+ *
+ * Собственный экземпляр VLAN освобождается, VLAN из другой группы
+ * переносится. Если VLAN был основным VLAN другого экземпляра, тот
+ * экземпляр освобождается вместе со своей группой.
+ *
+ * @param stp_index Индекс экземпляра STP, созданного для основного VLAN.
+ * @param vlan_id Идентификатор VLAN.
+ *
+ * @return `true`, если VLAN сгруппирован в экземпляр.
+ */
+static bool stpmgr_group_add_vlan(STP_INDEX stp_index, VLAN_ID vlan_id)
+{
+    STP_CLASS* stp_class = GET_STP_CLASS(stp_index);
+    STP_INDEX old_index;
+
+    if (stp_class->state == STP_CLASS_FREE)
+    {
+        STP_LOG_ERR("inst %u not configured, vlan %u not grouped", stp_index, vlan_id);
+        return false;
+    }
+
+    if (stp_class->vlan_id == vlan_id || STP_IS_GROUP_VLAN(stp_class, vlan_id))
+        return true;
+
+    if (stputil_get_index_from_vlan(vlan_id, &old_index))
+    {
+        if (STP_IS_GROUP_VLAN(GET_STP_CLASS(old_index), vlan_id))
+        {
+            stpmgr_group_del_vlan(old_index, vlan_id);
+        }
+        else
+        {
+            if (GET_STP_CLASS(old_index)->group_vlan_count)
+                STP_LOG_INFO("inst %u of vlan %u released with %u grouped vlans", old_index, vlan_id,
+                             GET_STP_CLASS(old_index)->group_vlan_count);
+            stpmgr_group_hold_vlan_ports(GET_STP_CLASS(old_index));
+            stpmgr_release_index(old_index);
+        }
+    }
+
+    if (stp_class->group_vlan_mask == NULL && bmp_alloc(&stp_class->group_vlan_mask, MAX_VLAN_ID + 1) != 0)
+    {
+        STP_LOG_ERR("inst %u group vlan mask alloc failed", stp_index);
+        return false;
+    }
+
+    bmp_set(stp_class->group_vlan_mask, vlan_id);
+    stp_class->group_vlan_count++;
+    g_stp_vlan_index_map[vlan_id] = stp_index;
+
+    stpsync_add_vlan_to_instance(vlan_id, stp_index);
+    stputil_group_vlan_join(stp_class, vlan_id);
+    return true;
+}
+
 /* FUNCTION
  *		stpmgr_release_index()
  *
@@ -1049,6 +1457,16 @@ bool stpmgr_release_index(STP_INDEX stp_index)
     clear_mask(stp_class->enable_mask);
     stpmgr_deactivate_stp_class(stp_class);
 
+    // grouped VLANs keep their blocked ports, control ports below open only the instance VLAN
+    if (stp_class->group_vlan_count)
+    {
+        BMP_ITER_T it;
+        BMP_ID vlan_id;
+
+        BMP_FOR_EACH_SET_BIT(stp_class->group_vlan_mask, it, vlan_id)
+            stpmgr_group_del_vlan(stp_index, vlan_id);
+    }
+
     port_number = port_mask_get_first_port(stp_class->control_mask);
     while (port_number != BAD_PORT_ID)
     {
@@ -1106,7 +1524,14 @@ bool stpmgr_add_control_port(STP_INDEX stp_index, PORT_ID port_number, uint8_t m
     if (is_member(stp_class->control_mask, port_number))
         return true;
 
+    if (stpdata_ensure_port_class(stp_class, port_number) == NULL)
+    {
+        STP_LOG_ERR("inst %d port %d not added, no port class", stp_index, port_number);
+        return false;
+    }
+
     set_mask_bit(stp_class->control_mask, port_number);
+    stp_pkt_sock_enable(port_number);
 
     if (mode == 0) // UnTagged mode //если сюда попали с мод0 то будет циско бпду
         set_mask_bit(stp_class->untag_mask, port_number);
@@ -1125,7 +1550,7 @@ bool stpmgr_add_control_port(STP_INDEX stp_index, PORT_ID port_number, uint8_t m
 
     if (stp_port_class)
     {
-        SET_ALL_BITS(stp_port_class->modified_fields);
+        STP_SET_PORT_MODIFIED_ALL(stp_class, stp_port_class);
     }
 
     return true;
@@ -1199,6 +1624,8 @@ bool stpmgr_delete_control_port(STP_INDEX stp_index, PORT_ID port_number, bool d
 
     clear_mask_bit(stp_class->control_mask, port_number);
     clear_mask_bit(stp_class->untag_mask, port_number);
+    stpdata_release_port_class(stp_class, port_number);
+    stputil_mark_wbos_port(stp_class, port_number);
 
     return true;
 }
@@ -1359,13 +1786,12 @@ static void stpmgr_update_stats(STP_INDEX stp_index, PORT_ID port_number, void*
  *
  * @param stp_index Индекс экземпляра STP, к которому относится BPDU.
  * @param port_number Идентификатор порта, с которого получен BPDU.
- * @param buffer Указатель на буфер с данными PVST BPDU.
+ * @param bpdu PVST BPDU, разобранный stp_bpdu_decode().
  *
  * @return void
  */
-void stpmgr_process_pvst_bpdu(STP_INDEX stp_index, PORT_ID port_number, void* buffer)
+void stpmgr_process_pvst_bpdu(STP_INDEX stp_index, PORT_ID port_number, STP_CONFIG_BPDU* bpdu)
 {
-    STP_CONFIG_BPDU* bpdu;
     STP_CLASS* stp_class;
 
     stp_class = GET_STP_CLASS(stp_index);
@@ -1379,11 +1805,6 @@ void stpmgr_process_pvst_bpdu(STP_INDEX stp_index, PORT_ID port_number, void* bu
         return;
     }
 
-    // hack the pointer to make it appear as a config bpdu so that the
-    // rest of the routines can be called without any problems.
-    bpdu = (STP_CONFIG_BPDU*)(((UINT8*)buffer) + 5);
-
-    stputil_decode_bpdu(bpdu);
     stpmgr_update_stats(stp_index, port_number, bpdu, true /* pvst */);
     stputil_process_bpdu(stp_index, port_number, (void*)bpdu);
 }
@@ -1405,13 +1826,12 @@ void stpmgr_process_pvst_bpdu(STP_INDEX stp_index, PORT_ID port_number, void* bu
  *
  * @param stp_index Индекс экземпляра STP, к которому относится BPDU.
  * @param port_number Идентификатор порта, с которого получен BPDU.
- * @param buffer Указатель на буфер с данными STP BPDU.
+ * @param bpdu STP BPDU, разобранный stp_bpdu_decode().
  *
  * @return void
  */
-void stpmgr_process_stp_bpdu(STP_INDEX stp_index, PORT_ID port_number, void* buffer)
+void stpmgr_process_stp_bpdu(STP_INDEX stp_index, PORT_ID port_number, STP_CONFIG_BPDU* bpdu)
 {
-    STP_CONFIG_BPDU* bpdu = (STP_CONFIG_BPDU*)buffer;
     STP_CLASS* stp_class = GET_STP_CLASS(stp_index);
 
     if (!is_member(stp_class->enable_mask, port_number))
@@ -1423,9 +1843,8 @@ void stpmgr_process_stp_bpdu(STP_INDEX stp_index, PORT_ID port_number, void* buf
         return;
     }
 
-    stputil_decode_bpdu(bpdu);
     stpmgr_update_stats(stp_index, port_number, bpdu, false /* pvst */);
-    stputil_process_bpdu(stp_index, port_number, buffer);
+    stputil_process_bpdu(stp_index, port_number, bpdu);
 }
 
 /* FUNCTION
@@ -1464,6 +1883,9 @@ void stpmgr_config_fastuplink(PORT_ID port_number, bool enable)
 
         clear_mask_bit(g_fastuplink_mask, port_number);
     }
+
+    // forward delay limits depend on fastuplink
+    stptimer_wakeup_all();
 }
 
 /* FUNCTION
@@ -1557,6 +1979,9 @@ static bool stpmgr_config_fastspan(PORT_ID port_id, bool enable)
         clear_mask_bit(g_fastspan_mask, port_id);
         stpsync_update_port_fast(stp_intf_get_port_name(port_id), false);
     }
+
+    // forward delay limits depend on fastspan
+    stptimer_wakeup_all();
     return ret;
 }
 
@@ -1598,6 +2023,9 @@ static bool stpmgr_config_protect(PORT_ID port_id, bool enable, bool do_disable)
             clear_mask_bit(stp_global.protect_do_disable_mask, port_id);
 
         set_mask_bit(stp_global.protect_mask, port_id);
+
+        // BPDU guard acts on BPDUs of ports outside STP instances too
+        stp_pkt_sock_enable(port_id);
     }
     else
     {
@@ -1642,6 +2070,8 @@ static bool stpmgr_config_root_protect(PORT_ID port_id, bool enable)
     else
         clear_mask_bit(stp_global.root_protect_mask, port_id);
 
+    // a running root protect timer expires once the port is unconfigured
+    stptimer_wakeup_all();
     return true;
 }
 
@@ -1672,6 +2102,7 @@ static bool stpmgr_config_root_protect_timeout(UINT timeout)
     }
 
     stp_global.root_protect_timeout = timeout;
+    stptimer_wakeup_all();
     return true;
 }
 
@@ -1776,7 +2207,7 @@ void stpmgr_port_event(PORT_ID port_number, bool up)
             stp_port->path_cost = path_cost;
         }
         (*func)(index, port_number);
-        SET_ALL_BITS(stp_port->modified_fields);
+        STP_SET_PORT_MODIFIED_ALL(stp_class, stp_port);
     }
 }
 
@@ -1796,8 +2227,10 @@ void stpmgr_port_event(PORT_ID port_number, bool up)
 void stpmgr_rx_stp_bpdu(uint16_t vlan_id, uint32_t port_id, char* pkt)
 {
     STP_INDEX stp_index = STP_INDEX_INVALID;
-    STP_CONFIG_BPDU* bpdu = NULL;
+    STP_CONFIG_BPDU decoded;
+    STP_CONFIG_BPDU* bpdu = &decoded;
     bool flag = true;
+    int result;
 
     // check for stp protect configuration.
     if (stpmgr_protect_process(port_id, vlan_id))
@@ -1805,10 +2238,9 @@ void stpmgr_rx_stp_bpdu(uint16_t vlan_id, uint32_t port_id, char* pkt)
         return;
     }
 
-    bpdu = (STP_CONFIG_BPDU*)pkt;
-
-    // validate bpdu
-    if (!stputil_validate_bpdu(bpdu))
+    // validate and decode bpdu
+    result = stp_bpdu_decode((const UINT8*)pkt, false /* pvst */, bpdu);
+    if (result == STP_BPDU_RX_INVALID)
     {
         if (STP_DEBUG_BPDU_RX(vlan_id, port_id))
         {
@@ -1838,6 +2270,12 @@ void stpmgr_rx_stp_bpdu(uint16_t vlan_id, uint32_t port_id, char* pkt)
     }
 
     // rstp/stp processing
+    if (flag && stp_index != STP_INDEX_INVALID && STP_IS_GROUP_VLAN(GET_STP_CLASS(stp_index), vlan_id))
+    {
+        GET_STP_CLASS(stp_index)->rx_drop_bpdu++;
+        flag = false; // grouped VLANs carry no BPDUs
+    }
+
     if (!flag)
     {
         if (bpdu->protocol_version_id == STP_VERSION_ID)
@@ -1857,13 +2295,12 @@ void stpmgr_rx_stp_bpdu(uint16_t vlan_id, uint32_t port_id, char* pkt)
     if (stp_index != STP_INDEX_INVALID)
     {
         // ieee 802.1d 9.3.4 validation of bpdus.
-        if (bpdu->type != TCN_BPDU_TYPE &&
-            ntohs(bpdu->message_age) >= ntohs(bpdu->max_age))
+        if (result == STP_BPDU_RX_AGED)
         {
             STP_LOG_INFO("Invalid BPDU (message age %u exceeds max age %u)",
-                         ntohs(bpdu->message_age), ntohs(bpdu->max_age));
+                         bpdu->message_age, bpdu->max_age);
         }
-        else
+        else if (!stp_worker_enqueue_rx(stp_index, port_id, bpdu, false /* pvst */))
         {
             stpmgr_process_stp_bpdu(stp_index, port_id, bpdu);
         }
@@ -1899,7 +2336,9 @@ void stpmgr_rx_stp_bpdu(uint16_t vlan_id, uint32_t port_id, char* pkt)
 void stpmgr_rx_pvst_bpdu(uint16_t vlan_id, uint32_t port_id, void* pkt)
 {
     STP_INDEX stp_index = STP_INDEX_INVALID;
-    PVST_CONFIG_BPDU* bpdu = NULL;
+    STP_CONFIG_BPDU decoded;
+    STP_CONFIG_BPDU* bpdu = &decoded;
+    int result;
 
     // check for stp protect configuration.
     if (stpmgr_protect_process(port_id, vlan_id))
@@ -1913,9 +2352,9 @@ void stpmgr_rx_pvst_bpdu(uint16_t vlan_id, uint32_t port_id, void* pkt)
         return;
     }
 
-    // validate pvst bpdu
-    bpdu = (PVST_CONFIG_BPDU*)(((UINT8*)pkt));
-    if (!stputil_validate_pvst_bpdu(bpdu))
+    // validate and decode pvst bpdu
+    result = stp_bpdu_decode((const UINT8*)pkt, true /* pvst */, bpdu);
+    if (result == STP_BPDU_RX_INVALID)
     {
         if (STP_DEBUG_BPDU_RX(vlan_id, port_id))
         {
@@ -1939,17 +2378,26 @@ void stpmgr_rx_pvst_bpdu(uint16_t vlan_id, uint32_t port_id, void* pkt)
 
     stputil_get_index_from_vlan(vlan_id, &stp_index);
 
+    // grouped VLANs carry no BPDUs, the instance runs in its primary VLAN
+    if (stp_index != STP_INDEX_INVALID && STP_IS_GROUP_VLAN(GET_STP_CLASS(stp_index), vlan_id))
+    {
+        if (STP_DEBUG_BPDU_RX(vlan_id, port_id))
+            STP_PKTLOG("Dropping PVST BPDU for grouped VLAN:%d Port:%d", vlan_id, port_id);
+        GET_STP_CLASS(stp_index)->rx_drop_bpdu++;
+        stp_global.pvst_drop_count++;
+        return;
+    }
+
     if (stp_index != STP_INDEX_INVALID)
     {
         // ieee 802.1d 9.3.4 validation of bpdus.
-        if (bpdu->type != TCN_BPDU_TYPE &&
-            ntohs(bpdu->message_age) >= ntohs(bpdu->max_age))
+        if (result == STP_BPDU_RX_AGED)
         {
             STP_LOG_INFO("Invalid BPDU (message age %u exceeds max age %u) vlan %u port %u",
-                         ntohs(bpdu->message_age), ntohs(bpdu->max_age), vlan_id, port_id);
+                         bpdu->message_age, bpdu->max_age, vlan_id, port_id);
             stp_global.pvst_drop_count++;
         }
-        else
+        else if (!stp_worker_enqueue_rx(stp_index, port_id, bpdu, true /* pvst */))
         {
             stpmgr_process_pvst_bpdu(stp_index, port_id, bpdu);
         }
@@ -2014,6 +2462,10 @@ void stpmgr_100ms_timer(evutil_socket_t fd, short what, void* arg)
     const char* data = (char*)arg;
     g_stpd_stats_libev_timer++;
     stptimer_tick();
+    stp_snapshot_tick();
+    stp_export_tick();
+    stpsync_flush();
+    stpdm_wbos_delta_tick(&stpd_context);
 }
 
 /**
@@ -2053,7 +2505,7 @@ static void stpmgr_process_bridge_config_msg(void* msg)
 
         if (stp_global.proto_mode == L2_NONE) // RSTP!
         {
-            stp_global.config_bpdu.protocol_version_id = RSTP_BPDU_TYPE; // этот флаг заставляет отказаться от отправки pvst bpdu и отправлять ieee RSTP bpdu
+            g_stp_config_bpdu.protocol_version_id = RSTP_BPDU_TYPE; // этот флаг заставляет отказаться от отправки pvst bpdu и отправлять ieee RSTP bpdu
         }
 
         stpmgr_config_root_protect_timeout(pmsg->rootguard_timeout);
@@ -2062,6 +2514,7 @@ static void stpmgr_process_bridge_config_msg(void* msg)
         memcpy((char*)&g_stp_base_mac_addr._ushort,
                (char*)(pmsg->base_mac_addr + 4),
                sizeof(g_stp_base_mac_addr._ushort));
+        stp_pkt_tx_invalidate_all();
     }
     else if (pmsg->opcode == STP_DEL_COMMAND)
     {
@@ -2077,96 +2530,196 @@ static void stpmgr_process_bridge_config_msg(void* msg)
             stpmgr_release_index(i);
         }
 
+        for (i = 0; i <= MAX_VLAN_ID; i++)
+            stputil_group_vlan_release(i);
+
         clear_mask(g_stp_enable_mask);
         stp_intf_reset_port_params();
     }
 }
 
+// port numbers of the PORT_ATTR list of the message being processed
+static uint32_t g_stpmgr_msg_port_id[STP_IPC_MSG_MAX_LEN / sizeof(PORT_ATTR)];
+
 /**
- * @brief Инициализирует клас и подготавливает инстанс для работы с портом.Должна вызываться при первичной инициализации, затем только добавляются порты и настраиваются приоритеты через остальные функции
+ * @brief Находит номера портов списка PORT_ATTR по именам (g_stpmgr_msg_port_id).
  *
- * @param pmsg Указатель на структуру сообщения конфигурации VLAN.
- *             Структура содержит информацию о VLAN, такую как идентификатор VLAN
- *             и параметры конфигурации STP.
+ * @param attr Список портов сообщения.
+ * @param count Количество портов.
  *
- * @return `true`, если STP был успешно активирован для VLAN,
- *         `false`, если произошла ошибка.
+ * @return Количество портов, для которых заполнен g_stpmgr_msg_port_id.
  */
-static bool stpmgr_vlan_stp_enable(STP_VLAN_CONFIG_MSG* pmsg)
+static int stpmgr_msg_resolve_ports(PORT_ATTR* attr, int count)
 {
-    PORT_ATTR* attr;
-    int port_count;
-    uint32_t port_id;
-
-    volatile STP_VLAN_CONFIG_MSG* msg_body;
-    msg_body = pmsg;
+    int i;
 
-    // STP_LOG_DEBUG("newInst:%d inst_id:%d", pmsg->newInstance, pmsg->inst_id);
-    STP_LOG_DEBUG("newInst:%d inst_id:%d", msg_body->newInstance, msg_body->inst_id);
+    if (count < 0 || (size_t)count > sizeof(g_stpmgr_msg_port_id) / sizeof(g_stpmgr_msg_port_id[0]))
+    {
+        STP_LOG_ERR("invalid port count %d", count);
+        return 0;
+    }
 
-    if (stp_global.proto_mode == L2_NONE) // RSTP!
+    for (i = 0; i < count; i++)
     {
-        // TODO ! recurent enter
-        stpdata_init_class(pmsg->inst_id, pmsg->vlan_id);
+        STP_LOG_INFO("Intf:%s Enab:%d Mode:%d", attr[i].intf_name, attr[i].enabled, attr[i].mode);
+        g_stpmgr_msg_port_id[i] = stp_intf_get_port_id_by_name(attr[i].intf_name);
+    }
+    return count;
+}
 
-        // stpsync_add_vlan_to_instance(pmsg->vlan_id, pmsg->inst_id);
+/**
+ * @brief Создаёт экземпляр STP для VLAN и добавляет в него порты.
+ *
+ * @param inst_id Индекс экземпляра STP.
+ * @param vlan_id Идентификатор VLAN.
+ * @param new_instance Новый экземпляр; существующий экземпляр PVST не пересоздаётся.
+ * @param attr Список портов, номера портов - в g_stpmgr_msg_port_id.
+ * @param count Количество портов.
+ *
+ * @return `false`, если VLAN сгруппирован в другой экземпляр и своего не имеет.
+ */
+static bool stpmgr_vlan_stp_add_ports(STP_INDEX inst_id, VLAN_ID vlan_id, bool new_instance, PORT_ATTR* attr, int count)
+{
+    STP_CLASS* stp_class;
+    PORT_MASK_ITER it;
+    PORT_ID port_number;
+    bool restored;
+    int i;
 
-        attr = pmsg->port_list;
-        for (port_count = 0; port_count < pmsg->count; port_count++)
+    // grouped VLAN follows its shared instance
+    stp_class = stpmgr_get_group_class(vlan_id);
+    if (stp_class)
+    {
+        STP_LOG_DEBUG("vlan %u grouped in inst %u", vlan_id, (STP_INDEX)GET_STP_INDEX(stp_class));
+        for (i = 0; i < count; i++)
         {
-            STP_LOG_INFO("Intf:%s Enab:%d Mode:%d", attr[port_count].intf_name, attr[port_count].enabled, attr[port_count].mode);
-            port_id = stp_intf_get_port_id_by_name(attr[port_count].intf_name);
+            if (g_stpmgr_msg_port_id[i] != BAD_PORT_ID)
+                stputil_group_vlan_set_member(stp_class, vlan_id, g_stpmgr_msg_port_id[i], attr[i].enabled,
+                                              attr[i].mode == 0);
+        }
+        return false;
+    }
 
-            if (port_id == BAD_PORT_ID)
-                continue;
+    // instance restored from the warm restart snapshot keeps its state
+    restored = stp_snapshot_claim(inst_id, vlan_id);
+    if (!restored)
+    {
+        if (stp_global.proto_mode != L2_NONE && !new_instance) // PVSTP
+            return true;
 
-            if (attr[port_count].enabled)
-            {
-                stpmgr_add_control_port(pmsg->inst_id, port_id, attr[port_count].mode); // Sets control_mask
-            }
-            else
-            {
-                /* STP not enabled on this interface. Make it FORWARDING */
-                stpsync_update_port_state(attr[port_count].intf_name, pmsg->inst_id, FORWARDING);
-            }
-        }
+        // TODO ! recurent enter (RSTP)
+        stpdata_init_class(inst_id, vlan_id);
+
+        if (stp_global.proto_mode != L2_NONE)
+            stpsync_add_vlan_to_instance(vlan_id, inst_id);
     }
-    else // PVSTP
+
+    for (i = 0; i < count; i++)
     {
-        if (msg_body->newInstance)
-        {
-            stpdata_init_class(pmsg->inst_id, pmsg->vlan_id);
+        if (g_stpmgr_msg_port_id[i] == BAD_PORT_ID)
+            continue;
 
-            stpsync_add_vlan_to_instance(pmsg->vlan_id, pmsg->inst_id);
+        if (attr[i].enabled)
+        {
+            stpmgr_add_control_port(inst_id, g_stpmgr_msg_port_id[i], attr[i].mode); // Sets control_mask
+        }
+        else if (!restored)
+        {
+            /* STP not enabled on this interface. Make it FORWARDING */
+            stpsync_update_port_state(attr[i].intf_name, inst_id, FORWARDING);
+        }
+    }
 
-            attr = pmsg->port_list;
-            for (port_count = 0; port_count < pmsg->count; port_count++)
-            {
-                STP_LOG_INFO("Intf:%s Enab:%d Mode:%d", attr[port_count].intf_name, attr[port_count].enabled, attr[port_count].mode);
-                port_id = stp_intf_get_port_id_by_name(attr[port_count].intf_name);
+    // ports held blocked since the VLAN left its group are now driven by its own instance
+    stputil_group_vlan_claim(GET_STP_CLASS(inst_id));
 
-                if (port_id == BAD_PORT_ID)
-                    continue;
+    if (!restored || (stp_global.proto_mode != L2_NONE && !new_instance))
+        return true;
 
-                if (attr[port_count].enabled)
-                {
-                    stpmgr_add_control_port(pmsg->inst_id, port_id, attr[port_count].mode); // Sets control_mask
-                }
-                else
-                {
-                    /* STP not enabled on this interface. Make it FORWARDING */
-                    stpsync_update_port_state(attr[port_count].intf_name, pmsg->inst_id, FORWARDING);
-                }
-            }
+    // the message carries the full port list: drop ports removed while stpd was down
+    stp_class = GET_STP_CLASS(inst_id);
+    PORT_MASK_FOR_EACH_PORT(stp_class->control_mask, it, port_number)
+    {
+        for (i = 0; i < count; i++)
+        {
+            if (g_stpmgr_msg_port_id[i] == port_number && attr[i].enabled)
+                break;
         }
+        if (i == count)
+            stpmgr_delete_control_port(inst_id, port_number, true);
     }
+    return true;
+}
 
-    if (pmsg->opcode == STP_SET_COMMAND)
+/**
+ * @brief Отключает STP на VLAN.
+ *
+ * Сгруппированный VLAN исключается из общего экземпляра, экземпляр VLAN
+ * освобождается. Удерживаемые заблокированными порты VLAN снова
+ * пересылают трафик.
+ *
+ * @param inst_id Индекс экземпляра STP VLAN.
+ * @param vlan_id Идентификатор VLAN.
+ *
+ * @return void
+ */
+static void stpmgr_vlan_stp_release(STP_INDEX inst_id, VLAN_ID vlan_id)
+{
+    STP_CLASS* stp_class = stpmgr_get_group_class(vlan_id);
+
+    if (stp_class)
+    {
+        stpmgr_group_del_vlan(GET_STP_INDEX(stp_class), vlan_id);
+        stputil_group_vlan_release(vlan_id);
+        if (GET_STP_INDEX(stp_class) == inst_id)
+            return;
+    }
+    stpmgr_release_index(inst_id);
+    stputil_group_vlan_release(vlan_id);
+}
+
+/**
+ * @brief Применяет параметры моста к экземпляру STP.
+ *
+ * @return void
+ */
+static void stpmgr_vlan_stp_config_bridge(STP_INDEX inst_id, int forward_delay, int hello_time, int max_age, int priority)
+{
+    stpmgr_config_bridge_forward_delay(inst_id, forward_delay);
+    stpmgr_config_bridge_hello_time(inst_id, hello_time);
+    stpmgr_config_bridge_max_age(inst_id, max_age);
+    stpmgr_config_bridge_priority(inst_id, priority);
+}
+
+/**
+ * @brief Инициализирует клас и подготавливает инстанс для работы с портом.Должна вызываться при первичной инициализации, затем только добавляются порты и настраиваются приоритеты через остальные функции
+ *
+ * Порты добавляются одним пакетом: состояния портов пересчитываются один раз.
+ *
+ * @param pmsg Указатель на структуру сообщения конфигурации VLAN.
+ *             Структура содержит информацию о VLAN, такую как идентификатор VLAN
+ *             и параметры конфигурации STP.
+ *
+ * @return `true`, если STP был успешно активирован для VLAN,
+ *         `false`, если произошла ошибка.
+ */
+static bool stpmgr_vlan_stp_enable(STP_VLAN_CONFIG_MSG* pmsg)
+{
+    bool added;
+    int count;
+
+    STP_LOG_DEBUG("newInst:%d inst_id:%d", pmsg->newInstance, pmsg->inst_id);
+
+    count = stpmgr_msg_resolve_ports(pmsg->port_list, pmsg->count);
+
+    stpmgr_batch_begin();
+    added = stpmgr_vlan_stp_add_ports(pmsg->inst_id, pmsg->vlan_id, pmsg->newInstance, pmsg->port_list, count);
+    stpmgr_batch_end();
+
+    if (added && pmsg->opcode == STP_SET_COMMAND)
     {
-        stpmgr_config_bridge_forward_delay(pmsg->inst_id, pmsg->forward_delay);
-        stpmgr_config_bridge_hello_time(pmsg->inst_id, pmsg->hello_time);
-        stpmgr_config_bridge_max_age(pmsg->inst_id, pmsg->max_age);
-        stpmgr_config_bridge_priority(pmsg->inst_id, pmsg->priority);
+        stpmgr_vlan_stp_config_bridge(pmsg->inst_id, pmsg->forward_delay, pmsg->hello_time,
+                                      pmsg->max_age, pmsg->priority);
     }
     return true;
 }
@@ -2187,7 +2740,7 @@ static bool stpmgr_vlan_stp_enable(STP_VLAN_CONFIG_MSG* pmsg)
  */
 static bool stpmgr_vlan_stp_disable(STP_VLAN_CONFIG_MSG* pmsg)
 {
-    stpmgr_release_index(pmsg->inst_id);
+    stpmgr_vlan_stp_release(pmsg->inst_id, pmsg->vlan_id);
     return true;
 }
 
@@ -2411,6 +2964,88 @@ static void stpmgr_process_intf_config_msg(void* msg)
     }
 }
 
+/**
+ * @brief Добавляет порт в экземпляр STP или удаляет его оттуда.
+ *
+ * Для сгруппированного VLAN экземпляр не меняется: порт запоминается со
+ * своим режимом тегирования и повторяет в ядре состояние порта экземпляра.
+ * Порты удерживаемого после исключения из группы VLAN также запоминаются.
+ *
+ * @param opcode STP_SET_COMMAND или STP_DEL_COMMAND.
+ * @param inst_id Индекс экземпляра STP.
+ * @param vlan_id Идентификатор VLAN.
+ * @param port_id Номер порта.
+ * @param intf_name Имя интерфейса.
+ * @param enabled STP включён на порту.
+ * @param mode Режим порта.
+ * @param path_cost Стоимость пути, 0 - не менять.
+ * @param priority Приоритет порта, -1 - не менять.
+ *
+ * @return void
+ */
+static void stpmgr_vlan_mem_apply(uint8_t opcode, STP_INDEX inst_id, VLAN_ID vlan_id, PORT_ID port_id,
+                                  char* intf_name, uint8_t enabled, int8_t mode, int path_cost, int priority)
+{
+    STP_CLASS* stp_class;
+    STP_PORT_CLASS* stp_port_class;
+
+    stp_class = stpmgr_get_group_class(vlan_id);
+    if (opcode == STP_SET_COMMAND)
+        stputil_group_vlan_set_member(stp_class, vlan_id, port_id, enabled, mode == 0);
+    else
+        stputil_group_vlan_del_member(vlan_id, port_id);
+    if (stp_class)
+        return;
+
+    if (opcode == STP_SET_COMMAND)
+    {
+        if (enabled)
+        {
+            stpmgr_add_control_port(inst_id, port_id, mode);
+        }
+        else
+        {
+            /* STP not enabled on this interface. Make it FORWARDING */
+            stpsync_update_port_state(intf_name, inst_id, FORWARDING);
+        }
+
+        if (priority != -1)
+            stpmgr_config_port_priority(inst_id, port_id, priority, true);
+        if (path_cost)
+            stpmgr_config_port_path_cost(inst_id, port_id, false, path_cost, true);
+    }
+    else
+    {
+        /* This is a case where vlan is deleted from port, so we shouldn't add vid from linux bridge port this happens
+         * as before deletion we set port to forwarding state (which adds vid to linux bridge port)
+         * Setting kernel state to forward ensures we skip deleting the vid from the linux bridge port
+         * */
+
+        stp_class = GET_STP_CLASS(inst_id);
+        if (is_member(stp_class->control_mask, port_id))
+        {
+            // the port stays in the grouped VLANs and leaves STP control there
+            if (stp_class->group_vlan_count)
+            {
+                BMP_ITER_T it;
+                BMP_ID group_vlan_id;
+
+                BMP_FOR_EACH_SET_BIT(stp_class->group_vlan_mask, it, group_vlan_id)
+                    stputil_group_vlan_set_port(stp_class, group_vlan_id, port_id, false);
+            }
+
+            stp_port_class = GET_STP_PORT_CLASS(stp_class, port_id);
+            stp_port_class->kernel_state = STP_KERNEL_STATE_FORWARD;
+
+            stpmgr_delete_control_port(inst_id, port_id, true);
+        }
+        else
+        {
+            stpsync_del_port_state(intf_name, inst_id);
+        }
+    }
+}
+
 /**
  * @brief Обрабатывает сообщение конфигурации членства VLAN.
  *
@@ -2428,8 +3063,6 @@ static void stpmgr_process_vlan_mem_config_msg(void* msg)
 {
     STP_VLAN_MEM_CONFIG_MSG* pmsg = (STP_VLAN_MEM_CONFIG_MSG*)msg;
     uint32_t port_id;
-    STP_CLASS* stp_class;
-    STP_PORT_CLASS* stp_port_class;
 
     if (!pmsg)
     {
@@ -2451,43 +3084,291 @@ static void stpmgr_process_vlan_mem_config_msg(void* msg)
     if (port_id == BAD_PORT_ID)
         return;
 
-    if (pmsg->opcode == STP_SET_COMMAND)
+    // port priority and path cost are applied with a single port state selection
+    stpmgr_batch_begin();
+    stpmgr_vlan_mem_apply(pmsg->opcode, pmsg->inst_id, pmsg->vlan_id, port_id, pmsg->intf_name, pmsg->enabled,
+                          pmsg->mode, pmsg->path_cost, pmsg->priority);
+    stpmgr_batch_end();
+}
+
+/**
+ * @brief Проверяет диапазоны VLAN пакетного сообщения.
+ *
+ * Сообщение применяется только целиком, поэтому все диапазоны проверяются
+ * до первого изменения.
+ *
+ * @param range Массив диапазонов.
+ * @param count Количество диапазонов.
+ *
+ * @return Количество VLAN во всех диапазонах, 0 - сообщение некорректно.
+ */
+static uint32_t stpmgr_bulk_check_ranges(STP_VLAN_RANGE* range, uint16_t count)
+{
+    uint32_t vlans = 0;
+    uint16_t i;
+
+    for (i = 0; i < count; i++)
     {
-        if (pmsg->enabled)
+        if (range[i].vlan_start == 0 || range[i].vlan_start > range[i].vlan_end || range[i].vlan_end > MAX_VLAN_ID ||
+            (uint32_t)range[i].inst_start + (range[i].vlan_end - range[i].vlan_start) >= g_stp_instances)
         {
-            stpmgr_add_control_port(pmsg->inst_id, port_id, pmsg->mode);
+            STP_LOG_ERR("invalid range %u: vlan %u-%u inst %u", i, range[i].vlan_start, range[i].vlan_end,
+                        range[i].inst_start);
+            return 0;
         }
-        else
+        vlans += range[i].vlan_end - range[i].vlan_start + 1;
+    }
+    return vlans;
+}
+
+/**
+ * @brief Обрабатывает пакетное сообщение конфигурации VLAN (STP_VLAN_BULK_CONFIG).
+ *
+ * Одно сообщение создаёт (или удаляет) экземпляры STP сразу для диапазонов
+ * VLAN с общими параметрами моста и общим списком портов. Имена портов
+ * разрешаются один раз, а выбор ролей портов выполняется один раз на
+ * экземпляр после добавления всех портов.
+ *
+ * @param msg Указатель на данные сообщения `STP_VLAN_BULK_CONFIG_MSG`.
+ * @param len Длина данных сообщения в байтах.
+ *
+ * @return void
+ */
+static void stpmgr_process_vlan_bulk_config_msg(void* msg, int len)
+{
+    STP_VLAN_BULK_CONFIG_MSG* pmsg = (STP_VLAN_BULK_CONFIG_MSG*)msg;
+    STP_VLAN_RANGE* range;
+    PORT_ATTR* attr;
+    uint64_t start_us;
+    uint32_t vlans;
+    uint16_t i;
+    VLAN_ID vlan_id;
+    STP_INDEX inst_id;
+    int count = 0;
+
+    if (!pmsg || len < (int)sizeof(STP_VLAN_BULK_CONFIG_MSG))
+    {
+        STP_LOG_ERR("rcvd short msg len %d", len);
+        return;
+    }
+
+    range = (STP_VLAN_RANGE*)pmsg->data;
+    attr = (PORT_ATTR*)(range + pmsg->range_count);
+    if (sizeof(STP_VLAN_BULK_CONFIG_MSG) + pmsg->range_count * sizeof(STP_VLAN_RANGE) +
+            pmsg->port_count * sizeof(PORT_ATTR) > (size_t)len)
+    {
+        STP_LOG_ERR("truncated msg len %d ranges %u ports %u", len, pmsg->range_count, pmsg->port_count);
+        return;
+    }
+
+    vlans = stpmgr_bulk_check_ranges(range, pmsg->range_count);
+    if (vlans == 0)
+        return;
+
+    STP_LOG_INFO("op:%d, NewInst:%d, ranges:%u, vlans:%u, fwd_del:%d, hello:%d, max_age:%d, pri:%d, count:%u",
+                 pmsg->opcode, pmsg->newInstance, pmsg->range_count, vlans, pmsg->forward_delay,
+                 pmsg->hello_time, pmsg->max_age, pmsg->priority, pmsg->port_count);
+
+    if (pmsg->opcode != STP_SET_COMMAND && pmsg->opcode != STP_DEL_COMMAND)
+    {
+        STP_LOG_ERR("invalid opcode %d", pmsg->opcode);
+        return;
+    }
+
+    start_us = stpmgr_mono_us();
+    if (pmsg->opcode == STP_SET_COMMAND)
+        count = stpmgr_msg_resolve_ports(attr, pmsg->port_count);
+
+    stpmgr_batch_begin();
+    for (i = 0; i < pmsg->range_count; i++)
+    {
+        inst_id = range[i].inst_start;
+        for (vlan_id = range[i].vlan_start; vlan_id <= range[i].vlan_end; vlan_id++, inst_id++)
         {
-            /* STP not enabled on this interface. Make it FORWARDING */
-            stpsync_update_port_state(pmsg->intf_name, pmsg->inst_id, FORWARDING);
+            if (pmsg->opcode == STP_DEL_COMMAND)
+            {
+                stpmgr_vlan_stp_release(inst_id, vlan_id);
+                continue;
+            }
+
+            if (stpmgr_vlan_stp_add_ports(inst_id, vlan_id, pmsg->newInstance, attr, count))
+                stpmgr_vlan_stp_config_bridge(inst_id, pmsg->forward_delay, pmsg->hello_time,
+                                              pmsg->max_age, pmsg->priority);
         }
+    }
+    stpmgr_batch_end();
 
-        if (pmsg->priority != -1)
-            stpmgr_config_port_priority(pmsg->inst_id, port_id, pmsg->priority, true);
-        if (pmsg->path_cost)
-            stpmgr_config_port_path_cost(pmsg->inst_id, port_id, false, pmsg->path_cost, true);
+    STP_LOG_INFO("%u vlans x %d ports done in %llu us", vlans, count,
+                 (unsigned long long)(stpmgr_mono_us() - start_us));
+}
+
+/**
+ * @brief Обрабатывает пакетное сообщение членства VLAN (STP_VLAN_MEM_BULK_CONFIG).
+ *
+ * Каждый порт списка добавляется (или удаляется) во все экземпляры диапазонов
+ * VLAN; выбор ролей портов выполняется один раз на экземпляр.
+ *
+ * @param msg Указатель на данные сообщения `STP_VLAN_MEM_BULK_CONFIG_MSG`.
+ * @param len Длина данных сообщения в байтах.
+ *
+ * @return void
+ */
+static void stpmgr_process_vlan_mem_bulk_config_msg(void* msg, int len)
+{
+    STP_VLAN_MEM_BULK_CONFIG_MSG* pmsg = (STP_VLAN_MEM_BULK_CONFIG_MSG*)msg;
+    STP_VLAN_RANGE* range;
+    PORT_ATTR* attr;
+    uint64_t start_us;
+    uint32_t vlans;
+    uint16_t i;
+    VLAN_ID vlan_id;
+    STP_INDEX inst_id;
+    int j, count;
+
+    if (!pmsg || len < (int)sizeof(STP_VLAN_MEM_BULK_CONFIG_MSG))
+    {
+        STP_LOG_ERR("rcvd short msg len %d", len);
+        return;
     }
-    else
+
+    range = (STP_VLAN_RANGE*)pmsg->data;
+    attr = (PORT_ATTR*)(range + pmsg->range_count);
+    if (sizeof(STP_VLAN_MEM_BULK_CONFIG_MSG) + pmsg->range_count * sizeof(STP_VLAN_RANGE) +
+            pmsg->port_count * sizeof(PORT_ATTR) > (size_t)len)
     {
-        /* This is a case where vlan is deleted from port, so we shouldn't add vid from linux bridge port this happens
-         * as before deletion we set port to forwarding state (which adds vid to linux bridge port)
-         * Setting kernel state to forward ensures we skip deleting the vid from the linux bridge port
-         * */
+        STP_LOG_ERR("truncated msg len %d ranges %u ports %u", len, pmsg->range_count, pmsg->port_count);
+        return;
+    }
 
-        stp_class = GET_STP_CLASS(pmsg->inst_id);
-        if (is_member(stp_class->control_mask, port_id))
+    vlans = stpmgr_bulk_check_ranges(range, pmsg->range_count);
+    if (vlans == 0)
+        return;
+
+    STP_LOG_INFO("op:%d, ranges:%u, vlans:%u, cost:%d, pri:%d, count:%u", pmsg->opcode, pmsg->range_count,
+                 vlans, pmsg->path_cost, pmsg->priority, pmsg->port_count);
+
+    start_us = stpmgr_mono_us();
+    count = stpmgr_msg_resolve_ports(attr, pmsg->port_count);
+
+    stpmgr_batch_begin();
+    for (i = 0; i < pmsg->range_count; i++)
+    {
+        inst_id = range[i].inst_start;
+        for (vlan_id = range[i].vlan_start; vlan_id <= range[i].vlan_end; vlan_id++, inst_id++)
         {
-            stp_port_class = GET_STP_PORT_CLASS(stp_class, port_id);
-            stp_port_class->kernel_state = STP_KERNEL_STATE_FORWARD;
+            for (j = 0; j < count; j++)
+            {
+                if (g_stpmgr_msg_port_id[j] == BAD_PORT_ID)
+                    continue;
+                stpmgr_vlan_mem_apply(pmsg->opcode, inst_id, vlan_id, g_stpmgr_msg_port_id[j], attr[j].intf_name,
+                                      attr[j].enabled, attr[j].mode, pmsg->path_cost, pmsg->priority);
+            }
+        }
+    }
+    stpmgr_batch_end();
 
-            stpmgr_delete_control_port(pmsg->inst_id, port_id, true);
+    STP_LOG_INFO("%u vlans x %d ports done in %llu us", vlans, count,
+                 (unsigned long long)(stpmgr_mono_us() - start_us));
+}
+
+/**
+ * @brief Обрабатывает сообщение группировки VLAN (STP_VLAN_GROUP_CONFIG).
+ *
+ * VLAN диапазонов добавляются в общие экземпляры STP или исключаются из них.
+ * Порты экземпляра не меняются, выбор ролей портов не требуется.
+ *
+ * @param msg Указатель на данные сообщения `STP_VLAN_GROUP_CONFIG_MSG`.
+ * @param len Длина данных сообщения в байтах.
+ *
+ * @return void
+ */
+static void stpmgr_process_vlan_group_config_msg(void* msg, int len)
+{
+    STP_VLAN_GROUP_CONFIG_MSG* pmsg = (STP_VLAN_GROUP_CONFIG_MSG*)msg;
+    STP_VLAN_RANGE* range;
+    uint64_t start_us;
+    uint32_t vlans = 0;
+    uint32_t done = 0;
+    uint16_t i;
+    VLAN_ID vlan_id;
+
+    if (!pmsg || len < (int)sizeof(STP_VLAN_GROUP_CONFIG_MSG) ||
+        sizeof(STP_VLAN_GROUP_CONFIG_MSG) + pmsg->range_count * sizeof(STP_VLAN_RANGE) > (size_t)len)
+    {
+        STP_LOG_ERR("rcvd short msg len %d", len);
+        return;
+    }
+
+    if (pmsg->opcode != STP_SET_COMMAND && pmsg->opcode != STP_DEL_COMMAND)
+    {
+        STP_LOG_ERR("invalid opcode %d", pmsg->opcode);
+        return;
+    }
+
+    range = (STP_VLAN_RANGE*)pmsg->data;
+    for (i = 0; i < pmsg->range_count; i++)
+    {
+        if (range[i].vlan_start == 0 || range[i].vlan_start > range[i].vlan_end || range[i].vlan_end > MAX_VLAN_ID ||
+            range[i].inst_start >= g_stp_instances)
+        {
+            STP_LOG_ERR("invalid range %u: vlan %u-%u inst %u", i, range[i].vlan_start, range[i].vlan_end,
+                        range[i].inst_start);
+            return;
         }
-        else
+        vlans += range[i].vlan_end - range[i].vlan_start + 1;
+    }
+
+    STP_LOG_INFO("op:%d, ranges:%u, vlans:%u", pmsg->opcode, pmsg->range_count, vlans);
+
+    start_us = stpmgr_mono_us();
+    stpmgr_batch_begin();
+    for (i = 0; i < pmsg->range_count; i++)
+    {
+        for (vlan_id = range[i].vlan_start; vlan_id <= range[i].vlan_end; vlan_id++)
         {
-            stpsync_del_port_state(pmsg->intf_name, pmsg->inst_id);
+            if (pmsg->opcode == STP_DEL_COMMAND)
+                stpmgr_group_del_vlan(range[i].inst_start, vlan_id);
+            else if (stpmgr_group_add_vlan(range[i].inst_start, vlan_id))
+                done++;
         }
     }
+    stpmgr_batch_end();
+
+    STP_LOG_INFO("%u vlans (%u grouped) done in %llu us", vlans, done,
+                 (unsigned long long)(stpmgr_mono_us() - start_us));
+}
+
+/**
+ * @brief Переключает формат периодического статуса для WBOS.
+ *
+ * Потребитель, поддерживающий двоичный протокол, запрашивает его этим
+ * сообщением; версия согласуется как минимум из предложенной и нашей.
+ * В двоичном и дельта-режиме сразу отправляется полный снимок, так что
+ * повторный запрос служит и для ресинхронизации после потерь.
+ *
+ * @param msg Указатель на данные сообщения `STP_WBOS_STATUS_MODE_MSG`.
+ *
+ * @return void
+ */
+static void stpmgr_process_wbos_status_mode_msg(void* msg)
+{
+    STP_WBOS_STATUS_MODE_MSG* pmsg = (STP_WBOS_STATUS_MODE_MSG*)msg;
+
+    if ((pmsg->format == STP_WBOS_FORMAT_BINARY || pmsg->format == STP_WBOS_FORMAT_DELTA) && pmsg->version != 0)
+    {
+        stpd_context.wbos_format = pmsg->format;
+        stpd_context.wbos_full_periods = 0;
+        stpd_context.wbos_delta_ticks = 0;
+        stpd_context.wbos_version = (pmsg->version < STP_WBOS_PROTO_VERSION) ? pmsg->version : STP_WBOS_PROTO_VERSION;
+        STP_LOG_INFO("WBOS status: %s v%u", (pmsg->format == STP_WBOS_FORMAT_DELTA) ? "delta" : "binary",
+                     stpd_context.wbos_version);
+        stpdm_global_wbos_bin(&stpd_context, stpd_context.buf_to_wbos, STP_WBOS_FRAME_MAX);
+    }
+    else
+    {
+        stpd_context.wbos_format = STP_WBOS_FORMAT_TEXT;
+        STP_LOG_INFO("WBOS status: text");
+    }
 }
 
 /**
@@ -2513,7 +3394,7 @@ static void stpmgr_process_ipc_msg(STP_IPC_MSG* msg, int len, struct sockaddr_un
     STP_LOG_INFO("rcvd %s msg type", msgtype_str[msg->msg_type]);
 
     /* Temp code until warm boot is handled */
-    if (msg->msg_type != STP_INIT_READY && msg->msg_type != STP_STPCTL_MSG)
+    if (msg->msg_type != STP_INIT_READY && msg->msg_type != STP_STPCTL_MSG && msg->msg_type != STP_WBOS_STATUS_MODE)
     {
         if (g_max_stp_port == 0)
         {
@@ -2522,11 +3403,18 @@ static void stpmgr_process_ipc_msg(STP_IPC_MSG* msg, int len, struct sockaddr_un
         }
     }
 
+    if (msg->msg_type != STP_INIT_READY && msg->msg_type != STP_STPCTL_MSG && msg->msg_type != STP_WBOS_STATUS_MODE)
+        STPD_STARTUP_MARK(STPD_STARTUP_CONFIG);
+
+    // BPDUs received before the config change are processed first
+    stp_worker_drain();
+
     switch (msg->msg_type)
     {
     case STP_INIT_READY:
     {
         STP_INIT_READY_MSG* pmsg = (STP_INIT_READY_MSG*)msg->data;
+        STPD_STARTUP_MARK(STPD_STARTUP_INIT_READY);
         /* All ports are initialized in the system. Now build IF DB in STP */
         ret = stp_intf_event_mgr_init();
         if (ret == -1)
@@ -2534,6 +3422,11 @@ static void stpmgr_process_ipc_msg(STP_IPC_MSG* msg, int len, struct sockaddr_un
 
         /* Do other protocol related inits */
         stpmgr_init(pmsg->max_stp_instances);
+
+        /* Warm restart, APP_DB was kept by stpd_main */
+        if (stp_snapshot_restore() == -1)
+            stpsync_clear_appdb_stp_tables();
+        STPD_STARTUP_MARK(STPD_STARTUP_STP_INIT);
         break;
     }
     case STP_BRIDGE_CONFIG:
@@ -2561,9 +3454,34 @@ static void stpmgr_process_ipc_msg(STP_IPC_MSG* msg, int len, struct sockaddr_un
         stpmgr_process_vlan_mem_config_msg(msg->data);
         break;
     }
+    case STP_VLAN_BULK_CONFIG:
+    {
+        stpmgr_process_vlan_bulk_config_msg(msg->data, len - (int)sizeof(STP_IPC_MSG));
+        break;
+    }
+    case STP_VLAN_MEM_BULK_CONFIG:
+    {
+        stpmgr_process_vlan_mem_bulk_config_msg(msg->data, len - (int)sizeof(STP_IPC_MSG));
+        break;
+    }
+    case STP_VLAN_GROUP_CONFIG:
+    {
+        stpmgr_process_vlan_group_config_msg(msg->data, len - (int)sizeof(STP_IPC_MSG));
+        break;
+    }
 
     case STP_STPCTL_MSG:
     {
+        STP_CTL_MSG* ctl = (STP_CTL_MSG*)msg->data;
+
+        // paged dumps are answered to the sender, one page per request
+        if (len >= (int)(sizeof(STP_IPC_MSG) + sizeof(STP_CTL_MSG)) &&
+            (ctl->cmd_type == STP_CTL_STREAM_CLASS || ctl->cmd_type == STP_CTL_STREAM_NL_DB))
+        {
+            stpdbg_process_ctl_stream(ctl, (struct sockaddr*)&client_addr, sizeof(client_addr));
+            break;
+        }
+
         STP_LOG_INFO("Server received from %s", client_addr.sun_path);
         stpdbg_process_ctl_msg(msg->data);
         // TODO! refactor to internal class sendf
@@ -2572,18 +3490,80 @@ static void stpmgr_process_ipc_msg(STP_IPC_MSG* msg, int len, struct sockaddr_un
         break;
     }
 
+    case STP_WBOS_STATUS_MODE:
+    {
+        stpmgr_process_wbos_status_mode_msg(msg->data);
+        break;
+    }
+
     default:
         break;
     }
 }
 
+/**
+ * @brief Проверяет заголовок одного сообщения IPC и передаёт его на обработку.
+ *
+ * @param buffer Принятая датаграмма.
+ * @param len Длина датаграммы.
+ * @param client_sock Адрес отправителя для ответа.
+ *
+ * @return void
+ */
+static void stpmgr_dispatch_client_msg(char* buffer, int len, struct sockaddr_un* client_sock)
+{
+    if (len < 10)
+    {
+        STP_LOG_ERR("message error, len too small= %d", len);
+    }
+    else if (!((buffer[0] == 'w') && (buffer[1] == 'b') && (buffer[2] == 'o') && (buffer[3] == 's') && (buffer[4] == 'b')))
+    {
+        STP_LOG_ERR("message error, magic is wrong bin header, message= %.*s", 5, buffer);
+        // stpmgr_process_ipc_msg((STP_IPC_MSG*)(buffer), (len), *client_sock);
+    }
+    else
+    {
+        STP_LOG_INFO("magic is ok, alpha message = %.*s", 5, buffer);
+        stpmgr_process_ipc_msg((STP_IPC_MSG*)(buffer + 5), (len - 5), *client_sock);
+    }
+}
+
+/**
+ * @brief Обновляет размер очереди и число потерь сокета IPC в статистике приёма.
+ *
+ * Значения берутся у ядра (SO_MEMINFO), вызывается, когда пакет приёма
+ * заполнен целиком, и при выводе статистики.
+ *
+ * @return void
+ */
+void stpmgr_ipc_rx_sample(void)
+{
+#ifdef SO_MEMINFO
+    STPD_IPC_RX_STATS* stats = &g_stpd_stats_ipc_rx;
+    uint32_t meminfo[SK_MEMINFO_VARS];
+    socklen_t optlen = sizeof(meminfo);
+
+    if (g_stpd_ipc_handle <= 0 || getsockopt(g_stpd_ipc_handle, SOL_SOCKET, SO_MEMINFO, meminfo, &optlen) == -1)
+        return;
+
+    stats->queue_bytes = meminfo[SK_MEMINFO_RMEM_ALLOC];
+    if (stats->queue_bytes > stats->max_queue_bytes)
+        stats->max_queue_bytes = stats->queue_bytes;
+    stats->drops = meminfo[SK_MEMINFO_DROPS];
+#endif
+}
+
+// Pkt queue batches served since the IPC socket was last read
+static uint32_t g_stpmgr_ipc_rx_pkt_batches;
+
 /* Process all messages from clients (STPMGRd) */
 /**
- * @brief Обрабатывает входящее сообщение от клиента через IPC-сокет.
+ * @brief Обрабатывает входящие сообщения от клиентов через IPC-сокет.
  *
- * Эта функция вызывается, когда приходит сообщение от клиента через IPC-сокет.
- * Она считывает данные, определяет тип сообщения и вызывает соответствующую
- * функцию для обработки. После выполнения запроса отправляет ответ клиенту.
+ * Эта функция вызывается, когда в IPC-сокете есть сообщения. За один вызов
+ * recvmmsg() читается до STP_IPC_RX_BATCH сообщений, каждое проверяется и
+ * передаётся на обработку. Остаток очереди читается в следующей итерации
+ * цикла событий, после более приоритетных таймера и приёма BPDU.
  *
  * @param fd Сокетный дескриптор, через который было получено сообщение.
  * @param what Тип события, связанный с сокетом (например, готовность к чтению).
@@ -2594,30 +3574,89 @@ static void stpmgr_process_ipc_msg(STP_IPC_MSG* msg, int len, struct sockaddr_un
  */
 void stpmgr_recv_client_msg(evutil_socket_t fd, short what, void* arg)
 {
-    char buffer[4096];
-    int len;
-    struct sockaddr_un client_sock;
+    // bulk VLAN messages carry up to STP_IPC_MSG_MAX_LEN bytes
+    static char buffer[STP_IPC_RX_BATCH][STP_IPC_MSG_MAX_LEN];
+    static struct sockaddr_un client_sock[STP_IPC_RX_BATCH];
+    static struct iovec iov[STP_IPC_RX_BATCH];
+    static struct mmsghdr msgs[STP_IPC_RX_BATCH];
+    STPD_IPC_RX_STATS* stats = &g_stpd_stats_ipc_rx;
+    int count;
+    int i;
 
     g_stpd_stats_libev_ipc++;
+    g_stpmgr_ipc_rx_pkt_batches = 0;
 
-    len = sizeof(struct sockaddr_un);
-    len = recvfrom(fd, buffer, 4096, 0, (struct sockaddr*)&client_sock, &len);
-    if (len == -1)
+    for (i = 0; i < STP_IPC_RX_BATCH; i++)
     {
-        STP_LOG_ERR("recv  message error %s", strerror(errno));
+        iov[i].iov_base = buffer[i];
+        iov[i].iov_len = sizeof(buffer[i]);
+        memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &client_sock[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(client_sock[i]);
     }
-    else if (len < 10)
+
+    count = recvmmsg(fd, msgs, STP_IPC_RX_BATCH, MSG_DONTWAIT, NULL);
+    if (count == -1)
     {
-        STP_LOG_ERR("message error, len too small= %d", len);
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            STP_LOG_ERR("recv  message error %s", strerror(errno));
+        return;
     }
-    else if (!((buffer[0] == 'w') && (buffer[1] == 'b') && (buffer[2] == 'o') && (buffer[3] == 's') && (buffer[4] == 'b')))
+    if (count == 0)
+        return;
+
+    stats->msgs += count;
+    stats->batches++;
+    if ((uint32_t)count > stats->max_batch)
+        stats->max_batch = count;
+    if (count == STP_IPC_RX_BATCH)
     {
-        STP_LOG_ERR("message error, magic is wrong bin header, message= %.*s", 5, buffer);
-        // stpmgr_process_ipc_msg((STP_IPC_MSG*)(buffer), (len), client_sock);
+        stats->full_batches++;
+        stpmgr_ipc_rx_sample();
     }
-    else
+
+    for (i = 0; i < count; i++)
     {
-        STP_LOG_INFO("magic is ok, alpha message = %.*s", 5, buffer);
-        stpmgr_process_ipc_msg((STP_IPC_MSG*)(buffer + 5), (len - 5), client_sock);
+        if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+        {
+            stats->truncated++;
+            STP_LOG_ERR("message error, len too big > %d", STP_IPC_MSG_MAX_LEN);
+            continue;
+        }
+        stpmgr_dispatch_client_msg(buffer[i], msgs[i].msg_len, &client_sock[i]);
     }
 }
+
+static void stpmgr_ipc_rx_kick_cb(evutil_socket_t fd, short what, void* arg)
+{
+    stpmgr_recv_client_msg(g_stpd_ipc_handle, EV_READ, arg);
+}
+
+/**
+ * @brief Учитывает пачку приёма BPDU и не даёт ей бесконечно откладывать IPC.
+ *
+ * Под непрерывным потоком BPDU очередь STP_LIBEV_LOW_PRI_Q с сокетом IPC
+ * не обслуживается. После STP_IPC_STARVE_BATCHES пачек без чтения IPC
+ * одна пачка IPC читается из события в STP_LIBEV_HIGH_PRI_Q.
+ *
+ * @return void
+ */
+void stpmgr_ipc_rx_pkt_batch(void)
+{
+    static struct event* kick_ev;
+
+    if (g_stpd_ipc_handle <= 0 || ++g_stpmgr_ipc_rx_pkt_batches < STP_IPC_STARVE_BATCHES)
+        return;
+    g_stpmgr_ipc_rx_pkt_batches = 0;
+
+    if (!kick_ev)
+        kick_ev = stpmgr_libevent_new(g_stpd_evbase, -1, 0, stpmgr_ipc_rx_kick_cb, NULL, NULL, "IPC-KICK",
+                                      STP_LIBEV_HIGH_PRI_Q);
+    if (!kick_ev)
+        return;
+
+    g_stpd_stats_ipc_rx.kicks++;
+    event_active(kick_ev, EV_READ, 0);
+}
@@ -24,6 +24,21 @@
 int stp_intf_get_netlink_fd();
 stp_netlink_cb_ptr *stp_netlink_cb;
 
+/**
+ * @struct stp_netlink_rx_ctx_t
+ * @brief Контекст приёма событий интерфейсов
+ */
+typedef struct
+{
+    void *buf;                    // Приёмный буфер: g_stp_netlink_rx_buf или увеличенный
+    uint32_t buf_size;            // Размер buf
+    bool dump_pending;            // Ожидается ответ на RTM_GETLINK дамп
+    stp_netlink_rx_stats_t stats; // Статистика
+} stp_netlink_rx_ctx_t;
+
+static stp_netlink_rx_ctx_t g_stp_netlink_rx;
+static uint8_t g_stp_netlink_rx_buf[STP_NETLINK_MSG_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+
 /**
  * @brief Устанавливает размер буфера для сокета Netlink.
  *
@@ -207,248 +222,313 @@ bool stp_netlink_intf_is_valid(char *name)
     return false;
 }
 
+/**
+ * @brief Находит атрибут заданного типа, не разбирая остальные.
+ *
+ * @param rta Указатель на первый атрибут.
+ * @param len Длина данных, содержащих атрибуты.
+ * @param type Тип искомого атрибута.
+ * @return struct rtattr* Атрибут или NULL, если его нет.
+ */
+static struct rtattr *stp_netlink_find_rtattr(struct rtattr *rta, int len, unsigned short type)
+{
+    while (RTA_OK(rta, len))
+    {
+        if (rta->rta_type == type)
+            return rta;
+        rta = RTA_NEXT(rta, len);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Разбирает сообщение RTM_NEWLINK/RTM_DELLINK и передаёт его в stp_netlink_cb.
+ *
+ * Сначала ищется только IFLA_IFNAME: интерфейсы, которые STP не отслеживает,
+ * отбрасываются до разбора остальных атрибутов.
+ *
+ * @param nh Заголовок сообщения.
+ * @param read_all Выполняется начальный дамп интерфейсов.
+ * @return bool true, если сообщение передано в stp_netlink_cb.
+ */
+static bool stp_netlink_recv_link(struct nlmsghdr *nh, bool read_all)
+{
+    struct rtattr *rt_list[IFLA_MAX + 1];
+    struct rtattr *linkinfo_list[IFLA_INFO_MAX + 1];
+    struct ifinfomsg *ifi = NLMSG_DATA(nh);
+    struct rtattr *ptr = 0;
+    netlink_db_t if_db;
+    int rta_len = 0;
+
+    if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg)))
+        return false;
+
+    if (ifi->ifi_type != ARPHRD_ETHER)
+        return false;
+
+    rta_len = IFLA_PAYLOAD(nh);
+    ptr = stp_netlink_find_rtattr(IFLA_RTA(ifi), rta_len, IFLA_IFNAME);
+    if (!ptr)
+    {
+        STP_LOG_DEBUG("No ifname for kif_index :%d ", ifi->ifi_index);
+        return false;
+    }
+
+    memset(&if_db, 0, sizeof(if_db));
+    if_db.kif_index = ifi->ifi_index;
+    strncpy(if_db.ifname, (char *)RTA_DATA(ptr), IFNAMSIZ - 1);
+
+    if (!stp_netlink_intf_is_valid(if_db.ifname))
+        return false;
+
+    if (ifi->ifi_family == AF_BRIDGE && nh->nlmsg_type == RTM_DELLINK)
+    {
+        /* For last vlan removed from the port(phy/PO)
+         * Bridge sends RTM_DELLINK, ignore that
+         */
+        STP_LOG_DEBUG("Ignore AF_BRIDGE RTM_DELLINK for %s kif:%u", if_db.ifname, if_db.kif_index);
+        return false;
+    }
+
+    if (ifi->ifi_flags & IFF_RUNNING)
+        if_db.oper_state = 1;
+    else
+        if_db.oper_state = 0;
+
+    stp_netlink_parse_rtattr(rt_list, IFLA_MAX + 1, IFLA_RTA(ifi), rta_len);
+
+    if (rt_list[IFLA_ADDRESS])
+    {
+        ptr = rt_list[IFLA_ADDRESS];
+        memcpy(if_db.mac, RTA_DATA(ptr), L2_ETH_ADD_LEN);
+    }
+
+    if (rt_list[IFLA_LINKINFO])
+    {
+        ptr = rt_list[IFLA_LINKINFO];
+
+        stp_netlink_parse_rtattr(linkinfo_list, IFLA_INFO_MAX + 1, RTA_DATA(ptr), RTA_PAYLOAD(ptr));
+
+        if (linkinfo_list[IFLA_INFO_KIND])
+        {
+            ptr = linkinfo_list[IFLA_INFO_KIND];
+            if ((0 == strncmp((char *)RTA_DATA(ptr), "team", 4)) ||
+                (0 == strncmp((char *)RTA_DATA(ptr), "bond", 4)))
+                if_db.is_bond = 1;
+        }
+        if (linkinfo_list[IFLA_INFO_SLAVE_KIND])
+        {
+            ptr = linkinfo_list[IFLA_INFO_SLAVE_KIND];
+            if ((0 == strncmp((char *)RTA_DATA(ptr), "team", 4)) ||
+                (0 == strncmp((char *)RTA_DATA(ptr), "bond", 4)))
+                if_db.is_member = 1;
+        }
+    }
+
+    if (if_db.is_member)
+    { // find my master
+        if (rt_list[IFLA_MASTER])
+        {
+            ptr = rt_list[IFLA_MASTER];
+            if_db.master_ifindex = *(uint32_t *)RTA_DATA(ptr);
+        }
+    }
+    STP_LOG_DEBUG("RTM-%s IF:%s KIF:%u Oper:%d Bond:%d Mem:%d Master:%u", (nh->nlmsg_type == RTM_NEWLINK) ? "UPDATE" : "DELETE",
+                  if_db.ifname, if_db.kif_index, if_db.oper_state, if_db.is_bond, if_db.is_member, if_db.master_ifindex);
+
+    stp_netlink_cb(&if_db, (nh->nlmsg_type == RTM_NEWLINK) ? 1 : 0, read_all);
+    return true;
+}
+
+/**
+ * @brief Увеличивает приёмный буфер сокета после переполнения (ENOBUFS).
+ *
+ * @param nl_fd Дескриптор Netlink-сокета.
+ * @return bool true, если буфер увеличен.
+ */
+static bool stp_netlink_grow_sock_buf(int nl_fd)
+{
+    int new_buf_size = g_stpd_netlink_cbuf_sz + g_stpd_netlink_ibuf_sz;
+
+    /*Netlink buffer size not enough, increase it*/
+    if (new_buf_size > STP_NETLINK_SOCK_MAX_BUF_SIZE)
+    {
+        STP_LOG_CRITICAL("new_buf_size [%u] is beyond max limit", new_buf_size);
+        return false;
+    }
+
+    if (-1 == stp_set_sock_buf_size(nl_fd, SO_RCVBUF, new_buf_size))
+    {
+        STP_LOG_ERR("stp_netlink_set_buf_size Failed");
+        return false;
+    }
+
+    g_stpd_netlink_cbuf_sz = new_buf_size;
+    STP_LOG_INFO("Netlink new rcv buf size : %d", g_stpd_netlink_cbuf_sz);
+    return true;
+}
+
+/**
+ * @brief Увеличивает приёмный буфер приложения под сообщение длины len.
+ *
+ * Буфер увеличивается один раз и используется для всех следующих чтений.
+ *
+ * @param len Длина сообщения, не поместившегося в буфер.
+ * @return bool true, если буфер увеличен.
+ */
+static bool stp_netlink_grow_rx_buf(int len)
+{
+    void *new_buf = 0;
+
+    if (len > STP_NETLINK_MAX_MSG_SIZE)
+    {
+        // TODO:
+        // This is a very unlikely condition to hit.
+        // STP_NETLINK_APPL_MAX_BUF_SIZE needs to be revisited only if we hit the error
+        STP_LOG_CRITICAL("Netlink msg len[%u] is too big", len);
+        return false;
+    }
+
+    new_buf = aligned_alloc(NLMSG_ALIGNTO, NLMSG_ALIGN(len));
+    if (!new_buf)
+    {
+        STP_LOG_CRITICAL("Alloc Failed, len %d", len);
+        return false;
+    }
+
+    if (g_stp_netlink_rx.buf != g_stp_netlink_rx_buf)
+        free(g_stp_netlink_rx.buf);
+    g_stp_netlink_rx.buf = new_buf;
+    g_stp_netlink_rx.buf_size = NLMSG_ALIGN(len);
+    STP_LOG_INFO("Netlink rx buf size : %u", g_stp_netlink_rx.buf_size);
+    return true;
+}
+
 /**
  * @brief Принимает и обрабатывает сообщения Netlink.
  *
- * Функция читает сообщения из Netlink-сокета, разбирает их и вызывает
- * функцию обратного вызова для каждого сообщения.
+ * Каждая датаграмма читается одним recvmsg() в постоянный буфер и разбирается
+ * по заголовкам NLMSG. При read_all чтение блокирующее до NLMSG_DONE, иначе
+ * сокет вычитывается без блокировки, не более STP_NETLINK_RX_BATCH датаграмм
+ * за вызов. Если датаграмма не поместилась в буфер или ядро отбросило события
+ * (ENOBUFS), буфер увеличивается и запрашивается повторный дамп интерфейсов.
  *
  * @param nl_fd Дескриптор Netlink-сокета.
  * @param read_all Флаг, указывающий, следует ли читать все доступные сообщения.
- * @return int Количество обработанных сообщений, -1 в случае ошибки.
+ * @return int 0 в случае успеха, -1 в случае ошибки.
  */
 static int stp_netlink_recv(int nl_fd, bool read_all)
 {
     int ret = 0;
-    uint8_t retry = 0;
-    int i = 0;
     int len = 0;
-    int nh_len = 0;
-    uint8_t read_more_msg = 0;
+    int reads = 0;
+    bool initial = read_all;
+    bool resync = false;
     struct iovec iov;
     struct sockaddr_nl nl_addr;
     struct msghdr msg;
-    struct rtattr *rt_list[IFLA_MAX + 1];
-    struct rtattr *linkinfo_list[IFLA_INFO_MAX + 1];
     struct nlmsghdr *nh = 0;
-    struct ifinfomsg *ifi = 0;
-    struct rtattr *ptr = 0;
-    netlink_db_t if_db;
-    int flags = MSG_PEEK;
-    int new_buf_size = 0;
-
-    void *new_buf = calloc(1, STP_NETLINK_MSG_SIZE);
-    iov.iov_base = new_buf;
-    iov.iov_len = STP_NETLINK_MSG_SIZE;
-
-    nl_addr.nl_family = AF_NETLINK;
 
-    msg.msg_name = (void *)&nl_addr;
-    msg.msg_namelen = sizeof(nl_addr);
-    msg.msg_iov = &iov;
-    msg.msg_iovlen = 1;
-    msg.msg_control = NULL;
-    msg.msg_controllen = 0;
-    msg.msg_flags = 0;
+    if (!g_stp_netlink_rx.buf)
+    {
+        g_stp_netlink_rx.buf = g_stp_netlink_rx_buf;
+        g_stp_netlink_rx.buf_size = sizeof(g_stp_netlink_rx_buf);
+    }
 
-    do
+again:
+    while (read_all || reads < STP_NETLINK_RX_BATCH)
     {
-        len = recvmsg(nl_fd, &msg, flags);
+        iov.iov_base = g_stp_netlink_rx.buf;
+        iov.iov_len = g_stp_netlink_rx.buf_size;
+
+        memset(&nl_addr, 0, sizeof(nl_addr));
+        nl_addr.nl_family = AF_NETLINK;
+
+        msg.msg_name = (void *)&nl_addr;
+        msg.msg_namelen = sizeof(nl_addr);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = NULL;
+        msg.msg_controllen = 0;
+        msg.msg_flags = 0;
+
+        // MSG_TRUNC: returns the real datagram length if it did not fit
+        len = recvmsg(nl_fd, &msg, read_all ? MSG_TRUNC : (MSG_TRUNC | MSG_DONTWAIT));
         if (-1 == len)
         {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
             if (errno == ENOBUFS)
             {
-                new_buf_size = g_stpd_netlink_cbuf_sz + g_stpd_netlink_ibuf_sz;
-                /*Netlink buffer size not enough, increase it*/
-                if (new_buf_size <= STP_NETLINK_SOCK_MAX_BUF_SIZE)
-                {
-                    g_stpd_netlink_cbuf_sz = new_buf_size;
-                    ret = stp_set_sock_buf_size(nl_fd, SO_RCVBUF, g_stpd_netlink_cbuf_sz);
-                    if (-1 == ret)
-                        STP_LOG_ERR("stp_netlink_set_buf_size Failed");
-                    else
-                    {
-                        STP_LOG_INFO("Netlink new rcv buf size : %d", g_stpd_netlink_cbuf_sz);
-                        retry = 1;
-                        continue;
-                    }
-                }
-                else
-                {
-                    STP_LOG_CRITICAL("new_buf_size [%u] is beyond max limit", new_buf_size);
-                }
+                // kernel dropped events, the interface DB has to be resynced
+                g_stp_netlink_rx.stats.overruns++;
+                resync = true;
+                if (stp_netlink_grow_sock_buf(nl_fd))
+                    continue;
             }
             else
                 STP_LOG_ERR("errno : %s", strerror(errno));
+            ret = -1;
             break;
         }
+        if (0 == len)
+            break;
 
-        if ((msg.msg_flags & MSG_TRUNC) || (len > iov.iov_len))
-        { /*Application buffer size not enough*/
-            STP_LOG_INFO("Packet truncated");
+        reads++;
+        g_stp_netlink_rx.stats.reads++;
 
-            if (len < STP_NETLINK_MAX_MSG_SIZE)
-            {
-                iov.iov_len = len;
-                new_buf = 0;
-                new_buf = realloc(iov.iov_base, len);
-                if (!new_buf)
-                {
-                    STP_LOG_CRITICAL("Relloc Failed");
-                    break;
-                }
-                iov.iov_base = new_buf;
-                flags = 0;
-                retry = 1;
-                continue;
-            }
-            else
+        if ((msg.msg_flags & MSG_TRUNC) || (len > iov.iov_len))
+        { /*Application buffer size not enough, datagram is lost*/
+            STP_LOG_INFO("Packet truncated, len %d", len);
+            g_stp_netlink_rx.stats.truncated++;
+            resync = true;
+            if (!stp_netlink_grow_rx_buf(len))
             {
-                // TODO:
-                // This is a very unlikely condition to hit.
-                // STP_NETLINK_APPL_MAX_BUF_SIZE needs to be revisited only if we hit the error
-                STP_LOG_CRITICAL("Netlink msg len[%u] is too big", len);
-                /*sys_assert(0);*/
+                ret = -1;
                 break;
             }
-        }
-
-        if (flags != 0)
-        {
-            // ALL set read without flags
-            flags = 0;
-            retry = 1;
             continue;
         }
 
-        // A message successfully read , disable retry attempts... continue processing.
-        retry = 0;
-
-        nh = (struct nlmsghdr *)(void *)(iov.iov_base);
-        for (; NLMSG_OK(nh, len);
-             nh = NLMSG_NEXT(nh, len))
+        for (nh = (struct nlmsghdr *)iov.iov_base; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len))
         {
-
-            if (nh->nlmsg_flags & NLM_F_MULTI)
-                read_more_msg = 1;
-            else
-                read_more_msg = 0;
+            g_stp_netlink_rx.stats.msgs++;
 
             if (nh->nlmsg_type == NLMSG_DONE)
             {
-                read_more_msg = 0;
-                read_all = 0;
+                read_all = false;
+                g_stp_netlink_rx.dump_pending = false;
                 break;
             }
 
-            if (nh->nlmsg_type == NLMSG_ERROR)
-            {
-                continue; // move on to next nh
-            }
-
             if ((nh->nlmsg_type == RTM_NEWLINK) || (nh->nlmsg_type == RTM_DELLINK))
             {
-                ifi = NLMSG_DATA(nh);
-                if (!ifi)
-                {
-                    continue; // move on to next nh
-                }
-
-                if (ifi->ifi_type != ARPHRD_ETHER)
-                {
-                    continue; // move on to next nh
-                }
-
-                memset(&if_db, 0, sizeof(if_db));
-                if_db.kif_index = ifi->ifi_index;
-                nh_len = nh->nlmsg_len;
-
-                stp_netlink_parse_rtattr(rt_list, IFLA_MAX, IFLA_RTA(ifi), nh_len);
-                if (rt_list[IFLA_IFNAME])
-                {
-                    ptr = rt_list[IFLA_IFNAME];
-                    strncpy(if_db.ifname, (char *)RTA_DATA(ptr), IFNAMSIZ);
-
-                    if (!stp_netlink_intf_is_valid(if_db.ifname))
-                    {
-                        continue;
-                    }
-
-                    if (ifi->ifi_family == AF_BRIDGE && nh->nlmsg_type == RTM_DELLINK)
-                    {
-                        /* For last vlan removed from the port(phy/PO)
-                         * Bridge sends RTM_DELLINK, ignore that
-                         */
-                        STP_LOG_DEBUG("Ignore AF_BRIDGE RTM_DELLINK for %s kif:%u", if_db.ifname, if_db.kif_index);
-                        continue;
-                    }
-
-                    if (ifi->ifi_flags & IFF_RUNNING)
-                    {
-                        if_db.oper_state = 1;
-                    }
-                    else
-                    {
-                        if_db.oper_state = 0;
-                    }
-
-                    if (rt_list[IFLA_ADDRESS])
-                    {
-                        ptr = rt_list[IFLA_ADDRESS];
-                        memcpy(if_db.mac, RTA_DATA(ptr), L2_ETH_ADD_LEN);
-                    }
-
-                    if (rt_list[IFLA_LINKINFO])
-                    {
-                        ptr = rt_list[IFLA_LINKINFO];
-
-                        stp_netlink_parse_rtattr(linkinfo_list, IFLA_INFO_MAX, RTA_DATA(ptr), ptr->rta_len);
-
-                        if (linkinfo_list[IFLA_INFO_KIND])
-                        {
-                            ptr = linkinfo_list[IFLA_INFO_KIND];
-                            if ((0 == strncmp((char *)RTA_DATA(ptr), "team", 4)) ||
-                                (0 == strncmp((char *)RTA_DATA(ptr), "bond", 4)))
-                                if_db.is_bond = 1;
-                        }
-                        if (linkinfo_list[IFLA_INFO_SLAVE_KIND])
-                        {
-                            ptr = linkinfo_list[IFLA_INFO_SLAVE_KIND];
-                            if ((0 == strncmp((char *)RTA_DATA(ptr), "team", 4)) ||
-                                (0 == strncmp((char *)RTA_DATA(ptr), "bond", 4)))
-                                if_db.is_member = 1;
-                        }
-                    }
-
-                    if (if_db.is_member)
-                    { // find my master
-                        if (rt_list[IFLA_MASTER])
-                        {
-                            ptr = rt_list[IFLA_MASTER];
-                            if_db.master_ifindex = *(uint32_t *)RTA_DATA(ptr);
-                        }
-                    }
-                    STP_LOG_INFO("RTM-%s IF:%s KIF:%u Oper:%d Bond:%d Mem:%d Master:%u", (nh->nlmsg_type == RTM_NEWLINK) ? "UPDATE" : "DELETE",
-                                 if_db.ifname, if_db.kif_index, if_db.oper_state, if_db.is_bond, if_db.is_member, if_db.master_ifindex);
-                }
-                else
-                {
-                    STP_LOG_DEBUG("No ifname for kif_index :%d ", if_db.kif_index);
-                }
+                if (!stp_netlink_recv_link(nh, read_all))
+                    g_stp_netlink_rx.stats.filtered++;
             }
-            stp_netlink_cb(&if_db, (nh->nlmsg_type == RTM_NEWLINK) ? 1 : 0, read_all);
-        } // end for loop
+        }
+    }
 
-        if (read_more_msg || read_all)
+    if (resync && !read_all && !g_stp_netlink_rx.dump_pending)
+    {
+        STP_LOG_ERR("Netlink events lost, requesting interface dump");
+        if (stp_netlink_request(nl_fd) != -1)
         {
-            STP_LOG_DEBUG("%s : Waiting for more msgs until NLMSG_DONE", read_all ? "READ_ALL" : "READ_MORE");
-            flags = MSG_PEEK;
+            g_stp_netlink_rx.dump_pending = true;
+            g_stp_netlink_rx.stats.resyncs++;
+            // the initial dump must be complete before the intf DB is used
+            if (initial)
+            {
+                read_all = true;
+                resync = false;
+                goto again;
+            }
         }
+    }
 
-    } while (retry || read_more_msg || read_all);
-
-    free(iov.iov_base);
-    return 0;
+    return ret;
 }
 
 // process all netlink msgs until EAGAIN/EWOULDBLOCK
@@ -463,12 +543,23 @@ int stp_netlink_recv_all(int nl_fd)
     if (stp_netlink_request(nl_fd) == -1)
         return -1;
 
+    g_stp_netlink_rx.dump_pending = true;
     return stp_netlink_recv(nl_fd, true);
 }
 
-// process one msg only
 /**
- * @brief Принимает одно сообщение Netlink.
+ * @brief Возвращает статистику приёма событий интерфейсов.
+ *
+ * @return stp_netlink_rx_stats_t* Указатель на статистику.
+ */
+stp_netlink_rx_stats_t *stp_netlink_rx_get_stats(void)
+{
+    return &g_stp_netlink_rx.stats;
+}
+
+// process pending msgs, at most STP_NETLINK_RX_BATCH datagrams
+/**
+ * @brief Принимает ожидающие сообщения Netlink без блокировки.
  *
  * @param nl_fd Дескриптор Netlink-сокета.
  * @return int Код результата операции: >=0 в случае успеха, -1 в случае ошибки.
@@ -497,3 +588,386 @@ void stp_netlink_events_cb(evutil_socket_t fd, short what, void *arg)
     else
         STP_LOG_ERR("Invalid event : %x", what);
 }
+
+/* KERNEL BRIDGE VLAN PROGRAMMING ------------------------------------------- */
+
+/**
+ * @struct stp_netlink_br_ctx_t
+ * @brief Контекст пакетного программирования VLAN моста ядра
+ */
+typedef struct
+{
+    int fd;                                // Netlink-сокет для запросов (без подписки на группы)
+    uint32_t seq_base;                     // Sequence первой операции текущего пакета
+    uint16_t count;                        // Количество операций в очереди
+    uint16_t batch_max;                    // Операций в пакете, не больше STP_NETLINK_BR_BATCH_MAX
+    uint32_t sent_seq;                     // Sequence первой операции отправленного пакета
+    uint16_t sent_count;                   // Операций в отправленном пакете
+    uint16_t sent_acked;                   // Из них уже получено ACK
+    struct event *flush_ev;                // Отложенное событие сброса очереди
+    struct event *ack_ev;                  // Чтение запоздавших ACK
+    stp_netlink_br_err_cb_ptr *err_cb;     // Отчёт об ошибках по операциям
+    stp_netlink_br_stats_t stats;          // Статистика
+    stp_netlink_br_vlan_op_t ops[STP_NETLINK_BR_BATCH_MAX];
+    stp_netlink_br_vlan_op_t sent[STP_NETLINK_BR_BATCH_MAX]; // Операции, ожидающие ACK
+} stp_netlink_br_ctx_t;
+
+static stp_netlink_br_ctx_t g_stp_netlink_br = {.fd = -1};
+static uint8_t g_stp_netlink_br_buf[STP_NETLINK_BR_BUF_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+static uint8_t g_stp_netlink_br_ack_buf[STP_NETLINK_MSG_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+
+static int stp_netlink_br_recv_acks(void);
+
+/**
+ * @brief Libevent callback отложенного сброса очереди операций VLAN моста.
+ *
+ * Активируется при постановке первой операции в очередь и выполняется после
+ * завершения текущего callback, так что все изменения состояния портов,
+ * произведённые одним BPDU, IPC-сообщением или тиком таймера, уходят в ядро
+ * одним netlink-запросом.
+ */
+static void stp_netlink_br_flush_cb(evutil_socket_t fd, short what, void *arg)
+{
+    stp_netlink_br_flush();
+}
+
+/**
+ * @brief Libevent callback чтения ACK, не прочитанных при сбросе пакета.
+ */
+static void stp_netlink_br_ack_cb(evutil_socket_t fd, short what, void *arg)
+{
+    uint16_t acked = g_stp_netlink_br.sent_acked;
+
+    stp_netlink_br_recv_acks();
+    g_stp_netlink_br.stats.late_acks += g_stp_netlink_br.sent_acked - acked;
+}
+
+/**
+ * @brief Инициализирует netlink-сокет для программирования VLAN моста ядра.
+ *
+ * Сокет неблокирующий: ядро отвечает на запросы синхронно, поэтому ACK
+ * пакета читаются сразу после sendmsg(), а запоздавшие - событием сокета.
+ *
+ * @param base База событий libevent для отложенного сброса очереди (может быть NULL,
+ *             тогда сброс выполняется только явным вызовом `stp_netlink_br_flush`).
+ * @param err_cb Callback для отчёта об ошибках отдельных операций.
+ * @return int Дескриптор сокета или -1 в случае ошибки.
+ */
+int stp_netlink_br_init(struct event_base *base, stp_netlink_br_err_cb_ptr *err_cb)
+{
+    int nl_fd = -1;
+    int val = 1;
+    int rcvbuf = 0;
+    struct sockaddr_nl sa = {
+        .nl_family = AF_NETLINK,
+        .nl_pad = 0,
+        .nl_pid = 0,
+        .nl_groups = 0};
+
+    nl_fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+    if (nl_fd == -1)
+    {
+        STP_LOG_ERR("bridge nl_fd CREATE Failed : %s", strerror(errno));
+        return -1;
+    }
+
+    if (bind(nl_fd, (struct sockaddr *)&sa, sizeof(sa)) == -1)
+    {
+        STP_LOG_ERR("bridge nl_fd BIND Failed : %s", strerror(errno));
+        close(nl_fd);
+        return -1;
+    }
+
+    // ACK carries only the header of the original request
+    if (-1 == setsockopt(nl_fd, SOL_NETLINK, NETLINK_CAP_ACK, &val, sizeof(val)))
+        STP_LOG_INFO("bridge nl_fd NETLINK_CAP_ACK not supported : %s", strerror(errno));
+
+    evutil_make_socket_nonblocking(nl_fd);
+
+    // the kernel limits SO_RCVBUF by rmem_max, so the batch follows the granted size
+    rcvbuf = stp_set_sock_buf_size(nl_fd, SO_RCVBUF, STP_NETLINK_BR_ACK_BUF_SIZE);
+    g_stp_netlink_br.batch_max = STP_NETLINK_BR_BATCH_MAX;
+    if (rcvbuf > 0 && rcvbuf / STP_NETLINK_BR_ACK_TRUESIZE < STP_NETLINK_BR_BATCH_MAX)
+        g_stp_netlink_br.batch_max = (rcvbuf / STP_NETLINK_BR_ACK_TRUESIZE) ? rcvbuf / STP_NETLINK_BR_ACK_TRUESIZE : 1;
+    g_stp_netlink_br.stats.batch_cap = g_stp_netlink_br.batch_max;
+
+    if (base)
+    {
+        g_stp_netlink_br.flush_ev = stpmgr_libevent_create_prio(base, -1, 0, stp_netlink_br_flush_cb, NULL, NULL,
+                                                                "BR-FLUSH", STP_LIBEV_HIGH_PRI_Q);
+        if (!g_stp_netlink_br.flush_ev)
+        {
+            STP_LOG_ERR("bridge flush event create failed");
+            close(nl_fd);
+            return -1;
+        }
+
+        g_stp_netlink_br.ack_ev = stpmgr_libevent_create_prio(base, nl_fd, EV_READ | EV_PERSIST, stp_netlink_br_ack_cb,
+                                                              NULL, NULL, "BR-ACK", STP_LIBEV_HIGH_PRI_Q);
+        if (!g_stp_netlink_br.ack_ev)
+        {
+            STP_LOG_ERR("bridge ack event create failed");
+            close(nl_fd);
+            return -1;
+        }
+    }
+
+    g_stp_netlink_br.fd = nl_fd;
+    g_stp_netlink_br.err_cb = err_cb;
+    g_stp_netlink_br.seq_base = (uint32_t)time(NULL);
+    g_stp_netlink_br.count = 0;
+
+    STP_LOG_INFO("bridge netlink init done, fd : %d, batch %u", nl_fd, g_stp_netlink_br.batch_max);
+    return nl_fd;
+}
+
+/**
+ * @brief Проверяет, доступно ли программирование VLAN моста через netlink.
+ *
+ * @return bool true, если сокет инициализирован.
+ */
+bool stp_netlink_br_is_ready(void)
+{
+    return (g_stp_netlink_br.fd != -1);
+}
+
+/**
+ * @brief Возвращает статистику программирования VLAN моста.
+ *
+ * @return stp_netlink_br_stats_t* Указатель на статистику.
+ */
+stp_netlink_br_stats_t *stp_netlink_br_get_stats(void)
+{
+    return &g_stp_netlink_br.stats;
+}
+
+/**
+ * @brief Ставит операцию добавления/удаления VLAN в очередь на отправку в ядро.
+ *
+ * При заполнении очереди она сбрасывается немедленно, иначе сброс выполняется
+ * отложенным событием по окончании текущего callback libevent.
+ *
+ * @param op Описание операции.
+ * @return bool true, если операция поставлена в очередь.
+ */
+bool stp_netlink_br_vlan_queue(const stp_netlink_br_vlan_op_t *op)
+{
+    if (g_stp_netlink_br.fd == -1 || !op)
+        return false;
+
+    if (g_stp_netlink_br.count >= g_stp_netlink_br.batch_max)
+        stp_netlink_br_flush();
+
+    g_stp_netlink_br.ops[g_stp_netlink_br.count++] = *op;
+    g_stp_netlink_br.stats.ops++;
+
+    if (g_stp_netlink_br.count == 1 && g_stp_netlink_br.flush_ev)
+        event_active(g_stp_netlink_br.flush_ev, EV_TIMEOUT, 0);
+
+    return true;
+}
+
+/**
+ * @brief Формирует netlink-сообщение RTM_SETLINK/RTM_DELLINK для одной операции.
+ *
+ * @param op Описание операции.
+ * @param buf Буфер для сообщения (не менее STP_NETLINK_BR_MSG_SIZE байт).
+ * @param seq Sequence number сообщения.
+ * @return uint32_t Выровненная длина сформированного сообщения.
+ */
+static uint32_t stp_netlink_br_build_msg(const stp_netlink_br_vlan_op_t *op, uint8_t *buf, uint32_t seq)
+{
+    struct nlmsghdr *nh = (struct nlmsghdr *)buf;
+    struct ifinfomsg *ifi = 0;
+    struct rtattr *af_spec = 0;
+    struct rtattr *rta = 0;
+    struct bridge_vlan_info vinfo;
+
+    memset(buf, 0, STP_NETLINK_BR_MSG_SIZE);
+
+    nh->nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    nh->nlmsg_type = op->add ? RTM_SETLINK : RTM_DELLINK;
+    nh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    nh->nlmsg_seq = seq;
+    nh->nlmsg_pid = 0;
+
+    ifi = NLMSG_DATA(nh);
+    ifi->ifi_family = AF_BRIDGE;
+    ifi->ifi_index = op->kif_index;
+
+    af_spec = (struct rtattr *)(buf + NLMSG_ALIGN(nh->nlmsg_len));
+    af_spec->rta_type = IFLA_AF_SPEC;
+    af_spec->rta_len = RTA_LENGTH(0);
+
+    memset(&vinfo, 0, sizeof(vinfo));
+    vinfo.vid = op->vlan_id;
+    if (op->untagged)
+        vinfo.flags |= BRIDGE_VLAN_INFO_UNTAGGED;
+
+    rta = (struct rtattr *)((uint8_t *)af_spec + RTA_ALIGN(af_spec->rta_len));
+    rta->rta_type = IFLA_BRIDGE_VLAN_INFO;
+    rta->rta_len = RTA_LENGTH(sizeof(vinfo));
+    memcpy(RTA_DATA(rta), &vinfo, sizeof(vinfo));
+
+    af_spec->rta_len = RTA_ALIGN(af_spec->rta_len) + RTA_ALIGN(rta->rta_len);
+    nh->nlmsg_len = NLMSG_ALIGN(nh->nlmsg_len) + af_spec->rta_len;
+
+    return NLMSG_ALIGN(nh->nlmsg_len);
+}
+
+/**
+ * @brief Сообщает об ошибке операции и обновляет статистику.
+ */
+static void stp_netlink_br_report_err(stp_netlink_br_vlan_op_t *op, int err)
+{
+    g_stp_netlink_br.stats.errors++;
+    if (g_stp_netlink_br.err_cb)
+        g_stp_netlink_br.err_cb(op, err);
+    else
+        STP_LOG_ERR("bridge vlan %s vid %u kif %u failed : %s", op->add ? "add" : "del",
+                    op->vlan_id, op->kif_index, strerror(err));
+}
+
+/**
+ * @brief Читает все ACK, стоящие в сокете, не блокируясь.
+ *
+ * Ошибки из NLMSG_ERROR сопоставляются с операциями отправленного пакета по
+ * sequence number и передаются в callback ошибок. Сокет вычитывается до
+ * EAGAIN, чтобы событие чтения не срабатывало повторно на чужих ACK.
+ *
+ * @return int Количество операций, завершившихся ошибкой.
+ */
+static int stp_netlink_br_recv_acks(void)
+{
+    stp_netlink_br_ctx_t *ctx = &g_stp_netlink_br;
+    struct nlmsghdr *nh = 0;
+    struct nlmsgerr *nl_err = 0;
+    uint32_t idx = 0;
+    bool overrun = false;
+    int errors = 0;
+    int ret = 0;
+
+    for (;;)
+    {
+        ret = recv(ctx->fd, g_stp_netlink_br_ack_buf, sizeof(g_stp_netlink_br_ack_buf), MSG_DONTWAIT);
+        if (ret == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOBUFS)
+            {
+                // reported once, the ACKs queued before the overrun follow
+                overrun = true;
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                STP_LOG_ERR("bridge vlan batch ACK recv failed, acked %u/%u : %s", ctx->sent_acked, ctx->sent_count,
+                            strerror(errno));
+            break;
+        }
+
+        for (nh = (struct nlmsghdr *)g_stp_netlink_br_ack_buf; NLMSG_OK(nh, ret); nh = NLMSG_NEXT(nh, ret))
+        {
+            if (nh->nlmsg_type != NLMSG_ERROR)
+                continue;
+
+            idx = nh->nlmsg_seq - ctx->sent_seq;
+            if (idx >= ctx->sent_count)
+                continue; // stale ACK of an earlier batch
+
+            ctx->sent_acked++;
+            nl_err = (struct nlmsgerr *)NLMSG_DATA(nh);
+            if (nl_err->error)
+            {
+                errors++;
+                stp_netlink_br_report_err(&ctx->sent[idx], -nl_err->error);
+            }
+        }
+    }
+
+    if (overrun && ctx->sent_acked < ctx->sent_count)
+    {
+        ctx->stats.lost_acks += ctx->sent_count - ctx->sent_acked;
+        STP_LOG_ERR("bridge vlan batch ACK overrun, acked %u/%u", ctx->sent_acked, ctx->sent_count);
+        ctx->sent_count = 0;
+        ctx->sent_acked = 0;
+    }
+
+    return errors;
+}
+
+/**
+ * @brief Отправляет все операции из очереди одним netlink-запросом и собирает ACK.
+ *
+ * Каждая операция оформляется отдельным сообщением с собственным sequence number,
+ * все сообщения отправляются одним sendmsg(). ACK, уже стоящие в сокете,
+ * читаются сразу, остальные - событием сокета или перед следующим пакетом.
+ *
+ * @return int Количество операций, завершившихся ошибкой по прочитанным ACK,
+ *             или -1 при ошибке отправки.
+ */
+int stp_netlink_br_flush(void)
+{
+    stp_netlink_br_ctx_t *ctx = &g_stp_netlink_br;
+    struct sockaddr_nl dst;
+    struct iovec iov;
+    struct msghdr msg;
+    uint32_t len = 0;
+    uint16_t i = 0;
+    int errors = 0;
+
+    if (ctx->fd == -1 || ctx->count == 0)
+        return 0;
+
+    // previous batch ACKs still queued are matched before the batch is replaced
+    if (ctx->sent_acked < ctx->sent_count)
+    {
+        stp_netlink_br_recv_acks();
+        if (ctx->sent_acked < ctx->sent_count)
+        {
+            ctx->stats.lost_acks += ctx->sent_count - ctx->sent_acked;
+            STP_LOG_ERR("bridge vlan batch[%u] %u ACKs missing", ctx->sent_count, ctx->sent_count - ctx->sent_acked);
+        }
+    }
+
+    for (i = 0; i < ctx->count; i++)
+        len += stp_netlink_br_build_msg(&ctx->ops[i], g_stp_netlink_br_buf + len, ctx->seq_base + i);
+
+    memset(&dst, 0, sizeof(dst));
+    dst.nl_family = AF_NETLINK;
+
+    iov.iov_base = g_stp_netlink_br_buf;
+    iov.iov_len = len;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &dst;
+    msg.msg_namelen = sizeof(dst);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    ctx->stats.flushes++;
+    if (ctx->count > ctx->stats.max_batch)
+        ctx->stats.max_batch = ctx->count;
+
+    if (-1 == sendmsg(ctx->fd, &msg, 0))
+    {
+        STP_LOG_ERR("bridge vlan batch[%u] send failed : %s", ctx->count, strerror(errno));
+        for (i = 0; i < ctx->count; i++)
+            stp_netlink_br_report_err(&ctx->ops[i], errno);
+        ctx->sent_count = 0;
+        ctx->sent_acked = 0;
+        errors = -1;
+        goto done;
+    }
+
+    memcpy(ctx->sent, ctx->ops, ctx->count * sizeof(ctx->ops[0]));
+    ctx->sent_seq = ctx->seq_base;
+    ctx->sent_count = ctx->count;
+    ctx->sent_acked = 0;
+    errors = stp_netlink_br_recv_acks();
+
+done:
+    ctx->seq_base += ctx->count;
+    ctx->count = 0;
+    return errors;
+}
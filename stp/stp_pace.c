@@ -0,0 +1,423 @@
+/**
+ * @file stp_pace.c
+ * @brief Распределение передачи hello BPDU по интервалу hello.
+ *
+ * @details
+ * Состояние порта выделяется при первом hello на нём, очередь и маска
+ * экземпляров в ней - при первом отложенном hello. Очереди ведёт главный
+ * поток: рабочие потоки передают ему hello через stp_worker_defer_hello(),
+ * а stp_pace_tick() вызывается из stptimer_tick() после раунда потоков.
+ */
+
+#include "stp_inc.h"
+
+/**
+ * @struct stp_pace_entry_t
+ * @brief Отложенный hello
+ */
+typedef struct
+{
+    uint32_t queued_slot; // Слот постановки в очередь
+    uint32_t deadline;    // Слот, после которого hello опаздывает
+    STP_INDEX stp_index;  // Экземпляр STP
+} stp_pace_entry_t;
+
+/**
+ * @struct stp_pace_port_t
+ * @brief Состояние порта
+ */
+typedef struct
+{
+    stp_pace_entry_t *ring; // Очередь hello
+    uint32_t size;          // Размер очереди
+    uint32_t head;          // Первая запись
+    uint32_t count;         // Записей в очереди
+    BITMAP_T *queued;       // Экземпляры в очереди, по STP_INDEX
+    uint32_t slot;          // Слот, к которому относится slot_sent
+    uint32_t slot_sent;     // Отправлено hello в слоте
+    uint32_t window_slot;   // Начало окна нагрузки
+    uint32_t window_hellos; // Hello в текущем окне
+    uint32_t load;          // Hello в прошлом окне
+} stp_pace_port_t;
+
+/**
+ * @struct stp_pace_t
+ * @brief Контекст распределения hello
+ */
+typedef struct
+{
+    stp_pace_port_t **ports; // По port_id, max_port записей
+    uint32_t max_port;
+    BITMAP_T *backlog;       // Порты с непустой очередью
+    uint32_t slot;           // Слотов с запуска
+    bool disabled;           // Не удалось выделить таблицу портов
+    stp_pace_stats_t stats;
+} stp_pace_t;
+
+static stp_pace_t g_stp_pace = {.stats = {.pps = STP_PACE_PPS, .burst = STP_PACE_BURST}};
+
+/**
+ * @brief Возвращает состояние порта, выделяя его при первом обращении.
+ *
+ * @param port_number Порт STP.
+ * @return Состояние порта или NULL, если памяти нет.
+ */
+static stp_pace_port_t *stp_pace_get_port(PORT_ID port_number)
+{
+    stp_pace_port_t *pace;
+
+    if (g_stp_pace.disabled)
+        return NULL;
+
+    if (!g_stp_pace.ports)
+    {
+        g_stp_pace.ports = calloc(g_max_stp_port, sizeof(stp_pace_port_t *));
+        if (!g_stp_pace.ports || -1 == bmp_alloc(&g_stp_pace.backlog, g_max_stp_port))
+        {
+            STP_LOG_ERR("tx pace alloc Failed");
+            free(g_stp_pace.ports);
+            g_stp_pace.ports = NULL;
+            g_stp_pace.disabled = true;
+            return NULL;
+        }
+        g_stp_pace.max_port = g_max_stp_port;
+    }
+
+    if (port_number >= g_stp_pace.max_port)
+        return NULL;
+
+    pace = g_stp_pace.ports[port_number];
+    if (!pace)
+    {
+        pace = calloc(1, sizeof(stp_pace_port_t));
+        if (!pace)
+            return NULL;
+        pace->slot = pace->window_slot = g_stp_pace.slot;
+        g_stp_pace.ports[port_number] = pace;
+        g_stp_pace.stats.ports++;
+    }
+    return pace;
+}
+
+/**
+ * @brief Потолок hello порта за слот.
+ */
+static uint32_t stp_pace_ceiling()
+{
+    uint32_t ceiling = (g_stp_pace.stats.pps + STP_PACE_SLOTS_PER_SEC - 1) / STP_PACE_SLOTS_PER_SEC;
+
+    return ceiling ? ceiling : 1;
+}
+
+/**
+ * @brief Возвращает квоту hello порта в текущем слоте.
+ *
+ * Сбрасывает счётчик слота при смене слота и сдвигает окно нагрузки.
+ *
+ * @param pace Состояние порта.
+ * @return Квота слота.
+ */
+static uint32_t stp_pace_quota(stp_pace_port_t *pace)
+{
+    uint32_t elapsed, spread, quota;
+
+    if (pace->slot != g_stp_pace.slot)
+    {
+        pace->slot = g_stp_pace.slot;
+        pace->slot_sent = 0;
+    }
+
+    elapsed = g_stp_pace.slot - pace->window_slot;
+    if (elapsed >= STP_PACE_WINDOW_SLOTS)
+    {
+        // a whole window without hellos leaves no load behind
+        pace->load = (elapsed < 2 * STP_PACE_WINDOW_SLOTS) ? pace->window_hellos : 0;
+        pace->window_hellos = 0;
+        pace->window_slot = g_stp_pace.slot;
+    }
+
+    // the queue has to drain before the deadline part of the interval is over
+    spread = STP_PACE_WINDOW_SLOTS * STP_PACE_DEADLINE_PCT / 100;
+    quota = (pace->load + spread - 1) / spread;
+    if (quota < g_stp_pace.stats.burst)
+        quota = g_stp_pace.stats.burst;
+    if (quota > stp_pace_ceiling())
+        quota = stp_pace_ceiling();
+    return quota;
+}
+
+/**
+ * @brief Ставит hello экземпляра в очередь порта.
+ *
+ * @param pace Состояние порта.
+ * @param port_number Порт STP.
+ * @param stp_class Экземпляр STP.
+ * @return false, если памяти для очереди нет.
+ */
+static bool stp_pace_push(stp_pace_port_t *pace, PORT_ID port_number, STP_CLASS *stp_class)
+{
+    STP_INDEX stp_index = GET_STP_INDEX(stp_class);
+    stp_pace_entry_t *ring, *entry;
+    uint32_t size, i, deadline;
+
+    if (!pace->queued && -1 == bmp_alloc(&pace->queued, g_stp_instances))
+        return false;
+    if (stp_index >= g_stp_instances)
+        return false;
+
+    if (bmp_isset(pace->queued, stp_index))
+    {
+        g_stp_pace.stats.merged++;
+        return true;
+    }
+
+    if (pace->count == pace->size)
+    {
+        size = pace->size ? 2 * pace->size : 16;
+        ring = malloc(size * sizeof(stp_pace_entry_t));
+        if (!ring)
+            return false;
+        for (i = 0; i < pace->count; i++)
+            ring[i] = pace->ring[(pace->head + i) % pace->size];
+        free(pace->ring);
+        pace->ring = ring;
+        pace->size = size;
+        pace->head = 0;
+    }
+
+    deadline = stp_class->bridge_info.hello_time * STP_PACE_SLOTS_PER_SEC * STP_PACE_DEADLINE_PCT / 100;
+    entry = &pace->ring[(pace->head + pace->count) % pace->size];
+    entry->queued_slot = g_stp_pace.slot;
+    entry->deadline = g_stp_pace.slot + (deadline ? deadline : 1);
+    entry->stp_index = stp_index;
+    pace->count++;
+    bmp_set(pace->queued, stp_index);
+    bmp_set(g_stp_pace.backlog, port_number);
+
+    g_stp_pace.stats.deferred++;
+    g_stp_pace.stats.queued++;
+    if (pace->count > g_stp_pace.stats.max_queued)
+        g_stp_pace.stats.max_queued = pace->count;
+    return true;
+}
+
+/**
+ * @brief Отправляет отложенный hello, если порт всё ещё назначенный.
+ *
+ * @return true, если вызван transmit_config().
+ */
+static bool stp_pace_send(STP_INDEX stp_index, PORT_ID port_number)
+{
+    STP_CLASS *stp_class;
+
+    if (stp_index >= g_stp_instances)
+        return false;
+
+    stp_class = GET_STP_CLASS(stp_index);
+    if (stp_class->state != STP_CLASS_ACTIVE || !is_member(stp_class->enable_mask, port_number) ||
+        !designated_port(stp_class, port_number))
+        return false;
+
+    transmit_config(stp_class, port_number);
+    return true;
+}
+
+/**
+ * @brief Отправляет hello из очереди порта в пределах квоты слота.
+ *
+ * @param port_number Порт STP.
+ * @param all Отправить всю очередь без учёта квоты.
+ * @return void
+ */
+static void stp_pace_drain(PORT_ID port_number, bool all)
+{
+    stp_pace_port_t *pace = g_stp_pace.ports[port_number];
+    stp_pace_entry_t entry;
+    uint32_t quota, ceiling, delay_ms;
+
+    quota = stp_pace_quota(pace);
+    ceiling = stp_pace_ceiling();
+
+    while (pace->count)
+    {
+        entry = pace->ring[pace->head];
+        if (!all && (pace->slot_sent >= ceiling || (pace->slot_sent >= quota && g_stp_pace.slot < entry.deadline)))
+            break;
+
+        pace->head = (pace->head + 1) % pace->size;
+        pace->count--;
+        g_stp_pace.stats.queued--;
+        bmp_reset(pace->queued, entry.stp_index);
+
+        if (!stp_pace_send(entry.stp_index, port_number))
+        {
+            g_stp_pace.stats.stale++;
+            continue;
+        }
+
+        pace->slot_sent++;
+        g_stp_pace.stats.paced++;
+        if (g_stp_pace.slot > entry.deadline)
+            g_stp_pace.stats.late++;
+        delay_ms = (g_stp_pace.slot - entry.queued_slot) * (1000 / STP_PACE_SLOTS_PER_SEC);
+        g_stp_pace.stats.delay_ms += delay_ms;
+        if (delay_ms > g_stp_pace.stats.max_delay_ms)
+            g_stp_pace.stats.max_delay_ms = delay_ms;
+    }
+
+    if (!pace->count)
+        bmp_reset(g_stp_pace.backlog, port_number);
+}
+
+/**
+ * @brief Отправляет hello порта сразу или ставит его в очередь.
+ *
+ * @param stp_class Экземпляр STP.
+ * @param port_number Назначенный порт.
+ * @return void
+ */
+static void stp_pace_port(STP_CLASS *stp_class, PORT_ID port_number)
+{
+    stp_pace_port_t *pace = NULL;
+    uint32_t quota;
+
+    if (g_stp_pace.stats.pps)
+        pace = stp_pace_get_port(port_number);
+    if (!pace)
+    {
+        transmit_config(stp_class, port_number);
+        return;
+    }
+
+    quota = stp_pace_quota(pace);
+    pace->window_hellos++;
+    if (!pace->count && pace->slot_sent < quota)
+    {
+        pace->slot_sent++;
+        g_stp_pace.stats.immediate++;
+        transmit_config(stp_class, port_number);
+        return;
+    }
+
+    if (!stp_pace_push(pace, port_number, stp_class))
+        transmit_config(stp_class, port_number);
+}
+
+/**
+ * @brief Распределяет hello экземпляра по его назначенным портам.
+ *
+ * Выполняется главным потоком, в том числе для hello, отложенных рабочими потоками.
+ *
+ * @param stp_class Экземпляр STP.
+ * @return void
+ */
+void stp_pace_generation(STP_CLASS *stp_class)
+{
+    PORT_MASK_ITER it;
+    PORT_ID port_number;
+
+    PORT_MASK_FOR_EACH_PORT(stp_class->enable_mask, it, port_number)
+    {
+        if (designated_port(stp_class, port_number))
+            stp_pace_port(stp_class, port_number);
+    }
+}
+
+/**
+ * @brief config_bpdu_generation() по истечении таймера hello.
+ *
+ * @param stp_class Экземпляр STP.
+ * @return void
+ */
+void stp_pace_hello(STP_CLASS *stp_class)
+{
+    if (!g_stp_pace.stats.pps)
+    {
+        config_bpdu_generation(stp_class);
+        return;
+    }
+
+    STP_SM_INCR(config_bpdu_generation);
+    if (stp_worker_defer_hello(stp_class))
+        return;
+    stp_pace_generation(stp_class);
+}
+
+/**
+ * @brief Начинает новый слот и отправляет hello из очередей портов.
+ *
+ * Вызывается из stptimer_tick() каждые 100 мс.
+ *
+ * @return void
+ */
+void stp_pace_tick()
+{
+    PORT_MASK_ITER it;
+    PORT_ID port_number;
+
+    g_stp_pace.slot++;
+    if (!g_stp_pace.stats.queued)
+        return;
+
+    PORT_MASK_FOR_EACH_PORT(g_stp_pace.backlog, it, port_number)
+        stp_pace_drain(port_number, false);
+}
+
+/**
+ * @brief Устанавливает потолок hello порта (stpctl txpace).
+ *
+ * При отключении очереди отправляются сразу.
+ *
+ * @param pps Hello порта в секунду, 0 отключает распределение.
+ * @param burst Hello порта, всегда отправляемые в слоте, 0 - STP_PACE_BURST.
+ * @return void
+ */
+void stp_pace_set(uint32_t pps, uint32_t burst)
+{
+    PORT_MASK_ITER it;
+    PORT_ID port_number;
+
+    g_stp_pace.stats.pps = pps;
+    g_stp_pace.stats.burst = burst ? burst : STP_PACE_BURST;
+
+    if (!pps && g_stp_pace.stats.queued)
+    {
+        PORT_MASK_FOR_EACH_PORT(g_stp_pace.backlog, it, port_number)
+            stp_pace_drain(port_number, true);
+    }
+}
+
+/**
+ * @brief Освобождает очереди и состояние портов.
+ *
+ * @return void
+ */
+void stp_pace_deinit()
+{
+    uint32_t p;
+
+    if (g_stp_pace.ports)
+    {
+        for (p = 0; p < g_stp_pace.max_port; p++)
+        {
+            if (!g_stp_pace.ports[p])
+                continue;
+            free(g_stp_pace.ports[p]->ring);
+            bmp_free(g_stp_pace.ports[p]->queued);
+            free(g_stp_pace.ports[p]);
+        }
+        free(g_stp_pace.ports);
+        bmp_free(g_stp_pace.backlog);
+    }
+    memset(&g_stp_pace, 0, sizeof(g_stp_pace));
+    g_stp_pace.stats.pps = STP_PACE_PPS;
+    g_stp_pace.stats.burst = STP_PACE_BURST;
+}
+
+/**
+ * @brief Возвращает статистику распределения hello.
+ */
+stp_pace_stats_t *stp_pace_get_stats()
+{
+    return &g_stp_pace.stats;
+}
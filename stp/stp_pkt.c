@@ -11,18 +11,75 @@
  * - Создание и закрытие сокетов.
  * - Фильтрация пакетов STP и PVST.
  * - Обработка входящих сообщений.
- * - Передача пакетов.
+ * - Приём через общее кольцо TPACKET_V3 (опционально, STP_PKT_RX_RING).
+ * - Передача пакетов, пакетная отправка через sendmmsg.
  *
  * @author
  * Broadcom, 2019. Лицензия Apache License 2.0.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // sendmmsg
+#endif
 #include <net/if.h>
+#include <sys/mman.h>
 #include "stp_inc.h"
 
 MAC_ADDRESS bridge_group_address = {0x0180c200L, 0x0000};
 MAC_ADDRESS pvst_bridge_group_address = {0x01000cccL, 0xcccd};
 
+/**
+ * @struct stp_pkt_rx_ring_t
+ * @brief Контекст общего кольца приёма TPACKET_V3
+ */
+typedef struct
+{
+    int fd;                         // PF_PACKET сокет с PACKET_RX_RING, не привязан к интерфейсу
+    uint8_t *map;                   // mmap кольца
+    size_t map_sz;                  // Размер mmap
+    uint32_t block_idx;             // Следующий блок для чтения
+    struct event *ev;               // Событие libevent на чтение
+    stp_pkt_rx_ring_stats_t stats;  // Статистика
+} stp_pkt_rx_ring_t;
+
+static stp_pkt_rx_ring_t g_stp_pkt_rx_ring = {.fd = -1};
+
+static void stp_pkt_rx_deliver(INTERFACE_NODE *intf_node, uint16_t vlan_id, char *pkt, ssize_t packet_len);
+
+/**
+ * @struct stp_pkt_tx_tmpl_t
+ * @brief Шаблон передачи на порт: адрес канального уровня и заголовки кадров BPDU
+ *
+ * Тег 802.1Q зависит от VLAN и вставляется при кодировании кадра.
+ */
+typedef struct
+{
+    uint8_t valid;                    // Шаблон заполнен
+    struct sockaddr_ll sa;            // Адрес назначения sendmmsg (kernel ifindex порта)
+    UINT8 stp_hdr[STP_BPDU_OFFSET];   // Заголовок 802.1D BPDU: MAC-адреса, длина, LLC
+    UINT8 pvst_hdr[PVST_BPDU_OFFSET]; // Заголовок PVST+ BPDU: MAC-адреса, длина, SNAP
+} stp_pkt_tx_tmpl_t;
+
+/**
+ * @struct stp_pkt_tx_queue_t
+ * @brief Очередь кадров BPDU для пакетной передачи
+ */
+typedef struct
+{
+    uint16_t count;                                  // Количество кадров в очереди
+    struct event *flush_ev;                          // Отложенное событие сброса очереди
+    stp_pkt_tx_tmpl_t *tmpl;                         // Шаблоны по port_id
+    uint32_t tmpl_sz;                                // Размер таблицы шаблонов
+    stp_pkt_tx_stats_t stats;                        // Статистика
+    uint32_t port_id[STP_PKT_TX_BATCH_MAX];          // Порт каждого кадра (для счётчиков)
+    struct sockaddr_ll sa[STP_PKT_TX_BATCH_MAX];     // Адрес каждого кадра
+    struct iovec iov[STP_PKT_TX_BATCH_MAX];          // Вектор каждого кадра
+    struct mmsghdr msg[STP_PKT_TX_BATCH_MAX];        // Заголовки sendmmsg
+    char buf[STP_PKT_TX_BATCH_MAX][STP_MAX_PKT_LEN]; // Кадры
+} stp_pkt_tx_queue_t;
+
+static stp_pkt_tx_queue_t g_stp_pkt_tx;
+
 /*
  * Psuedocode::
  * if (pkt-len < 1500)
@@ -117,6 +174,54 @@ struct sock_filter g_stp_filter[] = {
     BPF_STMT(BPF_RET | BPF_K, 0),
 };
 
+/**
+ * @brief Устанавливает фильтр BPDU на сокет приёма.
+ *
+ * При загруженном storm guard ставится eBPF программа с ограничением
+ * частоты, иначе классический фильтр g_stp_filter.
+ *
+ * @param sock Сокет приёма.
+ * @return int 0 при успехе, -1 при ошибке.
+ */
+static int stp_pkt_sock_filter(int sock)
+{
+    struct sock_fprog prog;
+
+    if (stp_bpf_attach(sock))
+        return 0;
+
+    prog.filter = g_stp_filter;
+    prog.len = (sizeof(g_stp_filter) / sizeof(struct sock_filter));
+    return setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+}
+
+/**
+ * @brief Переустанавливает фильтр на всех открытых сокетах приёма.
+ *
+ * Вызывается при загрузке storm guard.
+ *
+ * @return void
+ */
+void stp_pkt_sock_refilter()
+{
+    struct avl_traverser trav;
+    INTERFACE_NODE *node = 0;
+
+    if (stp_pkt_rx_ring_is_active())
+    {
+        if (-1 == stp_pkt_sock_filter(g_stp_pkt_rx_ring.fd))
+            STP_LOG_ERR("rx ring filter update Failed, errno : %s", strerror(errno));
+        return;
+    }
+
+    avl_t_init(&trav, g_stpd_intf_db);
+    while (NULL != (node = avl_t_next(&trav)))
+    {
+        if (node->sock > 0 && -1 == stp_pkt_sock_filter(node->sock))
+            STP_LOG_ERR("filter update for (%u) Failed, errno : %s", node->kif_index, strerror(errno));
+    }
+}
+
 /**
  * @brief Закрывает сокет для заданного сетевого интерфейса.
  *
@@ -127,6 +232,14 @@ struct sock_filter g_stp_filter[] = {
  */
 void stp_pkt_sock_close(INTERFACE_NODE *intf_node)
 {
+    // port shares the rx ring socket
+    if (stp_pkt_rx_ring_is_active())
+        return;
+
+    // RX was never enabled on the port
+    if (intf_node->sock <= 0)
+        return;
+
     stpmgr_libevent_destroy(intf_node->ev);
     close(intf_node->sock);
     intf_node->sock = 0;
@@ -145,10 +258,17 @@ void stp_pkt_sock_close(INTERFACE_NODE *intf_node)
 int stp_pkt_sock_create(INTERFACE_NODE *intf_node)
 {
     int val = 0;
-    struct sock_fprog prog;
     struct sockaddr_ll sa;
     struct event *evpkt = 0;
 
+    // all ports are received through the rx ring socket
+    if (stp_pkt_rx_ring_is_active())
+    {
+        intf_node->sock = g_stp_pkt_rx_ring.fd;
+        intf_node->ev = NULL;
+        return intf_node->sock;
+    }
+
     if (-1 == (intf_node->sock = socket(PF_PACKET, SOCK_RAW, htons(ETH_P_ALL))))
     {
         STP_LOG_ERR("SOCKET for (%u) Failed, errno : %s", intf_node->kif_index, strerror(errno));
@@ -164,9 +284,7 @@ int stp_pkt_sock_create(INTERFACE_NODE *intf_node)
     }
 
     // filter STP/PVST packets only
-    prog.filter = g_stp_filter;
-    prog.len = (sizeof(g_stp_filter) / sizeof(struct sock_filter));
-    if (-1 == setsockopt(intf_node->sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)))
+    if (-1 == stp_pkt_sock_filter(intf_node->sock))
     {
         STP_LOG_ERR("setsockopt SO_ATTACH_FILTER for (%u) Failed, errno : %s", intf_node->kif_index, strerror(errno));
         sys_assert(0);
@@ -188,8 +306,8 @@ int stp_pkt_sock_create(INTERFACE_NODE *intf_node)
     }
 
     /*Add to libevent list */
-    intf_node->ev = stpmgr_libevent_create(g_stpd_evbase, intf_node->sock, EV_PERSIST | EV_READ,
-                                           stp_pkt_rx_handler, intf_node, NULL);
+    intf_node->ev = stpmgr_libevent_create_prio(g_stpd_evbase, intf_node->sock, EV_PERSIST | EV_READ,
+                                                stp_pkt_rx_handler, intf_node, NULL, "PKT_RX", STP_LIBEV_PKT_PRI_Q);
 
     if (!intf_node->ev)
     {
@@ -202,6 +320,42 @@ int stp_pkt_sock_create(INTERFACE_NODE *intf_node)
     return intf_node->sock;
 }
 
+/**
+ * @brief Включает приём BPDU на порту.
+ *
+ * Вызывается, когда порт входит в control_mask экземпляра или на нём
+ * настраивается BPDU guard. Для Ethernet-порта создаётся сокет, для
+ * Port-channel - сокеты всех его участников; участники, добавленные позже,
+ * получают сокет в stp_intf_add_po_member(). Повторный вызов ничего не делает.
+ *
+ * @param port_id Идентификатор порта STP.
+ */
+void stp_pkt_sock_enable(uint32_t port_id)
+{
+    struct avl_traverser trav;
+    INTERFACE_NODE *node = stp_intf_get_node(port_id);
+    INTERFACE_NODE *member = 0;
+
+    if (!node || node->rx_enabled)
+        return;
+
+    node->rx_enabled = 1;
+
+    if (STP_IS_ETH_PORT(node->ifname))
+    {
+        if (node->sock <= 0)
+            stp_pkt_sock_create(node);
+        return;
+    }
+
+    avl_t_init(&trav, g_stpd_intf_db);
+    while (NULL != (member = avl_t_next(&trav)))
+    {
+        if (member->master_ifindex == node->kif_index && member->sock <= 0 && STP_IS_ETH_PORT(member->ifname))
+            stp_pkt_sock_create(member);
+    }
+}
+
 /**
  * @brief Выводит информацию о передаваемом или принимаемом пакете в лог.
  *
@@ -269,12 +423,206 @@ static void stp_pkt_fill_tx_buf(uint16_t size, VLAN_ID vlan_id, char *buffer, ch
     return;
 }
 
+/**
+ * @brief Возвращает шаблон передачи для порта, заполняя его при первом обращении.
+ *
+ * @param port_id Идентификатор порта.
+ * @return Указатель на шаблон или NULL, если порт не найден.
+ */
+static stp_pkt_tx_tmpl_t *stp_pkt_tx_get_tmpl(uint32_t port_id)
+{
+    INTERFACE_NODE *intf_node;
+    stp_pkt_tx_tmpl_t *tmpl;
+    MAC_ADDRESS mac;
+    uint32_t sz;
+
+    if (port_id >= g_stp_pkt_tx.tmpl_sz)
+    {
+        if (port_id >= STP_INTF_PORT_TBL_MAX)
+            return NULL;
+
+        sz = g_stp_pkt_tx.tmpl_sz ? g_stp_pkt_tx.tmpl_sz : STP_INTF_TBL_MIN_SZ;
+        while (sz <= port_id)
+            sz <<= 1;
+
+        tmpl = realloc(g_stp_pkt_tx.tmpl, sz * sizeof(stp_pkt_tx_tmpl_t));
+        if (!tmpl)
+        {
+            STP_LOG_ERR("tx template realloc %u Failed", sz);
+            return NULL;
+        }
+        memset(tmpl + g_stp_pkt_tx.tmpl_sz, 0, (sz - g_stp_pkt_tx.tmpl_sz) * sizeof(stp_pkt_tx_tmpl_t));
+        g_stp_pkt_tx.tmpl = tmpl;
+        g_stp_pkt_tx.tmpl_sz = sz;
+    }
+
+    tmpl = &g_stp_pkt_tx.tmpl[port_id];
+    if (!tmpl->valid)
+    {
+        intf_node = stp_intf_get_node(port_id);
+        if (!intf_node)
+            return NULL;
+
+        memset(&tmpl->sa, 0, sizeof(struct sockaddr_ll));
+        tmpl->sa.sll_family = AF_PACKET;
+        tmpl->sa.sll_ifindex = intf_node->kif_index;
+
+        stp_intf_get_mac(port_id, &mac);
+        stp_bpdu_build_hdr(tmpl->stp_hdr, &g_stp_config_bpdu, STP_BPDU_OFFSET, &mac);
+        stp_bpdu_build_hdr(tmpl->pvst_hdr, &g_stp_pvst_config_bpdu, PVST_BPDU_OFFSET, &mac);
+        tmpl->valid = 1;
+    }
+
+    return tmpl;
+}
+
+/**
+ * @brief Сбрасывает кэшированный шаблон передачи порта.
+ *
+ * Вызывается при удалении интерфейса или смене его port_id.
+ *
+ * @param port_id Идентификатор порта.
+ */
+void stp_pkt_tx_port_invalidate(uint32_t port_id)
+{
+    if (port_id < g_stp_pkt_tx.tmpl_sz)
+        g_stp_pkt_tx.tmpl[port_id].valid = 0;
+}
+
+/**
+ * @brief Сбрасывает шаблоны передачи всех портов.
+ *
+ * Вызывается при смене базового MAC-адреса, который входит в заголовки BPDU.
+ */
+void stp_pkt_tx_invalidate_all()
+{
+    uint32_t i;
+
+    for (i = 0; i < g_stp_pkt_tx.tmpl_sz; i++)
+        g_stp_pkt_tx.tmpl[i].valid = 0;
+}
+
+/**
+ * @brief Libevent callback отложенного сброса очереди передачи.
+ */
+static void stp_pkt_tx_flush_cb(evutil_socket_t fd, short what, void *arg)
+{
+    stp_pkt_tx_flush();
+}
+
+/**
+ * @brief Инициализирует пакетную передачу BPDU.
+ *
+ * Без инициализации каждый кадр отправляется сразу.
+ *
+ * @param base База событий libevent для отложенного сброса очереди.
+ * @return 0 в случае успеха, -1 при ошибке.
+ */
+int stp_pkt_tx_init(struct event_base *base)
+{
+    g_stp_pkt_tx.flush_ev = stpmgr_libevent_create_prio(base, -1, 0, stp_pkt_tx_flush_cb, NULL, NULL, "TX-FLUSH",
+                                                        STP_LIBEV_HIGH_PRI_Q);
+    if (!g_stp_pkt_tx.flush_ev)
+    {
+        STP_LOG_ERR("tx flush event create failed");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Отправляет все кадры очереди через sendmmsg.
+ *
+ * Кадр, на котором sendmmsg вернул ошибку, учитывается как ошибка передачи
+ * порта и пропускается, отправка продолжается со следующего кадра.
+ */
+void stp_pkt_tx_flush()
+{
+    int ret;
+    uint16_t i = 0;
+    uint16_t count = g_stp_pkt_tx.count;
+
+    if (!count)
+        return;
+
+    STPD_STARTUP_MARK(STPD_STARTUP_BPDU_TX);
+
+    if (count > g_stp_pkt_tx.stats.max_batch)
+        g_stp_pkt_tx.stats.max_batch = count;
+
+    while (i < count)
+    {
+        g_stp_pkt_tx.stats.flushes++;
+        ret = sendmmsg(g_stpd_pkt_handle, &g_stp_pkt_tx.msg[i], count - i, 0);
+        if (ret > 0)
+        {
+            i += ret;
+            continue;
+        }
+
+        if (ret == -1 && errno == EINTR)
+            continue;
+
+        STP_LOG_ERR("sendmmsg Failed port %u : %s", g_stp_pkt_tx.port_id[i], strerror(errno));
+        STPD_INCR_PKT_COUNT(g_stp_pkt_tx.port_id[i], pkt_tx_err);
+        g_stp_pkt_tx.stats.errors++;
+        i++;
+    }
+
+    g_stp_pkt_tx.count = 0;
+}
+
+/**
+ * @brief Ставит собранный в слоте кадр в очередь передачи.
+ *
+ * @param slot Слот очереди с кадром.
+ * @param tmpl Шаблон передачи порта.
+ * @param port_id Идентификатор порта.
+ * @param vlan_id Идентификатор VLAN.
+ * @param size Размер кадра вместе с тегом.
+ * @param tagged Кадр с тегом 802.1Q.
+ */
+static void stp_pkt_tx_commit(uint16_t slot, stp_pkt_tx_tmpl_t *tmpl, uint32_t port_id, VLAN_ID vlan_id,
+                              uint16_t size, bool tagged)
+{
+    INTERFACE_NODE *intf_node = 0;
+
+    stp_capture_frame(port_id, vlan_id, g_stp_pkt_tx.buf[slot], size, tagged ? STP_CAPTURE_TAGGED : 0);
+
+    if (STP_DEBUG_BPDU_TX(vlan_id, port_id))
+    {
+        intf_node = stp_intf_get_node(port_id);
+        if (intf_node)
+            stp_pkt_dump(intf_node, vlan_id, g_stp_pkt_tx.buf[slot], size, false);
+    }
+
+    g_stp_pkt_tx.port_id[slot] = port_id;
+    g_stp_pkt_tx.sa[slot] = tmpl->sa;
+    g_stp_pkt_tx.iov[slot].iov_base = g_stp_pkt_tx.buf[slot];
+    g_stp_pkt_tx.iov[slot].iov_len = size;
+    memset(&g_stp_pkt_tx.msg[slot], 0, sizeof(struct mmsghdr));
+    g_stp_pkt_tx.msg[slot].msg_hdr.msg_name = &g_stp_pkt_tx.sa[slot];
+    g_stp_pkt_tx.msg[slot].msg_hdr.msg_namelen = sizeof(struct sockaddr_ll);
+    g_stp_pkt_tx.msg[slot].msg_hdr.msg_iov = &g_stp_pkt_tx.iov[slot];
+    g_stp_pkt_tx.msg[slot].msg_hdr.msg_iovlen = 1;
+    g_stp_pkt_tx.stats.frames++;
+
+    STPD_INCR_PKT_COUNT(port_id, pkt_tx);
+
+    if (!g_stp_pkt_tx.flush_ev)
+        stp_pkt_tx_flush();
+    else if (slot == 0)
+        event_active(g_stp_pkt_tx.flush_ev, 0, 0);
+}
+
 /* buffer : contains the entire packet including mac */
 /**
  * @brief Обрабатывает передачу пакета на заданный порт.
  *
- * Эта функция отправляет пакет через сокет, связанный с заданным портом,
- * с учётом тегирования VLAN.
+ * Эта функция ставит пакет в очередь передачи на порт с учётом тегирования
+ * VLAN. Кадр собирается прямо в слоте очереди: адрес назначения берётся из
+ * шаблона порта, копируется только сам BPDU. Очередь отправляется одним
+ * sendmmsg после завершения текущего события libevent.
  *
  * @param port_id Идентификатор порта, через который передаётся пакет.
  * @param vlan_id Идентификатор VLAN.
@@ -285,15 +633,15 @@ static void stp_pkt_fill_tx_buf(uint16_t size, VLAN_ID vlan_id, char *buffer, ch
  */
 int stp_pkt_tx_handler(uint32_t port_id, VLAN_ID vlan_id, char *buffer, uint16_t size, bool tagged)
 {
-    int i = 0;
-    int ret = 0;
-    struct sockaddr_ll sa;
-    char send_buf[STP_MAX_PKT_LEN];
-    uint32_t kif_index = 0;
-    INTERFACE_NODE *intf_node = 0;
+    uint16_t slot;
+    stp_pkt_tx_tmpl_t *tmpl;
 
-    intf_node = stp_intf_get_node(port_id);
-    if (!intf_node)
+    // worker threads hand their frames over to the main thread
+    if (stp_worker_defer_tx(port_id, vlan_id, buffer, size, tagged))
+        return 0;
+
+    tmpl = stp_pkt_tx_get_tmpl(port_id);
+    if (!tmpl)
     {
         STPD_INCR_PKT_COUNT(port_id, pkt_tx_err);
         return -1;
@@ -302,27 +650,85 @@ int stp_pkt_tx_handler(uint32_t port_id, VLAN_ID vlan_id, char *buffer, uint16_t
     if (tagged)
         size += VLAN_HEADER_LEN;
 
-    memset(send_buf, 0, STP_MAX_PKT_LEN);
-    stp_pkt_fill_tx_buf(size, tagged ? vlan_id : 0, buffer, send_buf);
+    if (g_stp_pkt_tx.count == STP_PKT_TX_BATCH_MAX)
+        stp_pkt_tx_flush();
 
-    if (STP_DEBUG_BPDU_TX(vlan_id, intf_node->port_id))
-        stp_pkt_dump(intf_node, vlan_id, send_buf, size, false);
+    slot = g_stp_pkt_tx.count++;
+    stp_pkt_fill_tx_buf(size, tagged ? vlan_id : 0, buffer, g_stp_pkt_tx.buf[slot]);
+    stp_pkt_tx_commit(slot, tmpl, port_id, vlan_id, size, tagged);
 
-    memset(&sa, 0, sizeof(struct sockaddr_ll));
-    sa.sll_family = AF_PACKET;
-    sa.sll_ifindex = intf_node->kif_index;
+    return 0;
+}
 
-    ret = sendto(g_stpd_pkt_handle, send_buf, size, 0,
-                 (const struct sockaddr *)&sa, sizeof(struct sockaddr_ll));
+/**
+ * @brief Возвращает свободный слот очереди передачи для сборки кадра на месте.
+ *
+ * Кадр длиной до STP_MAX_PKT_LEN собирается прямо в слоте и ставится в
+ * очередь вызовом stp_pkt_tx_frame_send() до любой другой передачи.
+ *
+ * @param port_id Идентификатор порта.
+ * @return Буфер слота или NULL, если кадр нужно передать через
+ *         stp_pkt_tx_handler() (рабочий поток или неизвестный порт).
+ */
+char *stp_pkt_tx_frame_get(uint32_t port_id)
+{
+    if (stp_worker_in_thread() || !stp_pkt_tx_get_tmpl(port_id))
+        return NULL;
+
+    if (g_stp_pkt_tx.count == STP_PKT_TX_BATCH_MAX)
+        stp_pkt_tx_flush();
 
-    if (-1 == ret)
+    return g_stp_pkt_tx.buf[g_stp_pkt_tx.count];
+}
+
+/**
+ * @brief Возвращает заголовок кадра BPDU из шаблона порта.
+ *
+ * Вызывается только после успешного stp_pkt_tx_frame_get() для того же
+ * порта, когда шаблон уже заполнен.
+ *
+ * @param port_id Идентификатор порта.
+ * @param pvst Заголовок PVST+ (SNAP), иначе 802.1D (LLC).
+ * @return Заголовок длиной PVST_BPDU_OFFSET или STP_BPDU_OFFSET.
+ */
+const UINT8 *stp_pkt_tx_hdr_get(uint32_t port_id, bool pvst)
+{
+    stp_pkt_tx_tmpl_t *tmpl = &g_stp_pkt_tx.tmpl[port_id];
+
+    return pvst ? tmpl->pvst_hdr : tmpl->stp_hdr;
+}
+
+/**
+ * @brief Ставит в очередь кадр, собранный в слоте stp_pkt_tx_frame_get().
+ *
+ * @param port_id Идентификатор порта.
+ * @param vlan_id Идентификатор VLAN.
+ * @param size Размер кадра вместе с тегом.
+ * @param tagged Кадр с тегом 802.1Q.
+ * @return 0 в случае успеха, -1 при ошибке.
+ */
+int stp_pkt_tx_frame_send(uint32_t port_id, VLAN_ID vlan_id, uint16_t size, bool tagged)
+{
+    stp_pkt_tx_tmpl_t *tmpl = stp_pkt_tx_get_tmpl(port_id);
+
+    if (!tmpl)
     {
-        STP_LOG_ERR("sendto Failed : %s", strerror(errno));
         STPD_INCR_PKT_COUNT(port_id, pkt_tx_err);
+        return -1;
     }
 
-    STPD_INCR_PKT_COUNT(port_id, pkt_tx);
-    return ret;
+    stp_pkt_tx_commit(g_stp_pkt_tx.count++, tmpl, port_id, vlan_id, size, tagged);
+    return 0;
+}
+
+/**
+ * @brief Возвращает статистику пакетной передачи.
+ *
+ * @return Указатель на статистику.
+ */
+stp_pkt_tx_stats_t *stp_pkt_tx_get_stats()
+{
+    return &g_stp_pkt_tx.stats;
 }
 
 /**
@@ -341,9 +747,9 @@ int stp_pkt_tx_handler(uint32_t port_id, VLAN_ID vlan_id, char *buffer, uint16_t
 void stp_pkt_rx_handler(evutil_socket_t fd, short what, void *arg)
 {
     g_stpd_stats_libev_pktrx++;
+    stpmgr_ipc_rx_pkt_batch();
 
     INTERFACE_NODE *intf_node = (INTERFACE_NODE *)arg;
-    INTERFACE_NODE *intf_node_member = 0;
     int i = 0;
     uint16_t vlan_id = 0;
     ssize_t packet_len = 0;
@@ -440,6 +846,26 @@ void stp_pkt_rx_handler(evutil_socket_t fd, short what, void *arg)
         }
     }
 
+    stp_pkt_rx_deliver(intf_node, vlan_id, pkt, packet_len);
+}
+
+/**
+ * @brief Передаёт принятый BPDU менеджеру STP.
+ *
+ * Общая часть приёма для сокетов портов и кольца TPACKET_V3: замена
+ * member-порта на Port-channel, учёт статистики, отладочный вывод.
+ *
+ * @param intf_node Интерфейс, на котором принят пакет.
+ * @param vlan_id Идентификатор VLAN из вспомогательных данных (0, если нет тега).
+ * @param pkt Буфер пакета (не менее STP_MAX_PKT_LEN байт).
+ * @param packet_len Длина пакета.
+ *
+ * @return void
+ */
+static void stp_pkt_rx_deliver(INTERFACE_NODE *intf_node, uint16_t vlan_id, char *pkt, ssize_t packet_len)
+{
+    INTERFACE_NODE *intf_node_member = 0;
+
     // if PO-member port, assign intf_node to PO node.
     if (intf_node->master_ifindex)
     {
@@ -454,6 +880,8 @@ void stp_pkt_rx_handler(evutil_socket_t fd, short what, void *arg)
     }
 
     STPD_INCR_PKT_COUNT(intf_node->port_id, pkt_rx);
+    STPD_STARTUP_MARK(STPD_STARTUP_BPDU_RX);
+    stp_capture_frame(intf_node->port_id, vlan_id, pkt, packet_len, STP_CAPTURE_RX);
 
     if (STP_DEBUG_BPDU_RX(vlan_id, intf_node->port_id))
         stp_pkt_dump(intf_node, vlan_id, pkt, packet_len, true);
@@ -462,3 +890,240 @@ void stp_pkt_rx_handler(evutil_socket_t fd, short what, void *arg)
 
     return;
 }
+
+/**
+ * @brief Обрабатывает один кадр из блока кольца TPACKET_V3.
+ *
+ * Кадр демультиплексируется по `sll_ifindex` и `tp_vlan_tci` из заголовков
+ * кольца. Принимаются только кадры с Ethernet-портов, для которых в режиме
+ * сокетов на порт создавался бы собственный сокет.
+ *
+ * @param hdr Заголовок кадра в кольце.
+ *
+ * @return void
+ */
+static void stp_pkt_rx_ring_frame(struct tpacket3_hdr *hdr)
+{
+    struct sockaddr_ll *sll;
+    INTERFACE_NODE *intf_node;
+    uint16_t vlan_id = 0;
+    static char pkt[STP_MAX_PKT_LEN];
+
+    g_stp_pkt_rx_ring.stats.frames++;
+
+    sll = (struct sockaddr_ll *)((uint8_t *)hdr + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+
+    // socket is not bound, skip our own transmitted BPDUs
+    if (sll->sll_pkttype == PACKET_OUTGOING)
+    {
+        g_stp_pkt_rx_ring.stats.drop_out++;
+        return;
+    }
+
+    intf_node = stp_intf_get_node_by_kif_index(sll->sll_ifindex);
+    if (!intf_node || !STP_IS_ETH_PORT(intf_node->ifname))
+    {
+        // lo, eth0, PortChannel/Vlan/Bridge netdevs etc.
+        g_stp_pkt_rx_ring.stats.drop_intf++;
+        return;
+    }
+
+    if (hdr->tp_len > STP_MAX_PKT_LEN)
+    {
+        STPD_INCR_PKT_COUNT(intf_node->port_id, pkt_rx_err_trunc);
+        return;
+    }
+
+    if (hdr->tp_status & TP_STATUS_VLAN_VALID)
+        vlan_id = (hdr->hv1.tp_vlan_tci & 0x0fff);
+
+    // frame slot is returned to the kernel with the block, copy to a zero padded buffer
+    memcpy(pkt, (uint8_t *)hdr + hdr->tp_mac, hdr->tp_snaplen);
+    memset(pkt + hdr->tp_snaplen, 0, sizeof(pkt) - hdr->tp_snaplen);
+
+    stp_pkt_rx_deliver(intf_node, vlan_id, pkt, hdr->tp_snaplen);
+}
+
+/**
+ * @brief Обработчик события чтения кольца TPACKET_V3.
+ *
+ * За одно пробуждение обрабатываются все готовые блоки кольца, каждый блок
+ * возвращается ядру после разбора всех его кадров.
+ *
+ * @param fd Дескриптор сокета кольца.
+ * @param what Тип события.
+ * @param arg Не используется.
+ *
+ * @return void
+ */
+static void stp_pkt_rx_ring_handler(evutil_socket_t fd, short what, void *arg)
+{
+    struct tpacket_block_desc *bd;
+    struct tpacket3_hdr *hdr;
+    struct tpacket_stats_v3 st;
+    socklen_t st_len = sizeof(st);
+    uint32_t i, n;
+
+    g_stpd_stats_libev_pktrx++;
+    stpmgr_ipc_rx_pkt_batch();
+
+    for (n = 0; n < STP_PKT_RX_RING_BLOCK_NR; n++)
+    {
+        bd = (struct tpacket_block_desc *)(g_stp_pkt_rx_ring.map + g_stp_pkt_rx_ring.block_idx * STP_PKT_RX_RING_BLOCK_SZ);
+        if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+            break;
+
+        hdr = (struct tpacket3_hdr *)((uint8_t *)bd + bd->hdr.bh1.offset_to_first_pkt);
+        for (i = 0; i < bd->hdr.bh1.num_pkts; i++)
+        {
+            stp_pkt_rx_ring_frame(hdr);
+            hdr = (struct tpacket3_hdr *)((uint8_t *)hdr + hdr->tp_next_offset);
+        }
+
+        g_stp_pkt_rx_ring.stats.blocks++;
+        __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        g_stp_pkt_rx_ring.block_idx = (g_stp_pkt_rx_ring.block_idx + 1) % STP_PKT_RX_RING_BLOCK_NR;
+    }
+
+    // reading the statistics also resets them in the kernel
+    if (0 == getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &st, &st_len))
+        g_stp_pkt_rx_ring.stats.kernel_drops += st.tp_drops;
+}
+
+/**
+ * @brief Создаёт общее кольцо приёма TPACKET_V3 для всех портов.
+ *
+ * Сокет не привязывается к интерфейсу, на него устанавливается тот же
+ * фильтр `g_stp_filter`, что и на сокеты портов. Вызывается до заполнения
+ * базы интерфейсов; после успешной инициализации `stp_pkt_sock_create`
+ * не создаёт сокеты портов.
+ *
+ * @param base База событий libevent.
+ * @return int Дескриптор сокета или -1 в случае ошибки.
+ */
+int stp_pkt_rx_ring_init(struct event_base *base)
+{
+    int fd = -1;
+    int val = TPACKET_V3;
+    struct tpacket_req3 req;
+    struct sockaddr_ll sa;
+    uint8_t *map;
+
+    if (-1 == (fd = socket(PF_PACKET, SOCK_RAW, htons(ETH_P_ALL))))
+    {
+        STP_LOG_ERR("rx ring SOCKET Failed, errno : %s", strerror(errno));
+        return -1;
+    }
+
+    // attach the filter before the ring is mapped, so that only BPDUs get queued
+    if (-1 == stp_pkt_sock_filter(fd))
+    {
+        STP_LOG_ERR("rx ring SO_ATTACH_FILTER Failed, errno : %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    if (-1 == setsockopt(fd, SOL_PACKET, PACKET_VERSION, &val, sizeof(val)))
+    {
+        STP_LOG_ERR("rx ring PACKET_VERSION Failed, errno : %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = STP_PKT_RX_RING_BLOCK_SZ;
+    req.tp_block_nr = STP_PKT_RX_RING_BLOCK_NR;
+    req.tp_frame_size = STP_PKT_RX_RING_FRAME_SZ;
+    req.tp_frame_nr = (STP_PKT_RX_RING_BLOCK_SZ / STP_PKT_RX_RING_FRAME_SZ) * STP_PKT_RX_RING_BLOCK_NR;
+    req.tp_retire_blk_tov = STP_PKT_RX_RING_TMO_MS;
+    if (-1 == setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)))
+    {
+        STP_LOG_ERR("rx ring PACKET_RX_RING Failed, errno : %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    map = mmap(NULL, (size_t)req.tp_block_size * req.tp_block_nr, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        STP_LOG_ERR("rx ring mmap Failed, errno : %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sll_family = AF_PACKET;
+    sa.sll_protocol = htons(ETH_P_ALL);
+    sa.sll_ifindex = 0;
+    if (-1 == bind(fd, (struct sockaddr *)&sa, sizeof(sa)))
+    {
+        STP_LOG_ERR("rx ring BIND Failed, errno : %s", strerror(errno));
+        munmap(map, (size_t)req.tp_block_size * req.tp_block_nr);
+        close(fd);
+        return -1;
+    }
+
+    g_stp_pkt_rx_ring.fd = fd;
+    g_stp_pkt_rx_ring.map = map;
+    g_stp_pkt_rx_ring.map_sz = (size_t)req.tp_block_size * req.tp_block_nr;
+    g_stp_pkt_rx_ring.block_idx = 0;
+
+    g_stp_pkt_rx_ring.ev = stpmgr_libevent_create_prio(base, fd, EV_PERSIST | EV_READ, stp_pkt_rx_ring_handler, NULL, NULL,
+                                                       "PKT_RX_RING", STP_LIBEV_PKT_PRI_Q);
+    if (!g_stp_pkt_rx_ring.ev)
+    {
+        STP_LOG_ERR("rx ring Event Create failed");
+        stp_pkt_rx_ring_deinit();
+        return -1;
+    }
+
+    STP_LOG_INFO("rx ring sock-%d blocks %u x %u", fd, req.tp_block_nr, req.tp_block_size);
+
+    return fd;
+}
+
+/**
+ * @brief Освобождает кольцо приёма TPACKET_V3.
+ *
+ * @return void
+ */
+void stp_pkt_rx_ring_deinit()
+{
+    if (g_stp_pkt_rx_ring.ev)
+    {
+        stpmgr_libevent_destroy(g_stp_pkt_rx_ring.ev);
+        g_stp_pkt_rx_ring.ev = NULL;
+    }
+
+    if (g_stp_pkt_rx_ring.map)
+    {
+        munmap(g_stp_pkt_rx_ring.map, g_stp_pkt_rx_ring.map_sz);
+        g_stp_pkt_rx_ring.map = NULL;
+    }
+
+    if (g_stp_pkt_rx_ring.fd != -1)
+    {
+        close(g_stp_pkt_rx_ring.fd);
+        g_stp_pkt_rx_ring.fd = -1;
+    }
+}
+
+/**
+ * @brief Проверяет, используется ли кольцо приёма TPACKET_V3.
+ *
+ * @return true, если BPDU всех портов принимаются через кольцо.
+ */
+bool stp_pkt_rx_ring_is_active()
+{
+    return (g_stp_pkt_rx_ring.ev != NULL);
+}
+
+/**
+ * @brief Возвращает статистику кольца приёма.
+ *
+ * @return Указатель на статистику.
+ */
+stp_pkt_rx_ring_stats_t *stp_pkt_rx_ring_get_stats()
+{
+    return &g_stp_pkt_rx_ring.stats;
+}
@@ -0,0 +1,974 @@
+/**
+ * @file stp_snapshot.c
+ * @brief Снимок состояния STP в отображаемом в память файле для тёплого перезапуска.
+ *
+ * @details
+ * Снимок пишется прямо в отображение файла (MAP_SHARED), поэтому переживает
+ * аварийное завершение stpd. На время записи счётчик seq нечётный, и
+ * недописанный снимок при запуске отбрасывается. Каждый тик stpd обновляет
+ * в заголовке alive_ms, по нему при восстановлении определяется, сколько
+ * stpd не работал.
+ *
+ * При восстановлении таймер возраста сообщения продолжается от сохранённого
+ * значения плюс время простоя: соседи продолжали слать BPDU, пока stpd
+ * работал. Остальные таймеры продолжаются от сохранённого значения плюс
+ * время с момента сохранения. Состояния портов в ядре и ключи APP DB не
+ * перезаписываются, изменяются только порты, чьё состояние по netlink
+ * разошлось со снимком.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "stp_inc.h"
+
+/**
+ * @struct stp_snapshot_t
+ * @brief Контекст снимка
+ */
+typedef struct
+{
+    int fd;                        // Файл снимка, -1 - тёплый перезапуск выключен
+    STP_SNAPSHOT_HDR *hdr;         // Отображение файла
+    size_t map_size;               // Размер отображения
+    bool pending;                  // Найден корректный снимок, ещё не восстановлен
+    UINT32 saved_gen;              // g_stp_snapshot_gen последнего сохранения
+    UINT32 ticks;                  // Тиков с последней проверки
+    UINT32 full_ticks;             // Тиков с последнего сохранения
+    BITMAP_T *restored;            // Экземпляры из снимка, ещё не подтверждённые конфигурацией
+    UINT32 claim_ticks;            // Тиков с восстановления или последнего подтверждения
+    stp_snapshot_stats_t stats;    // Статистика
+} stp_snapshot_t;
+
+static stp_snapshot_t g_stp_snapshot = {.fd = -1};
+
+/**
+ * @brief Текущее время CLOCK_MONOTONIC в миллисекундах.
+ */
+static uint64_t stp_snapshot_now_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief FNV-1a данных снимка после заголовка.
+ */
+static UINT32 stp_snapshot_checksum(const uint8_t *data, size_t len)
+{
+    UINT32 hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+/**
+ * @brief Отображает файл снимка размером не меньше size.
+ *
+ * @return 0 при успехе, -1 при ошибке.
+ */
+static int stp_snapshot_map(size_t size)
+{
+    void *addr;
+
+    if (g_stp_snapshot.hdr && g_stp_snapshot.map_size >= size)
+        return 0;
+
+    // grow by a quarter to avoid remapping on every added port
+    size += size / 4;
+    if (ftruncate(g_stp_snapshot.fd, size) == -1)
+    {
+        STP_LOG_ERR("snapshot ftruncate %zu failed %s", size, strerror(errno));
+        return -1;
+    }
+
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, g_stp_snapshot.fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        STP_LOG_ERR("snapshot mmap %zu failed %s", size, strerror(errno));
+        return -1;
+    }
+
+    if (g_stp_snapshot.hdr)
+        munmap(g_stp_snapshot.hdr, g_stp_snapshot.map_size);
+    g_stp_snapshot.hdr = (STP_SNAPSHOT_HDR *)addr;
+    g_stp_snapshot.map_size = size;
+    return 0;
+}
+
+/**
+ * @brief Проверяет заголовок и контрольную сумму найденного снимка.
+ *
+ * @param file_size Размер файла.
+ *
+ * @return `true`, если снимок можно восстановить.
+ */
+static bool stp_snapshot_valid(size_t file_size)
+{
+    STP_SNAPSHOT_HDR *hdr = g_stp_snapshot.hdr;
+    uint64_t now = stp_snapshot_now_ms();
+
+    if (memcmp(hdr->magic, STP_SNAPSHOT_MAGIC, sizeof(STP_SNAPSHOT_MAGIC)) != 0 ||
+        hdr->version != STP_SNAPSHOT_VERSION || hdr->class_size != sizeof(STP_SNAPSHOT_CLASS) ||
+        hdr->port_size != sizeof(STP_SNAPSHOT_PORT))
+    {
+        STP_LOG_INFO("snapshot format mismatch, cold start");
+        return false;
+    }
+
+    if ((hdr->seq & 1) || hdr->size < sizeof(STP_SNAPSHOT_HDR) || hdr->size > file_size)
+    {
+        STP_LOG_INFO("snapshot incomplete seq %u size %u, cold start", hdr->seq, hdr->size);
+        return false;
+    }
+
+    // the monotonic clock restarts with the system, so does the kernel bridge state
+    if (hdr->alive_ms < hdr->saved_ms || hdr->alive_ms > now || now - hdr->alive_ms > STP_SNAPSHOT_MAX_DOWN_MS)
+    {
+        STP_LOG_INFO("snapshot expired, cold start");
+        return false;
+    }
+
+    if (stp_snapshot_checksum((uint8_t *)(hdr + 1), hdr->size - sizeof(STP_SNAPSHOT_HDR)) != hdr->checksum)
+    {
+        STP_LOG_ERR("snapshot checksum mismatch, cold start");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Открывает файл снимка и проверяет, можно ли выполнить тёплый перезапуск.
+ *
+ * Вызывается при запуске stpd до очистки APP DB.
+ *
+ * @return `true`, если найден корректный снимок и APP DB очищать не нужно.
+ */
+bool stp_snapshot_open()
+{
+    struct stat st;
+
+    if (!STP_WARM_RESTART)
+        return false;
+
+    g_stp_snapshot.fd = open(STP_SNAPSHOT_FILE, O_RDWR | O_CREAT, 0600);
+    if (g_stp_snapshot.fd == -1)
+    {
+        STP_LOG_ERR("snapshot open %s failed %s", STP_SNAPSHOT_FILE, strerror(errno));
+        return false;
+    }
+
+    if (fstat(g_stp_snapshot.fd, &st) == -1 || (size_t)st.st_size < sizeof(STP_SNAPSHOT_HDR))
+        return false;
+
+    g_stp_snapshot.hdr = (STP_SNAPSHOT_HDR *)mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                                  g_stp_snapshot.fd, 0);
+    if (g_stp_snapshot.hdr == MAP_FAILED)
+    {
+        STP_LOG_ERR("snapshot mmap failed %s", strerror(errno));
+        g_stp_snapshot.hdr = NULL;
+        return false;
+    }
+    g_stp_snapshot.map_size = st.st_size;
+
+    g_stp_snapshot.pending = stp_snapshot_valid(st.st_size);
+    if (g_stp_snapshot.pending)
+        STP_LOG_INFO("snapshot found: %u instances, down %llu ms", g_stp_snapshot.hdr->class_count,
+                     (unsigned long long)(stp_snapshot_now_ms() - g_stp_snapshot.hdr->alive_ms));
+    return g_stp_snapshot.pending;
+}
+
+/**
+ * @brief Переводит таймер в вид "тиков с запуска" для снимка.
+ */
+static void stp_snapshot_timer_save(TIMER *timer)
+{
+    if (timer->active)
+        timer->value = timer_elapsed(timer);
+}
+
+/**
+ * @brief Запускает таймер из снимка, добавив к сохранённому значению extra тиков.
+ */
+static void stp_snapshot_timer_restore(TIMER *timer, TIMER *saved, UINT32 extra)
+{
+    if (saved->active)
+        start_timer(timer, saved->value + extra);
+    else
+        stop_timer(timer);
+}
+
+/**
+ * @brief Запускает таймер Message Age из снимка, добавив к нему время простоя.
+ *
+ * Возраст не доводится до max_age: иначе корень, о котором помнит порт,
+ * устареет в первый же тик, не дождавшись следующего Hello от соседа.
+ *
+ * @param limit Наибольшее значение таймера в тиках.
+ */
+static void stp_snapshot_age_restore(TIMER *timer, TIMER *saved, UINT32 extra, UINT32 limit)
+{
+    UINT32 age;
+
+    if (!saved->active)
+    {
+        stop_timer(timer);
+        return;
+    }
+
+    age = saved->value + extra;
+    if (age > limit)
+    {
+        age = limit;
+        g_stp_snapshot.stats.capped_ages++;
+    }
+    start_timer(timer, age);
+}
+
+/**
+ * @brief Маски порта в глобальных масках stp_global.
+ */
+static UINT16 stp_snapshot_gport_masks(PORT_ID port_number)
+{
+    UINT16 masks = 0;
+
+    if (is_member(g_stp_enable_mask, port_number))
+        masks |= STP_SNAPSHOT_ENABLE;
+    if (is_member(g_stp_enable_config_mask, port_number))
+        masks |= STP_SNAPSHOT_ENABLE_ADMIN;
+    if (is_member(g_fastspan_mask, port_number))
+        masks |= STP_SNAPSHOT_FASTSPAN;
+    if (is_member(g_fastspan_config_mask, port_number))
+        masks |= STP_SNAPSHOT_FASTSPAN_ADMIN;
+    if (is_member(g_fastuplink_mask, port_number))
+        masks |= STP_SNAPSHOT_FASTUPLINK_ADMIN;
+    if (is_member(g_stp_protect_mask, port_number))
+        masks |= STP_SNAPSHOT_PROTECT;
+    if (is_member(g_stp_protect_do_disable_mask, port_number))
+        masks |= STP_SNAPSHOT_PROTECT_DO_DISABLE;
+    if (is_member(g_stp_protect_disabled_mask, port_number))
+        masks |= STP_SNAPSHOT_PROTECT_DISABLED;
+    if (is_member(g_stp_root_protect_mask, port_number))
+        masks |= STP_SNAPSHOT_ROOT_PROTECT;
+    return masks;
+}
+
+/**
+ * @brief Размер записи VLAN группы в снимке вместе с его портами.
+ */
+static size_t stp_snapshot_group_size(VLAN_ID vlan_id)
+{
+    STP_GROUP_VLAN *group = stpdata_group_vlan_get(vlan_id, false);
+
+    return sizeof(STP_SNAPSHOT_GROUP) +
+           (group ? bmp_count_set_bits(group->member_mask) * sizeof(STP_SNAPSHOT_GROUP_PORT) : 0);
+}
+
+/**
+ * @brief Размер записей сгруппированных VLAN экземпляра в снимке.
+ */
+static size_t stp_snapshot_groups_size(STP_CLASS *stp_class)
+{
+    BMP_ITER_T it;
+    BMP_ID vlan_id;
+    size_t size = 0;
+
+    if (!stp_class->group_vlan_count)
+        return 0;
+
+    BMP_FOR_EACH_SET_BIT(stp_class->group_vlan_mask, it, vlan_id)
+        size += stp_snapshot_group_size(vlan_id);
+    return size;
+}
+
+/**
+ * @brief Проверяет, что VLAN вышел из группы, а его порты удерживаются.
+ */
+static bool stp_snapshot_is_held(VLAN_ID vlan_id)
+{
+    STP_GROUP_VLAN *group = stpdata_group_vlan_get(vlan_id, false);
+
+    return group != NULL && group->stp_index == STP_INDEX_INVALID;
+}
+
+/**
+ * @brief Записывает VLAN группы с его портами.
+ *
+ * @return Позиция после записанных данных.
+ */
+static uint8_t *stp_snapshot_save_group(VLAN_ID vlan_id, uint8_t *pos)
+{
+    STP_SNAPSHOT_GROUP *group_rec = (STP_SNAPSHOT_GROUP *)pos;
+    STP_SNAPSHOT_GROUP_PORT *port_rec;
+    STP_GROUP_VLAN *group;
+    PORT_MASK_ITER it;
+    PORT_ID port_number;
+    char *ifname;
+
+    pos += sizeof(STP_SNAPSHOT_GROUP);
+    group_rec->vlan_id = vlan_id;
+    group_rec->port_count = 0;
+
+    group = stpdata_group_vlan_get(vlan_id, false);
+    if (!group)
+        return pos;
+
+    PORT_MASK_FOR_EACH_PORT(group->member_mask, it, port_number)
+    {
+        ifname = stp_intf_get_port_name(port_number);
+        if (ifname == NULL)
+            continue;
+
+        port_rec = (STP_SNAPSHOT_GROUP_PORT *)pos;
+        pos += sizeof(STP_SNAPSHOT_GROUP_PORT);
+        strncpy(port_rec->intf_name, ifname, IFNAMSIZ - 1);
+        port_rec->intf_name[IFNAMSIZ - 1] = 0;
+        port_rec->untagged = is_member(group->untag_mask, port_number);
+        port_rec->blocked = is_member(group->blocked_mask, port_number);
+        group_rec->port_count++;
+    }
+    return pos;
+}
+
+/**
+ * @brief Записывает сгруппированные VLAN экземпляра с их портами.
+ *
+ * @return Позиция после записанных данных.
+ */
+static uint8_t *stp_snapshot_save_groups(STP_CLASS *stp_class, STP_SNAPSHOT_CLASS *rec, uint8_t *pos)
+{
+    BMP_ITER_T it;
+    BMP_ID vlan_id;
+
+    rec->group_count = 0;
+    if (!stp_class->group_vlan_count)
+        return pos;
+
+    BMP_FOR_EACH_SET_BIT(stp_class->group_vlan_mask, it, vlan_id)
+    {
+        pos = stp_snapshot_save_group(vlan_id, pos);
+        rec->group_count++;
+    }
+    return pos;
+}
+
+/**
+ * @brief Сохраняет текущее состояние STP в файл снимка.
+ *
+ * @return 0 при успехе, -1 при ошибке.
+ */
+int stp_snapshot_save()
+{
+    STP_SNAPSHOT_HDR *hdr;
+    STP_SNAPSHOT_CLASS *rec;
+    STP_SNAPSHOT_PORT *port_rec;
+    STP_SNAPSHOT_GPORT *gport;
+    STP_CLASS *stp_class;
+    STP_PORT_CLASS *stp_port_class;
+    PORT_MASK_ITER it;
+    PORT_ID port_number;
+    uint64_t start_us;
+    size_t size;
+    uint8_t *pos;
+    char *ifname;
+    VLAN_ID vlan_id;
+    UINT16 i, masks;
+
+    if (g_stp_snapshot.fd == -1 || g_stp_class_array == NULL || g_stp_snapshot.pending)
+        return -1;
+
+    start_us = stp_snapshot_now_ms() * 1000;
+
+    size = sizeof(STP_SNAPSHOT_HDR) + g_max_stp_port * sizeof(STP_SNAPSHOT_GPORT);
+    for (vlan_id = MIN_VLAN_ID; vlan_id <= MAX_VLAN_ID; vlan_id++)
+    {
+        if (stp_snapshot_is_held(vlan_id))
+            size += stp_snapshot_group_size(vlan_id);
+    }
+    for (i = 0; i < g_stp_instances; i++)
+    {
+        stp_class = GET_STP_CLASS(i);
+        if (stp_class->state != STP_CLASS_FREE)
+            size += sizeof(STP_SNAPSHOT_CLASS) + bmp_count_set_bits(stp_class->control_mask) * sizeof(STP_SNAPSHOT_PORT) +
+                    stp_snapshot_groups_size(stp_class);
+    }
+
+    if (stp_snapshot_map(size) == -1)
+        return -1;
+
+    hdr = g_stp_snapshot.hdr;
+    hdr->seq |= 1;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    memcpy(hdr->magic, STP_SNAPSHOT_MAGIC, sizeof(STP_SNAPSHOT_MAGIC));
+    hdr->version = STP_SNAPSHOT_VERSION;
+    hdr->class_size = sizeof(STP_SNAPSHOT_CLASS);
+    hdr->port_size = sizeof(STP_SNAPSHOT_PORT);
+    hdr->max_instances = g_stp_instances;
+    hdr->max_port = g_max_stp_port;
+    hdr->class_count = 0;
+    hdr->gport_count = 0;
+    hdr->held_count = 0;
+    hdr->proto_mode = stp_global.proto_mode;
+    hdr->enable = stp_global.enable;
+    hdr->fast_span = stp_global.fast_span;
+    hdr->sstp_enabled = stp_global.sstp_enabled;
+    hdr->pvst_protect_do_disable = stp_global.pvst_protect_do_disable;
+    hdr->extend_mode = g_stpd_extend_mode;
+    hdr->root_protect_timeout = stp_global.root_protect_timeout;
+    hdr->base_mac_addr = g_stp_base_mac_addr;
+
+    pos = (uint8_t *)(hdr + 1);
+    for (i = 0; i < g_stp_instances; i++)
+    {
+        stp_class = GET_STP_CLASS(i);
+        if (stp_class->state == STP_CLASS_FREE)
+            continue;
+
+        rec = (STP_SNAPSHOT_CLASS *)pos;
+        pos += sizeof(STP_SNAPSHOT_CLASS);
+        rec->index = i;
+        rec->vlan_id = stp_class->vlan_id;
+        rec->state = stp_class->state;
+        rec->fast_aging = stp_class->fast_aging;
+        rec->bridge_info = stp_class->bridge_info;
+        rec->hello_timer = stp_class->hello_timer;
+        rec->tcn_timer = stp_class->tcn_timer;
+        rec->topology_change_timer = stp_class->topology_change_timer;
+        stp_snapshot_timer_save(&rec->hello_timer);
+        stp_snapshot_timer_save(&rec->tcn_timer);
+        stp_snapshot_timer_save(&rec->topology_change_timer);
+        rec->rx_drop_bpdu = stp_class->rx_drop_bpdu;
+        rec->port_count = 0;
+
+        PORT_MASK_FOR_EACH_PORT(stp_class->control_mask, it, port_number)
+        {
+            stp_port_class = GET_STP_PORT_CLASS(stp_class, port_number);
+            ifname = stp_intf_get_port_name(port_number);
+            if (stp_port_class == NULL || ifname == NULL)
+                continue;
+
+            port_rec = (STP_SNAPSHOT_PORT *)pos;
+            pos += sizeof(STP_SNAPSHOT_PORT);
+            strncpy(port_rec->intf_name, ifname, IFNAMSIZ - 1);
+            port_rec->intf_name[IFNAMSIZ - 1] = 0;
+            port_rec->enabled = is_member(stp_class->enable_mask, port_number);
+            port_rec->untagged = is_member(stp_class->untag_mask, port_number);
+            port_rec->port = *stp_port_class;
+            stp_snapshot_timer_save(&port_rec->port.message_age_timer);
+            stp_snapshot_timer_save(&port_rec->port.forward_delay_timer);
+            stp_snapshot_timer_save(&port_rec->port.hold_timer);
+            stp_snapshot_timer_save(&port_rec->port.root_protect_timer);
+            rec->port_count++;
+        }
+        pos = stp_snapshot_save_groups(stp_class, rec, pos);
+        hdr->class_count++;
+    }
+
+    for (port_number = 0; port_number < g_max_stp_port; port_number++)
+    {
+        masks = stp_snapshot_gport_masks(port_number);
+        ifname = stp_intf_get_port_name(port_number);
+        if (masks == 0 || ifname == NULL)
+            continue;
+
+        gport = (STP_SNAPSHOT_GPORT *)pos;
+        pos += sizeof(STP_SNAPSHOT_GPORT);
+        strncpy(gport->intf_name, ifname, IFNAMSIZ - 1);
+        gport->intf_name[IFNAMSIZ - 1] = 0;
+        gport->masks = masks;
+        hdr->gport_count++;
+    }
+
+    // VLANs that left their group keep the blocked ports until claimed or released
+    for (vlan_id = MIN_VLAN_ID; vlan_id <= MAX_VLAN_ID; vlan_id++)
+    {
+        if (!stp_snapshot_is_held(vlan_id))
+            continue;
+        pos = stp_snapshot_save_group(vlan_id, pos);
+        hdr->held_count++;
+    }
+
+    hdr->size = pos - (uint8_t *)hdr;
+    hdr->checksum = stp_snapshot_checksum((uint8_t *)(hdr + 1), hdr->size - sizeof(STP_SNAPSHOT_HDR));
+    hdr->saved_ms = stp_snapshot_now_ms();
+    hdr->alive_ms = hdr->saved_ms;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    hdr->seq++;
+    msync(hdr, hdr->size, MS_ASYNC);
+
+    g_stp_snapshot.saved_gen = g_stp_snapshot_gen;
+    g_stp_snapshot.full_ticks = 0;
+    g_stp_snapshot.stats.saves++;
+    g_stp_snapshot.stats.last_size = hdr->size;
+    g_stp_snapshot.stats.save_us += stp_snapshot_now_ms() * 1000 - start_us;
+    return 0;
+}
+
+/**
+ * @brief Восстанавливает глобальные маски портов из снимка.
+ */
+static void stp_snapshot_restore_gports(STP_SNAPSHOT_GPORT *gport, UINT32 count)
+{
+    PORT_ID port_number;
+    UINT32 i;
+
+    for (i = 0; i < count; i++, gport++)
+    {
+        port_number = stp_intf_get_port_id_by_name(gport->intf_name);
+        if (port_number == BAD_PORT_ID || port_number >= g_max_stp_port)
+            continue;
+
+        stputil_update_mask(g_stp_enable_mask, port_number, gport->masks & STP_SNAPSHOT_ENABLE);
+        stputil_update_mask(g_stp_enable_config_mask, port_number, gport->masks & STP_SNAPSHOT_ENABLE_ADMIN);
+        stputil_update_mask(g_fastspan_mask, port_number, gport->masks & STP_SNAPSHOT_FASTSPAN);
+        stputil_update_mask(g_fastspan_config_mask, port_number, gport->masks & STP_SNAPSHOT_FASTSPAN_ADMIN);
+        stputil_update_mask(g_fastuplink_mask, port_number, gport->masks & STP_SNAPSHOT_FASTUPLINK_ADMIN);
+        stputil_update_mask(g_stp_protect_mask, port_number, gport->masks & STP_SNAPSHOT_PROTECT);
+        stputil_update_mask(g_stp_protect_do_disable_mask, port_number, gport->masks & STP_SNAPSHOT_PROTECT_DO_DISABLE);
+        stputil_update_mask(g_stp_protect_disabled_mask, port_number, gport->masks & STP_SNAPSHOT_PROTECT_DISABLED);
+        stputil_update_mask(g_stp_root_protect_mask, port_number, gport->masks & STP_SNAPSHOT_ROOT_PROTECT);
+        if (gport->masks & STP_SNAPSHOT_PROTECT)
+            stp_pkt_sock_enable(port_number);
+    }
+}
+
+/**
+ * @brief Восстанавливает порты записи VLAN группы из снимка.
+ *
+ * @param group Запись VLAN.
+ * @param group_rec Запись снимка, за ней group_rec->port_count записей портов.
+ *
+ * @return void
+ */
+static void stp_snapshot_restore_group_ports(STP_GROUP_VLAN *group, STP_SNAPSHOT_GROUP *group_rec)
+{
+    STP_SNAPSHOT_GROUP_PORT *port_rec = (STP_SNAPSHOT_GROUP_PORT *)(group_rec + 1);
+    PORT_ID port_number;
+    UINT32 j;
+
+    for (j = 0; j < group_rec->port_count; j++, port_rec++)
+    {
+        port_number = stp_intf_get_port_id_by_name(port_rec->intf_name);
+        if (port_number == BAD_PORT_ID || port_number >= g_max_stp_port)
+        {
+            g_stp_snapshot.stats.dropped_ports++;
+            continue;
+        }
+
+        set_mask_bit(group->member_mask, port_number);
+        if (port_rec->untagged)
+            set_mask_bit(group->untag_mask, port_number);
+        if (port_rec->blocked)
+            set_mask_bit(group->blocked_mask, port_number);
+    }
+}
+
+/**
+ * @brief Восстанавливает сгруппированные или удерживаемые VLAN из снимка.
+ *
+ * Ядро и APP DB не программируются: VLAN уже состоят в STG экземпляра и
+ * сняты с заблокированных портов.
+ *
+ * @param stp_class Восстановленный экземпляр группы, NULL - для удерживаемых
+ *                  VLAN (held), иначе записи только пропускаются.
+ * @param pos Первая запись STP_SNAPSHOT_GROUP.
+ * @param end Конец снимка.
+ * @param count Записей STP_SNAPSHOT_GROUP.
+ * @param held Записи удерживаемых VLAN, вышедших из группы.
+ *
+ * @return Позиция после записей или NULL, если записи выходят за конец снимка.
+ */
+static uint8_t *stp_snapshot_restore_groups(STP_CLASS *stp_class, uint8_t *pos, uint8_t *end, UINT32 count, bool held)
+{
+    STP_SNAPSHOT_GROUP *group_rec;
+    STP_GROUP_VLAN *group;
+    UINT32 i;
+
+    for (i = 0; i < count; i++)
+    {
+        group_rec = (STP_SNAPSHOT_GROUP *)pos;
+        if (pos + sizeof(STP_SNAPSHOT_GROUP) > end ||
+            pos + sizeof(STP_SNAPSHOT_GROUP) + group_rec->port_count * sizeof(STP_SNAPSHOT_GROUP_PORT) > end)
+            return NULL;
+        pos += sizeof(STP_SNAPSHOT_GROUP) + group_rec->port_count * sizeof(STP_SNAPSHOT_GROUP_PORT);
+
+        if ((stp_class == NULL && !held) || group_rec->vlan_id > MAX_VLAN_ID ||
+            g_stp_vlan_index_map[group_rec->vlan_id] != STP_INDEX_INVALID ||
+            stpdata_group_vlan_get(group_rec->vlan_id, false) != NULL)
+            continue;
+
+        if (stp_class && stp_class->group_vlan_mask == NULL &&
+            bmp_alloc(&stp_class->group_vlan_mask, MAX_VLAN_ID + 1) != 0)
+            return pos;
+
+        group = stpdata_group_vlan_get(group_rec->vlan_id, true);
+        if (!group)
+            continue;
+
+        if (stp_class)
+        {
+            bmp_set(stp_class->group_vlan_mask, group_rec->vlan_id);
+            stp_class->group_vlan_count++;
+            g_stp_vlan_index_map[group_rec->vlan_id] = GET_STP_INDEX(stp_class);
+            group->stp_index = GET_STP_INDEX(stp_class);
+        }
+        else
+            g_stp_snapshot.stats.restored_held++;
+
+        stp_snapshot_restore_group_ports(group, group_rec);
+    }
+    return pos;
+}
+
+/**
+ * @brief Восстанавливает экземпляр STP и его порты из снимка.
+ *
+ * @param rec Запись экземпляра, за ней rec->port_count записей портов.
+ * @param since_save Тиков с момента сохранения снимка.
+ * @param down Тиков простоя stpd.
+ *
+ * @return `true`, если экземпляр восстановлен.
+ */
+static bool stp_snapshot_restore_class(STP_SNAPSHOT_CLASS *rec, UINT32 since_save, UINT32 down)
+{
+    STP_SNAPSHOT_PORT *port_rec = (STP_SNAPSHOT_PORT *)(rec + 1);
+    STP_CLASS *stp_class;
+    STP_PORT_CLASS *stp_port_class;
+    PORT_IDENTIFIER saved_id;
+    PORT_ID port_number;
+    UINT32 i, age_limit;
+
+    if (rec->index >= g_stp_instances || stpdata_init_class(rec->index, rec->vlan_id) != 0)
+        return false;
+
+    stp_class = GET_STP_CLASS(rec->index);
+    stp_class->bridge_info = rec->bridge_info;
+    stp_class->bridge_info.modified_fields = 0;
+    stp_class->fast_aging = rec->fast_aging;
+    stp_class->rx_drop_bpdu = rec->rx_drop_bpdu;
+    stp_snapshot_timer_restore(&stp_class->hello_timer, &rec->hello_timer, since_save);
+    stp_snapshot_timer_restore(&stp_class->tcn_timer, &rec->tcn_timer, since_save);
+    stp_snapshot_timer_restore(&stp_class->topology_change_timer, &rec->topology_change_timer, since_save);
+
+    // leave at least one hello interval to refresh the root before max_age
+    age_limit = 0;
+    if (stp_class->bridge_info.max_age > stp_class->bridge_info.hello_time)
+        age_limit = STP_SECONDS_TO_TICKS(stp_class->bridge_info.max_age - stp_class->bridge_info.hello_time);
+
+    for (i = 0; i < rec->port_count; i++, port_rec++)
+    {
+        port_number = stp_intf_get_port_id_by_name(port_rec->intf_name);
+        if (port_number == BAD_PORT_ID || port_number >= g_max_stp_port ||
+            (stp_port_class = stpdata_ensure_port_class(stp_class, port_number)) == NULL)
+        {
+            g_stp_snapshot.stats.dropped_ports++;
+            continue;
+        }
+
+        saved_id = port_rec->port.port_id;
+        *stp_port_class = port_rec->port;
+        stp_port_class->port_id.number = port_number;
+        // Port-channel numbers may change, keep our own designated port id in sync
+        if (stp_port_class->designated_port.number == saved_id.number &&
+            stputil_compare_bridge_id(&stp_port_class->designated_bridge, &stp_class->bridge_info.bridge_id) == EQUAL_TO)
+            stp_port_class->designated_port.number = port_number;
+
+        stp_snapshot_age_restore(&stp_port_class->message_age_timer, &port_rec->port.message_age_timer, down, age_limit);
+        stp_snapshot_timer_restore(&stp_port_class->forward_delay_timer, &port_rec->port.forward_delay_timer, since_save);
+        stp_snapshot_timer_restore(&stp_port_class->hold_timer, &port_rec->port.hold_timer, since_save);
+        stp_snapshot_timer_restore(&stp_port_class->root_protect_timer, &port_rec->port.root_protect_timer, since_save);
+        stp_port_class->modified_fields = 0;
+
+        set_mask_bit(stp_class->control_mask, port_number);
+        stp_pkt_sock_enable(port_number);
+        if (port_rec->untagged)
+            set_mask_bit(stp_class->untag_mask, port_number);
+        if (port_rec->enabled)
+            set_mask_bit(stp_class->enable_mask, port_number);
+        g_stp_snapshot.stats.restored_ports++;
+    }
+
+    // APP DB already holds this state
+    stp_class->state = rec->state;
+    stp_class->modified_fields = 0;
+    clear_mask(stp_class->dirty_port_mask);
+
+    if (stp_class->state == STP_CLASS_ACTIVE)
+        stptimer_schedule_class(stp_class);
+
+    bmp_set(g_stp_snapshot.restored, rec->index);
+    g_stp_snapshot.stats.restored_classes++;
+    return true;
+}
+
+/**
+ * @brief Сверяет включённые порты восстановленных экземпляров с состоянием интерфейсов.
+ *
+ * Порты, оперативное состояние которых изменилось, пока stpd не работал,
+ * включаются или выключаются штатным путём, остальные не трогаются.
+ */
+static void stp_snapshot_reconcile()
+{
+    STP_CLASS *stp_class;
+    PORT_MASK_ITER it;
+    PORT_ID port_number;
+    BMP_ITER_T bit;
+    BMP_ID index;
+    bool up;
+
+    BMP_FOR_EACH_SET_BIT(g_stp_snapshot.restored, bit, index)
+    {
+        stp_class = GET_STP_CLASS(index);
+        PORT_MASK_FOR_EACH_PORT(stp_class->control_mask, it, port_number)
+        {
+            up = stp_intf_is_port_up(port_number);
+            if (up == is_member(stp_class->enable_mask, port_number))
+                continue;
+
+            g_stp_snapshot.stats.reconciled_ports++;
+            if (up)
+                stpmgr_add_enable_port(index, port_number);
+            else
+                stpmgr_delete_enable_port(index, port_number);
+        }
+    }
+}
+
+/**
+ * @brief Восстанавливает состояние STP из снимка, найденного stp_snapshot_open().
+ *
+ * Вызывается после stpmgr_init(), когда база интерфейсов уже построена.
+ *
+ * @return 0, если снимок восстановлен или его нет, -1, если найденный снимок
+ *         не подходит и нужен холодный старт с очисткой APP DB.
+ */
+int stp_snapshot_restore()
+{
+    STP_SNAPSHOT_HDR *hdr = g_stp_snapshot.hdr;
+    STP_SNAPSHOT_CLASS *rec;
+    uint8_t *pos, *end;
+    uint64_t now;
+    UINT32 since_save, down, i;
+    bool restored;
+
+    if (!g_stp_snapshot.pending)
+        return 0;
+    g_stp_snapshot.pending = false;
+
+    if (hdr->max_instances != g_stp_instances)
+    {
+        STP_LOG_ERR("snapshot max instances %u, configured %u", hdr->max_instances, g_stp_instances);
+        return -1;
+    }
+
+    if (g_stp_snapshot.restored == NULL && bmp_alloc(&g_stp_snapshot.restored, g_stp_instances) == -1)
+        return -1;
+
+    now = stp_snapshot_now_ms();
+    since_save = (UINT32)((now - hdr->saved_ms) * STP_SECONDS_TO_TICKS(1) / 1000);
+    down = (UINT32)((now - hdr->alive_ms) * STP_SECONDS_TO_TICKS(1) / 1000);
+
+    stp_global.proto_mode = hdr->proto_mode;
+    stp_global.enable = hdr->enable;
+    stp_global.fast_span = hdr->fast_span;
+    stp_global.sstp_enabled = hdr->sstp_enabled;
+    stp_global.pvst_protect_do_disable = hdr->pvst_protect_do_disable;
+    stp_global.root_protect_timeout = hdr->root_protect_timeout;
+    g_stpd_extend_mode = hdr->extend_mode;
+    g_stp_base_mac_addr = hdr->base_mac_addr;
+    stp_pkt_tx_invalidate_all();
+    if (stp_global.proto_mode == L2_NONE)
+        g_stp_config_bpdu.protocol_version_id = RSTP_BPDU_TYPE;
+
+    pos = (uint8_t *)(hdr + 1);
+    end = (uint8_t *)hdr + hdr->size;
+    for (i = 0; i < hdr->class_count && pos; i++)
+    {
+        rec = (STP_SNAPSHOT_CLASS *)pos;
+        if (pos + sizeof(STP_SNAPSHOT_CLASS) > end ||
+            pos + sizeof(STP_SNAPSHOT_CLASS) + rec->port_count * sizeof(STP_SNAPSHOT_PORT) > end)
+            break;
+
+        restored = stp_snapshot_restore_class(rec, since_save, down);
+        if (!restored)
+            STP_LOG_ERR("snapshot inst %u vlan %u not restored", rec->index, rec->vlan_id);
+        pos += sizeof(STP_SNAPSHOT_CLASS) + rec->port_count * sizeof(STP_SNAPSHOT_PORT);
+
+        // group records of an instance that was not restored are only skipped
+        pos = stp_snapshot_restore_groups(restored ? GET_STP_CLASS(rec->index) : NULL, pos, end, rec->group_count,
+                                          false);
+    }
+
+    if (pos && pos + hdr->gport_count * sizeof(STP_SNAPSHOT_GPORT) <= end)
+    {
+        stp_snapshot_restore_gports((STP_SNAPSHOT_GPORT *)pos, hdr->gport_count);
+        pos += hdr->gport_count * sizeof(STP_SNAPSHOT_GPORT);
+        // held VLANs come last, after the instances that may group them again
+        stp_snapshot_restore_groups(NULL, pos, end, hdr->held_count, true);
+    }
+
+    stp_snapshot_reconcile();
+    g_stp_snapshot.claim_ticks = 0;
+
+    STP_LOG_INFO("warm restart: %u instances %u ports restored, %u ports dropped, %u reconciled, %u ages capped, down %u ms",
+                 g_stp_snapshot.stats.restored_classes, g_stp_snapshot.stats.restored_ports,
+                 g_stp_snapshot.stats.dropped_ports, g_stp_snapshot.stats.reconciled_ports,
+                 g_stp_snapshot.stats.capped_ages, (UINT32)(now - hdr->alive_ms));
+
+    // the restored state is the new baseline
+    stp_snapshot_save();
+    return 0;
+}
+
+/**
+ * @brief Отмечает восстановленный экземпляр как подтверждённый конфигурацией.
+ *
+ * Первое сообщение конфигурации VLAN после тёплого перезапуска не должно
+ * пересоздавать экземпляр, восстановленный из снимка.
+ *
+ * @param stp_index Индекс экземпляра STP.
+ * @param vlan_id VLAN из сообщения конфигурации.
+ *
+ * @return `true`, если экземпляр был восстановлен из снимка для этого VLAN.
+ */
+bool stp_snapshot_claim(STP_INDEX stp_index, VLAN_ID vlan_id)
+{
+    STP_CLASS *stp_class;
+
+    if (g_stp_snapshot.restored == NULL || stp_index >= g_stp_instances || !bmp_isset(g_stp_snapshot.restored, stp_index))
+        return false;
+
+    bmp_reset(g_stp_snapshot.restored, stp_index);
+    g_stp_snapshot.claim_ticks = 0;
+    stp_class = GET_STP_CLASS(stp_index);
+    return stp_class->state != STP_CLASS_FREE && stp_class->vlan_id == vlan_id;
+}
+
+/**
+ * @brief Освобождает восстановленные экземпляры, которые конфигурация так и не подтвердила.
+ *
+ * Такие экземпляры остались от VLAN, удалённых из конфигурации, пока stpd
+ * не работал. Освобождение удаляет их ключи из APP DB, а порты
+ * сгруппированных в них VLAN переводятся в пересылку.
+ *
+ * @return Число освобождённых экземпляров.
+ */
+UINT32 stp_snapshot_sweep()
+{
+    STP_CLASS *stp_class;
+    BITMAP_T *groups = NULL;
+    BMP_ITER_T it;
+    BMP_ID vlan_id;
+    STP_INDEX index;
+    UINT32 swept = 0;
+
+    if (g_stp_snapshot.restored == NULL)
+        return 0;
+
+    for (index = 0; index < g_stp_instances; index++)
+    {
+        if (!bmp_isset(g_stp_snapshot.restored, index))
+            continue;
+        bmp_reset(g_stp_snapshot.restored, index);
+
+        stp_class = GET_STP_CLASS(index);
+        if (stp_class->state == STP_CLASS_FREE)
+            continue;
+
+        STP_LOG_INFO("snapshot inst %u vlan %u not claimed by config, released", index, stp_class->vlan_id);
+
+        // stpmgr_release_index() only holds the grouped VLANs
+        if (stp_class->group_vlan_count && bmp_alloc(&groups, MAX_VLAN_ID + 1) == 0)
+            bmp_copy_mask(groups, stp_class->group_vlan_mask);
+
+        stpmgr_release_index(index);
+
+        if (groups)
+        {
+            BMP_FOR_EACH_SET_BIT(groups, it, vlan_id)
+                stputil_group_vlan_release(vlan_id);
+            bmp_free(groups);
+            groups = NULL;
+        }
+        swept++;
+    }
+
+    g_stp_snapshot.stats.swept_classes += swept;
+    return swept;
+}
+
+/**
+ * @brief Тик 100 мс: отметка работоспособности и периодическое сохранение снимка.
+ *
+ * Через STP_SNAPSHOT_CLAIM_TICKS без новых подтверждений экземпляров
+ * оставшиеся неподтверждёнными освобождаются stp_snapshot_sweep().
+ *
+ * @return void
+ */
+void stp_snapshot_tick()
+{
+    if (g_stp_snapshot.fd == -1 || g_stp_class_array == NULL || g_stp_snapshot.pending)
+        return;
+
+    if (g_stp_snapshot.restored && ++g_stp_snapshot.claim_ticks >= STP_SNAPSHOT_CLAIM_TICKS)
+    {
+        g_stp_snapshot.claim_ticks = 0;
+        if (bmp_isset_any(g_stp_snapshot.restored))
+            stp_snapshot_sweep();
+    }
+
+    g_stp_snapshot.full_ticks++;
+    if (++g_stp_snapshot.ticks >= STP_SNAPSHOT_CHECK_TICKS)
+    {
+        g_stp_snapshot.ticks = 0;
+        if (g_stp_snapshot.saved_gen != g_stp_snapshot_gen || g_stp_snapshot.full_ticks >= STP_SNAPSHOT_FULL_TICKS)
+        {
+            stp_snapshot_save();
+            return;
+        }
+    }
+
+    if (g_stp_snapshot.hdr)
+        g_stp_snapshot.hdr->alive_ms = stp_snapshot_now_ms();
+}
+
+/**
+ * @brief Сохраняет последний снимок и закрывает файл при остановке stpd.
+ *
+ * @return void
+ */
+void stp_snapshot_close()
+{
+    if (g_stp_snapshot.fd == -1)
+        return;
+
+    stp_snapshot_save();
+    if (g_stp_snapshot.hdr)
+        munmap(g_stp_snapshot.hdr, g_stp_snapshot.map_size);
+    g_stp_snapshot.hdr = NULL;
+    g_stp_snapshot.map_size = 0;
+    close(g_stp_snapshot.fd);
+    g_stp_snapshot.fd = -1;
+}
+
+/**
+ * @brief Тёплый перезапуск включён.
+ */
+bool stp_snapshot_enabled()
+{
+    return g_stp_snapshot.fd != -1;
+}
+
+/**
+ * @brief Возвращает статистику снимков.
+ */
+stp_snapshot_stats_t *stp_snapshot_get_stats()
+{
+    return &g_stp_snapshot.stats;
+}
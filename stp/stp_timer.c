@@ -12,12 +12,15 @@
  * - Проверка активности таймеров.
  * - Проверка истечения времени таймеров.
  * - Получение текущего значения таймера.
+ * - Колесо таймеров для планирования по абсолютному тику срабатывания.
  *
  * @author
  * Broadcom, 2019. Лицензия Apache License 2.0.
  */
 #include "stp_inc.h"
 
+static UINT32 timer_clock; // часы таймеров, тики приложения
+
 /**
  * @brief Возвращает текущее время в секундах.
  *
@@ -37,10 +40,42 @@ uint32_t sys_get_seconds()
 	return ts.tv_sec;
 }
 
+/**
+ * @brief Продвигает часы таймеров на один тик.
+ */
+void timer_clock_tick(void)
+{
+	timer_clock = (timer_clock + 1) & TIMER_VALUE_MASK;
+}
+
+/**
+ * @brief Возвращает текущее значение часов таймеров.
+ *
+ * @return Текущий тик.
+ */
+UINT32 timer_clock_get(void)
+{
+	return timer_clock;
+}
+
+/**
+ * @brief Устанавливает часы таймеров.
+ *
+ * Используется симулятором, в котором несколько экземпляров автомата
+ * разделяют одни виртуальные часы.
+ *
+ * @param value Значение часов.
+ */
+void timer_clock_set(UINT32 value)
+{
+	timer_clock = value & TIMER_VALUE_MASK;
+}
+
 /**
  * @brief Запускает таймер с заданным значением.
  *
- * Эта функция активирует таймер и инициализирует его начальным значением.
+ * Эта функция активирует таймер и запоминает тик старта так, чтобы к
+ * текущему моменту уже прошло value тиков.
  *
  * @param timer Указатель на структуру таймера.
  * @param value Начальное значение таймера.
@@ -48,7 +83,7 @@ uint32_t sys_get_seconds()
 void start_timer(TIMER *timer, UINT32 value)
 {
 	timer->active = true;
-	timer->value = value;
+	timer->value = (timer_clock - value) & TIMER_VALUE_MASK;
 }
 
 /**
@@ -67,9 +102,9 @@ void stop_timer(TIMER *timer)
 /**
  * @brief Проверяет, истёк ли таймер.
  *
- * Эта функция увеличивает значение таймера, если он активен. Если значение
- * таймера превышает заданный лимит, таймер останавливается, и возвращается
- * true.
+ * Эта функция сравнивает число тиков, прошедших с запуска активного таймера,
+ * с заданным лимитом. Если лимит достигнут, таймер останавливается, и
+ * возвращается true.
  *
  * @param timer Указатель на структуру таймера.
  * @param timer_limit Лимит времени, после которого таймер считается истекшим.
@@ -79,8 +114,7 @@ bool timer_expired(TIMER *timer, UINT32 timer_limit)
 {
 	if (timer->active)
 	{
-		timer->value++;
-		if (timer->value >= timer_limit)
+		if (timer_elapsed(timer) >= timer_limit)
 		{
 			stop_timer(timer);
 			return true;
@@ -106,7 +140,7 @@ bool is_timer_active(TIMER *timer)
 /**
  * @brief Получает текущее значение таймера.
  *
- * Эта функция возвращает текущее значение таймера, если он активен.
+ * Эта функция возвращает число тиков, прошедших с запуска таймера, если он активен.
  *
  * @param timer Указатель на структуру таймера.
  * @param value_in_ticks Указатель для записи текущего значения таймера в тиках.
@@ -117,6 +151,105 @@ bool get_timer_value(TIMER *timer, UINT32 *value_in_ticks)
 	if (!timer->active)
 		return false;
 
-	*value_in_ticks = timer->value;
+	*value_in_ticks = timer_elapsed(timer);
 	return true;
 }
+
+/**
+ * @brief Возвращает число тиков, прошедших с запуска таймера.
+ *
+ * @param timer Указатель на структуру таймера.
+ * @return Прошедшие тики или 0, если таймер неактивен.
+ */
+UINT32 timer_elapsed(TIMER *timer)
+{
+	if (!timer->active)
+		return 0;
+
+	return (timer_clock - timer->value) & TIMER_VALUE_MASK;
+}
+
+/**
+ * @brief Ставит узел в колесо таймеров.
+ *
+ * Если узел уже стоит в колесе, он переставляется в слот нового тика.
+ *
+ * @param wheel Указатель на колесо.
+ * @param node Указатель на узел.
+ * @param expiry Абсолютный тик срабатывания.
+ */
+void timer_wheel_add(TIMER_WHEEL *wheel, TIMER_WHEEL_NODE *node, UINT32 expiry)
+{
+	TIMER_WHEEL_NODE **head;
+
+	if (node->linked)
+	{
+		if (node->expiry == expiry)
+			return;
+		timer_wheel_del(wheel, node);
+	}
+
+	expiry &= TIMER_VALUE_MASK;
+	head = &wheel->slot[expiry % TIMER_WHEEL_SLOTS];
+
+	node->expiry = expiry;
+	node->prev = NULL;
+	node->next = *head;
+	if (*head)
+		(*head)->prev = node;
+	*head = node;
+	node->linked = 1;
+	wheel->count++;
+}
+
+/**
+ * @brief Снимает узел с колеса таймеров.
+ *
+ * @param wheel Указатель на колесо.
+ * @param node Указатель на узел.
+ */
+void timer_wheel_del(TIMER_WHEEL *wheel, TIMER_WHEEL_NODE *node)
+{
+	if (!node->linked)
+		return;
+
+	if (node->prev)
+		node->prev->next = node->next;
+	else
+		wheel->slot[node->expiry % TIMER_WHEEL_SLOTS] = node->next;
+
+	if (node->next)
+		node->next->prev = node->prev;
+
+	node->next = node->prev = NULL;
+	node->linked = 0;
+	wheel->count--;
+}
+
+/**
+ * @brief Снимает с колеса один узел, срок которого наступил.
+ *
+ * Просматривается только слот текущего тика; узлы следующих оборотов колеса
+ * остаются на месте. Узел возвращается отвязанным, и владелец может сразу
+ * поставить его обратно.
+ *
+ * @param wheel Указатель на колесо.
+ * @param now Текущий тик.
+ * @return Сработавший узел или NULL.
+ */
+TIMER_WHEEL_NODE *timer_wheel_expire(TIMER_WHEEL *wheel, UINT32 now)
+{
+	TIMER_WHEEL_NODE *node;
+
+	for (node = wheel->slot[now % TIMER_WHEEL_SLOTS]; node; node = node->next)
+	{
+		/* expiry is at or before now (modulo the 31-bit clock) */
+		if (((now - node->expiry) & TIMER_VALUE_MASK) <= (TIMER_VALUE_MASK >> 1))
+		{
+			timer_wheel_del(wheel, node);
+			return node;
+		}
+	}
+
+	return NULL;
+}
@@ -150,10 +150,94 @@ void stputil_set_vlan_topo_change(STP_CLASS *stp_class)
     if (stp_class->bridge_info.topology_change == stp_class->fast_aging)
         return;
 
-    stpsync_update_fastage_state(stp_class->vlan_id, stp_class->bridge_info.topology_change);
+    stputil_set_vlan_fastage(stp_class->vlan_id, stp_class->bridge_info.topology_change);
+    if (stp_class->group_vlan_count)
+    {
+        BMP_ITER_T it;
+        BMP_ID vlan_id;
+
+        BMP_FOR_EACH_SET_BIT(stp_class->group_vlan_mask, it, vlan_id)
+            stputil_set_vlan_fastage(vlan_id, stp_class->bridge_info.topology_change);
+    }
     stp_class->fast_aging = stp_class->bridge_info.topology_change;
 }
 
+/**
+ * @brief Включает или выключает быстрое старение FDB одного VLAN.
+ *
+ * Изменение не отправляется сразу: VLAN отмечается в g_stp_fastage_vlan_mask,
+ * и все VLAN тика уходят в APP DB одним пакетом stputil_flush_vlan_fastage().
+ * Повтор уже ожидающего состояния отбрасывается, для VLAN, изменённого
+ * дважды за тик, отправляется последнее состояние.
+ *
+ * @param vlan_id Идентификатор VLAN.
+ * @param enable Включить быстрое старение.
+ *
+ * @return void
+ */
+void stputil_set_vlan_fastage(VLAN_ID vlan_id, bool enable)
+{
+    if (stp_worker_defer_fastage(vlan_id, enable))
+        return;
+
+    if (!g_stp_fastage_vlan_mask)
+    {
+        stpsync_update_fastage_state(vlan_id, enable);
+        return;
+    }
+
+    stp_global.fastage_stats.requests++;
+    if (bmp_isset(g_stp_fastage_vlan_mask, vlan_id) && bmp_isset(g_stp_fastage_state_mask, vlan_id) == enable)
+    {
+        stp_global.fastage_stats.merged++;
+        return;
+    }
+
+    bmp_set(g_stp_fastage_vlan_mask, vlan_id);
+    if (enable)
+        bmp_set(g_stp_fastage_state_mask, vlan_id);
+    else
+        bmp_reset(g_stp_fastage_state_mask, vlan_id);
+}
+
+/**
+ * @brief Отправляет накопленные за тик изменения быстрого старения FDB.
+ *
+ * Все VLAN, отмеченные stputil_set_vlan_fastage(), передаются одним вызовом
+ * stpsync_update_fastage_vlans(), чтобы orchagent получил их одним пакетом,
+ * а не отдельной записью на каждый VLAN.
+ *
+ * @return void
+ */
+void stputil_flush_vlan_fastage(void)
+{
+    static uint16_t add[MAX_VLAN_ID + 1];
+    static uint16_t del[MAX_VLAN_ID + 1];
+    uint16_t add_count = 0;
+    uint16_t del_count = 0;
+    BMP_ITER_T it;
+    BMP_ID vlan_id;
+
+    if (!g_stp_fastage_vlan_mask || !bmp_isset_any(g_stp_fastage_vlan_mask))
+        return;
+
+    BMP_FOR_EACH_SET_BIT(g_stp_fastage_vlan_mask, it, vlan_id)
+    {
+        if (bmp_isset(g_stp_fastage_state_mask, vlan_id))
+            add[add_count++] = vlan_id;
+        else
+            del[del_count++] = vlan_id;
+    }
+    bmp_reset_all(g_stp_fastage_vlan_mask);
+
+    stpsync_update_fastage_vlans(add, add_count, del, del_count);
+
+    stp_global.fastage_stats.batches++;
+    stp_global.fastage_stats.vlans += add_count + del_count;
+    if (add_count + del_count > stp_global.fastage_stats.max_batch)
+        stp_global.fastage_stats.max_batch = add_count + del_count;
+}
+
 /**
  * @brief Устанавливает состояние порта моста в ядре (kernel bridge port state).
  *
@@ -171,31 +255,88 @@ void stputil_set_vlan_topo_change(STP_CLASS *stp_class)
  */
 bool stputil_set_kernel_bridge_port_state(STP_CLASS *stp_class, STP_PORT_CLASS *stp_port_class)
 {
-    char cmd_buff[100];
-    int ret;
-    char *if_name = GET_STP_PORT_IFNAME(stp_port_class);
-    char *tagged;
-
-    if (is_member(stp_class->untag_mask, stp_port_class->port_id.number))
-        tagged = "untagged";
-    else
-        tagged = "tagged";
+    bool untagged = is_member(stp_class->untag_mask, stp_port_class->port_id.number);
+    bool add;
+    bool ret;
 
     if (stp_port_class->state == FORWARDING && stp_port_class->kernel_state != STP_KERNEL_STATE_FORWARD)
     {
         stp_port_class->kernel_state = STP_KERNEL_STATE_FORWARD;
-        snprintf(cmd_buff, 100, "/sbin/bridge vlan add vid %u dev %s %s", stp_class->vlan_id, if_name, tagged);
+        add = true;
     }
     else if (stp_port_class->state != FORWARDING && stp_port_class->kernel_state != STP_KERNEL_STATE_BLOCKING)
     {
         stp_port_class->kernel_state = STP_KERNEL_STATE_BLOCKING;
-        snprintf(cmd_buff, 100, "/sbin/bridge vlan del vid %u dev %s %s", stp_class->vlan_id, if_name, tagged);
+        add = false;
     }
     else
     {
         return true; // no-op
     }
 
+    ret = stputil_set_kernel_vlan_port(GET_STP_INDEX(stp_class), stp_port_class->port_id.number,
+                                       stp_class->vlan_id, add, untagged);
+    if (stp_class->group_vlan_count)
+    {
+        BMP_ITER_T it;
+        BMP_ID vlan_id;
+
+        BMP_FOR_EACH_SET_BIT(stp_class->group_vlan_mask, it, vlan_id)
+            ret &= stputil_group_vlan_set_port(stp_class, vlan_id, stp_port_class->port_id.number, !add);
+    }
+    return ret;
+}
+
+/**
+ * @brief Добавляет VLAN порту моста в ядре или удаляет его.
+ *
+ * Порт в состоянии FORWARDING состоит в VLAN моста ядра, в остальных
+ * состояниях VLAN с порта снимается. Кэш `kernel_state` не меняется.
+ *
+ * @param stp_index Экземпляр STP, от имени которого программируется порт
+ *                  (для обработки ошибки), STP_INDEX_INVALID - без экземпляра.
+ * @param port_number Номер порта.
+ * @param vlan_id VLAN экземпляра (основной или сгруппированный).
+ * @param add Добавить VLAN (FORWARDING) или удалить.
+ * @param untagged Порт нетегированный в VLAN.
+ *
+ * @return false, если операцию не удалось выполнить или поставить в очередь.
+ */
+bool stputil_set_kernel_vlan_port(STP_INDEX stp_index, PORT_ID port_number, VLAN_ID vlan_id, bool add, bool untagged)
+{
+    char cmd_buff[100];
+    int ret;
+    char *if_name = NULL;
+    char *tagged;
+    INTERFACE_NODE *node = NULL;
+    stp_netlink_br_vlan_op_t op;
+
+    if (stp_netlink_br_is_ready())
+    {
+        node = stp_intf_get_node(port_number);
+        if (!node)
+        {
+            STP_LOG_ERR("Error: vlan %s vid %u port %u not in intf db", add ? "add" : "del", vlan_id, port_number);
+            return false;
+        }
+
+        memset(&op, 0, sizeof(op));
+        op.kif_index = node->kif_index;
+        op.vlan_id = vlan_id;
+        op.add = add;
+        op.untagged = untagged;
+        op.stp_index = stp_index;
+        op.port_id = port_number;
+
+        return stp_netlink_br_vlan_queue(&op);
+    }
+
+    if_name = stp_intf_get_port_name(port_number);
+    if (!if_name)
+        return false;
+    tagged = untagged ? "untagged" : "tagged";
+    snprintf(cmd_buff, 100, "/sbin/bridge vlan %s vid %u dev %s %s", add ? "add" : "del", vlan_id, if_name, tagged);
+
     ret = system(cmd_buff);
     if (ret == -1)
     {
@@ -206,6 +347,266 @@ bool stputil_set_kernel_bridge_port_state(STP_CLASS *stp_class, STP_PORT_CLASS *
     return true;
 }
 
+/**
+ * @brief Обрабатывает ошибку программирования VLAN моста ядра через netlink.
+ *
+ * Вызывается из `stp_netlink_br_flush` для каждой операции, отвергнутой ядром.
+ * Удаление отсутствующего VLAN не считается ошибкой. В остальных случаях
+ * кэшированное состояние порта в ядре сбрасывается, чтобы следующий вызов
+ * `stputil_set_kernel_bridge_port_state` повторил программирование.
+ *
+ * @param op Операция, завершившаяся ошибкой.
+ * @param err Код ошибки (errno).
+ *
+ * @return void
+ */
+void stputil_kernel_bridge_op_failed(stp_netlink_br_vlan_op_t *op, int err)
+{
+    STP_CLASS *stp_class;
+    STP_PORT_CLASS *stp_port_class;
+    UINT8 expected = op->add ? STP_KERNEL_STATE_FORWARD : STP_KERNEL_STATE_BLOCKING;
+
+    if (!op->add && err == ENOENT)
+        return;
+
+    STP_LOG_ERR("Error: bridge vlan %s vid %u dev %s(kif %u) strerr - %s", op->add ? "add" : "del",
+                op->vlan_id, stp_intf_get_port_name(op->port_id), op->kif_index, strerror(err));
+
+    if (op->stp_index >= g_stp_instances)
+        return;
+
+    stp_class = GET_STP_CLASS(op->stp_index);
+    if (stp_class->state == STP_CLASS_FREE ||
+        (stp_class->vlan_id != op->vlan_id && !STP_IS_GROUP_VLAN(stp_class, op->vlan_id)) ||
+        !is_member(stp_class->control_mask, op->port_id))
+        return;
+
+    stp_port_class = GET_STP_PORT_CLASS(stp_class, op->port_id);
+    if (stp_port_class->kernel_state == expected)
+        stp_port_class->kernel_state = 0;
+}
+
+/**
+ * @brief Блокирует или открывает сгруппированный VLAN на порту в ядре.
+ *
+ * Программируются только порты VLAN (member_mask) с их режимом тегирования,
+ * текущее состояние порта в ядре - blocked_mask.
+ *
+ * @param stp_class Экземпляр группы или NULL.
+ * @param vlan_id Сгруппированный VLAN.
+ * @param port_number Номер порта.
+ * @param blocked Снять VLAN с порта (иначе - добавить).
+ *
+ * @return false, если операцию не удалось выполнить или поставить в очередь.
+ */
+bool stputil_group_vlan_set_port(STP_CLASS *stp_class, VLAN_ID vlan_id, PORT_ID port_number, bool blocked)
+{
+    STP_GROUP_VLAN *group = stpdata_group_vlan_get(vlan_id, false);
+    STP_INDEX stp_index = stp_class ? GET_STP_INDEX(stp_class) : STP_INDEX_INVALID;
+
+    if (!group || !is_member(group->member_mask, port_number) ||
+        is_member(group->blocked_mask, port_number) == blocked)
+        return true;
+
+    if (blocked)
+        set_mask_bit(group->blocked_mask, port_number);
+    else
+        clear_mask_bit(group->blocked_mask, port_number);
+
+    return stputil_set_kernel_vlan_port(stp_index, port_number, vlan_id, !blocked,
+                                        is_member(group->untag_mask, port_number));
+}
+
+/**
+ * @brief Приводит порт сгруппированного VLAN к состоянию порта экземпляра группы.
+ *
+ * @param stp_class Экземпляр группы.
+ * @param vlan_id Сгруппированный VLAN.
+ * @param port_number Номер порта.
+ *
+ * @return void
+ */
+static void stputil_group_vlan_sync_port(STP_CLASS *stp_class, VLAN_ID vlan_id, PORT_ID port_number)
+{
+    STP_PORT_CLASS *stp_port_class;
+    bool blocked = false;
+
+    if (is_member(stp_class->control_mask, port_number))
+    {
+        stp_port_class = GET_STP_PORT_CLASS(stp_class, port_number);
+        blocked = (stp_port_class->kernel_state == STP_KERNEL_STATE_BLOCKING);
+    }
+    stputil_group_vlan_set_port(stp_class, vlan_id, port_number, blocked);
+}
+
+/**
+ * @brief Применяет состояние портов экземпляра к VLAN, вошедшему в группу.
+ *
+ * Каждый порт VLAN повторяет состояние порта экземпляра в ядре: VLAN
+ * снимается с заблокированных портов экземпляра и возвращается на
+ * остальные, в том числе удерживаемые после исключения из прежней группы.
+ * Быстрое старение FDB VLAN переключается вслед за экземпляром.
+ *
+ * @param stp_class Экземпляр STP.
+ * @param vlan_id Сгруппированный VLAN.
+ *
+ * @return void
+ */
+void stputil_group_vlan_join(STP_CLASS *stp_class, VLAN_ID vlan_id)
+{
+    STP_GROUP_VLAN *group = stpdata_group_vlan_get(vlan_id, true);
+    PORT_MASK_ITER it;
+    PORT_ID port_number;
+
+    if (!group)
+        return;
+
+    group->stp_index = GET_STP_INDEX(stp_class);
+    g_stp_snapshot_gen++;
+    PORT_MASK_FOR_EACH_PORT(group->member_mask, it, port_number)
+        stputil_group_vlan_sync_port(stp_class, vlan_id, port_number);
+
+    if (stp_class->fast_aging)
+        stputil_set_vlan_fastage(vlan_id, true);
+}
+
+/**
+ * @brief Исключает VLAN из экземпляра группы.
+ *
+ * Ядро не программируется: заблокированные порты VLAN удерживаются, пока
+ * VLAN не получит свой экземпляр (stputil_group_vlan_claim()) или STP на
+ * нём не будет выключен (stputil_group_vlan_release()).
+ *
+ * @param stp_class Экземпляр STP.
+ * @param vlan_id Сгруппированный VLAN.
+ *
+ * @return void
+ */
+void stputil_group_vlan_leave(STP_CLASS *stp_class, VLAN_ID vlan_id)
+{
+    STP_GROUP_VLAN *group = stpdata_group_vlan_get(vlan_id, false);
+
+    if (group && group->stp_index == GET_STP_INDEX(stp_class))
+        group->stp_index = STP_INDEX_INVALID;
+    g_stp_snapshot_gen++;
+
+    if (stp_class->fast_aging)
+        stputil_set_vlan_fastage(vlan_id, false);
+}
+
+/**
+ * @brief Открывает удерживаемые порты VLAN и освобождает его запись.
+ *
+ * Вызывается при выключении STP на VLAN: вне STP порты VLAN пересылают трафик.
+ *
+ * @param vlan_id Идентификатор VLAN.
+ *
+ * @return void
+ */
+void stputil_group_vlan_release(VLAN_ID vlan_id)
+{
+    STP_GROUP_VLAN *group = stpdata_group_vlan_get(vlan_id, false);
+    PORT_MASK_ITER it;
+    PORT_ID port_number;
+
+    if (!group || group->stp_index != STP_INDEX_INVALID)
+        return;
+
+    PORT_MASK_FOR_EACH_PORT(group->blocked_mask, it, port_number)
+        stputil_set_kernel_vlan_port(STP_INDEX_INVALID, port_number, vlan_id, true,
+                                     is_member(group->untag_mask, port_number));
+    stpdata_group_vlan_free(vlan_id);
+}
+
+/**
+ * @brief Передаёт удерживаемые порты VLAN его собственному экземпляру.
+ *
+ * Порты экземпляра программируются его автоматом, остальные порты VLAN
+ * вне STP и снова пересылают трафик.
+ *
+ * @param stp_class Экземпляр, созданный для VLAN.
+ *
+ * @return void
+ */
+void stputil_group_vlan_claim(STP_CLASS *stp_class)
+{
+    STP_GROUP_VLAN *group = stpdata_group_vlan_get(stp_class->vlan_id, false);
+    PORT_MASK_ITER it;
+    PORT_ID port_number;
+
+    if (!group || group->stp_index != STP_INDEX_INVALID)
+        return;
+
+    PORT_MASK_FOR_EACH_PORT(group->blocked_mask, it, port_number)
+    {
+        if (!is_member(stp_class->control_mask, port_number))
+            stputil_set_kernel_vlan_port(GET_STP_INDEX(stp_class), port_number, stp_class->vlan_id, true,
+                                         is_member(group->untag_mask, port_number));
+    }
+    stpdata_group_vlan_free(stp_class->vlan_id);
+}
+
+/**
+ * @brief Запоминает порт удерживаемого или сгруппированного VLAN (VLAN_MEM).
+ *
+ * @param stp_class Экземпляр группы или NULL, если VLAN удерживается.
+ * @param vlan_id Идентификатор VLAN.
+ * @param port_number Номер порта.
+ * @param member Порт под управлением STP в VLAN (иначе - порт исключается
+ *               и, если был заблокирован, снова пересылает трафик).
+ * @param untagged Порт нетегированный в VLAN.
+ *
+ * @return void
+ */
+void stputil_group_vlan_set_member(STP_CLASS *stp_class, VLAN_ID vlan_id, PORT_ID port_number, bool member,
+                                   bool untagged)
+{
+    STP_GROUP_VLAN *group = stpdata_group_vlan_get(vlan_id, stp_class != NULL && member);
+
+    if (!group)
+        return;
+
+    g_stp_snapshot_gen++;
+    if (untagged)
+        set_mask_bit(group->untag_mask, port_number);
+    else
+        clear_mask_bit(group->untag_mask, port_number);
+
+    if (member)
+    {
+        set_mask_bit(group->member_mask, port_number);
+        if (stp_class)
+            stputil_group_vlan_sync_port(stp_class, vlan_id, port_number);
+        return;
+    }
+
+    stputil_group_vlan_set_port(stp_class, vlan_id, port_number, false);
+    clear_mask_bit(group->member_mask, port_number);
+}
+
+/**
+ * @brief Забывает порт, удалённый из удерживаемого или сгруппированного VLAN.
+ *
+ * Порт уже не состоит в VLAN моста ядра, поэтому ядро не программируется.
+ *
+ * @param vlan_id Идентификатор VLAN.
+ * @param port_number Номер порта.
+ *
+ * @return void
+ */
+void stputil_group_vlan_del_member(VLAN_ID vlan_id, PORT_ID port_number)
+{
+    STP_GROUP_VLAN *group = stpdata_group_vlan_get(vlan_id, false);
+
+    if (!group)
+        return;
+
+    g_stp_snapshot_gen++;
+    clear_mask_bit(group->member_mask, port_number);
+    clear_mask_bit(group->untag_mask, port_number);
+    clear_mask_bit(group->blocked_mask, port_number);
+}
+
 /**
  * @brief Устанавливает состояние порта STP.
  *
@@ -223,6 +624,10 @@ bool stputil_set_kernel_bridge_port_state(STP_CLASS *stp_class, STP_PORT_CLASS *
  */
 bool stputil_set_port_state(STP_CLASS *stp_class, STP_PORT_CLASS *stp_port_class)
 {
+    // kernel and APP DB are updated from the main thread
+    if (stp_worker_defer_port_state(stp_class, stp_port_class))
+        return true;
+
     stputil_set_kernel_bridge_port_state(stp_class, stp_port_class);
     stpsync_update_port_state(GET_STP_PORT_IFNAME(stp_port_class), GET_STP_INDEX(stp_class), stp_port_class->state);
     return true;
@@ -264,19 +669,11 @@ bool stputil_is_protocol_enabled(L2_PROTO_MODE proto_mode)
 STP_CLASS *stputil_get_class_from_vlan(VLAN_ID vlan_id)
 {
     STP_INDEX stp_index;
-    STP_CLASS *stp_class;
 
-    for (stp_index = 0; stp_index < g_stp_instances; stp_index++)
-    {
-        stp_class = GET_STP_CLASS(stp_index);
-        if (stp_class->state == STP_CLASS_FREE)
-            continue;
-
-        if (stp_class->vlan_id == vlan_id)
-            return stp_class;
-    }
+    if (!stputil_get_index_from_vlan(vlan_id, &stp_index))
+        return NULL;
 
-    return NULL;
+    return GET_STP_CLASS(stp_index);
 }
 
 /**
@@ -297,17 +694,18 @@ bool stputil_is_port_untag(VLAN_ID vlan_id, PORT_ID port_id)
     STP_CLASS *stp_class = 0;
 
     stp_class = stputil_get_class_from_vlan(vlan_id);
-    if (stp_class)
+    if (stp_class && stp_class->vlan_id == vlan_id)
         return is_member(stp_class->untag_mask, port_id);
 
-    return false;
+    return false; // grouped VLANs are tagged
 }
 
 /**
  * @brief Получает индекс STP (STP_INDEX) для указанного VLAN.
  *
- * Функция выполняет поиск STP-индекса, соответствующего указанному идентификатору VLAN.
- * Индекс используется для доступа к данным STP, связанным с этим VLAN.
+ * Функция находит STP-индекс, соответствующий указанному идентификатору VLAN, по
+ * таблице прямого отображения VLAN -> STP_INDEX. Индекс используется для доступа
+ * к данным STP, связанным с этим VLAN.
  *
  * @param vlan_id Идентификатор VLAN, для которого необходимо получить индекс.
  * @param stp_index Указатель на переменную, в которую будет записан найденный индекс STP.
@@ -318,22 +716,18 @@ bool stputil_is_port_untag(VLAN_ID vlan_id, PORT_ID port_id)
  */
 bool stputil_get_index_from_vlan(VLAN_ID vlan_id, STP_INDEX *stp_index)
 {
-    STP_CLASS *stp_class;
-    STP_INDEX i = 0;
+    STP_INDEX i;
 
-    for (i = 0; i < g_stp_instances; i++)
-    {
-        stp_class = GET_STP_CLASS(i);
-        if (stp_class->state == STP_CLASS_FREE)
-            continue;
+    if (vlan_id > MAX_VLAN_ID)
+        return false;
 
-        if (stp_class->vlan_id == vlan_id)
-        {
-            *stp_index = i;
-            return true;
-        }
-    }
-    return false;
+    // map is maintained by stpdata_init_class()/stpdata_class_free() and the VLAN group config
+    i = g_stp_vlan_index_map[vlan_id];
+    if (i == STP_INDEX_INVALID || i >= g_stp_instances)
+        return false;
+
+    *stp_index = i;
+    return true;
 }
 
 /**
@@ -495,105 +889,6 @@ void stputil_set_global_enable_mask(PORT_ID port_id, uint8_t add)
         clear_mask_bit(g_stp_enable_mask, port_id);
 }
 
-/**
- * @brief Проверяет корректность BPDU (Bridge Protocol Data Unit).
- *
- * Функция выполняет валидацию структуры BPDU, чтобы убедиться, что данные в ней
- * соответствуют спецификации протокола STP. Используется для проверки входящих
- * BPDU перед их обработкой.
- *
- * @param bpdu Указатель на структуру `STP_CONFIG_BPDU`, содержащую данные BPDU для проверки.
- *
- * @return bool
- *         - `true`, если BPDU валиден.
- *         - `false`, если BPDU содержит ошибки или некорректные данные.
- */
-bool stputil_validate_bpdu(STP_CONFIG_BPDU *bpdu)
-{
-    if (bpdu->llc_header.destination_address_DSAP != LSAP_BRIDGE_SPANNING_TREE_PROTOCOL ||
-        bpdu->llc_header.source_address_SSAP != LSAP_BRIDGE_SPANNING_TREE_PROTOCOL ||
-        bpdu->llc_header.llc_frame_type != UNNUMBERED_INFORMATION)
-    {
-        return false;
-    }
-
-    if (bpdu->type != CONFIG_BPDU_TYPE &&
-        bpdu->type != TCN_BPDU_TYPE)
-    {
-        return false;
-    }
-
-    if (bpdu->type != TCN_BPDU_TYPE)
-    {
-        if (ntohs(bpdu->hello_time) < STP_MIN_HELLO_TIME << 8)
-        {
-            // reset to default if received bpdu is incorrect.
-            bpdu->hello_time = htons(STP_DFLT_HELLO_TIME << 8);
-        }
-    }
-
-    return true;
-}
-
-/**
- * @brief Проверяет корректность PVST BPDU (Per VLAN Spanning Tree Protocol BPDU).
- *
- * Функция выполняет валидацию структуры PVST BPDU, чтобы убедиться, что данные
- * соответствуют спецификации протокола PVST. Используется для проверки входящих
- * PVST BPDU перед их обработкой.
- *
- * @param bpdu Указатель на структуру `PVST_CONFIG_BPDU`, содержащую данные BPDU для проверки.
- *
- * @return bool
- *         - `true`, если BPDU валиден.
- *         - `false`, если BPDU содержит ошибки или некорректные данные.
- */
-bool stputil_validate_pvst_bpdu(PVST_CONFIG_BPDU *bpdu)
-{
-    if (bpdu->snap_header.destination_address_DSAP != LSAP_SNAP_LLC ||
-        bpdu->snap_header.source_address_SSAP != LSAP_SNAP_LLC ||
-        bpdu->snap_header.llc_frame_type != (enum LLC_FRAME_TYPE)UNNUMBERED_INFORMATION ||
-        bpdu->snap_header.protocol_id_filler[0] != 0x00 ||
-        bpdu->snap_header.protocol_id_filler[1] != 0x00 ||
-        bpdu->snap_header.protocol_id_filler[2] != 0x0c ||
-        ntohs(bpdu->snap_header.protocol_id) != SNAP_CISCO_PVST_ID ||
-        ntohs(bpdu->protocol_id) != 0)
-    {
-        return false;
-    }
-
-    if (bpdu->type != CONFIG_BPDU_TYPE &&
-        bpdu->type != TCN_BPDU_TYPE)
-    {
-        return false;
-    }
-
-    if (bpdu->type != TCN_BPDU_TYPE)
-    {
-        bpdu->vlan_id = ntohs(bpdu->vlan_id);
-        bpdu->tag_length = ntohs(bpdu->tag_length);
-
-        if ((bpdu->tag_length != 2) ||
-            (bpdu->vlan_id < MIN_VLAN_ID || bpdu->vlan_id > MAX_VLAN_ID))
-        {
-            if (STP_DEBUG_BPDU_RX(bpdu->vlan_id, bpdu->port_id.number))
-            {
-                STP_PKTLOG("Discarding PVST BPDU with invalid VLAN:%u Port:%d",
-                           bpdu->vlan_id, bpdu->port_id.number);
-            }
-            return false;
-        }
-
-        if (ntohs(bpdu->hello_time) < (STP_MIN_HELLO_TIME << 8))
-        {
-            // reset to default if received bpdu is incorrect.
-            bpdu->hello_time = htons(STP_DFLT_HELLO_TIME << 8);
-        }
-    }
-
-    return true;
-}
-
 /**
  * @brief Проверяет, истёк ли таймер защиты корневого порта (Root Protect Timer) для указанного порта.
  *
@@ -617,7 +912,7 @@ static bool stputil_root_protect_timer_expired(STP_CLASS *stp_class, PORT_ID por
         STP_SYSLOG("STP: Root Guard interface %s, VLAN %u consistent (Timeout) ",
                    stp_intf_get_port_name(port_number), stp_class->vlan_id);
         stp_port = GET_STP_PORT_CLASS(stp_class, port_number);
-        SET_BIT(stp_port->modified_fields, STP_PORT_CLASS_ROOT_PROTECT_BIT);
+        STP_SET_PORT_MODIFIED(stp_class, stp_port, STP_PORT_CLASS_ROOT_PROTECT_BIT);
     }
 
     make_forwarding(stp_class, port_number);
@@ -651,11 +946,12 @@ static bool stputil_root_protect_violation(STP_CLASS *stp_class, PORT_ID port_nu
         // log message
         STP_SYSLOG("STP: Root Guard interface %s, VLAN %u inconsistent (Received superior BPDU) ",
                    stp_intf_get_port_name(port_number), stp_class->vlan_id);
-        SET_BIT(stp_port->modified_fields, STP_PORT_CLASS_ROOT_PROTECT_BIT);
+        STP_SET_PORT_MODIFIED(stp_class, stp_port, STP_PORT_CLASS_ROOT_PROTECT_BIT);
     }
 
     // start/reset timer
     start_timer(&stp_port->root_protect_timer, 0);
+    stptimer_class_wakeup(stp_class);
     return true;
 }
 
@@ -759,38 +1055,7 @@ void stputil_encode_bpdu(STP_CONFIG_BPDU *bpdu)
         bpdu->message_age = htons(bpdu->message_age);
         bpdu->max_age = htons(bpdu->max_age);
         bpdu->hello_time = htons(bpdu->hello_time);
-        bpdu->forward_delay = htons(bpdu->forward_delay);
-    }
-}
-
-/**
- * @brief Декодирует полученные данные BPDU в структуру `STP_CONFIG_BPDU`.
- *
- * Функция принимает данные BPDU, полученные по сети, и преобразует их в
- * структуру `STP_CONFIG_BPDU` для дальнейшей обработки. Распаковка данных
- * выполняется в соответствии со спецификацией STP.
- *
- * @param bpdu Указатель на структуру `STP_CONFIG_BPDU`, куда будут записаны декодированные данные BPDU.
- *
- * @return void
- */
-void stputil_decode_bpdu(STP_CONFIG_BPDU *bpdu)
-{
-    bpdu->protocol_id = ntohs(bpdu->protocol_id);
-    if (bpdu->type == CONFIG_BPDU_TYPE ||
-        bpdu->type == RSTP_BPDU_TYPE)
-    {
-        NET_TO_HOST_MAC(&bpdu->root_id.address, &bpdu->root_id.address);
-        *((UINT16 *)&bpdu->root_id) = ntohs(*((UINT16 *)&bpdu->root_id));
-        bpdu->root_path_cost = ntohl(bpdu->root_path_cost);
-        NET_TO_HOST_MAC(&bpdu->bridge_id.address, &bpdu->bridge_id.address);
-        *((UINT16 *)&bpdu->bridge_id) = ntohs(*((UINT16 *)&bpdu->bridge_id));
-        *((UINT16 *)&bpdu->port_id) = ntohs(*((UINT16 *)&bpdu->port_id));
-
-        bpdu->message_age = ntohs(bpdu->message_age) >> 8;
-        bpdu->max_age = ntohs(bpdu->max_age) >> 8;
-        bpdu->hello_time = ntohs(bpdu->hello_time) >> 8;
-        bpdu->forward_delay = ntohs(bpdu->forward_delay) >> 8;
+        bpdu->forward_delay = htons(bpdu->forward_delay);
     }
 }
 
@@ -842,17 +1107,14 @@ void stputil_send_bpdu(STP_CLASS *stp_class, PORT_ID port_number, enum STP_BPDU_
     VLAN_ID vlan_id;
     STP_PORT_CLASS *stp_port_class;
     MAC_ADDRESS port_mac = {0, 0};
+    UINT8 frame[STP_MAX_PKT_LEN];
+    UINT8 hdr[STP_BPDU_OFFSET];
+    char *tx_frame;
 
     stp_port_class = GET_STP_PORT_CLASS(stp_class, port_number);
-    stp_intf_get_mac(port_number, &port_mac);
 
     if (type == CONFIG_BPDU_TYPE)
     {
-        // stputil_encode_bpdu(&g_stp_config_bpdu);
-        COPY_MAC(&g_stp_config_bpdu.mac_header.source_address, &port_mac);
-
-        bpdu = (UINT8 *)&g_stp_config_bpdu;
-        bpdu_size = sizeof(STP_CONFIG_BPDU);
         (stp_port_class->tx_config_bpdu)++;
     }
     else
@@ -863,10 +1125,8 @@ void stputil_send_bpdu(STP_CLASS *stp_class, PORT_ID port_number, enum STP_BPDU_
                        stp_class->vlan_id, port_number);
         }
 
+        stp_intf_get_mac(port_number, &port_mac);
         COPY_MAC(&g_stp_tcn_bpdu.mac_header.source_address, &port_mac);
-
-        bpdu = (UINT8 *)&g_stp_tcn_bpdu;
-        bpdu_size = sizeof(STP_TCN_BPDU);
         (stp_port_class->tx_tcn_bpdu)++;
     }
 
@@ -878,6 +1138,31 @@ void stputil_send_bpdu(STP_CLASS *stp_class, PORT_ID port_number, enum STP_BPDU_
         return;
     }
 
+    if (type == CONFIG_BPDU_TYPE)
+    {
+        // serialize the host order template straight into the tx queue slot
+        tx_frame = stp_pkt_tx_frame_get(port_number);
+        if (tx_frame)
+        {
+            bpdu_size = stp_bpdu_encode_config((UINT8 *)tx_frame, &g_stp_config_bpdu,
+                                               stp_pkt_tx_hdr_get(port_number, false), 0);
+            if (-1 == stp_pkt_tx_frame_send(port_number, vlan_id, bpdu_size, false))
+                STP_LOG_ERR("Send STP-BPDU Failed");
+            return;
+        }
+
+        // the port template caches the header, build it here without one
+        bpdu = frame;
+        stp_intf_get_mac(port_number, &port_mac);
+        stp_bpdu_build_hdr(hdr, &g_stp_config_bpdu, STP_BPDU_OFFSET, &port_mac);
+        bpdu_size = stp_bpdu_encode_config(frame, &g_stp_config_bpdu, hdr, 0);
+    }
+    else
+    {
+        bpdu = (UINT8 *)&g_stp_tcn_bpdu;
+        bpdu_size = sizeof(STP_TCN_BPDU);
+    }
+
     if (-1 == stp_pkt_tx_handler(port_number, vlan_id, (void *)bpdu, bpdu_size, false))
     {
         // Handle send err
@@ -902,33 +1187,48 @@ void stputil_send_bpdu(STP_CLASS *stp_class, PORT_ID port_number, enum STP_BPDU_
  */
 void stputil_send_pvst_bpdu(STP_CLASS *stp_class, PORT_ID port_number, enum STP_BPDU_TYPE type)
 {
-    UINT8 *bpdu, *bpdu_tmp, *pvst_tmp;
-    UINT16 bpdu_size, pvst_inc, bpdu_inc;
+    UINT8 *bpdu;
+    UINT16 bpdu_size;
     VLAN_ID vlan_id;
     MAC_ADDRESS port_mac = {0, 0};
     STP_PORT_CLASS *stp_port_class;
+    UINT8 frame[STP_MAX_PKT_LEN];
+    UINT8 hdr[PVST_BPDU_OFFSET];
+    const UINT8 *port_hdr;
+    char *tx_frame;
     bool untagged;
 
     stp_port_class = GET_STP_PORT_CLASS(stp_class, port_number);
-    stp_intf_get_mac(port_number, &port_mac);
-    if (type == CONFIG_BPDU_TYPE)
-    {
-        stputil_encode_bpdu(&g_stp_config_bpdu);
-
-        COPY_MAC(&g_stp_pvst_config_bpdu.mac_header.source_address, &port_mac);
-
-        g_stp_pvst_config_bpdu.vlan_id = htons(GET_VLAN_ID_TAG(stp_class->vlan_id));
+    vlan_id = stp_class->vlan_id;
 
-        bpdu_inc = sizeof(MAC_HEADER) + sizeof(LLC_HEADER);
-        pvst_inc = sizeof(MAC_HEADER) + sizeof(SNAP_HEADER);
+    if (g_stp_pvst_config_bpdu.protocol_id == L2_NONE)
+    {
+        stputil_send_bpdu(stp_class, port_number, type);
+        return;
+    }
 
-        pvst_tmp = (UINT8 *)(&g_stp_pvst_config_bpdu) + pvst_inc;
-        bpdu_tmp = (UINT8 *)(&g_stp_config_bpdu) + bpdu_inc;
-        memcpy(pvst_tmp, bpdu_tmp, STP_SIZEOF_CONFIG_BPDU);
+    untagged = stputil_is_port_untag(vlan_id, port_number);
 
-        bpdu = (UINT8 *)&g_stp_pvst_config_bpdu;
-        bpdu_size = sizeof(PVST_CONFIG_BPDU);
+    if (type == CONFIG_BPDU_TYPE)
+    {
         stp_port_class->tx_config_bpdu++;
+
+        // the 802.1Q tag is written by the serializer, no second copy
+        tx_frame = stp_pkt_tx_frame_get(port_number);
+        if (tx_frame)
+        {
+            bpdu = (UINT8 *)tx_frame;
+            port_hdr = stp_pkt_tx_hdr_get(port_number, true);
+        }
+        else
+        {
+            bpdu = frame;
+            stp_intf_get_mac(port_number, &port_mac);
+            stp_bpdu_build_hdr(hdr, &g_stp_pvst_config_bpdu, PVST_BPDU_OFFSET, &port_mac);
+            port_hdr = hdr;
+        }
+        bpdu_size = stp_bpdu_encode_pvst_config(bpdu, &g_stp_config_bpdu, port_hdr, &g_stp_pvst_config_bpdu,
+                                                tx_frame && !untagged ? vlan_id : 0, vlan_id);
     }
     else
     {
@@ -937,37 +1237,28 @@ void stputil_send_pvst_bpdu(STP_CLASS *stp_class, PORT_ID port_number, enum STP_
             STP_PKTLOG("Sending PVST TCN BPDU on Vlan:%d Port:%d", stp_class->vlan_id, port_number);
         }
 
+        stp_intf_get_mac(port_number, &port_mac);
         COPY_MAC(&g_stp_pvst_tcn_bpdu.mac_header.source_address, &port_mac);
 
+        tx_frame = NULL;
         bpdu = (UINT8 *)&g_stp_pvst_tcn_bpdu;
         bpdu_size = sizeof(PVST_TCN_BPDU);
         stp_port_class->tx_tcn_bpdu++;
     }
 
-    vlan_id = stp_class->vlan_id;
+    if (-1 == (tx_frame ? stp_pkt_tx_frame_send(port_number, vlan_id, bpdu_size, !untagged)
+                        : stp_pkt_tx_handler(port_number, vlan_id, (void *)bpdu, bpdu_size, !untagged)))
+    {
+        // Handle send err
+        STP_LOG_ERR("Send PVST-BPDU Failed Vlan %u Port %u", vlan_id, port_number);
+    }
 
-    untagged = stputil_is_port_untag(vlan_id, port_number);
-    
-    if (g_stp_pvst_config_bpdu.protocol_id==L2_NONE)
+    // PVST+ compatibility
+    // send an untagged IEEE BPDU when sending a PVST BPDU for VLAN 1
+    if (stp_class->vlan_id == 1)
     {
         stputil_send_bpdu(stp_class, port_number, type);
-    }else{
-
-        if (-1 == stp_pkt_tx_handler(port_number, vlan_id, (void *)bpdu, bpdu_size, !untagged))
-        {
-            // Handle send err
-            STP_LOG_ERR("Send PVST-BPDU Failed Vlan %u Port %u", vlan_id, port_number);
-        }
-    
-        // PVST+ compatibility
-        // send an untagged IEEE BPDU when sending a PVST BPDU for VLAN 1
-        if (stp_class->vlan_id == 1)
-        {
-            stputil_send_bpdu(stp_class, port_number, type);
-        }
     }
-
-
 }
 
 /**
@@ -991,7 +1282,7 @@ void stputil_process_bpdu(STP_INDEX stp_index, PORT_ID port_number, void *buffer
     UINT32 current_time = 0;
 
     // disable fast span on this port
-    if (STP_IS_FASTSPAN_ENABLED(port_number))
+    if (STP_IS_FASTSPAN_ENABLED(port_number) && !stp_worker_defer_port_fast(port_number))
     {
         stputil_update_mask(g_fastspan_mask, port_number, false);
         stpsync_update_port_fast(stp_intf_get_port_name(port_number), false);
@@ -1045,6 +1336,9 @@ void stputil_process_bpdu(STP_INDEX stp_index, PORT_ID port_number, void *buffer
     }
     else
         received_config_bpdu(stp_class, port_number, bpdu); // both RSTP and CONFIG bpdu
+
+    // timeout values and port roles may have changed
+    stptimer_class_wakeup(stp_class);
 }
 
 /**
@@ -1359,6 +1653,7 @@ void stptimer_sync_stp_class(STP_CLASS *stp_class)
 void stptimer_sync_db(STP_CLASS *stp_class)
 {
     PORT_ID port_number;
+    PORT_MASK_ITER it;
     STP_PORT_CLASS *stp_port_class;
 
     stptimer_sync_stp_class(stp_class);
@@ -1366,15 +1661,119 @@ void stptimer_sync_db(STP_CLASS *stp_class)
     if (!stp_class->control_mask)
         return;
 
-    for (port_number = port_mask_get_first_port(stp_class->control_mask);
-         port_number != BAD_PORT_ID;
-         port_number = port_mask_get_next_port(stp_class->control_mask, port_number))
+    PORT_MASK_FOR_EACH_PORT(stp_class->control_mask, it, port_number)
     {
         stp_port_class = GET_STP_PORT_CLASS(stp_class, port_number);
         stptimer_sync_port_class(stp_class, stp_port_class);
     }
 }
 
+/**
+ * @brief Ставит экземпляр STP в очередь синхронизации с APP DB.
+ *
+ * Экземпляр попадает в очередь не более одного раза до ближайшего
+ * вызова stptimer_sync_dirty().
+ *
+ * @param stp_class Указатель на структуру `STP_CLASS`.
+ *
+ * @return void
+ */
+void stputil_mark_class_dirty(STP_CLASS *stp_class)
+{
+    if (stp_worker_defer_dirty(stp_class))
+        return;
+
+    if (g_stp_wbos_class_mask)
+        bmp_set(g_stp_wbos_class_mask, GET_STP_INDEX(stp_class));
+    g_stp_snapshot_gen++;
+
+    if (stp_class->dirty_queued)
+        return;
+
+    stp_class->dirty_queued = 1;
+    stp_class->dirty_next = NULL;
+    if (g_stp_dirty_tail)
+        g_stp_dirty_tail->dirty_next = stp_class;
+    else
+        g_stp_dirty_head = stp_class;
+    g_stp_dirty_tail = stp_class;
+}
+
+/**
+ * @brief Отмечает порт экземпляра STP как изменённый для синхронизации с APP DB.
+ *
+ * @param stp_class Указатель на структуру `STP_CLASS`.
+ * @param stp_port Указатель на структуру `STP_PORT_CLASS` изменённого порта.
+ *
+ * @return void
+ */
+void stputil_mark_port_dirty(STP_CLASS *stp_class, STP_PORT_CLASS *stp_port)
+{
+    if (stp_class->dirty_port_mask)
+        set_mask_bit(stp_class->dirty_port_mask, stp_port->port_id.number);
+    stputil_mark_wbos_port(stp_class, stp_port->port_id.number);
+    stputil_mark_class_dirty(stp_class);
+}
+
+/**
+ * @brief Отмечает порт экземпляра STP для ближайшей дельта-отправки статуса в WBOS.
+ *
+ * @param stp_class Указатель на структуру `STP_CLASS`.
+ * @param port_number Номер порта.
+ *
+ * @return void
+ */
+void stputil_mark_wbos_port(STP_CLASS *stp_class, PORT_ID port_number)
+{
+    if (stp_class->wbos_port_mask)
+        set_mask_bit(stp_class->wbos_port_mask, port_number);
+    if (g_stp_wbos_class_mask && !stp_worker_defer_wbos(stp_class))
+        bmp_set(g_stp_wbos_class_mask, GET_STP_INDEX(stp_class));
+}
+
+/**
+ * @brief Синхронизирует с APP DB только изменившиеся экземпляры и порты.
+ *
+ * Разбирает очередь, наполняемую stputil_mark_class_dirty() и
+ * stputil_mark_port_dirty(), вместо обхода всех экземпляров и портов.
+ *
+ * @return void
+ */
+void stptimer_sync_dirty(void)
+{
+    STP_CLASS *stp_class;
+    STP_PORT_CLASS *stp_port_class;
+    PORT_MASK_ITER it;
+    PORT_ID port_number;
+
+    while ((stp_class = g_stp_dirty_head) != NULL)
+    {
+        g_stp_dirty_head = stp_class->dirty_next;
+        if (g_stp_dirty_head == NULL)
+            g_stp_dirty_tail = NULL;
+        stp_class->dirty_next = NULL;
+        stp_class->dirty_queued = 0;
+
+        if (stp_class->state != STP_CLASS_ACTIVE && stp_class->state != STP_CLASS_CONFIG)
+        {
+            clear_mask(stp_class->dirty_port_mask);
+            continue;
+        }
+
+        stptimer_sync_stp_class(stp_class);
+
+        PORT_MASK_FOR_EACH_PORT(stp_class->dirty_port_mask, it, port_number)
+        {
+            clear_mask_bit(stp_class->dirty_port_mask, port_number);
+            if (!is_member(stp_class->control_mask, port_number))
+                continue;
+
+            stp_port_class = GET_STP_PORT_CLASS(stp_class, port_number);
+            stptimer_sync_port_class(stp_class, stp_port_class);
+        }
+    }
+}
+
 /**
  * @brief Синхронизирует счётчики порта с текущим состоянием экземпляра STP.
  *
@@ -1434,6 +1833,220 @@ void stptimer_sync_bpdu_counters(STP_CLASS *stp_class)
 
 /* STP TIMER ROUTINES ------------------------------------------------------- */
 
+#define STP_CLASS_FROM_TIMER_NODE(node) \
+    ((STP_CLASS *)((UINT8 *)(node) - offsetof(STP_CLASS, timer_node)))
+
+/**
+ * @brief Возвращает значение forward delay, действующее для порта.
+ *
+ * Учитывает настройки fastspan и fastuplink порта.
+ *
+ * @param stp_class Указатель на структуру `STP_CLASS`, представляющую экземпляр STP.
+ * @param port_number Номер порта.
+ * @param stp_port_class Указатель на структуру `STP_PORT_CLASS` порта.
+ *
+ * @return Значение forward delay в секундах.
+ */
+static UINT32 stptimer_get_forward_delay(STP_CLASS *stp_class, PORT_ID port_number, STP_PORT_CLASS *stp_port_class)
+{
+    if (STP_IS_FASTSPAN_ENABLED(port_number))
+        return STP_FASTSPAN_FORWARD_DELAY;
+
+    if (stputil_is_fastuplink_ok(stp_class, port_number))
+    {
+        /* With uplink fast transition to forwarding should happen in 1 sec */
+        if (stp_port_class->state == LISTENING)
+            return STP_FASTUPLINK_FORWARD_DELAY;
+        return 0;
+    }
+
+    return stp_class->bridge_info.forward_delay;
+}
+
+/**
+ * @brief Возвращает тик часов таймеров, на котором группа экземпляра будет обслужена в следующий раз.
+ *
+ * Часы продвигаются в начале тика группы 0, g_stp_tick_id указывает на
+ * следующую обслуживаемую группу.
+ *
+ * @param stp_class Указатель на структуру `STP_CLASS`, представляющую экземпляр STP.
+ *
+ * @return Абсолютный тик обслуживания.
+ */
+static UINT32 stptimer_next_service_tick(STP_CLASS *stp_class)
+{
+    UINT32 now = timer_clock_get();
+
+    if (g_stp_tick_id == 0 || STP_TIMER_GROUP(stp_class) < g_stp_tick_id)
+        return now + 1;
+
+    return now;
+}
+
+/**
+ * @brief Учитывает активный таймер при поиске ближайшего срабатывания.
+ *
+ * @param timer Указатель на таймер.
+ * @param limit_in_seconds Лимит таймера в секундах.
+ * @param remaining Указатель на минимальное оставшееся число тиков.
+ *
+ * @return void
+ */
+static void stptimer_update_remaining(TIMER *timer, UINT32 limit_in_seconds, UINT32 *remaining)
+{
+    UINT32 limit, elapsed;
+
+    if (!timer->active)
+        return;
+
+    limit = STP_SECONDS_TO_TICKS(limit_in_seconds);
+    elapsed = timer_elapsed(timer);
+
+    if (elapsed >= limit)
+        *remaining = 0;
+    else if (limit - elapsed < *remaining)
+        *remaining = limit - elapsed;
+}
+
+/**
+ * @brief Ставит экземпляр STP в колесо таймеров на ближайшее срабатывание.
+ *
+ * Вычисляет минимальный срок среди активных таймеров экземпляра и его портов
+ * с теми же лимитами, что и stptimer_update(). Если активных таймеров нет или
+ * экземпляр неактивен, экземпляр снимается с колеса.
+ *
+ * @param stp_class Указатель на структуру `STP_CLASS`, представляющую экземпляр STP.
+ *
+ * @return void
+ */
+void stptimer_schedule_class(STP_CLASS *stp_class)
+{
+    UINT32 remaining = UINT32_MAX;
+    UINT32 now, service, due;
+    PORT_ID port_number;
+    STP_PORT_CLASS *stp_port_class;
+
+    if (stp_class->state != STP_CLASS_ACTIVE)
+    {
+        stptimer_unschedule_class(stp_class);
+        return;
+    }
+
+    /* pending fast-aging update is applied from stptimer_update */
+    if (stp_class->bridge_info.topology_change != stp_class->fast_aging)
+        remaining = 0;
+
+    stptimer_update_remaining(&stp_class->hello_timer, stp_class->bridge_info.hello_time, &remaining);
+    stptimer_update_remaining(&stp_class->topology_change_timer, stp_class->bridge_info.topology_change_time, &remaining);
+    stptimer_update_remaining(&stp_class->tcn_timer, stp_class->bridge_info.hello_time, &remaining);
+
+    port_number = port_mask_get_first_port(stp_class->enable_mask);
+    while (port_number != BAD_PORT_ID && remaining)
+    {
+        stp_port_class = GET_STP_PORT_CLASS(stp_class, port_number);
+
+        if (stp_port_class->forward_delay_timer.active)
+            stptimer_update_remaining(&stp_port_class->forward_delay_timer,
+                                      stptimer_get_forward_delay(stp_class, port_number, stp_port_class), &remaining);
+        stptimer_update_remaining(&stp_port_class->message_age_timer, stp_class->bridge_info.max_age, &remaining);
+        stptimer_update_remaining(&stp_port_class->hold_timer, stp_class->bridge_info.hold_time, &remaining);
+
+        if (stp_port_class->root_protect_timer.active && !STP_IS_ROOT_PROTECT_CONFIGURED(port_number))
+            remaining = 0;
+        else
+            stptimer_update_remaining(&stp_port_class->root_protect_timer, stp_global.root_protect_timeout, &remaining);
+
+        port_number = port_mask_get_next_port(stp_class->enable_mask, port_number);
+    }
+
+    if (remaining == UINT32_MAX)
+    {
+        stptimer_unschedule_class(stp_class);
+        return;
+    }
+
+    now = timer_clock_get();
+    service = stptimer_next_service_tick(stp_class);
+    due = now + remaining;
+    if (remaining < service - now)
+        due = service;
+
+    timer_wheel_add(STP_TIMER_WHEEL(stp_class), &stp_class->timer_node, due);
+}
+
+/**
+ * @brief Планирует обслуживание экземпляра STP на ближайший тик его группы.
+ *
+ * Вызывается при запуске таймеров и изменении их лимитов вне stptimer_update();
+ * точный срок будет пересчитан после обслуживания.
+ *
+ * @param stp_class Указатель на структуру `STP_CLASS`, представляющую экземпляр STP.
+ *
+ * @return void
+ */
+void stptimer_class_wakeup(STP_CLASS *stp_class)
+{
+    if (stp_class->state != STP_CLASS_ACTIVE)
+        return;
+
+    timer_wheel_add(STP_TIMER_WHEEL(stp_class), &stp_class->timer_node, stptimer_next_service_tick(stp_class));
+}
+
+/**
+ * @brief Планирует обслуживание всех активных экземпляров STP.
+ *
+ * Используется при изменении глобальных параметров, влияющих на лимиты
+ * таймеров (fastspan, fastuplink, root protect).
+ *
+ * @return void
+ */
+void stptimer_wakeup_all()
+{
+    STP_CLASS *stp_class;
+    UINT16 i;
+
+    for (i = 0; i < g_stp_instances; i++)
+    {
+        stp_class = GET_STP_CLASS(i);
+        stptimer_class_wakeup(stp_class);
+    }
+}
+
+/**
+ * @brief Снимает экземпляр STP с колеса таймеров.
+ *
+ * @param stp_class Указатель на структуру `STP_CLASS`, представляющую экземпляр STP.
+ *
+ * @return void
+ */
+void stptimer_unschedule_class(STP_CLASS *stp_class)
+{
+    timer_wheel_del(STP_TIMER_WHEEL(stp_class), &stp_class->timer_node);
+}
+
+/**
+ * @brief Обновляет экземпляры STP, срок обслуживания которых наступил на колесе.
+ *
+ * @param wheel Колесо таймеров группы.
+ *
+ * @return void
+ */
+void stptimer_expire_wheel(TIMER_WHEEL *wheel)
+{
+    STP_CLASS *stp_class;
+    TIMER_WHEEL_NODE *node;
+
+    while ((node = timer_wheel_expire(wheel, timer_clock_get())) != NULL)
+    {
+        stp_class = STP_CLASS_FROM_TIMER_NODE(node);
+
+        if (stp_class->state == STP_CLASS_ACTIVE)
+            stptimer_update(stp_class);
+
+        stptimer_schedule_class(stp_class);
+    }
+}
+
 /* FUNCTION
  *		stptimer_tick()
  *
@@ -1453,6 +2066,10 @@ void stptimer_sync_bpdu_counters(STP_CLASS *stp_class)
  *		      3                3,8,13 ...
  *		      4                4,9,14 ...
  *
+ *		Each group has its own timer wheel, with worker threads every
+ *		worker has its own set of them (see stp_worker.c). Only the instances whose earliest
+ *		timer is due on the current 500ms clock tick are updated; they are
+ *		rescheduled right after the update.
  */
 
 /**
@@ -1461,7 +2078,7 @@ void stptimer_sync_bpdu_counters(STP_CLASS *stp_class)
  * Функция вызывается периодически (обычно каждые 100 мс или другой фиксированный интервал),
  * чтобы обновить состояние таймеров, связанных с протоколом STP. Отвечает за обработку событий,
  * связанных с истечением времени, таких как управление топологическими изменениями и
- * обработка таймеров портов.
+ * обработка таймеров портов. Обновляются только экземпляры, снятые с колеса таймеров группы.
  *
  * @return void
  */
@@ -1469,21 +2086,29 @@ void stptimer_tick()
 {
     STP_CLASS *stp_class;
     UINT16 i, start_instance;
+    UINT8 tick_id;
 
-    // handle stp timer
-    if (g_stp_active_instances)
+    tick_id = g_stp_tick_id;
+    if (tick_id == 0)
+        timer_clock_tick();
+
+    /* queued hellos go first, hellos expiring below queue up behind them */
+    stp_pace_tick();
+
+    /* advance first, so that instances rescheduled below land on their next service */
+    g_stp_tick_id++;
+    if (g_stp_tick_id >= STP_TIMER_GROUPS)
     {
-        for (i = g_stp_tick_id; i < g_stp_instances; i += 5)
-        {
-            stp_class = GET_STP_CLASS(i);
+        g_stp_tick_id = 0;
+    }
 
-            if (stp_class->state == STP_CLASS_ACTIVE)
-                stptimer_update(stp_class);
+    // handle stp timer, with worker threads each of them expires its own wheel
+    if (g_stp_active_instances)
+    {
+        if (!stp_worker_run(tick_id))
+            stptimer_expire_wheel(&g_stp_timer_wheel[tick_id]);
 
-            if (stp_class->state == STP_CLASS_ACTIVE || stp_class->state == STP_CLASS_CONFIG)
-                //TODO! refactor когда отлучение
-                stptimer_sync_db(stp_class);
-        }
+        stptimer_sync_dirty();
 
         if (g_stp_bpdu_sync_tick_id % 10 == 0)
         {
@@ -1493,32 +2118,34 @@ void stptimer_tick()
                 stp_class = GET_STP_CLASS(i);
 
                 if (stp_class->state == STP_CLASS_ACTIVE)
+                {
                     stptimer_sync_bpdu_counters(stp_class);
+                    /* recompute the expiry in case a limit changed behind our back */
+                    stptimer_schedule_class(stp_class);
+                }
             }
         }
     }
 
+    /* fast-age changes of this tick, from expiries and config alike, go out as one batch */
+    stputil_flush_vlan_fastage();
+
     g_stp_bpdu_sync_tick_id++;
     if (g_stp_bpdu_sync_tick_id >= 100)
     {
         g_stp_bpdu_sync_tick_id = 0;
     }
-
-    g_stp_tick_id++;
-    if (g_stp_tick_id >= 5)
-    {
-        g_stp_tick_id = 0;
-    }
 }
 
 /* FUNCTION
  *		stptimer_update()
  *
  * SYNOPSIS
- *		this is called every 500ms for every stp class. it updates the values
- *		of the timers. if any timer has expired, it also executes the timer
- *		expiry routine. this is also currently the point when a topology
- *		change is indicated to the parent vlan.
+ *		this is called for an stp class when one of its timers is due (at
+ *		most every 500ms). it checks the timers against their limits. if any
+ *		timer has expired, it also executes the timer expiry routine. this is
+ *		also currently the point when a topology change is indicated to the
+ *		parent vlan.
  */
 
 /**
@@ -1536,6 +2163,7 @@ void stptimer_update(STP_CLASS *stp_class)
 {
     UINT32 forward_delay;
     PORT_ID port_number;
+    PORT_MASK_ITER it;
     STP_PORT_CLASS *stp_port_class;
 
     if (stptimer_expired(&stp_class->hello_timer, stp_class->bridge_info.hello_time))
@@ -1553,28 +2181,11 @@ void stptimer_update(STP_CLASS *stp_class)
         tcn_timer_expiry(stp_class);
     }
 
-    port_number = port_mask_get_first_port(stp_class->enable_mask);
-    while (port_number != BAD_PORT_ID)
+    PORT_MASK_FOR_EACH_PORT(stp_class->enable_mask, it, port_number)
     {
         stp_port_class = GET_STP_PORT_CLASS(stp_class, port_number);
 
-        if (STP_IS_FASTSPAN_ENABLED(port_number))
-        {
-            forward_delay = STP_FASTSPAN_FORWARD_DELAY;
-        }
-        else if (stputil_is_fastuplink_ok(stp_class, port_number))
-        {
-            /* With uplink fast transition to forwarding should happen in 1 sec */
-            if (stp_port_class->state == LISTENING)
-                forward_delay = STP_FASTUPLINK_FORWARD_DELAY;
-            else
-                forward_delay = 0;
-        }
-        else
-        {
-            forward_delay = stp_class->bridge_info.forward_delay;
-        }
-
+        forward_delay = stptimer_get_forward_delay(stp_class, port_number, stp_port_class);
         if (stptimer_expired(&stp_port_class->forward_delay_timer, forward_delay))
         {
             forwarding_delay_timer_expiry(stp_class, port_number);
@@ -1599,8 +2210,7 @@ void stptimer_update(STP_CLASS *stp_class)
             }
 
             /* Sync to APP DB */
-            SET_ALL_BITS(stp_class->bridge_info.modified_fields);
-            SET_ALL_BITS(stp_class->modified_fields);
+            STP_SET_CLASS_MODIFIED_ALL(stp_class);
         }
 
         if (stptimer_expired(&stp_port_class->hold_timer,
@@ -1629,8 +2239,6 @@ void stptimer_update(STP_CLASS *stp_class)
                              stp_class->vlan_id, STP_RAS_ROOT_PROTECT_TIMER_EXPIRY);
             }
         }
-
-        port_number = port_mask_get_next_port(stp_class->enable_mask, port_number);
     }
 
     // initiate fast-aging on vlan if the stp instance is in topology change
@@ -0,0 +1,682 @@
+/**
+ * @file stp_worker.c
+ * @brief Пул рабочих потоков для обработки экземпляров STP на нескольких ядрах.
+ *
+ * @details
+ * Экземпляры STP делятся между потоками по STP_WORKER_OF_INDEX. Главный
+ * поток складывает принятые BPDU в очередь потока-владельца экземпляра и
+ * раундами запускает все потоки: каждый обрабатывает свою очередь BPDU и,
+ * на тике таймера, своё колесо текущей группы. Пока идёт раунд, главный
+ * поток ждёт, поэтому очереди и состояние экземпляров не требуют блокировок.
+ *
+ * Всё, что выходит за пределы экземпляра (передача BPDU, состояние портов в
+ * ядре, stpsync, очереди синхронизации с APP DB и WBOS, глобальные маски),
+ * поток не выполняет, а записывает в журнал отложенных операций. Журналы
+ * выполняются главным потоком после раунда в порядке номеров потоков.
+ */
+
+#include <semaphore.h>
+#include "stp_inc.h"
+
+/**
+ * @enum stp_worker_op_type_t
+ * @brief Типы отложенных операций рабочего потока
+ */
+typedef enum
+{
+    STP_WORKER_OP_TX,         // stp_pkt_tx_handler()
+    STP_WORKER_OP_PORT_STATE, // stputil_set_port_state()
+    STP_WORKER_OP_FASTAGE,    // stputil_set_vlan_fastage()
+    STP_WORKER_OP_PORT_FAST,  // снятие Fast Span с порта
+    STP_WORKER_OP_DIRTY,      // stputil_mark_class_dirty()
+    STP_WORKER_OP_WBOS,       // отметка экземпляра для WBOS
+    STP_WORKER_OP_HELLO,      // stp_pace_generation()
+} stp_worker_op_type_t;
+
+/**
+ * @struct stp_worker_op_t
+ * @brief Отложенная операция рабочего потока
+ */
+typedef struct
+{
+    uint8_t type;                  // stp_worker_op_type_t
+    uint8_t flag;                  // TX: tagged, FASTAGE: состояние
+    uint16_t size;                 // TX: размер кадра
+    STP_INDEX stp_index;           // Экземпляр STP
+    uint32_t port_id;              // Порт
+    VLAN_ID vlan_id;               // VLAN
+    char data[STP_MAX_PKT_LEN];    // TX: кадр
+} stp_worker_op_t;
+
+/**
+ * @struct stp_worker_rx_t
+ * @brief BPDU в очереди рабочего потока
+ */
+typedef struct
+{
+    STP_INDEX stp_index;           // Экземпляр STP
+    PORT_ID port_id;               // Порт приёма
+    bool pvst;                     // PVST BPDU
+    STP_CONFIG_BPDU bpdu;          // Разобранный BPDU
+} stp_worker_rx_t;
+
+/**
+ * @struct stp_worker_t
+ * @brief Контекст рабочего потока
+ */
+typedef struct
+{
+    uint8_t id;                    // Номер потока, он же номер набора колёс таймеров
+    pthread_t thread;              // Поток
+    sem_t start;                   // Запуск раунда
+    int8_t tick_id;                // Группа таймеров раунда, -1 только BPDU
+    bool stop;                     // Завершение потока
+    uint32_t rx_count;             // BPDU в очереди
+    stp_worker_rx_t *rx;           // Очередь BPDU, STP_WORKER_RX_MAX
+    uint32_t op_count;             // Отложенных операций
+    uint32_t op_size;              // Размер журнала
+    stp_worker_op_t *ops;          // Журнал отложенных операций
+    STP_CLASS *last_dirty;         // Последний экземпляр операции DIRTY
+    STP_CLASS *last_wbos;          // Последний экземпляр операции WBOS
+    STP_BPDU_TMPL tmpl;            // Шаблоны BPDU потока
+    STP_SM_STATS sm_stats;         // Счётчики автомата за раунд
+    uint64_t busy_ns;              // Время работы потока
+} stp_worker_t;
+
+/**
+ * @struct stp_worker_pool_t
+ * @brief Пул рабочих потоков
+ */
+typedef struct
+{
+    uint8_t count;                 // Количество потоков, 0 - пул не запущен
+    uint32_t rx_pending;           // BPDU в очередях всех потоков
+    sem_t done;                    // Окончание раунда потоком
+    struct event *dispatch_ev;     // Отложенный запуск раунда для очередей BPDU
+    stp_worker_stats_t stats;      // Статистика
+    stp_worker_t worker[STP_WORKER_MAX];
+} stp_worker_pool_t;
+
+static stp_worker_pool_t g_stp_worker_pool;
+static __thread stp_worker_t *g_stp_worker_self; // NULL в главном потоке
+
+__thread STP_BPDU_TMPL *g_stp_bpdu_tmpl;
+__thread STP_SM_STATS *g_stp_sm_local;
+
+/**
+ * @brief Текущее время CLOCK_MONOTONIC в наносекундах.
+ */
+static uint64_t stp_worker_now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Ожидание семафора с повтором при EINTR.
+ */
+static void stp_worker_sem_wait(sem_t *sem)
+{
+    while (sem_wait(sem) == -1 && errno == EINTR)
+        ;
+}
+
+/**
+ * @brief Добавляет отложенную операцию в журнал текущего потока.
+ *
+ * @return Указатель на операцию или NULL при ошибке выделения памяти.
+ */
+static stp_worker_op_t *stp_worker_op_add(stp_worker_t *worker, uint8_t type)
+{
+    stp_worker_op_t *ops;
+    uint32_t size;
+
+    if (worker->op_count == worker->op_size)
+    {
+        size = worker->op_size ? worker->op_size * 2 : 256;
+        ops = (stp_worker_op_t *)realloc(worker->ops, size * sizeof(stp_worker_op_t));
+        if (!ops)
+        {
+            STP_LOG_ERR("worker %u op log alloc %u failed", worker->id, size);
+            return NULL;
+        }
+        worker->ops = ops;
+        worker->op_size = size;
+    }
+
+    worker->ops[worker->op_count].type = type;
+    return &worker->ops[worker->op_count++];
+}
+
+/**
+ * @brief Тело рабочего потока: ждёт запуска раунда и обрабатывает свои экземпляры.
+ */
+static void *stp_worker_main(void *arg)
+{
+    stp_worker_t *worker = (stp_worker_t *)arg;
+    stp_worker_rx_t *item;
+    uint64_t start;
+    uint32_t i;
+
+    g_stp_worker_self = worker;
+    g_stp_bpdu_tmpl = &worker->tmpl;
+    g_stp_sm_local = &worker->sm_stats;
+
+    while (1)
+    {
+        stp_worker_sem_wait(&worker->start);
+        if (worker->stop)
+            break;
+
+        start = stp_worker_now_ns();
+        // main thread may have changed the templates between the rounds
+        memcpy(&worker->tmpl, &stp_global.tmpl, sizeof(STP_BPDU_TMPL));
+
+        for (i = 0; i < worker->rx_count; i++)
+        {
+            item = &worker->rx[i];
+            if (item->pvst)
+                stpmgr_process_pvst_bpdu(item->stp_index, item->port_id, &item->bpdu);
+            else
+                stpmgr_process_stp_bpdu(item->stp_index, item->port_id, &item->bpdu);
+        }
+
+        if (worker->tick_id >= 0 && g_stp_active_instances)
+            stptimer_expire_wheel(&g_stp_timer_wheel[worker->id * STP_TIMER_GROUPS + worker->tick_id]);
+
+        worker->busy_ns += stp_worker_now_ns() - start;
+        sem_post(&g_stp_worker_pool.done);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Выполняет журнал отложенных операций потока в главном потоке.
+ */
+static void stp_worker_replay(stp_worker_t *worker)
+{
+    STP_CLASS *stp_class;
+    STP_PORT_CLASS *stp_port_class;
+    stp_worker_op_t *op;
+    STP_SM_STATS total;
+    uint64_t *dst, *src;
+    uint32_t i;
+
+    for (i = 0; i < worker->op_count; i++)
+    {
+        op = &worker->ops[i];
+        switch (op->type)
+        {
+        case STP_WORKER_OP_TX:
+            stp_pkt_tx_handler(op->port_id, op->vlan_id, op->data, op->size, op->flag);
+            break;
+
+        case STP_WORKER_OP_PORT_STATE:
+            // state is read here, the last change of the round wins
+            stp_class = GET_STP_CLASS(op->stp_index);
+            if (stp_class->state == STP_CLASS_FREE || !is_member(stp_class->control_mask, op->port_id))
+                break;
+            stp_port_class = GET_STP_PORT_CLASS(stp_class, op->port_id);
+            if (stp_port_class)
+                stputil_set_port_state(stp_class, stp_port_class);
+            break;
+
+        case STP_WORKER_OP_FASTAGE:
+            stputil_set_vlan_fastage(op->vlan_id, op->flag);
+            break;
+
+        case STP_WORKER_OP_PORT_FAST:
+            if (STP_IS_FASTSPAN_ENABLED(op->port_id))
+            {
+                stputil_update_mask(g_fastspan_mask, op->port_id, false);
+                stpsync_update_port_fast(stp_intf_get_port_name(op->port_id), false);
+            }
+            break;
+
+        case STP_WORKER_OP_DIRTY:
+            stputil_mark_class_dirty(GET_STP_CLASS(op->stp_index));
+            break;
+
+        case STP_WORKER_OP_WBOS:
+            if (g_stp_wbos_class_mask)
+                bmp_set(g_stp_wbos_class_mask, op->stp_index);
+            break;
+
+        case STP_WORKER_OP_HELLO:
+            stp_class = GET_STP_CLASS(op->stp_index);
+            if (stp_class->state == STP_CLASS_ACTIVE)
+                stp_pace_generation(stp_class);
+            break;
+        }
+    }
+
+    g_stp_worker_pool.stats.ops += worker->op_count;
+    worker->op_count = 0;
+    worker->rx_count = 0;
+    worker->last_dirty = NULL;
+    worker->last_wbos = NULL;
+
+    memcpy(&total, &stp_global.sm_stats, sizeof(total));
+    dst = (uint64_t *)&total;
+    src = (uint64_t *)&worker->sm_stats;
+    for (i = 0; i < sizeof(STP_SM_STATS) / sizeof(uint64_t); i++)
+        dst[i] += src[i];
+    memcpy(&stp_global.sm_stats, &total, sizeof(total));
+    memset(&worker->sm_stats, 0, sizeof(STP_SM_STATS));
+}
+
+/**
+ * @brief Выполняет раунд: очереди BPDU всех потоков и, если задано, колёса группы таймеров.
+ *
+ * Отложенные операции потоков выполняются до возврата.
+ *
+ * @param tick_id Группа таймеров (см. stptimer_tick()) или -1 только для очередей BPDU.
+ * @return true, если раунд выполнен пулом; false, если пул не запущен
+ *         и вызывающий должен обработать экземпляры сам.
+ */
+bool stp_worker_run(int8_t tick_id)
+{
+    stp_worker_pool_t *pool = &g_stp_worker_pool;
+    uint64_t start, wait_end;
+    uint8_t i;
+
+    if (!pool->count)
+        return false;
+
+    start = stp_worker_now_ns();
+    pool->stats.rounds++;
+    pool->stats.rx += pool->rx_pending;
+    if (pool->rx_pending > pool->stats.max_batch)
+        pool->stats.max_batch = pool->rx_pending;
+    pool->rx_pending = 0;
+
+    for (i = 0; i < pool->count; i++)
+    {
+        pool->worker[i].tick_id = tick_id;
+        sem_post(&pool->worker[i].start);
+    }
+    for (i = 0; i < pool->count; i++)
+        stp_worker_sem_wait(&pool->done);
+
+    wait_end = stp_worker_now_ns();
+    pool->stats.wait_ns += wait_end - start;
+
+    for (i = 0; i < pool->count; i++)
+        stp_worker_replay(&pool->worker[i]);
+
+    pool->stats.replay_ns += stp_worker_now_ns() - wait_end;
+    return true;
+}
+
+/**
+ * @brief Обрабатывает очереди BPDU, если они не пусты.
+ *
+ * Вызывается перед изменением конфигурации и состояния интерфейсов, чтобы
+ * BPDU, принятые раньше, обрабатывались до этих изменений.
+ *
+ * @return void
+ */
+void stp_worker_drain()
+{
+    if (g_stp_worker_pool.rx_pending && !g_stp_worker_self)
+        stp_worker_run(-1);
+}
+
+/**
+ * @brief Libevent callback отложенного раунда для очередей BPDU.
+ */
+static void stp_worker_dispatch_cb(evutil_socket_t fd, short what, void *arg)
+{
+    stp_worker_drain();
+}
+
+/**
+ * @brief Передаёт принятый BPDU потоку-владельцу экземпляра.
+ *
+ * @param stp_index Индекс экземпляра STP.
+ * @param port_number Порт приёма.
+ * @param bpdu BPDU, разобранный stp_bpdu_decode().
+ * @param pvst PVST BPDU.
+ * @return true, если BPDU поставлен в очередь; false, если пул не запущен.
+ */
+bool stp_worker_enqueue_rx(STP_INDEX stp_index, PORT_ID port_number, STP_CONFIG_BPDU *bpdu, bool pvst)
+{
+    stp_worker_pool_t *pool = &g_stp_worker_pool;
+    stp_worker_t *worker;
+    stp_worker_rx_t *item;
+
+    if (!pool->count || g_stp_worker_self)
+        return false;
+
+    worker = &pool->worker[STP_WORKER_OF_INDEX(stp_index, pool->count)];
+    if (worker->rx_count == STP_WORKER_RX_MAX)
+        stp_worker_run(-1);
+
+    item = &worker->rx[worker->rx_count++];
+    item->stp_index = stp_index;
+    item->port_id = port_number;
+    item->pvst = pvst;
+    item->bpdu = *bpdu;
+
+    if (pool->rx_pending++ == 0)
+        event_active(pool->dispatch_ev, 0, 0);
+    return true;
+}
+
+/**
+ * @brief Проверяет, выполняется ли вызов в рабочем потоке.
+ *
+ * @return true в рабочем потоке, false в главном.
+ */
+bool stp_worker_in_thread()
+{
+    return g_stp_worker_self != NULL;
+}
+
+/**
+ * @brief Откладывает передачу BPDU рабочим потоком до конца раунда.
+ *
+ * @return true, если вызвано из рабочего потока и передача отложена.
+ */
+bool stp_worker_defer_tx(uint32_t port_id, VLAN_ID vlan_id, char *buffer, uint16_t size, bool tagged)
+{
+    stp_worker_op_t *op;
+
+    if (!g_stp_worker_self)
+        return false;
+
+    if (size > STP_MAX_PKT_LEN)
+    {
+        STP_LOG_ERR("worker %u tx size %u port %u too big", g_stp_worker_self->id, size, port_id);
+        return true;
+    }
+
+    op = stp_worker_op_add(g_stp_worker_self, STP_WORKER_OP_TX);
+    if (!op)
+        return true;
+    op->port_id = port_id;
+    op->vlan_id = vlan_id;
+    op->size = size;
+    op->flag = tagged;
+    memcpy(op->data, buffer, size);
+    return true;
+}
+
+/**
+ * @brief Откладывает установку состояния порта в ядре и APP DB до конца раунда.
+ *
+ * @return true, если вызвано из рабочего потока и операция отложена.
+ */
+bool stp_worker_defer_port_state(STP_CLASS *stp_class, STP_PORT_CLASS *stp_port_class)
+{
+    stp_worker_op_t *op;
+
+    if (!g_stp_worker_self)
+        return false;
+
+    op = stp_worker_op_add(g_stp_worker_self, STP_WORKER_OP_PORT_STATE);
+    if (op)
+    {
+        op->stp_index = GET_STP_INDEX(stp_class);
+        op->port_id = stp_port_class->port_id.number;
+    }
+    return true;
+}
+
+/**
+ * @brief Откладывает изменение состояния fast aging VLAN до конца раунда.
+ *
+ * @return true, если вызвано из рабочего потока и операция отложена.
+ */
+bool stp_worker_defer_fastage(VLAN_ID vlan_id, bool enable)
+{
+    stp_worker_op_t *op;
+
+    if (!g_stp_worker_self)
+        return false;
+
+    op = stp_worker_op_add(g_stp_worker_self, STP_WORKER_OP_FASTAGE);
+    if (op)
+    {
+        op->vlan_id = vlan_id;
+        op->flag = enable;
+    }
+    return true;
+}
+
+/**
+ * @brief Откладывает снятие Fast Span с порта до конца раунда.
+ *
+ * @return true, если вызвано из рабочего потока и операция отложена.
+ */
+bool stp_worker_defer_port_fast(PORT_ID port_number)
+{
+    stp_worker_op_t *op;
+
+    if (!g_stp_worker_self)
+        return false;
+
+    op = stp_worker_op_add(g_stp_worker_self, STP_WORKER_OP_PORT_FAST);
+    if (op)
+        op->port_id = port_number;
+    return true;
+}
+
+/**
+ * @brief Откладывает постановку экземпляра в очередь синхронизации до конца раунда.
+ *
+ * @return true, если вызвано из рабочего потока и операция отложена.
+ */
+bool stp_worker_defer_dirty(STP_CLASS *stp_class)
+{
+    stp_worker_op_t *op;
+
+    if (!g_stp_worker_self)
+        return false;
+
+    // dirty_queued belongs to the main thread, only repeats are skipped here
+    if (g_stp_worker_self->last_dirty == stp_class)
+        return true;
+
+    op = stp_worker_op_add(g_stp_worker_self, STP_WORKER_OP_DIRTY);
+    if (op)
+    {
+        op->stp_index = GET_STP_INDEX(stp_class);
+        g_stp_worker_self->last_dirty = stp_class;
+    }
+    return true;
+}
+
+/**
+ * @brief Откладывает отметку экземпляра для отправки статуса в WBOS до конца раунда.
+ *
+ * @return true, если вызвано из рабочего потока и операция отложена.
+ */
+bool stp_worker_defer_wbos(STP_CLASS *stp_class)
+{
+    stp_worker_op_t *op;
+
+    if (!g_stp_worker_self)
+        return false;
+
+    if (g_stp_worker_self->last_wbos == stp_class)
+        return true;
+
+    op = stp_worker_op_add(g_stp_worker_self, STP_WORKER_OP_WBOS);
+    if (op)
+    {
+        op->stp_index = GET_STP_INDEX(stp_class);
+        g_stp_worker_self->last_wbos = stp_class;
+    }
+    return true;
+}
+
+/**
+ * @brief Откладывает распределение hello экземпляра (stp_pace.c) до конца раунда.
+ *
+ * @return true, если вызвано из рабочего потока и операция отложена.
+ */
+bool stp_worker_defer_hello(STP_CLASS *stp_class)
+{
+    stp_worker_op_t *op;
+
+    if (!g_stp_worker_self)
+        return false;
+
+    op = stp_worker_op_add(g_stp_worker_self, STP_WORKER_OP_HELLO);
+    if (op)
+        op->stp_index = GET_STP_INDEX(stp_class);
+    return true;
+}
+
+/**
+ * @brief Количество наборов колёс таймеров для stpdata_init_global_structures().
+ *
+ * @return Количество рабочих потоков или 1, если пул не запущен.
+ */
+UINT8 stp_worker_get_wheel_sets()
+{
+    return g_stp_worker_pool.count ? g_stp_worker_pool.count : 1;
+}
+
+/**
+ * @brief Количество рабочих потоков.
+ */
+uint8_t stp_worker_count()
+{
+    return g_stp_worker_pool.count;
+}
+
+/**
+ * @brief Время работы рабочего потока в наносекундах.
+ */
+uint64_t stp_worker_get_busy_ns(uint8_t id)
+{
+    if (id >= g_stp_worker_pool.count)
+        return 0;
+    return g_stp_worker_pool.worker[id].busy_ns;
+}
+
+/**
+ * @brief Статистика пула рабочих потоков.
+ */
+stp_worker_stats_t *stp_worker_get_stats()
+{
+    return &g_stp_worker_pool.stats;
+}
+
+/**
+ * @brief Останавливает рабочие потоки и освобождает пул.
+ *
+ * @return void
+ */
+void stp_worker_deinit()
+{
+    stp_worker_pool_t *pool = &g_stp_worker_pool;
+    stp_worker_t *worker;
+    uint8_t i, count = pool->count;
+
+    // from here on everything runs on the main thread again
+    pool->count = 0;
+    for (i = 0; i < count; i++)
+    {
+        worker = &pool->worker[i];
+        worker->stop = true;
+        sem_post(&worker->start);
+        pthread_join(worker->thread, NULL);
+        sem_destroy(&worker->start);
+        free(worker->rx);
+        free(worker->ops);
+        memset(worker, 0, sizeof(stp_worker_t));
+    }
+
+    if (pool->dispatch_ev)
+    {
+        stpmgr_libevent_destroy(pool->dispatch_ev);
+        event_free(pool->dispatch_ev);
+        pool->dispatch_ev = NULL;
+        sem_destroy(&pool->done);
+    }
+}
+
+/**
+ * @brief Запускает пул рабочих потоков.
+ *
+ * Должен вызываться до stpmgr_init(): количество наборов колёс таймеров
+ * определяется при выделении глобальных структур.
+ *
+ * @param base База событий libevent для раундов обработки очередей BPDU.
+ * @param count Количество потоков, 0 - без пула.
+ * @return 0 в случае успеха, -1 при ошибке (пул не запущен).
+ */
+int stp_worker_init(struct event_base *base, uint8_t count)
+{
+    stp_worker_pool_t *pool = &g_stp_worker_pool;
+    stp_worker_t *worker;
+    sigset_t all, old;
+    uint8_t i;
+    int ret = 0;
+
+    if (!count)
+        return 0;
+
+    if (count > STP_WORKER_MAX)
+        count = STP_WORKER_MAX;
+
+    pool->dispatch_ev = stpmgr_libevent_create_prio(base, -1, 0, stp_worker_dispatch_cb, NULL, NULL, "WORKER",
+                                                    STP_LIBEV_PKT_PRI_Q);
+    if (!pool->dispatch_ev || -1 == sem_init(&pool->done, 0, 0))
+    {
+        STP_LOG_ERR("worker dispatch event create failed");
+        if (pool->dispatch_ev)
+        {
+            stpmgr_libevent_destroy(pool->dispatch_ev);
+            event_free(pool->dispatch_ev);
+        }
+        pool->dispatch_ev = NULL;
+        return -1;
+    }
+
+    // signals are handled by the main thread only
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+
+    for (i = 0; i < count; i++)
+    {
+        worker = &pool->worker[i];
+        worker->id = i;
+        worker->rx = (stp_worker_rx_t *)calloc(STP_WORKER_RX_MAX, sizeof(stp_worker_rx_t));
+        if (!worker->rx || -1 == sem_init(&worker->start, 0, 0))
+        {
+            free(worker->rx);
+            worker->rx = NULL;
+            ret = -1;
+            break;
+        }
+
+        if (0 != pthread_create(&worker->thread, NULL, stp_worker_main, worker))
+        {
+            sem_destroy(&worker->start);
+            free(worker->rx);
+            worker->rx = NULL;
+            ret = -1;
+            break;
+        }
+        pool->count++;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (ret == -1)
+    {
+        STP_LOG_ERR("worker %u create failed : %s", i, strerror(errno));
+        stp_worker_deinit();
+        return -1;
+    }
+
+    STP_LOG_INFO("STP worker pool started, %u threads", pool->count);
+    return 0;
+}
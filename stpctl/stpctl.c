@@ -11,7 +11,7 @@
  */
 #include "stpctl.h"
 
-#define cmd_max STP_CTL_MAX
+#define cmd_max (sizeof(g_cmd_list) / sizeof(g_cmd_list[0]))
 
 /**
  * @var CMD_LIST g_cmd_list[]
@@ -32,6 +32,18 @@ CMD_LIST g_cmd_list[] = {
     {"clrstsvlan", STP_CTL_CLEAR_VLAN},
     {"clrstsintf", STP_CTL_CLEAR_INTF},
     {"clrstsvlanintf", STP_CTL_CLEAR_VLAN_INTF},
+    {"lprof", STP_CTL_DUMP_LIBEV_PROF},
+    {"clrlprof", STP_CTL_CLEAR_LIBEV_PROF},
+    {"stormguard", STP_CTL_SET_STORM_GUARD},
+    {"stormstats", STP_CTL_DUMP_STORM_GUARD},
+    {"bpducap", STP_CTL_DUMP_BPDU_CAPTURE},
+    {"bpdupcap", STP_CTL_PCAP_BPDU_CAPTURE},
+    {"clrbpducap", STP_CTL_CLEAR_BPDU_CAPTURE},
+    {"shm", STP_CTL_DUMP_SHM},
+    {"stream", STP_CTL_STREAM_CLASS},
+    {"streamnl", STP_CTL_STREAM_NL_DB},
+    {"metrics", STP_CTL_DUMP_METRICS},
+    {"txpace", STP_CTL_SET_TX_PACE},
 };
 
 
@@ -359,7 +371,118 @@ int send_command(int argc, char **argv)
         break;
     }
 
+    case STP_CTL_SET_STORM_GUARD:
+    {
+        /*
+         * stpctl stormguard <intf|all> <vlan|all> <pps> [burst]   //pps = 0 removes the rule
+         */
+        if ((argc < 5) || (argc > 6))
+        {
+            stpout("stpctl stormguard <intf|all> <vlan|all> <pps> [burst]\n");
+            return -1;
+        }
+
+        if (0 == strcmp("all", argv[2]))
+            msg.intf_name[0] = '\0';
+        else
+            strncpy(msg.intf_name, argv[2], IFNAMSIZ);
+
+        if (0 == strcmp("all", argv[3]))
+            msg.vlan_id = 0xffff; // STP_BPF_VLAN_ANY
+        else
+        {
+            msg.vlan_id = strtol(argv[3], &end_ptr, 10);
+            if (*end_ptr != '\0' || msg.vlan_id < 1 || msg.vlan_id > 4094)
+            {
+                stpout("invalid vlan : %s\n", argv[3]);
+                return -1;
+            }
+        }
+
+        msg.storm.pps = strtoul(argv[4], &end_ptr, 10);
+        if (*end_ptr != '\0')
+        {
+            stpout("invalid pps : %s\n", argv[4]);
+            return -1;
+        }
+        msg.storm.burst = 0;
+        if (argc == 6)
+        {
+            msg.storm.burst = strtoul(argv[5], &end_ptr, 10);
+            if (*end_ptr != '\0')
+            {
+                stpout("invalid burst : %s\n", argv[5]);
+                return -1;
+            }
+        }
+        break;
+    }
+
+    case STP_CTL_SET_TX_PACE:
+    {
+        /*
+         * stpctl txpace <pps> [burst]   //pps = 0 disables hello pacing
+         */
+        if ((argc < 3) || (argc > 4))
+        {
+            stpout("stpctl txpace <pps> [burst]\n");
+            return -1;
+        }
+
+        msg.storm.pps = strtoul(argv[2], &end_ptr, 10);
+        if (*end_ptr != '\0')
+        {
+            stpout("invalid pps : %s\n", argv[2]);
+            return -1;
+        }
+        msg.storm.burst = 0;
+        if (argc == 4)
+        {
+            msg.storm.burst = strtoul(argv[3], &end_ptr, 10);
+            if (*end_ptr != '\0')
+            {
+                stpout("invalid burst : %s\n", argv[3]);
+                return -1;
+            }
+        }
+        break;
+    }
+
+    case STP_CTL_DUMP_BPDU_CAPTURE:
+    case STP_CTL_PCAP_BPDU_CAPTURE:
+    {
+        /*
+         * stpctl bpducap [intf|all] [vlan|all]
+         * stpctl bpdupcap [intf|all] [vlan|all]
+         */
+        if (argc > 4)
+        {
+            stpout("stpctl %s [intf|all] [vlan|all]\n", argv[1]);
+            return -1;
+        }
+
+        msg.intf_name[0] = '\0';
+        if (argc > 2 && 0 != strcmp("all", argv[2]))
+            strncpy(msg.intf_name, argv[2], IFNAMSIZ);
+
+        msg.vlan_id = 0;
+        if (argc > 3 && 0 != strcmp("all", argv[3]))
+        {
+            msg.vlan_id = strtol(argv[3], &end_ptr, 10);
+            if (*end_ptr != '\0' || msg.vlan_id < 1 || msg.vlan_id > 4094)
+            {
+                stpout("invalid vlan : %s\n", argv[3]);
+                return -1;
+            }
+        }
+        break;
+    }
+
+    case STP_CTL_CLEAR_BPDU_CAPTURE:
+    case STP_CTL_DUMP_STORM_GUARD:
     case STP_CTL_DUMP_LIBEV_STATS:
+    case STP_CTL_DUMP_LIBEV_PROF:
+    case STP_CTL_CLEAR_LIBEV_PROF:
     {
         /* No arg */
         if (!(argc == 2))
@@ -470,6 +593,469 @@ void display_resp()
         free(line);
 }
 
+/**
+ * @brief Копирует согласованный снимок из файла экспорта stpd.
+ *
+ * Повторяет копирование, пока seq нечётный или изменился за время чтения.
+ *
+ * @return Копия области экспорта (освобождает вызывающий) или NULL.
+ */
+STP_EXPORT_HDR *shm_snapshot()
+{
+    STP_EXPORT_HDR *hdr = MAP_FAILED, *copy = NULL;
+    size_t map_size = 0;
+    struct stat st;
+    uint32_t seq, size;
+    int fd, retry;
+
+    fd = open(STP_EXPORT_FILE, O_RDONLY);
+    if (fd == -1)
+    {
+        stpout("%s: %s\n", STP_EXPORT_FILE, strerror(errno));
+        return NULL;
+    }
+
+    for (retry = 0; retry < 1000; retry++)
+    {
+        if (hdr == MAP_FAILED)
+        {
+            if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(STP_EXPORT_HDR))
+                break;
+            map_size = st.st_size;
+            hdr = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (hdr == MAP_FAILED)
+                break;
+        }
+
+        seq = __atomic_load_n(&hdr->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+        {
+            usleep(100);
+            continue;
+        }
+
+        size = hdr->size;
+        if (size > map_size)
+        {
+            // stpd has grown the file
+            munmap(hdr, map_size);
+            hdr = MAP_FAILED;
+            continue;
+        }
+        if (size < sizeof(STP_EXPORT_HDR))
+            break;
+
+        copy = realloc(copy, size);
+        if (!copy)
+            break;
+        memcpy(copy, hdr, size);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (hdr->seq == seq)
+        {
+            munmap(hdr, map_size);
+            close(fd);
+            return copy;
+        }
+    }
+
+    stpout("no consistent state in %s\n", STP_EXPORT_FILE);
+    if (hdr != MAP_FAILED)
+        munmap(hdr, map_size);
+    free(copy);
+    close(fd);
+    return NULL;
+}
+
+/**
+ * @brief Проверяет, что формат снимка совпадает с форматом stpctl.
+ *
+ * @return 0 при совпадении, -1 при несовпадении.
+ */
+int shm_check_format(STP_EXPORT_HDR *hdr)
+{
+    if (memcmp(hdr->magic, STP_EXPORT_MAGIC, sizeof(STP_EXPORT_MAGIC)) != 0 || hdr->version != STP_EXPORT_VERSION ||
+        hdr->hdr_size != sizeof(STP_EXPORT_HDR) || hdr->class_size != sizeof(STP_EXPORT_CLASS) ||
+        hdr->port_size != sizeof(STP_EXPORT_PORT) || hdr->intf_size != sizeof(STP_EXPORT_INTF))
+    {
+        stpout("%s: format mismatch, version %u\n", STP_EXPORT_FILE, hdr->version);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Выводит MAC из идентификатора моста STP_EXPORT_CLASS.
+ */
+void shm_print_bridge_id(const char *label, uint64_t id)
+{
+    stpout("%s%04x.%012llx", label, (unsigned)(id >> 48), (unsigned long long)(id & 0xffffffffffffULL));
+}
+
+/**
+ * @brief Выводит состояние STP из разделяемой памяти без запроса к stpd.
+ *
+ * @param vlan_id VLAN для вывода портов, 0 - только сводка по экземплярам.
+ * @return 0 при успехе, -1 при ошибке.
+ */
+int dump_shm(uint32_t vlan_id)
+{
+    static const char *port_state[] = {"DISABLED", "BLOCKING", "LISTENING", "LEARNING", "FORWARDING"};
+    STP_EXPORT_HDR *hdr;
+    STP_EXPORT_CLASS *cls;
+    STP_EXPORT_PORT *port;
+    STP_EXPORT_INTF *intf;
+    struct timespec ts;
+    uint32_t i, j;
+
+    hdr = shm_snapshot();
+    if (!hdr)
+        return -1;
+
+    if (shm_check_format(hdr) == -1)
+    {
+        free(hdr);
+        return -1;
+    }
+
+    cls = (STP_EXPORT_CLASS *)((uint8_t *)hdr + hdr->class_offset);
+    port = (STP_EXPORT_PORT *)((uint8_t *)hdr + hdr->port_offset);
+    intf = (STP_EXPORT_INTF *)((uint8_t *)hdr + hdr->intf_offset);
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    stpout("stpd pid %u, published %llu ms ago, publish %llu gen %llu\n", hdr->pid,
+           (unsigned long long)((uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 - hdr->published_ms),
+           (unsigned long long)hdr->publish_count, (unsigned long long)hdr->state_gen);
+    stpout("enable %u mode %u fastspan %u extend %u root-protect-timeout %u\n", hdr->enable, hdr->proto_mode,
+           hdr->fast_span, hdr->extend_mode, hdr->root_protect_timeout);
+    stpout("base mac %02x:%02x:%02x:%02x:%02x:%02x instances %u/%u ports %u\n", hdr->base_mac[0], hdr->base_mac[1],
+           hdr->base_mac[2], hdr->base_mac[3], hdr->base_mac[4], hdr->base_mac[5], hdr->active_instances,
+           hdr->max_instances, hdr->max_port);
+
+    stpout("\n VLAN | Inst | Root ID             | Cost     | RPort | Bridge ID           | TC count | Ports | Grouped\n");
+    for (i = 0; i < hdr->class_count; i++)
+    {
+        if (vlan_id && cls[i].vlan_id != vlan_id)
+            continue;
+        stpout(" %4u | %4u | ", cls[i].vlan_id, cls[i].index);
+        shm_print_bridge_id("", cls[i].root_id);
+        stpout(" | %8u | %5u | ", cls[i].root_path_cost, cls[i].root_port);
+        shm_print_bridge_id("", cls[i].bridge_id);
+        stpout(" | %8u | %5u | %u\n", cls[i].topology_change_count, cls[i].port_count, cls[i].group_vlans);
+
+        if (!vlan_id)
+            continue;
+        stpout("\n   Port | State      | Cost     | Desig bridge        | Rx cfg   | Tx cfg   | Rx tcn | Tx tcn\n");
+        for (j = cls[i].port_first; j < cls[i].port_first + cls[i].port_count && j < hdr->port_count; j++)
+        {
+            stpout("   %4u | %-10s | %8u | ", port[j].port_number,
+                   port[j].state < sizeof(port_state) / sizeof(port_state[0]) ? port_state[port[j].state] : "?",
+                   port[j].path_cost);
+            shm_print_bridge_id("", port[j].designated_bridge);
+            stpout(" | %8llu | %8llu | %6llu | %6llu\n", (unsigned long long)port[j].rx_config_bpdu,
+                   (unsigned long long)port[j].tx_config_bpdu, (unsigned long long)port[j].rx_tcn_bpdu,
+                   (unsigned long long)port[j].tx_tcn_bpdu);
+        }
+    }
+
+    if (!vlan_id)
+    {
+        stpout("\n Port | Name             | Oper | Speed  | Rx       | Tx       | Rx-Err | Tx-Err\n");
+        for (i = 0; i < hdr->intf_count; i++)
+            stpout(" %4u | %-16.16s | %-4s | %6u | %8llu | %8llu | %6llu | %6llu\n", intf[i].port_number, intf[i].name,
+                   (intf[i].flags & STP_EXPORT_INTF_OPER_UP) ? "UP" : "DOWN", intf[i].speed,
+                   (unsigned long long)intf[i].pkt_rx, (unsigned long long)intf[i].pkt_tx,
+                   (unsigned long long)intf[i].pkt_rx_err, (unsigned long long)intf[i].pkt_tx_err);
+    }
+
+    free(hdr);
+    return 0;
+}
+
+/**
+ * @brief Выводит метрику Prometheus с метками vlan и port.
+ */
+void metrics_print_port(const char *name, uint16_t vlan_id, const char *port_name, uint64_t value)
+{
+    stpout("%s{vlan=\"%u\",port=\"%s\"} %llu\n", name, vlan_id, port_name, (unsigned long long)value);
+}
+
+/**
+ * @brief Выводит метрику Prometheus с меткой port.
+ */
+void metrics_print_intf(const char *name, const char *port_name, uint64_t value)
+{
+    stpout("%s{port=\"%s\"} %llu\n", name, port_name, (unsigned long long)value);
+}
+
+/**
+ * @brief Выводит счётчики из разделяемой памяти в текстовом формате Prometheus.
+ *
+ * Вывод предназначен для textfile collector node_exporter или агента
+ * телеметрии; stpd в сборе метрик не участвует. Счётчики монотонные, очистка
+ * статистики их не сбрасывает.
+ *
+ * @return 0 при успехе, -1 при ошибке.
+ */
+int dump_metrics()
+{
+    static const struct
+    {
+        const char *name;
+        const char *help;
+    } port_metrics[] = {
+        {"stpd_port_rx_config_bpdu_total", "Config BPDUs received"},
+        {"stpd_port_tx_config_bpdu_total", "Config BPDUs sent"},
+        {"stpd_port_rx_tcn_bpdu_total", "TCN BPDUs received"},
+        {"stpd_port_tx_tcn_bpdu_total", "TCN BPDUs sent"},
+        {"stpd_port_rx_delayed_bpdu_total", "Delayed BPDUs received"},
+        {"stpd_port_rx_drop_bpdu_total", "BPDUs dropped by the port"},
+        {"stpd_port_forward_transitions_total", "Transitions to forwarding"},
+    };
+    static const struct
+    {
+        const char *name;
+        const char *help;
+    } intf_metrics[] = {
+        {"stpd_intf_rx_packets_total", "BPDU frames received"},
+        {"stpd_intf_tx_packets_total", "BPDU frames sent"},
+        {"stpd_intf_rx_errors_total", "Malformed frames received"},
+        {"stpd_intf_rx_truncated_total", "Truncated frames received"},
+        {"stpd_intf_tx_errors_total", "Send failures"},
+        {"stpd_intf_rx_ratelimit_drops_total", "Frames dropped by the kernel storm guard"},
+    };
+    STP_EXPORT_HDR *hdr;
+    STP_EXPORT_CLASS *cls;
+    STP_EXPORT_PORT *port;
+    STP_EXPORT_INTF *intf;
+    const char **port_name;
+    char (*number_name)[12];
+    uint64_t value;
+    uint32_t i, j, m;
+
+    hdr = shm_snapshot();
+    if (!hdr)
+        return -1;
+    if (shm_check_format(hdr) == -1)
+    {
+        free(hdr);
+        return -1;
+    }
+
+    cls = (STP_EXPORT_CLASS *)((uint8_t *)hdr + hdr->class_offset);
+    port = (STP_EXPORT_PORT *)((uint8_t *)hdr + hdr->port_offset);
+    intf = (STP_EXPORT_INTF *)((uint8_t *)hdr + hdr->intf_offset);
+
+    // STP port number -> interface name, ports without a record are labelled by number
+    port_name = calloc(hdr->max_port, sizeof(*port_name));
+    number_name = calloc(hdr->max_port, sizeof(*number_name));
+    if (!port_name || !number_name)
+    {
+        free(port_name);
+        free(number_name);
+        free(hdr);
+        return -1;
+    }
+    for (i = 0; i < hdr->intf_count; i++)
+        if (intf[i].port_number < hdr->max_port)
+            port_name[intf[i].port_number] = intf[i].name;
+    for (i = 0; i < hdr->max_port; i++)
+    {
+        if (!port_name[i])
+        {
+            snprintf(number_name[i], sizeof(number_name[i]), "%u", i);
+            port_name[i] = number_name[i];
+        }
+    }
+
+    stpout("# HELP stpd_publish_count_total State publications by stpd\n# TYPE stpd_publish_count_total counter\n");
+    stpout("stpd_publish_count_total %llu\n", (unsigned long long)hdr->publish_count);
+
+    stpout("# HELP stpd_vlan_topology_changes_total Topology changes\n# TYPE stpd_vlan_topology_changes_total counter\n");
+    for (i = 0; i < hdr->class_count; i++)
+        stpout("stpd_vlan_topology_changes_total{vlan=\"%u\"} %u\n", cls[i].vlan_id, cls[i].topology_change_count);
+    stpout("# HELP stpd_vlan_rx_drop_bpdu_total BPDUs dropped by the instance\n# TYPE stpd_vlan_rx_drop_bpdu_total counter\n");
+    for (i = 0; i < hdr->class_count; i++)
+        stpout("stpd_vlan_rx_drop_bpdu_total{vlan=\"%u\"} %llu\n", cls[i].vlan_id,
+               (unsigned long long)cls[i].rx_drop_bpdu);
+
+    for (m = 0; m < sizeof(port_metrics) / sizeof(port_metrics[0]); m++)
+    {
+        stpout("# HELP %s %s\n# TYPE %s counter\n", port_metrics[m].name, port_metrics[m].help, port_metrics[m].name);
+        for (i = 0; i < hdr->class_count; i++)
+        {
+            for (j = cls[i].port_first; j < cls[i].port_first + cls[i].port_count && j < hdr->port_count; j++)
+            {
+                if (port[j].port_number >= hdr->max_port)
+                    continue;
+                switch (m)
+                {
+                case 0: value = port[j].rx_config_bpdu; break;
+                case 1: value = port[j].tx_config_bpdu; break;
+                case 2: value = port[j].rx_tcn_bpdu; break;
+                case 3: value = port[j].tx_tcn_bpdu; break;
+                case 4: value = port[j].rx_delayed_bpdu; break;
+                case 5: value = port[j].rx_drop_bpdu; break;
+                default: value = port[j].forward_transitions; break;
+                }
+                metrics_print_port(port_metrics[m].name, cls[i].vlan_id, port_name[port[j].port_number], value);
+            }
+        }
+    }
+
+    for (m = 0; m < sizeof(intf_metrics) / sizeof(intf_metrics[0]); m++)
+    {
+        stpout("# HELP %s %s\n# TYPE %s counter\n", intf_metrics[m].name, intf_metrics[m].help, intf_metrics[m].name);
+        for (i = 0; i < hdr->intf_count; i++)
+        {
+            switch (m)
+            {
+            case 0: value = intf[i].pkt_rx; break;
+            case 1: value = intf[i].pkt_tx; break;
+            case 2: value = intf[i].pkt_rx_err; break;
+            case 3: value = intf[i].pkt_rx_err_trunc; break;
+            case 4: value = intf[i].pkt_tx_err; break;
+            default: value = intf[i].pkt_rx_storm_drop; break;
+            }
+            metrics_print_intf(intf_metrics[m].name, intf[i].name, value);
+        }
+    }
+
+    free(port_name);
+    free(number_name);
+    free(hdr);
+    return 0;
+}
+
+/**
+ * @brief Разбирает фильтры постраничного вывода.
+ *
+ * Формат: [vlan <id>[-<id>]] [intf <имя>] [state <состояние>].
+ *
+ * @return 0 при успехе, -1 при ошибке.
+ */
+int stream_parse_filters(int argc, char **argv, STP_CTL_MSG *msg)
+{
+    static const char *states[] = {"disabled", "blocking", "listening", "learning", "forwarding"};
+    char *end_ptr = 0;
+    int i, s;
+
+    for (i = 2; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "vlan") == 0)
+        {
+            msg->stream.vlan_lo = strtol(argv[i + 1], &end_ptr, 10);
+            msg->stream.vlan_hi = msg->stream.vlan_lo;
+            if (*end_ptr == '-')
+                msg->stream.vlan_hi = strtol(end_ptr + 1, &end_ptr, 10);
+            if (*end_ptr != '\0' || msg->stream.vlan_lo > msg->stream.vlan_hi)
+            {
+                stpout("invalid vlan range %s\n", argv[i + 1]);
+                return -1;
+            }
+        }
+        else if (strcmp(argv[i], "intf") == 0)
+            strncpy(msg->intf_name, argv[i + 1], IFNAMSIZ - 1);
+        else if (strcmp(argv[i], "state") == 0 && msg->cmd_type == STP_CTL_STREAM_CLASS)
+        {
+            for (s = 0; s < sizeof(states) / sizeof(states[0]); s++)
+            {
+                if (strcasecmp(argv[i + 1], states[s]) == 0)
+                    break;
+            }
+            if (s == sizeof(states) / sizeof(states[0]))
+            {
+                stpout("invalid state %s\n", argv[i + 1]);
+                return -1;
+            }
+            msg->stream.state = s;
+        }
+        else
+            break;
+    }
+
+    if (i != argc)
+    {
+        stpout("usage: stpctl %s [vlan <id>[-<id>]] [intf <name>]%s\n", argv[1],
+               msg->cmd_type == STP_CTL_STREAM_CLASS ? " [state <state>]" : "");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Постраничный вывод: запрашивает страницы у stpd, пока они есть.
+ *
+ * Запросы идут на сокет IPC stpd (UDP, loopback), каждая страница сразу
+ * выводится. Потерянная страница запрашивается повторно с тем же курсором.
+ *
+ * @return 0 при успехе, -1 при ошибке.
+ */
+int stream_command(int argc, char **argv, int cmd_type)
+{
+    static char reply[sizeof(STP_CTL_PAGE_HDR) + 2 * STP_CTL_PAGE_SIZE];
+    char request[STP_IPC_MAGIC_LEN + sizeof(STP_IPC_MSG) + sizeof(STP_CTL_MSG)];
+    STP_IPC_MSG *ipc = (STP_IPC_MSG *)(request + STP_IPC_MAGIC_LEN);
+    STP_CTL_MSG *msg = (STP_CTL_MSG *)ipc->data;
+    STP_CTL_PAGE_HDR *hdr = (STP_CTL_PAGE_HDR *)reply;
+    struct timeval tv = {.tv_sec = 2};
+    struct sockaddr_in addr;
+    uint32_t cursor = 0;
+    int fd, len, retry = 0;
+
+    memset(request, 0, sizeof(request));
+    memcpy(request, STP_IPC_MAGIC, STP_IPC_MAGIC_LEN);
+    ipc->msg_type = STP_STPCTL_MSG;
+    ipc->msg_len = sizeof(STP_CTL_MSG);
+    msg->cmd_type = cmd_type;
+    msg->stream.state = STP_CTL_STATE_ANY;
+    if (stream_parse_filters(argc, argv, msg) == -1)
+        return -1;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd == -1)
+    {
+        stpout("socket error %s\n", strerror(errno));
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(STPD_IPC_UDP_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    while (cursor != STP_CTL_CURSOR_END)
+    {
+        msg->stream.cursor = cursor;
+        if (sendto(fd, request, sizeof(request), 0, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+        {
+            stpout("send error %s\n", strerror(errno));
+            break;
+        }
+
+        len = recv(fd, reply, sizeof(reply), 0);
+        if (len == -1)
+        {
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && ++retry < 3)
+                continue;
+            stpout("recv error %s\n", strerror(errno));
+            break;
+        }
+        // a late reply to an already retried page
+        if (len < (int)sizeof(STP_CTL_PAGE_HDR) || hdr->cmd_type != cmd_type || hdr->cursor != cursor ||
+            hdr->len > len - sizeof(STP_CTL_PAGE_HDR))
+            continue;
+
+        fwrite(reply + sizeof(STP_CTL_PAGE_HDR), 1, hdr->len, stdout);
+        cursor = hdr->next_cursor;
+        retry = 0;
+    }
+
+    close(fd);
+    return cursor == STP_CTL_CURSOR_END ? 0 : -1;
+}
+
 /**
  * @brief Точка входа в программу.
  *
@@ -496,6 +1082,22 @@ int main(int argc, char **argv)
         return 0;
     }
 
+    // read directly from the shared memory export, stpd is not involved
+    if (get_cmd_type(argv[1]) == STP_CTL_DUMP_SHM)
+    {
+        if (argc > 3)
+        {
+            stpout("invalid number of args\n");
+            return -1;
+        }
+        return dump_shm(argc == 3 ? atoi(argv[2]) : 0) == -1 ? -1 : 0;
+    }
+    if (get_cmd_type(argv[1]) == STP_CTL_DUMP_METRICS)
+        return dump_metrics() == -1 ? -1 : 0;
+
+    if (get_cmd_type(argv[1]) == STP_CTL_STREAM_CLASS || get_cmd_type(argv[1]) == STP_CTL_STREAM_NL_DB)
+        return stream_command(argc, argv, get_cmd_type(argv[1]));
+
     if (connect_server() != -1)
     {
         if (send_command(argc, argv) != -1)
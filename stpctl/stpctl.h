@@ -16,10 +16,18 @@
 #include <sys/socket.h>
 #include <linux/if.h>
 #include "stp_ipc.h"
+#include "stp_export.h"
 #include <stdint.h>
 #include <sys/un.h>
 #include <stddef.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <strings.h>
+#include <netinet/in.h>
+#include <sys/time.h>
 
 /**
  * @def STP_CLIENT_SOCK
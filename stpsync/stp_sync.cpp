@@ -37,13 +37,14 @@ using namespace swss;
  * @param db Указатель на подключение к базе данных состояния.
  * @param cfgDb Указатель на подключение к базе данных конфигурации.
  */
-StpSync::StpSync(DBConnector *db, DBConnector *cfgDb) : m_stpVlanTable(db, APP_STP_VLAN_TABLE_NAME),
-                                                        m_stpVlanPortTable(db, APP_STP_VLAN_PORT_TABLE_NAME),
+StpSync::StpSync(DBConnector *db, DBConnector *cfgDb) : m_pipeline(db, STPSYNC_PIPELINE_SIZE),
+                                                        m_stpVlanTable(&m_pipeline, APP_STP_VLAN_TABLE_NAME, true),
+                                                        m_stpVlanPortTable(&m_pipeline, APP_STP_VLAN_PORT_TABLE_NAME, true),
                                                         m_stpVlanInstanceTable(db, APP_STP_VLAN_INSTANCE_TABLE_NAME),
                                                         m_stpPortTable(db, APP_STP_PORT_TABLE_NAME),
                                                         m_stpPortStateTable(db, APP_STP_PORT_STATE_TABLE_NAME),
                                                         m_appVlanMemberTable(db, APP_VLAN_MEMBER_TABLE_NAME),
-                                                        m_stpFastAgeFlushTable(db, APP_STP_FASTAGEING_FLUSH_TABLE_NAME),
+                                                        m_stpFastAgeFlushTable(&m_pipeline, APP_STP_FASTAGEING_FLUSH_TABLE_NAME, true),
                                                         m_appPortTable(db, APP_PORT_TABLE_NAME),
                                                         m_cfgPortTable(cfgDb, CFG_PORT_TABLE_NAME),
                                                         m_cfgLagTable(cfgDb, CFG_LAG_TABLE_NAME)
@@ -231,6 +232,25 @@ extern "C"
         stpsync.updateStpVlanFastage(vlan_id, add);
     }
 
+    /**
+     * @brief Обновляет состояние быстрого старения нескольких VLAN одним пакетом.
+     *
+     * Вызывается раз в тик stputil_flush_vlan_fastage() со всеми VLAN,
+     * изменившими состояние быстрого старения; записи уходят в APP DB одним
+     * конвейером Redis, и orchagent обрабатывает их одним пакетом.
+     *
+     * @param add VLAN, для которых включается быстрое старение.
+     * @param add_count Количество VLAN в `add`.
+     * @param del VLAN, для которых быстрое старение выключается.
+     * @param del_count Количество VLAN в `del`.
+     *
+     * @return void
+     */
+    void stpsync_update_fastage_vlans(const uint16_t *add, uint16_t add_count, const uint16_t *del, uint16_t del_count)
+    {
+        stpsync.updateStpVlanFastageBatch(add, add_count, del, del_count);
+    }
+
     /**
      * @brief Обновляет административное состояние порта.
      *
@@ -334,6 +354,102 @@ extern "C"
     {
         stpsync.clearAllStpAppDbTables();
     }
+
+    /**
+     * @brief Записывает накопленные за тик изменения STP в APP DB.
+     *
+     * Вызывается из 100мс таймера stpd.
+     *
+     * @return void
+     */
+    void stpsync_flush(void)
+    {
+        stpsync.flush();
+    }
+}
+
+/**
+ * @brief Ставит в очередь запись полей ключа, объединяя её с уже ожидающей.
+ *
+ * Повторные изменения одного ключа в пределах тика сливаются в одну запись,
+ * для каждого поля сохраняется последнее значение.
+ */
+void StpSync::queueSet(ProducerStateTable &table, const std::string &key, const std::vector<FieldValueTuple> &fvVector)
+{
+    std::string id = table.getTableName() + "|" + key;
+    auto it = m_pendingIndex.find(id);
+
+    if (it == m_pendingIndex.end())
+    {
+        m_pending.push_back(PendingEntry{&table, key, false, {}});
+        it = m_pendingIndex.emplace(id, std::prev(m_pending.end())).first;
+    }
+
+    for (const auto &fv : fvVector)
+        it->second->fields[fvField(fv)] = fvValue(fv);
+}
+
+/**
+ * @brief Ставит в очередь удаление ключа, отбрасывая ожидающие поля.
+ */
+void StpSync::queueDel(ProducerStateTable &table, const std::string &key)
+{
+    std::string id = table.getTableName() + "|" + key;
+    auto it = m_pendingIndex.find(id);
+
+    if (it == m_pendingIndex.end())
+    {
+        m_pending.push_back(PendingEntry{&table, key, true, {}});
+        m_pendingIndex.emplace(id, std::prev(m_pending.end()));
+        return;
+    }
+
+    it->second->del = true;
+    it->second->fields.clear();
+}
+
+/**
+ * @brief Отбрасывает все ожидающие записи.
+ */
+void StpSync::dropPending(void)
+{
+    m_pending.clear();
+    m_pendingIndex.clear();
+}
+
+void StpSync::flush(void)
+{
+    uint32_t count = 0;
+
+    if (m_pending.empty())
+        return;
+
+    while (!m_pending.empty() && count < STPSYNC_FLUSH_MAX_KEYS)
+    {
+        PendingEntry &entry = m_pending.front();
+
+        if (entry.del)
+            entry.table->del(entry.key);
+
+        if (!entry.fields.empty())
+        {
+            std::vector<FieldValueTuple> fvVector;
+
+            fvVector.reserve(entry.fields.size());
+            for (const auto &f : entry.fields)
+                fvVector.emplace_back(f.first, f.second);
+            entry.table->set(entry.key, fvVector);
+        }
+
+        m_pendingIndex.erase(entry.table->getTableName() + "|" + entry.key);
+        m_pending.pop_front();
+        count++;
+    }
+
+    m_pipeline.flush();
+
+    if (!m_pending.empty())
+        SWSS_LOG_DEBUG("STP APP DB flush: %u keys written, %zu deferred", count, m_pending.size());
 }
 
 void StpSync::addVlanToInstance(uint16_t vlan_id, uint16_t instance)
@@ -455,7 +571,7 @@ void StpSync::updateStpVlanInfo(STP_VLAN_TABLE *stp_vlan)
     FieldValueTuple rsi("stp_instance", to_string(stp_vlan->stp_instance));
     fvVector.push_back(rsi);
 
-    m_stpVlanTable.set(vlan, fvVector);
+    queueSet(m_stpVlanTable, vlan, fvVector);
 
     SWSS_LOG_DEBUG("Update STP_VLAN_TABLE for %s", vlan.c_str());
 }
@@ -466,7 +582,7 @@ void StpSync::delStpVlanInfo(uint16_t vlan_id)
 
     vlan = VLAN_PREFIX + to_string(vlan_id);
 
-    m_stpVlanTable.del(vlan);
+    queueDel(m_stpVlanTable, vlan);
     SWSS_LOG_NOTICE("Delete STP_VLAN_TABLE for %s", vlan.c_str());
 }
 
@@ -563,7 +679,7 @@ void StpSync::updateStpVlanInterfaceInfo(STP_VLAN_PORT_TABLE *stp_vlan_intf)
     vlan = VLAN_PREFIX + to_string(stp_vlan_intf->vlan_id);
     key = vlan + ":" + ifName;
 
-    m_stpVlanPortTable.set(key, fvVector);
+    queueSet(m_stpVlanPortTable, key, fvVector);
 
     SWSS_LOG_DEBUG("Update STP_VLAN_PORT_TABLE for %s intf %s", vlan.c_str(), ifName.c_str());
 }
@@ -576,7 +692,7 @@ void StpSync::delStpVlanInterfaceInfo(char *if_name, uint16_t vlan_id)
     vlan = VLAN_PREFIX + to_string(vlan_id);
     key = vlan + ":" + ifName;
 
-    m_stpVlanPortTable.del(key);
+    queueDel(m_stpVlanPortTable, key);
 
     SWSS_LOG_NOTICE("Delete STP_VLAN_PORT_TABLE for %s intf %s", vlan.c_str(), ifName.c_str());
 }
@@ -656,10 +772,27 @@ void StpSync::updateStpVlanFastage(uint16_t vlan_id, bool add)
     {
         m_stpFastAgeFlushTable.del(vlan);
     }
+    m_pipeline.flush();
 
     SWSS_LOG_NOTICE(" %s VLAN %s fastage", add ? "Update" : "Delete", vlan.c_str());
 }
 
+void StpSync::updateStpVlanFastageBatch(const uint16_t *add, uint16_t add_count, const uint16_t *del, uint16_t del_count)
+{
+    std::vector<FieldValueTuple> fvVector;
+    uint16_t i;
+
+    fvVector.emplace_back("state", "true");
+
+    for (i = 0; i < add_count; i++)
+        m_stpFastAgeFlushTable.set(VLAN_PREFIX + to_string(add[i]), fvVector);
+    for (i = 0; i < del_count; i++)
+        m_stpFastAgeFlushTable.del(VLAN_PREFIX + to_string(del[i]));
+    m_pipeline.flush();
+
+    SWSS_LOG_NOTICE(" Update %u VLANs delete %u VLANs fastage", add_count, del_count);
+}
+
 void StpSync::updatePortAdminState(char *if_name, bool up, bool physical)
 {
     std::vector<FieldValueTuple> fvVector;
@@ -736,6 +869,7 @@ void StpSync::updatePortFast(char *if_name, bool enabled)
 
 void StpSync::clearAllStpAppDbTables(void)
 {
+    dropPending();
     m_stpVlanTable.clear();
     m_stpVlanPortTable.clear();
     // m_stpVlanInstanceTable.clear();
@@ -743,5 +877,6 @@ void StpSync::clearAllStpAppDbTables(void)
     // m_stpPortStateTable.clear();
     // m_appVlanMemberTable.clear();
     m_stpFastAgeFlushTable.clear();
+    m_pipeline.flush();
     SWSS_LOG_NOTICE("STP clear all APP DB STP tables");
 }
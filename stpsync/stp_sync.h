@@ -28,7 +28,11 @@
 #define __STPSYNC__
 
 #include <string>
+#include <list>
+#include <map>
+#include <unordered_map>
 #include "dbconnector.h"
+#include "redispipeline.h"
 #include "producerstatetable.h"
 #include "stp_dbsync.h"
 
@@ -109,6 +113,14 @@ namespace swss
          * @param add Указывает, добавлять или удалять VLAN из режима быстрого старения.
          */
         void updateStpVlanFastage(uint16_t vlan_id, bool add);
+        /**
+         * @brief Обновляет быстрое старение нескольких VLAN одной записью конвейера.
+         * @param add VLAN, для которых включается быстрое старение.
+         * @param add_count Количество VLAN в add.
+         * @param del VLAN, для которых быстрое старение выключается.
+         * @param del_count Количество VLAN в del.
+         */
+        void updateStpVlanFastageBatch(const uint16_t *add, uint16_t add_count, const uint16_t *del, uint16_t del_count);
         /**
          * @brief Обновляет административное состояние порта.
          * @param if_name Имя интерфейса.
@@ -143,9 +155,32 @@ namespace swss
          * @brief Очищает все таблицы приложения STP.
          */
         void clearAllStpAppDbTables(void);
+        /**
+         * @brief Сбрасывает накопленные изменения таблиц VLAN/порт VLAN в APP DB.
+         *
+         * За один вызов отправляется не более STPSYNC_FLUSH_MAX_KEYS ключей
+         * одним конвейером Redis, остаток переносится на следующий тик.
+         */
+        void flush(void);
 
     protected:
     private:
+        /**
+         * @brief Отложенная запись одного ключа таблицы APP DB.
+         */
+        struct PendingEntry
+        {
+            ProducerStateTable *table;                 /**< Таблица, в которую пишется ключ. */
+            std::string key;                           /**< Ключ записи. */
+            bool del;                                  /**< Перед записью полей ключ удаляется. */
+            std::map<std::string, std::string> fields; /**< Накопленные поля (последнее значение). */
+        };
+
+        void queueSet(ProducerStateTable &table, const std::string &key, const std::vector<FieldValueTuple> &fvVector);
+        void queueDel(ProducerStateTable &table, const std::string &key);
+        void dropPending(void);
+
+        RedisPipeline m_pipeline;                  /**< Конвейер для буферизованных таблиц (объявлен первым). */
         ProducerStateTable m_stpVlanTable;         /**< Таблица состояния VLAN. */
         ProducerStateTable m_stpVlanPortTable;     /**< Таблица состояния портов VLAN. */
         ProducerStateTable m_stpVlanInstanceTable; /**< Таблица экземпляров VLAN. */
@@ -156,6 +191,9 @@ namespace swss
         Table m_appPortTable;                      /**< Таблица портов приложения. */
         Table m_cfgPortTable;                      /**< Таблица конфигурации портов. */
         Table m_cfgLagTable;                       /**< Таблица конфигурации агрегатов портов (LAG). */
+
+        std::list<PendingEntry> m_pending;                                                /**< Очередь изменений в порядке поступления. */
+        std::unordered_map<std::string, std::list<PendingEntry>::iterator> m_pendingIndex; /**< Индекс "таблица|ключ" -> запись очереди. */
     };
 
 }